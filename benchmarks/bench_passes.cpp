@@ -0,0 +1,225 @@
+// Compile-time micro-benchmarks for the obfuscation passes.
+//
+// Each benchmark transforms a synthetic module whose shape is given by the
+// benchmark arguments: functions, blocks per function, string constants and
+// binary operators per block. Counters report instructions and functions
+// transformed per second, so a slower pass shows up as a lower rate:
+//
+//   h5x_bench_passes --benchmark_filter=Flattening
+//   h5x_bench_passes --benchmark_out=passes.json --benchmark_out_format=json
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "passes/AntiAnalysisPass.hpp"
+#include "passes/BogusControlFlow.hpp"
+#include "passes/ControlFlowFlattening.hpp"
+#include "passes/InstructionSubstitution.hpp"
+#include "passes/StringObfuscation.hpp"
+
+using namespace h5x;
+
+namespace {
+
+struct SyntheticShape {
+    int functions;
+    int blocks_per_function;
+    int strings;
+    int binops_per_block;
+};
+
+SyntheticShape shape_from(const benchmark::State& state) {
+    return {static_cast<int>(state.range(0)), static_cast<int>(state.range(1)),
+            static_cast<int>(state.range(2)), static_cast<int>(state.range(3))};
+}
+
+// Builds a deterministic module of the given shape. Every function is a
+// chain of diamonds closed by a loop back to its header, so the passes see
+// conditional branches, PHI nodes and a loop; strings are passed to puts
+// from the functions in round-robin order.
+std::unique_ptr<llvm::Module> build_synthetic_module(llvm::LLVMContext& context, const SyntheticShape& shape) {
+    auto module = std::make_unique<llvm::Module>("h5x_bench", context);
+    llvm::IRBuilder<> builder(context);
+    llvm::Type* i32 = builder.getInt32Ty();
+    std::mt19937 gen(12345);
+
+    llvm::FunctionCallee puts = module->getOrInsertFunction(
+        "puts", llvm::FunctionType::get(i32, {llvm::PointerType::getUnqual(context)}, false));
+
+    std::vector<llvm::GlobalVariable*> strings;
+    for (int s = 0; s < shape.strings; ++s) {
+        auto* data = llvm::ConstantDataArray::getString(context, "h5x benchmark string " + std::to_string(s));
+        strings.push_back(new llvm::GlobalVariable(*module, data->getType(), true,
+                                                   llvm::GlobalValue::PrivateLinkage, data,
+                                                   "bench_str" + std::to_string(s)));
+    }
+
+    const llvm::Instruction::BinaryOps ops[] = {
+        llvm::Instruction::Add, llvm::Instruction::Sub, llvm::Instruction::Xor,
+        llvm::Instruction::And, llvm::Instruction::Or, llvm::Instruction::Mul
+    };
+    std::uniform_int_distribution<size_t> op_dis(0, sizeof(ops) / sizeof(ops[0]) - 1);
+
+    int blocks = std::max(2, shape.blocks_per_function);
+    size_t next_string = 0;
+    for (int f = 0; f < shape.functions; ++f) {
+        auto* type = llvm::FunctionType::get(i32, {i32, i32}, false);
+        auto* function = llvm::Function::Create(type, llvm::GlobalValue::ExternalLinkage,
+                                                "bench_fn" + std::to_string(f), *module);
+        llvm::Value* a = function->getArg(0);
+        llvm::Value* b = function->getArg(1);
+
+        auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+        auto* header = llvm::BasicBlock::Create(context, "header", function);
+        auto* exit = llvm::BasicBlock::Create(context, "exit", function);
+        builder.SetInsertPoint(entry);
+        builder.CreateBr(header);
+
+        builder.SetInsertPoint(header);
+        llvm::PHINode* counter = builder.CreatePHI(i32, 2, "i");
+        llvm::PHINode* carried = builder.CreatePHI(i32, 2, "acc");
+        counter->addIncoming(builder.getInt32(0), entry);
+        carried->addIncoming(a, entry);
+
+        // Diamonds: cond -> (left | right) -> join, each arm doing arithmetic
+        llvm::Value* acc = carried;
+        int diamonds = std::max(1, (blocks - 3) / 3);
+        for (int d = 0; d < diamonds; ++d) {
+            auto* left = llvm::BasicBlock::Create(context, "left", function, exit);
+            auto* right = llvm::BasicBlock::Create(context, "right", function, exit);
+            auto* join = llvm::BasicBlock::Create(context, "join", function, exit);
+            llvm::Value* cond = builder.CreateICmpSLT(acc, b);
+            builder.CreateCondBr(cond, left, right);
+
+            llvm::Value* arm_values[2];
+            llvm::BasicBlock* arms[2] = {left, right};
+            for (int arm = 0; arm < 2; ++arm) {
+                builder.SetInsertPoint(arms[arm]);
+                llvm::Value* value = acc;
+                for (int op = 0; op < shape.binops_per_block; ++op) {
+                    llvm::Value* rhs = op % 2 ? b : static_cast<llvm::Value*>(counter);
+                    value = builder.CreateBinOp(ops[op_dis(gen)], value, rhs);
+                }
+                if (!strings.empty() && arm == 0) {
+                    builder.CreateCall(puts, {strings[next_string++ % strings.size()]});
+                }
+                builder.CreateBr(join);
+                arm_values[arm] = value;
+            }
+
+            builder.SetInsertPoint(join);
+            llvm::PHINode* merged = builder.CreatePHI(i32, 2);
+            merged->addIncoming(arm_values[0], left);
+            merged->addIncoming(arm_values[1], right);
+            acc = merged;
+        }
+
+        llvm::Value* next = builder.CreateAdd(counter, builder.getInt32(1));
+        counter->addIncoming(next, builder.GetInsertBlock());
+        carried->addIncoming(acc, builder.GetInsertBlock());
+        builder.CreateCondBr(builder.CreateICmpSLT(next, builder.getInt32(16)), header, exit);
+
+        builder.SetInsertPoint(exit);
+        builder.CreateRet(acc);
+    }
+
+    // Strings not reached by any function are still referenced
+    if (next_string < strings.size()) {
+        auto* type = llvm::FunctionType::get(i32, {}, false);
+        auto* function = llvm::Function::Create(type, llvm::GlobalValue::ExternalLinkage, "bench_strings", *module);
+        builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+        for (; next_string < strings.size(); ++next_string) {
+            builder.CreateCall(puts, {strings[next_string]});
+        }
+        builder.CreateRet(builder.getInt32(0));
+    }
+
+    return module;
+}
+
+size_t count_instructions(const llvm::Module& module) {
+    size_t count = 0;
+    for (const auto& function : module) {
+        count += function.getInstructionCount();
+    }
+    return count;
+}
+
+size_t count_defined_functions(const llvm::Module& module) {
+    size_t count = 0;
+    for (const auto& function : module) {
+        count += function.isDeclaration() ? 0 : 1;
+    }
+    return count;
+}
+
+// Times PassT on a fresh copy of the synthetic module per iteration
+template <typename PassT>
+void BM_Pass(benchmark::State& state) {
+    llvm::LLVMContext context;
+    SyntheticShape shape = shape_from(state);
+    std::unique_ptr<llvm::Module> base = build_synthetic_module(context, shape);
+    size_t instructions = count_instructions(*base);
+    size_t functions = count_defined_functions(*base);
+
+    PassOptions options;
+    options.seed = 0x5eed;
+
+    std::unique_ptr<llvm::Module> module;
+    for (auto _ : state) {
+        state.PauseTiming();
+        module = llvm::CloneModule(*base);
+        llvm::ModuleAnalysisManager analysis_manager;
+        state.ResumeTiming();
+
+        PassT(options).run(*module, analysis_manager);
+        benchmark::DoNotOptimize(module.get());
+    }
+
+    // Broken output would make the timing meaningless
+    if (module && llvm::verifyModule(*module)) {
+        state.SkipWithError("pass produced an invalid module");
+        return;
+    }
+
+    state.counters["instructions"] = static_cast<double>(instructions);
+    state.counters["instructions/s"] = benchmark::Counter(static_cast<double>(instructions),
+                                                          benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["functions/s"] = benchmark::Counter(static_cast<double>(functions),
+                                                       benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["growth"] = module ? static_cast<double>(count_instructions(*module)) / instructions : 0.0;
+}
+
+// {functions, blocks per function, strings, binary operators per block}
+void pass_shapes(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"fn", "bb", "str", "ops"});
+    benchmark->Args({10, 8, 10, 4});
+    benchmark->Args({100, 16, 100, 4});
+    benchmark->Args({500, 32, 500, 8});
+    benchmark->Args({20, 256, 20, 8});   // Few large functions
+    benchmark->Unit(benchmark::kMillisecond);
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_Pass, ControlFlowFlatteningPass)->Apply(pass_shapes);
+BENCHMARK_TEMPLATE(BM_Pass, StringObfuscationPass)->Apply(pass_shapes);
+BENCHMARK_TEMPLATE(BM_Pass, InstructionSubstitutionPass)->Apply(pass_shapes);
+BENCHMARK_TEMPLATE(BM_Pass, BogusControlFlowPass)->Apply(pass_shapes);
+BENCHMARK_TEMPLATE(BM_Pass, AntiAnalysisPass)->Apply(pass_shapes);
+
+BENCHMARK_MAIN();
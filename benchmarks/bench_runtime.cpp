@@ -0,0 +1,739 @@
+// Runtime-overhead benchmark for obfuscated binaries.
+//
+// Every program under demos/ is compiled to IR once, obfuscated with each
+// configuration (single passes and obfuscation levels), compiled to a native
+// binary and run repeatedly on a pinned CPU after a few warm-up runs. A
+// second binary whose main returns at once measures startup alone (loading
+// and module constructors, such as startup string decryption). The report
+// is JSON with stable key order, so two runs can be diffed directly:
+//
+//   h5x_bench_runtime --output before.json
+//   h5x_bench_runtime --output after.json
+//   diff before.json after.json
+//
+// With --pgo-profile, each configuration is planned with ProfileGuidance
+// first, so the measured overhead is that of the guided obfuscation and the
+// report lists the functions it downgraded. With --budget, every pass runs
+// through an OverheadBudget and the report lists what it rolled back.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <json/json.h>
+
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "passes/AntiAnalysisPass.hpp"
+#include "passes/BogusControlFlow.hpp"
+#include "passes/ControlFlowFlattening.hpp"
+#include "passes/IRCostModel.hpp"
+#include "passes/InstructionSubstitution.hpp"
+#include "passes/OverheadBudget.hpp"
+#include "passes/ProfileGuidance.hpp"
+#include "passes/StringObfuscation.hpp"
+#include "utils/ConfigParser.hpp"
+
+#ifndef H5X_BENCH_DEMOS_DIR
+#define H5X_BENCH_DEMOS_DIR "demos"
+#endif
+
+#ifndef H5X_BENCH_CLANGXX
+#define H5X_BENCH_CLANGXX "clang++"
+#endif
+
+namespace fs = std::filesystem;
+using namespace h5x;
+
+namespace {
+
+enum class BenchPass {
+    STRING_OBFUSCATION,
+    STRING_OBFUSCATION_STARTUP,
+    INSTRUCTION_SUBSTITUTION,
+    CONTROL_FLOW_FLATTENING,
+    CONTROL_FLOW_FLATTENING_CLUSTERED,
+    CONTROL_FLOW_FLATTENING_KEEP_LOOPS,
+    BOGUS_CONTROL_FLOW,
+    ANTI_ANALYSIS
+};
+
+const char* pass_name(BenchPass pass) {
+    switch (pass) {
+        case BenchPass::STRING_OBFUSCATION: return "string_obfuscation";
+        case BenchPass::STRING_OBFUSCATION_STARTUP: return "string_obfuscation_startup";
+        case BenchPass::INSTRUCTION_SUBSTITUTION: return "instruction_substitution";
+        case BenchPass::CONTROL_FLOW_FLATTENING: return "control_flow_flattening";
+        case BenchPass::CONTROL_FLOW_FLATTENING_CLUSTERED: return "control_flow_flattening_clustered";
+        case BenchPass::CONTROL_FLOW_FLATTENING_KEEP_LOOPS: return "control_flow_flattening_keep_loops";
+        case BenchPass::BOGUS_CONTROL_FLOW: return "bogus_control_flow";
+        case BenchPass::ANTI_ANALYSIS: return "anti_analysis";
+    }
+    return "unknown";
+}
+
+GuidedPass guided_pass(BenchPass pass) {
+    switch (pass) {
+        case BenchPass::STRING_OBFUSCATION:
+        case BenchPass::STRING_OBFUSCATION_STARTUP: return GuidedPass::StringObfuscation;
+        case BenchPass::INSTRUCTION_SUBSTITUTION: return GuidedPass::InstructionSubstitution;
+        case BenchPass::CONTROL_FLOW_FLATTENING:
+        case BenchPass::CONTROL_FLOW_FLATTENING_CLUSTERED:
+        case BenchPass::CONTROL_FLOW_FLATTENING_KEEP_LOOPS: return GuidedPass::ControlFlowFlattening;
+        case BenchPass::BOGUS_CONTROL_FLOW: return GuidedPass::BogusControlFlow;
+        case BenchPass::ANTI_ANALYSIS: return GuidedPass::AntiAnalysis;
+    }
+    return GuidedPass::AntiAnalysis;
+}
+
+struct BenchConfiguration {
+    std::string name;
+    std::vector<BenchPass> passes;
+};
+
+// Levels follow docs/configuration.md. Levels 4 and 5 raise the substitution
+// and bogus-flow rates; the passes use fixed rates, so those levels apply
+// them a second and third time instead.
+std::vector<BenchConfiguration> default_configurations() {
+    using P = BenchPass;
+    std::vector<P> level1 = {P::STRING_OBFUSCATION, P::ANTI_ANALYSIS};
+    std::vector<P> level2 = {P::STRING_OBFUSCATION, P::INSTRUCTION_SUBSTITUTION, P::BOGUS_CONTROL_FLOW,
+                             P::ANTI_ANALYSIS};
+    std::vector<P> level3 = {P::STRING_OBFUSCATION, P::INSTRUCTION_SUBSTITUTION, P::CONTROL_FLOW_FLATTENING,
+                             P::BOGUS_CONTROL_FLOW, P::ANTI_ANALYSIS};
+    std::vector<P> level4 = level3;
+    level4.insert(level4.end() - 1, {P::INSTRUCTION_SUBSTITUTION, P::BOGUS_CONTROL_FLOW});
+    std::vector<P> level5 = level4;
+    level5.insert(level5.end() - 1, {P::INSTRUCTION_SUBSTITUTION, P::BOGUS_CONTROL_FLOW});
+
+    return {
+        {"baseline", {}},
+        {"string_obfuscation", {P::STRING_OBFUSCATION}},
+        {"string_obfuscation_startup", {P::STRING_OBFUSCATION_STARTUP}},
+        {"instruction_substitution", {P::INSTRUCTION_SUBSTITUTION}},
+        {"control_flow_flattening", {P::CONTROL_FLOW_FLATTENING}},
+        {"control_flow_flattening_clustered", {P::CONTROL_FLOW_FLATTENING_CLUSTERED}},
+        {"control_flow_flattening_keep_loops", {P::CONTROL_FLOW_FLATTENING_KEEP_LOOPS}},
+        {"bogus_control_flow", {P::BOGUS_CONTROL_FLOW}},
+        {"anti_analysis", {P::ANTI_ANALYSIS}},
+        {"level1", level1},
+        {"level2", level2},
+        {"level3", level3},
+        {"level4", level4},
+        {"level5", level5},
+    };
+}
+
+struct BenchArgs {
+    std::string demos_dir{H5X_BENCH_DEMOS_DIR};
+    std::vector<std::string> programs;
+    std::vector<std::string> only;
+    std::string compiler{H5X_BENCH_CLANGXX};
+    std::string opt_level{"-O1"};
+    std::string output;
+    std::string work_dir;
+    std::string pgo_profile;
+    double overhead_budget{0.05};
+    bool budget{false};
+    int runs{30};
+    int warmup{3};
+    int cpu{-1};
+    uint64_t seed{0x5eed};
+    bool keep{false};
+};
+
+void print_usage() {
+    std::cout << "USAGE:\n";
+    std::cout << "  h5x_bench_runtime [OPTIONS]\n";
+    std::cout << "\n";
+    std::cout << "OPTIONS:\n";
+    std::cout << "  --demos <dir>        Directory of programs to benchmark (default: " << H5X_BENCH_DEMOS_DIR << ")\n";
+    std::cout << "  --program <file>     Benchmark only this program (repeatable; .cpp, .ll or .bc)\n";
+    std::cout << "  --config <name>      Run only this configuration (repeatable)\n";
+    std::cout << "  --compiler <path>    C++ compiler that accepts IR input (default: " << H5X_BENCH_CLANGXX << ")\n";
+    std::cout << "  --opt <flag>         Optimisation flag for both compile steps (default: -O1)\n";
+    std::cout << "  --runs <n>           Measured runs per binary (default: 30)\n";
+    std::cout << "  --warmup <n>         Unmeasured runs before measuring (default: 3)\n";
+    std::cout << "  --cpu <n>            CPU to pin the benchmarked process to (default: last allowed CPU)\n";
+    std::cout << "  --seed <n>           Pass seed, fixed so runs are comparable (default: 24301)\n";
+    std::cout << "  --pgo-profile <file> Downgrade hot functions using this PGO or sample profile of the IR\n";
+    std::cout << "  --overhead-budget <percent>\n";
+    std::cout << "                       Slowdown allowed with --pgo-profile (default: 5)\n";
+    std::cout << "  --budget             Run every pass within the default config's OverheadBudget\n";
+    std::cout << "  --output <file>      Write the JSON report here instead of stdout\n";
+    std::cout << "  --work-dir <dir>     Where IR and binaries are built (default: a temporary directory)\n";
+    std::cout << "  --keep               Keep the work directory\n";
+    std::cout << "\n";
+    std::cout << "CONFIGURATIONS:\n ";
+    for (const auto& configuration : default_configurations()) {
+        std::cout << " " << configuration.name;
+    }
+    std::cout << "\n";
+}
+
+bool parse_arguments(int argc, char* argv[], BenchArgs& args) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (arg == "--demos" && has_value) {
+            args.demos_dir = argv[++i];
+        } else if (arg == "--program" && has_value) {
+            args.programs.push_back(argv[++i]);
+        } else if (arg == "--config" && has_value) {
+            args.only.push_back(argv[++i]);
+        } else if (arg == "--compiler" && has_value) {
+            args.compiler = argv[++i];
+        } else if (arg == "--opt" && has_value) {
+            args.opt_level = argv[++i];
+        } else if (arg == "--runs" && has_value) {
+            args.runs = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--warmup" && has_value) {
+            args.warmup = std::max(0, std::stoi(argv[++i]));
+        } else if (arg == "--cpu" && has_value) {
+            args.cpu = std::stoi(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            args.seed = std::stoull(argv[++i]);
+        } else if (arg == "--pgo-profile" && has_value) {
+            args.pgo_profile = argv[++i];
+        } else if (arg == "--overhead-budget" && has_value) {
+            args.overhead_budget = std::max(0.0, std::stod(argv[++i])) / 100.0;
+        } else if (arg == "--budget") {
+            args.budget = true;
+        } else if (arg == "--output" && has_value) {
+            args.output = argv[++i];
+        } else if (arg == "--work-dir" && has_value) {
+            args.work_dir = argv[++i];
+        } else if (arg == "--keep") {
+            args.keep = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int resolve_cpu(int requested) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return -1;
+    }
+    if (requested >= 0) {
+        return CPU_ISSET(requested, &allowed) ? requested : -1;
+    }
+    // The last CPU is usually the least busy with interrupts and housekeeping
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0; --cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+struct ProcessResult {
+    bool ok{false};
+    double wall_ms{0.0};
+    long max_rss_kb{0};
+};
+
+// Runs argv to completion; output goes to log_path (or /dev/null)
+ProcessResult run_process(const std::vector<std::string>& argv, const std::string& log_path, int cpu) {
+    ProcessResult result;
+
+    std::vector<char*> c_argv;
+    for (const auto& arg : argv) {
+        c_argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    c_argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        return result;
+    }
+    if (pid == 0) {
+        if (cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+        int null_fd = open("/dev/null", O_RDWR);
+        int out_fd = log_path.empty() ? null_fd : open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        dup2(null_fd, STDIN_FILENO);
+        dup2(out_fd, STDOUT_FILENO);
+        dup2(out_fd, STDERR_FILENO);
+        execvp(c_argv[0], c_argv.data());
+        _exit(127);
+    }
+
+    int status = 0;
+    rusage usage{};
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        return result;
+    }
+    result.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.max_rss_kb = usage.ru_maxrss;
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return result;
+}
+
+void run_pass(BenchPass pass, llvm::Module& module, const PassOptions& options) {
+    llvm::ModuleAnalysisManager analysis_manager;
+    switch (pass) {
+        case BenchPass::STRING_OBFUSCATION:
+            StringObfuscationPass(options).run(module, analysis_manager);
+            break;
+        case BenchPass::STRING_OBFUSCATION_STARTUP:
+            StringObfuscationPass(options, StringDecryption::AtStartup).run(module, analysis_manager);
+            break;
+        case BenchPass::INSTRUCTION_SUBSTITUTION:
+            InstructionSubstitutionPass(options).run(module, analysis_manager);
+            break;
+        case BenchPass::CONTROL_FLOW_FLATTENING:
+            ControlFlowFlatteningPass(options).run(module, analysis_manager);
+            break;
+        case BenchPass::CONTROL_FLOW_FLATTENING_CLUSTERED: {
+            FlatteningOptions flattening;
+            flattening.dispatcher = DispatcherLayout::Clustered;
+            ControlFlowFlatteningPass(options, flattening).run(module, analysis_manager);
+            break;
+        }
+        case BenchPass::CONTROL_FLOW_FLATTENING_KEEP_LOOPS: {
+            FlatteningOptions flattening;
+            flattening.preserveInnermostLoops = true;
+            ControlFlowFlatteningPass(options, flattening).run(module, analysis_manager);
+            break;
+        }
+        case BenchPass::BOGUS_CONTROL_FLOW:
+            BogusControlFlowPass(options).run(module, analysis_manager);
+            break;
+        case BenchPass::ANTI_ANALYSIS:
+            AntiAnalysisPass(options).run(module, analysis_manager);
+            break;
+    }
+}
+
+// guidance, when given, restricts the pass to what its plan allows; budget,
+// when given, rolls it back where it costs too much
+void apply_pass(BenchPass pass, llvm::Module& module, uint64_t seed, const ProfileGuidance* guidance,
+                OverheadBudget* budget) {
+    PassOptions options;
+    options.seed = seed;
+    if (guidance) {
+        options = guidance->optionsFor(guided_pass(pass), options);
+    }
+    if (!budget) {
+        run_pass(pass, module, options);
+        return;
+    }
+    budget->run(pass_name(pass), options, [pass](llvm::Module& target, const PassOptions& budgeted) {
+        run_pass(pass, target, budgeted);
+    });
+}
+
+bool write_bitcode(const llvm::Module& module, const std::string& path, std::string& error) {
+    std::error_code ec;
+    llvm::raw_fd_ostream out(path, ec);
+    if (ec) {
+        error = "cannot write " + path + ": " + ec.message();
+        return false;
+    }
+    llvm::WriteBitcodeToFile(module, out);
+    return true;
+}
+
+// Makes main return at once, leaving only what runs before and after it
+bool strip_main(llvm::Module& module) {
+    llvm::Function* main_fn = module.getFunction("main");
+    if (!main_fn || main_fn->isDeclaration()) {
+        return false;
+    }
+    main_fn->deleteBody();
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(module.getContext(), "entry", main_fn));
+    llvm::Type* return_type = main_fn->getReturnType();
+    if (return_type->isVoidTy()) {
+        builder.CreateRetVoid();
+    } else {
+        builder.CreateRet(llvm::Constant::getNullValue(return_type));
+    }
+    return true;
+}
+
+Json::Value budget_json(const OverheadBudget& budget) {
+    Json::Value json;
+    json["module_slowdown"] = budget.getModuleSlowdown();
+    json["code_growth"] = budget.getCodeGrowth();
+    json["rolled_back"] = Json::Value(Json::arrayValue);
+    for (const auto& outcome : budget.getOutcomes()) {
+        for (const auto& function : outcome.rolledBack) {
+            Json::Value entry;
+            entry["pass"] = outcome.pass;
+            entry["function"] = function;
+            json["rolled_back"].append(entry);
+        }
+    }
+    return json;
+}
+
+Json::Value guidance_json(const GuidanceReport& report) {
+    Json::Value json;
+    json["overhead_budget"] = report.overheadBudget;
+    json["unguided_overhead"] = report.unguidedOverhead;
+    json["projected_overhead"] = report.projectedOverhead;
+    json["downgrades"] = Json::Value(Json::arrayValue);
+    for (const auto& downgrade : report.downgrades) {
+        Json::Value entry;
+        entry["function"] = downgrade.function;
+        entry["tier"] = tierName(downgrade.tier);
+        entry["runtime_share"] = downgrade.runtimeShare;
+        entry["avoided_overhead"] = downgrade.avoidedOverhead;
+        json["downgrades"].append(entry);
+    }
+    return json;
+}
+
+// Produces the obfuscated bitcode for one configuration, its startup probe
+// and its cost as predicted by IRCostModel. With a profile, the passes follow
+// a ProfileGuidance plan, reported in guidance; with --budget, they run
+// within an OverheadBudget, reported in budget
+bool obfuscate_ir(const std::string& ir_path, const BenchConfiguration& configuration, const BenchArgs& args,
+                  const std::string& bitcode_path, const std::string& probe_path, double& estimated_cost,
+                  Json::Value& guidance, Json::Value& budget, std::string& error) {
+    llvm::LLVMContext context;
+    llvm::SMDiagnostic diagnostic;
+    std::unique_ptr<llvm::Module> module = llvm::parseIRFile(ir_path, diagnostic, context);
+    if (!module) {
+        error = "failed to parse " + ir_path + ": " + diagnostic.getMessage().str();
+        return false;
+    }
+
+    // The baseline gets the counts too: they steer codegen and the cost
+    // estimate, so every configuration is compared like for like
+    std::unique_ptr<ProfileGuidance> profile_guidance;
+    if (!args.pgo_profile.empty()) {
+        if (!ProfileGuidance::loadProfile(*module, args.pgo_profile, error)) {
+            return false;
+        }
+        std::vector<GuidedPass> passes;
+        for (BenchPass pass : configuration.passes) {
+            passes.push_back(guided_pass(pass));
+        }
+        profile_guidance = std::make_unique<ProfileGuidance>();
+        guidance = guidance_json(profile_guidance->plan(*module, passes, args.overhead_budget));
+    }
+
+    // Created after the counts are loaded, which change the module's cost
+    std::unique_ptr<OverheadBudget> overhead_budget;
+    if (args.budget && !configuration.passes.empty()) {
+        overhead_budget = std::make_unique<OverheadBudget>(
+            *module, BudgetLimits::fromConfig(ConfigParser::getDefaultConfig()));
+    }
+
+    for (size_t i = 0; i < configuration.passes.size(); ++i) {
+        apply_pass(configuration.passes[i], *module, args.seed + i, profile_guidance.get(),
+                   overhead_budget.get());
+    }
+    if (overhead_budget) {
+        budget = budget_json(*overhead_budget);
+    }
+
+    std::string verifier_output;
+    llvm::raw_string_ostream verifier_stream(verifier_output);
+    if (llvm::verifyModule(*module, &verifier_stream)) {
+        error = "obfuscated module is invalid: " + verifier_stream.str();
+        return false;
+    }
+    estimated_cost = IRCostModel().analyzeModule(*module).dynamicCost;
+
+    if (!write_bitcode(*module, bitcode_path, error)) {
+        return false;
+    }
+    if (!strip_main(*module)) {
+        error = "no main function in " + ir_path;
+        return false;
+    }
+    return write_bitcode(*module, probe_path, error);
+}
+
+// Nearest-rank percentile of sorted samples
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+double median(const std::vector<double>& sorted) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t middle = sorted.size() / 2;
+    return sorted.size() % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2.0;
+}
+
+struct Measurement {
+    bool ok{false};
+    std::string error;
+    std::vector<double> samples_ms;   // Sorted
+    std::vector<double> startup_ms;   // Sorted; runs of the startup probe
+    long max_rss_kb{0};
+    uintmax_t size_bytes{0};
+    double estimated_cost{0.0};       // IRCostModel dynamic cost of the IR
+    Json::Value guidance;             // ProfileGuidance plan, with --pgo-profile
+    Json::Value budget;               // OverheadBudget outcome, with --budget
+};
+
+Measurement measure_binary(const std::string& binary, const BenchArgs& args, int cpu) {
+    Measurement measurement;
+    measurement.size_bytes = fs::file_size(binary);
+
+    for (int i = 0; i < args.warmup + args.runs; ++i) {
+        ProcessResult run = run_process({binary}, "", cpu);
+        if (!run.ok) {
+            measurement.error = "benchmark run exited with an error";
+            return measurement;
+        }
+        if (i >= args.warmup) {
+            measurement.samples_ms.push_back(run.wall_ms);
+            measurement.max_rss_kb = std::max(measurement.max_rss_kb, run.max_rss_kb);
+        }
+    }
+
+    std::sort(measurement.samples_ms.begin(), measurement.samples_ms.end());
+    measurement.ok = true;
+    return measurement;
+}
+
+double ratio(double value, double base) {
+    return base > 0.0 ? value / base - 1.0 : 0.0;
+}
+
+Json::Value measurement_json(const Measurement& measurement, const Measurement* baseline) {
+    Json::Value json;
+    if (!measurement.ok) {
+        json["error"] = measurement.error;
+        return json;
+    }
+
+    double median_ms = median(measurement.samples_ms);
+    double p99_ms = percentile(measurement.samples_ms, 99.0);
+    json["median_ms"] = median_ms;
+    json["p99_ms"] = p99_ms;
+    json["min_ms"] = measurement.samples_ms.front();
+    json["size_bytes"] = static_cast<Json::UInt64>(measurement.size_bytes);
+    json["max_rss_kb"] = static_cast<Json::Int64>(measurement.max_rss_kb);
+    double startup_ms = median(measurement.startup_ms);
+    json["startup_ms"] = startup_ms;
+
+    if (baseline && baseline->ok) {
+        json["runtime_overhead_median"] = ratio(median_ms, median(baseline->samples_ms));
+        json["runtime_overhead_p99"] = ratio(p99_ms, percentile(baseline->samples_ms, 99.0));
+        json["size_growth"] = ratio(static_cast<double>(measurement.size_bytes),
+                                    static_cast<double>(baseline->size_bytes));
+        json["rss_growth"] = ratio(static_cast<double>(measurement.max_rss_kb),
+                                   static_cast<double>(baseline->max_rss_kb));
+        // Predicted counterpart of runtime_overhead_median
+        json["estimated_overhead"] = ratio(measurement.estimated_cost, baseline->estimated_cost);
+        // Absolute, since startup is a small share of the whole run
+        json["startup_delta_ms"] = startup_ms - median(baseline->startup_ms);
+    }
+    if (!measurement.guidance.isNull()) {
+        json["profile_guidance"] = measurement.guidance;
+    }
+    if (!measurement.budget.isNull()) {
+        json["overhead_budget"] = measurement.budget;
+    }
+    return json;
+}
+
+std::vector<std::string> collect_programs(const BenchArgs& args) {
+    if (!args.programs.empty()) {
+        return args.programs;
+    }
+    std::vector<std::string> programs;
+    if (fs::is_directory(args.demos_dir)) {
+        for (const auto& entry : fs::directory_iterator(args.demos_dir)) {
+            std::string ext = entry.path().extension().string();
+            if (entry.is_regular_file() && (ext == ".cpp" || ext == ".ll" || ext == ".bc")) {
+                programs.push_back(entry.path().string());
+            }
+        }
+    }
+    std::sort(programs.begin(), programs.end());
+    return programs;
+}
+
+Json::Value bench_program(const std::string& program, const std::vector<BenchConfiguration>& configurations,
+                          const BenchArgs& args, const fs::path& work_dir, int cpu) {
+    std::string name = fs::path(program).stem().string();
+    fs::path program_dir = work_dir / name;
+    fs::create_directories(program_dir);
+    std::string log = (program_dir / "build.log").string();
+
+    Json::Value json;
+    json["source"] = fs::path(program).filename().string();
+
+    // Compile the source to IR once; every configuration starts from it
+    std::string ir_path = program;
+    std::string ext = fs::path(program).extension().string();
+    if (ext != ".ll" && ext != ".bc") {
+        ir_path = (program_dir / (name + ".ll")).string();
+        if (!run_process({args.compiler, args.opt_level, "-S", "-emit-llvm", program, "-o", ir_path}, log, -1).ok) {
+            json["error"] = "failed to compile to IR, see " + log;
+            return json;
+        }
+    }
+
+    std::map<std::string, Measurement> measurements;
+    for (const auto& configuration : configurations) {
+        std::cerr << "  " << name << " / " << configuration.name << "\n";
+
+        Measurement& measurement = measurements[configuration.name];
+        std::string bitcode = (program_dir / (configuration.name + ".bc")).string();
+        std::string binary = (program_dir / configuration.name).string();
+        std::string probe_bitcode = (program_dir / (configuration.name + ".startup.bc")).string();
+        std::string probe = (program_dir / (configuration.name + ".startup")).string();
+
+        double estimated_cost = 0.0;
+        Json::Value guidance;
+        Json::Value budget;
+        if (!obfuscate_ir(ir_path, configuration, args, bitcode, probe_bitcode, estimated_cost, guidance, budget,
+                          measurement.error)) {
+            continue;
+        }
+        if (!run_process({args.compiler, args.opt_level, bitcode, "-o", binary}, log, -1).ok ||
+            !run_process({args.compiler, args.opt_level, probe_bitcode, "-o", probe}, log, -1).ok) {
+            measurement.error = "failed to build binary, see " + log;
+            continue;
+        }
+        Measurement startup = measure_binary(probe, args, cpu);
+        measurement = measure_binary(binary, args, cpu);
+        measurement.estimated_cost = estimated_cost;
+        measurement.guidance = guidance;
+        measurement.budget = budget;
+        if (!startup.ok) {
+            measurement.ok = false;
+            measurement.error = "startup probe " + startup.error;
+            continue;
+        }
+        measurement.startup_ms = std::move(startup.samples_ms);
+    }
+
+    auto baseline = measurements.find("baseline");
+    const Measurement* base = baseline == measurements.end() ? nullptr : &baseline->second;
+    for (const auto& configuration : configurations) {
+        Json::Value entry = measurement_json(measurements[configuration.name], base);
+        entry["passes"] = Json::Value(Json::arrayValue);
+        for (BenchPass pass : configuration.passes) {
+            entry["passes"].append(pass_name(pass));
+        }
+        json["configurations"][configuration.name] = entry;
+    }
+    return json;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchArgs args;
+    if (!parse_arguments(argc, argv, args)) {
+        print_usage();
+        return argc > 1 && (std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h") ? 0 : 1;
+    }
+
+    std::vector<BenchConfiguration> configurations;
+    for (const auto& configuration : default_configurations()) {
+        bool wanted = args.only.empty() || configuration.name == "baseline" ||
+                      std::find(args.only.begin(), args.only.end(), configuration.name) != args.only.end();
+        if (wanted) {
+            configurations.push_back(configuration);
+        }
+    }
+
+    std::vector<std::string> programs = collect_programs(args);
+    if (programs.empty()) {
+        std::cerr << "No programs found in " << args.demos_dir << "\n";
+        return 1;
+    }
+
+    int cpu = resolve_cpu(args.cpu);
+    if (args.cpu >= 0 && cpu < 0) {
+        std::cerr << "CPU " << args.cpu << " is not available to this process\n";
+        return 1;
+    }
+
+    fs::path work_dir = args.work_dir.empty()
+        ? fs::temp_directory_path() / ("h5x-bench-" + std::to_string(getpid()))
+        : fs::path(args.work_dir);
+    fs::create_directories(work_dir);
+
+    Json::Value report;
+    report["schema_version"] = 1;
+    report["settings"]["runs"] = args.runs;
+    report["settings"]["warmup"] = args.warmup;
+    report["settings"]["cpu"] = cpu;
+    report["settings"]["opt_level"] = args.opt_level;
+    report["settings"]["seed"] = static_cast<Json::UInt64>(args.seed);
+    if (!args.pgo_profile.empty()) {
+        report["settings"]["pgo_profile"] = args.pgo_profile;
+        report["settings"]["overhead_budget"] = args.overhead_budget;
+    }
+    report["settings"]["budget"] = args.budget;
+
+    bool all_ok = true;
+    for (const auto& program : programs) {
+        std::cerr << "Benchmarking " << program << "\n";
+        Json::Value result = bench_program(program, configurations, args, work_dir, cpu);
+        all_ok = all_ok && !result.isMember("error");
+        for (const auto& name : result["configurations"].getMemberNames()) {
+            all_ok = all_ok && !result["configurations"][name].isMember("error");
+        }
+        report["programs"][fs::path(program).stem().string()] = result;
+    }
+
+    // Failed builds point at their logs; keep them around
+    if (!args.keep && all_ok) {
+        std::error_code ec;
+        fs::remove_all(work_dir, ec);
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    std::string json = Json::writeString(builder, report) + "\n";
+    if (args.output.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream(args.output) << json;
+    }
+
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+# Generates h5x::build_id() for h5x_core at build time.
+#
+# Input:  BUILD_ID_SOURCES_FILE - file listing the library sources and
+#                                 headers, one absolute path per line
+#         BUILD_ID_OUTPUT       - the .cpp file to write
+#
+# The ID is a hash of every listed file, so any change to the library gives
+# it a new ID. The output is only rewritten when the ID changes.
+
+file(STRINGS "${BUILD_ID_SOURCES_FILE}" build_id_sources)
+
+set(build_id_input "")
+foreach(source IN LISTS build_id_sources)
+    file(SHA256 "${source}" source_hash)
+    string(APPEND build_id_input "${source}:${source_hash}\n")
+endforeach()
+string(SHA256 build_id "${build_id_input}")
+
+file(WRITE "${BUILD_ID_OUTPUT}.tmp"
+"// Generated by cmake/BuildId.cmake; do not edit
+#include \"core/BuildId.hpp\"
+
+namespace h5x {
+
+const char* build_id() {
+    return \"${build_id}\";
+}
+
+} // namespace h5x
+")
+file(COPY_FILE "${BUILD_ID_OUTPUT}.tmp" "${BUILD_ID_OUTPUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${BUILD_ID_OUTPUT}.tmp")
@@ -1,16 +1,228 @@
 #include "GeneticOptimizer.hpp"
 #include "../utils/ConfigParser.hpp"
+#include "../utils/HashUtils.hpp"
+#include "../utils/ThreadPool.hpp"
+#include "../passes/AntiAnalysisPass.hpp"
+#include "../passes/BogusControlFlow.hpp"
+#include "../passes/ControlFlowFlattening.hpp"
+#include "../passes/IRCostModel.hpp"
+#include "../passes/InstructionSubstitution.hpp"
+#include "../passes/StringObfuscation.hpp"
 #include <algorithm>
 #include <numeric>
 #include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
 #include <set>
 #include <map>
+#include <sstream>
+#include <stdexcept>
 #include <unordered_set>
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
 
 namespace h5x {
 
+namespace {
+
+// Bump whenever evaluate_fitness changes so persisted scores are not reused
+const char* const kFitnessModelVersion = "fitness-v4";
+
+// Used for evaluation when no seed is configured; scoring must be repeatable
+const uint64_t kDefaultEvaluationSeed = 0x5eed5eed5eed5eedULL;
+
+void eliminate_dead_code(llvm::Module& module) {
+    for (auto& function : module) {
+        if (function.isDeclaration()) continue;
+        llvm::removeUnreachableBlocks(function);
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto& bb : function) {
+                for (auto& inst : llvm::make_early_inc_range(bb)) {
+                    if (llvm::isInstructionTriviallyDead(&inst)) {
+                        inst.eraseFromParent();
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void propagate_constants(llvm::Module& module) {
+    const llvm::DataLayout& layout = module.getDataLayout();
+    for (auto& function : module) {
+        for (auto& bb : function) {
+            for (auto& inst : llvm::make_early_inc_range(bb)) {
+                if (llvm::Constant* folded = llvm::ConstantFoldInstruction(&inst, layout)) {
+                    inst.replaceAllUsesWith(folded);
+                    if (llvm::isInstructionTriviallyDead(&inst)) {
+                        inst.eraseFromParent();
+                    }
+                }
+            }
+        }
+    }
+}
+
+// 0 when nothing grew, approaching 1 as after/before grows without bound
+double saturate_growth(double before, double after) {
+    if (after <= before) return 0.0;
+    return 1.0 - std::exp(-(after - before) / std::max(before, 1.0));
+}
+
+// Finds the largest functions of module and copies them, with every global,
+// into a new module; the rest become declarations
+std::unique_ptr<llvm::Module> build_proxy_module(const llvm::Module& module, size_t sample_functions) {
+    std::vector<const llvm::Function*> functions;
+    for (const auto& function : module) {
+        if (!function.isDeclaration()) functions.push_back(&function);
+    }
+    if (sample_functions == 0 || functions.size() <= sample_functions) {
+        return nullptr;  // Would be no cheaper than the module itself
+    }
+
+    std::stable_sort(functions.begin(), functions.end(), [](const llvm::Function* a, const llvm::Function* b) {
+        return a->getInstructionCount() > b->getInstructionCount();
+    });
+    std::unordered_set<const llvm::GlobalValue*> keep(functions.begin(), functions.begin() + sample_functions);
+
+    llvm::ValueToValueMapTy value_map;
+    return llvm::CloneModule(module, value_map, [&keep](const llvm::GlobalValue* value) {
+        return !llvm::isa<llvm::Function>(value) || keep.count(value) != 0;
+    });
+}
+
+std::unique_ptr<llvm::Module> parse_module_copy(const llvm::SmallVector<char, 0>& bitcode, llvm::LLVMContext& context) {
+    llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), "ga_module");
+    auto parsed = llvm::parseBitcodeFile(buffer, context);
+    if (!parsed) {
+        throw std::runtime_error("Failed to copy module for fitness worker: " +
+                                 llvm::toString(parsed.takeError()));
+    }
+    return std::move(*parsed);
+}
+
+struct FitnessWeights {
+    double security;
+    double performance;
+    double complexity;
+};
+
+// Normalised so the weights sum to 1; unusable config values fall back to 0.7/0.3
+FitnessWeights fitness_weights(const GeneticAlgorithmParams& params) {
+    double security = std::max(0.0, params.security_weight);
+    double performance = std::max(0.0, params.performance_weight);
+    if (security + performance <= 0.0) {
+        security = 0.7;
+        performance = 0.3;
+    }
+    double total = security + performance;
+    return {security / total * 5.0 / 7.0, performance / total, security / total * 2.0 / 7.0};
+}
+
+} // anonymous namespace
+
+struct ModuleMetrics {
+    size_t functions{0};
+    size_t blocks{0};
+    size_t edges{0};
+    size_t instructions{0};
+    size_t data_flow_ops{0};        // Arithmetic, logic and comparisons
+    double cost{0.0};               // IRCostModel dynamic cost
+    std::set<std::string> plaintext_strings;
+    std::set<std::string> function_names;
+
+    explicit ModuleMetrics(llvm::Module& module)
+        : cost(IRCostModel().analyzeModule(module).dynamicCost)
+    {
+        for (const auto& function : module) {
+            if (function.isDeclaration()) continue;
+            functions++;
+            if (function.hasName()) function_names.insert(function.getName().str());
+            for (const auto& bb : function) {
+                blocks++;
+                if (const llvm::Instruction* terminator = bb.getTerminator()) {
+                    edges += terminator->getNumSuccessors();
+                }
+                for (const auto& inst : bb) {
+                    instructions++;
+                    if (inst.isBinaryOp() || llvm::isa<llvm::CmpInst>(inst)) data_flow_ops++;
+                }
+            }
+        }
+
+        for (const auto& global : module.globals()) {
+            if (!global.hasInitializer()) continue;
+            auto* data = llvm::dyn_cast<llvm::ConstantDataSequential>(global.getInitializer());
+            if (data && data->isCString()) {
+                plaintext_strings.insert(data->getAsCString().str());
+            }
+        }
+    }
+
+    // Edges - nodes + 2 per connected component, summed over functions
+    double cyclomatic_complexity() const {
+        return std::max(1.0, static_cast<double>(edges) - static_cast<double>(blocks) + 2.0 * functions);
+    }
+};
+
+// An LLVMContext, and every module in it, may only be used by one thread at
+// a time. Each worker therefore parses its own copy of the module from
+// bitcode on first use and keeps it for the whole optimisation run.
+struct FitnessWorkers {
+    FitnessWorkers(const llvm::SmallVector<char, 0>& module_bitcode,
+                   const llvm::SmallVector<char, 0>& proxy_module_bitcode, size_t count)
+        : pool(count), bitcode(module_bitcode), proxy_bitcode(proxy_module_bitcode), contexts(count),
+          modules(count), proxy_modules(count), snapshots(count)
+    {
+    }
+
+    llvm::Module& module_for(size_t worker_id) {
+        if (!modules[worker_id]) {
+            modules[worker_id] = parse_module_copy(bitcode, context_for(worker_id));
+        }
+        return *modules[worker_id];
+    }
+
+    llvm::Module& proxy_module_for(size_t worker_id) {
+        if (!proxy_modules[worker_id]) {
+            proxy_modules[worker_id] = parse_module_copy(proxy_bitcode, context_for(worker_id));
+        }
+        return *proxy_modules[worker_id];
+    }
+
+    llvm::LLVMContext& context_for(size_t worker_id) {
+        if (!contexts[worker_id]) {
+            contexts[worker_id] = std::make_unique<llvm::LLVMContext>();
+        }
+        return *contexts[worker_id];
+    }
+
+    ThreadPool pool;
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::SmallVector<char, 0> proxy_bitcode;
+    std::vector<std::unique_ptr<llvm::LLVMContext>> contexts;
+    std::vector<std::unique_ptr<llvm::Module>> modules;
+    std::vector<std::unique_ptr<llvm::Module>> proxy_modules;
+    std::vector<std::unique_ptr<PassPrefixTrie>> snapshots;   // Declared last: freed before the contexts
+};
+
 GeneticOptimizer::GeneticOptimizer(Logger& logger)
     : logger_(logger)
     , initialized_(false)
@@ -27,11 +239,13 @@ GeneticOptimizer::GeneticOptimizer(Logger& logger)
         PassType::CONSTANT_PROPAGATION
     };
 
-    logger_.debug("GeneticOptimizer created");
+    H5X_LOG_DEBUG(logger_, "GeneticOptimizer created");
 }
 
+GeneticOptimizer::~GeneticOptimizer() = default;
+
 bool GeneticOptimizer::initialize(const ObfuscationConfig& config) {
-    logger_.info("Initializing GeneticOptimizer...");
+    H5X_LOG_INFO(logger_, "Initializing GeneticOptimizer...");
 
     try {
         // Configure genetic algorithm parameters based on config
@@ -39,13 +253,25 @@ bool GeneticOptimizer::initialize(const ObfuscationConfig& config) {
         params_.generations = config.genetic_algorithm_generations;
         params_.mutation_rate = config.mutation_rate;
         params_.crossover_rate = config.crossover_rate;
+        params_.num_threads = config.max_threads;
+        params_.seed = config.random_seed;
+        params_.fitness_cache_file = config.fitness_cache_file;
+        // A quarter of the memory limit goes to prefix snapshots
+        params_.snapshot_budget_mb = config.memory_limit_mb > 0 ? config.memory_limit_mb / 4 : 0;
+        params_.proxy_prune_ratio = std::max(0.0, std::min(1.0, config.fitness_proxy_prune_ratio));
+        params_.security_weight = config.security_weight;
+        params_.performance_weight = config.performance_weight;
+        params_.flattening = FlatteningOptions::fromConfig(config);
+        if (params_.seed != 0) {
+            rng_.seed(static_cast<std::mt19937::result_type>(params_.seed));
+        }
 
         initialized_ = true;
-        logger_.info("GeneticOptimizer initialized successfully");
-        logger_.info("Parameters: pop=" + std::to_string(params_.population_size) +
-                    ", gen=" + std::to_string(params_.generations) +
-                    ", mut=" + std::to_string(params_.mutation_rate) +
-                    ", cross=" + std::to_string(params_.crossover_rate));
+        H5X_LOG_INFO(logger_, "GeneticOptimizer initialized successfully");
+        H5X_LOG_INFO(logger_, "Parameters: pop=" + std::to_string(params_.population_size) +
+                             ", gen=" + std::to_string(params_.generations) +
+                             ", mut=" + std::to_string(params_.mutation_rate) +
+                             ", cross=" + std::to_string(params_.crossover_rate));
 
         return true;
 
@@ -59,8 +285,18 @@ void GeneticOptimizer::update_configuration(const ObfuscationConfig& config) {
     params_.generations = config.genetic_algorithm_generations;
     params_.mutation_rate = config.mutation_rate;
     params_.crossover_rate = config.crossover_rate;
+    params_.security_weight = config.security_weight;
+    params_.performance_weight = config.performance_weight;
+    params_.flattening = FlatteningOptions::fromConfig(config);
+
+    H5X_LOG_INFO(logger_, "GeneticOptimizer configuration updated");
+}
 
-    logger_.info("GeneticOptimizer configuration updated");
+void GeneticOptimizer::set_params(const GeneticAlgorithmParams& params) {
+    params_ = params;
+    if (params_.seed != 0) {
+        rng_.seed(static_cast<std::mt19937::result_type>(params_.seed));
+    }
 }
 
 std::vector<int> GeneticOptimizer::optimize_pass_sequence(llvm::Module& module) {
@@ -69,7 +305,7 @@ std::vector<int> GeneticOptimizer::optimize_pass_sequence(llvm::Module& module)
         return generate_random_sequence();
     }
 
-    logger_.info("Starting genetic algorithm optimization...");
+    H5X_LOG_INFO(logger_, "Starting genetic algorithm optimization...");
     fitness_history_.clear();
 
     auto start_time = std::chrono::high_resolution_clock::now();
@@ -77,13 +313,62 @@ std::vector<int> GeneticOptimizer::optimize_pass_sequence(llvm::Module& module)
     try {
         // Initialize population
         auto population = initialize_population();
-        logger_.info("Initialized population with " + std::to_string(population.size()) + " individuals");
+        H5X_LOG_INFO(logger_, "Initialized population with " + std::to_string(population.size()) + " individuals");
+
+        // The module fingerprint scopes the fitness cache; the same bitcode
+        // seeds the per-worker module copies
+        llvm::SmallVector<char, 0> bitcode;
+        llvm::raw_svector_ostream bitcode_os(bitcode);
+        llvm::WriteBitcodeToFile(module, bitcode_os);
+        module_fingerprint_ = HashUtils::sha256_hex(bitcode.data(), bitcode.size());
+        fitness_cache_hits_ = 0;
+        fitness_cache_lookups_ = 0;
+        full_evaluations_ = 0;
+        proxy_pruned_ = 0;
+        evaluation_seed_ = params_.seed != 0 ? params_.seed : kDefaultEvaluationSeed;
+        load_fitness_cache();
+
+        // Every candidate is compared against the same unmodified input
+        baseline_metrics_ = std::make_unique<ModuleMetrics>(module);
+
+        llvm::SmallVector<char, 0> proxy_bitcode;
+        proxy_module_.reset();
+        proxy_baseline_metrics_.reset();
+        if (params_.proxy_prune_ratio > 0.0) {
+            proxy_module_ = build_proxy_module(module, params_.proxy_sample_functions);
+            if (proxy_module_) {
+                proxy_baseline_metrics_ = std::make_unique<ModuleMetrics>(*proxy_module_);
+                llvm::raw_svector_ostream proxy_os(proxy_bitcode);
+                llvm::WriteBitcodeToFile(*proxy_module_, proxy_os);
+                H5X_LOG_INFO(logger_, "Proxy fitness on the " + std::to_string(params_.proxy_sample_functions) +
+                                      " largest functions prunes " +
+                                      std::to_string(params_.proxy_prune_ratio * 100.0) + "% of each batch");
+            }
+        }
 
-        // Evaluate initial population
-        for (auto& individual : population) {
-            individual.fitness_score = evaluate_fitness(individual, module);
+        // Fitness evaluation only reads the module, so it can fan out;
+        // everything that draws from rng_ stays on this thread
+        size_t worker_count = std::min(ThreadPool::resolve_worker_count(params_.num_threads),
+                                       static_cast<size_t>(std::max(1, params_.population_size)));
+        std::unique_ptr<FitnessWorkers> workers;
+        size_t snapshot_budget = params_.snapshot_budget_mb * 1024 * 1024;
+        if (worker_count > 1) {
+            workers = std::make_unique<FitnessWorkers>(bitcode, proxy_bitcode, worker_count);
+            if (snapshot_budget > 0) {
+                for (auto& trie : workers->snapshots) {
+                    trie = std::make_unique<PassPrefixTrie>(snapshot_budget / worker_count);
+                }
+            }
+            H5X_LOG_INFO(logger_, "Evaluating fitness on " + std::to_string(worker_count) + " workers");
+        }
+        snapshots_.reset();
+        if (!workers && snapshot_budget > 0) {
+            snapshots_ = std::make_unique<PassPrefixTrie>(snapshot_budget);
         }
 
+        // Evaluate initial population
+        evaluate_population(population, module, workers.get());
+
         // Sort population by fitness (higher is better)
         std::sort(population.begin(), population.end(), 
                  [](const Individual& a, const Individual& b) {
@@ -101,7 +386,8 @@ std::vector<int> GeneticOptimizer::optimize_pass_sequence(llvm::Module& module)
             }
 
             // Generate offspring through selection, crossover, and mutation
-            while (new_population.size() < static_cast<size_t>(params_.population_size)) {
+            std::vector<Individual> offspring_batch;
+            while (new_population.size() + offspring_batch.size() < static_cast<size_t>(params_.population_size)) {
                 // Selection
                 auto selected = selection(population);
 
@@ -116,11 +402,14 @@ std::vector<int> GeneticOptimizer::optimize_pass_sequence(llvm::Module& module)
                         offspring = mutate(offspring);
                     }
 
-                    offspring.fitness_score = evaluate_fitness(offspring, module);
-                    new_population.push_back(offspring);
+                    offspring_batch.push_back(offspring);
                 }
             }
 
+            // Evaluate the whole generation at once
+            evaluate_population(offspring_batch, module, workers.get());
+            new_population.insert(new_population.end(), offspring_batch.begin(), offspring_batch.end());
+
             // Replace population
             population = new_population;
 
@@ -142,14 +431,47 @@ std::vector<int> GeneticOptimizer::optimize_pass_sequence(llvm::Module& module)
         auto end_time = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
 
-        logger_.info("Genetic algorithm optimization completed in " + 
-                    std::to_string(duration.count()) + "ms");
-        logger_.info("Best fitness achieved: " + std::to_string(population[0].fitness_score));
+        H5X_LOG_INFO(logger_, "Genetic algorithm optimization completed in " + 
+                             std::to_string(duration.count()) + "ms");
+        H5X_LOG_INFO(logger_, "Best fitness achieved: " + std::to_string(population[0].fitness_score));
+
+        PrefixTrieStats trie_stats;
+        std::vector<PassPrefixTrie*> tries;
+        if (snapshots_) tries.push_back(snapshots_.get());
+        if (workers) {
+            for (auto& trie : workers->snapshots) {
+                if (trie) tries.push_back(trie.get());
+            }
+        }
+        for (PassPrefixTrie* trie : tries) {
+            trie_stats.passes_applied += trie->get_stats().passes_applied;
+            trie_stats.passes_reused += trie->get_stats().passes_reused;
+            trie_stats.snapshots_evicted += trie->get_stats().snapshots_evicted;
+        }
+        if (!tries.empty()) {
+            H5X_LOG_INFO(logger_, "Prefix snapshots: " + std::to_string(trie_stats.passes_reused) + " passes reused, " +
+                                  std::to_string(trie_stats.passes_applied) + " applied, " +
+                                  std::to_string(trie_stats.snapshots_evicted) + " evicted");
+        }
+        if (proxy_pruned_ > 0) {
+            H5X_LOG_INFO(logger_, "Proxy pruned " + std::to_string(proxy_pruned_) + " candidates; " +
+                                  std::to_string(full_evaluations_) + " scored in full");
+        }
+        snapshots_.reset();
+        proxy_module_.reset();
+        baseline_metrics_.reset();
+        proxy_baseline_metrics_.reset();
+
+        save_fitness_cache();
 
         return population[0].pass_sequence;
 
     } catch (const std::exception& e) {
         logger_.error("Genetic algorithm optimization failed: " + std::string(e.what()));
+        snapshots_.reset();
+        proxy_module_.reset();
+        baseline_metrics_.reset();
+        proxy_baseline_metrics_.reset();
         return generate_random_sequence();
     }
 }
@@ -166,33 +488,44 @@ std::vector<Individual> GeneticOptimizer::initialize_population() {
     return population;
 }
 
-double GeneticOptimizer::evaluate_fitness(const Individual& individual, llvm::Module& module) {
+double GeneticOptimizer::evaluate_fitness(const Individual& individual, llvm::Module& module,
+                                          PassPrefixTrie* snapshots, const ModuleMetrics* baseline) {
     try {
-        // For now, use simple heuristics based on the pass sequence
-        // TODO: Apply actual obfuscation passes to create obfuscated module
-        auto original_clone = llvm::CloneModule(module);
-        
-        // Calculate fitness based on pass sequence characteristics
-        double security_score = calculate_security_score(module, *original_clone);
-        double performance_impact = calculate_performance_impact(module, *original_clone);
-        double complexity_score = calculate_complexity_score(module);
-
-        // Weighted fitness function for Level 2 obfuscation
-        double fitness = 0.0;
-        fitness += security_score * 0.5;           // 50% weight on security
-        fitness += (100.0 - performance_impact) * 0.3;  // 30% weight on performance (lower impact = higher score)
-        fitness += complexity_score * 0.2;        // 20% weight on complexity
-
-        // Penalty for overly long sequences (efficiency consideration)
-        if (individual.pass_sequence.size() > 6) {
-            fitness *= 0.9; 
+        // Build the obfuscated module, resuming from a cached prefix if possible
+        auto apply = [this](int pass, llvm::Module& target, uint64_t prefix_hash) {
+            apply_pass(pass, target, prefix_hash);
+        };
+        std::unique_ptr<llvm::Module> obfuscated;
+        if (snapshots) {
+            obfuscated = snapshots->materialize(module, individual.pass_sequence, apply);
+        } else {
+            obfuscated = llvm::CloneModule(module);
+            for (size_t i = 0; i < individual.pass_sequence.size(); ++i) {
+                apply(individual.pass_sequence[i], *obfuscated,
+                      PassPrefixTrie::prefix_hash(individual.pass_sequence, i + 1));
+            }
         }
 
-        // Bonus for using complementary techniques
-        std::set<int> unique_passes(individual.pass_sequence.begin(), individual.pass_sequence.end());
-        if (unique_passes.size() >= 3) {
-            fitness *= 1.1; // 10% bonus for diversity
+        // Every term is measured on the transformed IR against the input, so
+        // long or redundant sequences pay through their measured overhead
+        std::unique_ptr<ModuleMetrics> measured;
+        if (!baseline) {
+            measured = std::make_unique<ModuleMetrics>(module);
+            baseline = measured.get();
         }
+        const ModuleMetrics& before = *baseline;
+        ModuleMetrics after(*obfuscated);
+        double security_score = calculate_security_score(before, after);
+        double performance_impact = calculate_performance_impact(before, after);
+        double complexity_score = calculate_complexity_score(before, after);
+
+        // security_weight covers security and complexity (5:2), performance_weight
+        // low overhead; the default 0.7/0.3 gives 50% / 20% / 30%
+        FitnessWeights weights = fitness_weights(params_);
+        double fitness = 0.0;
+        fitness += security_score * weights.security;
+        fitness += (100.0 - performance_impact) * weights.performance;  // Lower impact = higher score
+        fitness += complexity_score * weights.complexity;
 
         return std::max(0.0, std::min(100.0, fitness));
 
@@ -202,6 +535,206 @@ double GeneticOptimizer::evaluate_fitness(const Individual& individual, llvm::Mo
     }
 }
 
+void GeneticOptimizer::evaluate_population(std::vector<Individual>& individuals, llvm::Module& module,
+                                           FitnessWorkers* workers) {
+    // Scores batch in full, except what the proxy prunes. Pruned candidates
+    // keep their proxy score, capped at the weakest full score so they never
+    // outrank a candidate that was actually evaluated. Returns which
+    // candidates were scored in full
+    auto score = [&](std::vector<Individual>& batch) {
+        std::vector<size_t> selected = select_by_proxy(batch, workers);
+        full_evaluations_ += selected.size();
+        std::vector<bool> full(batch.size(), false);
+        if (!workers) {
+            for (size_t index : selected) {
+                batch[index].fitness_score = evaluate_fitness(batch[index], module, snapshots_.get(),
+                                                              baseline_metrics_.get());
+            }
+        } else {
+            // Scores land in their own slot, so the order matches the serial run
+            workers->pool.parallel_for(selected.size(), [&](size_t i, size_t worker_id) {
+                Individual& individual = batch[selected[i]];
+                individual.fitness_score = evaluate_fitness(individual, workers->module_for(worker_id),
+                                                            workers->snapshots[worker_id].get(),
+                                                            baseline_metrics_.get());
+            });
+        }
+
+        double weakest = 100.0;
+        for (size_t index : selected) {
+            full[index] = true;
+            weakest = std::min(weakest, batch[index].fitness_score);
+        }
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!full[i]) batch[i].fitness_score = std::min(batch[i].fitness_score, weakest);
+        }
+        return full;
+    };
+
+    if (module_fingerprint_.empty()) {
+        score(individuals);
+        return;
+    }
+
+    // Look everything up first; each distinct unseen sequence is scored once
+    std::vector<std::string> keys(individuals.size());
+    std::vector<Individual> pending;
+    std::unordered_set<std::string> pending_keys;
+    for (size_t i = 0; i < individuals.size(); ++i) {
+        keys[i] = fitness_cache_key(individuals[i].pass_sequence);
+        fitness_cache_lookups_++;
+        if (fitness_cache_.count(keys[i]) || !pending_keys.insert(keys[i]).second) {
+            fitness_cache_hits_++;
+        } else {
+            pending.push_back(individuals[i]);
+        }
+    }
+
+    // Proxy scores are not cached: a pruned sequence is reconsidered against
+    // the next batch it shows up in
+    std::vector<bool> full = score(pending);
+    std::unordered_map<std::string, double> pruned;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        auto& scores = full[i] ? fitness_cache_ : pruned;
+        scores[fitness_cache_key(pending[i].pass_sequence)] = pending[i].fitness_score;
+    }
+    for (size_t i = 0; i < individuals.size(); ++i) {
+        auto cached = fitness_cache_.find(keys[i]);
+        individuals[i].fitness_score = cached != fitness_cache_.end() ? cached->second : pruned[keys[i]];
+    }
+}
+
+std::vector<size_t> GeneticOptimizer::select_by_proxy(std::vector<Individual>& batch, FitnessWorkers* workers) {
+    std::vector<size_t> selected(batch.size());
+    std::iota(selected.begin(), selected.end(), 0);
+
+    size_t pruned = static_cast<size_t>(batch.size() * params_.proxy_prune_ratio);
+    pruned = std::min(pruned, batch.size() > 0 ? batch.size() - 1 : 0);
+    if (!proxy_module_ || pruned == 0) {
+        return selected;
+    }
+
+    // Prefix snapshots belong to the full module, so the proxy runs without them
+    if (!workers) {
+        for (auto& individual : batch) {
+            individual.fitness_score = evaluate_fitness(individual, *proxy_module_, nullptr,
+                                                        proxy_baseline_metrics_.get());
+        }
+    } else {
+        workers->pool.parallel_for(batch.size(), [&](size_t index, size_t worker_id) {
+            batch[index].fitness_score = evaluate_fitness(batch[index], workers->proxy_module_for(worker_id),
+                                                          nullptr, proxy_baseline_metrics_.get());
+        });
+    }
+
+    // Ties keep batch order, so the choice is the same for any worker count
+    std::stable_sort(selected.begin(), selected.end(), [&batch](size_t a, size_t b) {
+        return batch[a].fitness_score > batch[b].fitness_score;
+    });
+    selected.resize(batch.size() - pruned);
+    std::sort(selected.begin(), selected.end());
+
+    proxy_pruned_ += pruned;
+    return selected;
+}
+
+void GeneticOptimizer::apply_pass(int pass, llvm::Module& module, uint64_t prefix_hash) const {
+    // Every prefix gets its own seed, so a snapshot of a prefix is exactly
+    // what re-applying that prefix from scratch would produce
+    PassOptions options;
+    options.seed = (evaluation_seed_ ^ prefix_hash) | 1;
+
+    llvm::ModuleAnalysisManager analysis_manager;
+    switch (static_cast<PassType>(pass)) {
+        case PassType::CONTROL_FLOW_FLATTENING:
+            ControlFlowFlatteningPass(options, params_.flattening).run(module, analysis_manager);
+            break;
+        case PassType::INSTRUCTION_SUBSTITUTION:
+            InstructionSubstitutionPass(options).run(module, analysis_manager);
+            break;
+        case PassType::STRING_OBFUSCATION:
+            StringObfuscationPass(options).run(module, analysis_manager);
+            break;
+        case PassType::BOGUS_CONTROL_FLOW:
+            BogusControlFlowPass(options).run(module, analysis_manager);
+            break;
+        case PassType::ANTI_ANALYSIS:
+            AntiAnalysisPass(options).run(module, analysis_manager);
+            break;
+        case PassType::DEAD_CODE_ELIMINATION:
+            eliminate_dead_code(module);
+            break;
+        case PassType::CONSTANT_PROPAGATION:
+            propagate_constants(module);
+            break;
+    }
+}
+
+std::string GeneticOptimizer::fitness_cache_key(const std::vector<int>& sequence) const {
+    std::ostringstream key;
+    FitnessWeights weights = fitness_weights(params_);
+    key << kFitnessModelVersion << ':' << evaluation_seed_ << ':' << weights.security << ':'
+        << weights.performance << ':' << static_cast<int>(params_.flattening.dispatcher) << ':'
+        << params_.flattening.clusterSize << ':' << params_.flattening.preserveInnermostLoops << ':'
+        << module_fingerprint_ << ':';
+    for (size_t i = 0; i < sequence.size(); ++i) {
+        key << (i ? "," : "") << sequence[i];
+    }
+    return key.str();
+}
+
+void GeneticOptimizer::load_fitness_cache() {
+    if (params_.fitness_cache_file.empty()) {
+        return;
+    }
+
+    std::ifstream file(params_.fitness_cache_file);
+    if (!file) {
+        return;
+    }
+
+    std::string line;
+    size_t loaded = 0;
+    while (std::getline(file, line)) {
+        size_t tab = line.find('\t');
+        if (line.empty() || line[0] == '#' || tab == std::string::npos) {
+            continue;
+        }
+        try {
+            fitness_cache_[line.substr(0, tab)] = std::stod(line.substr(tab + 1));
+            loaded++;
+        } catch (const std::exception&) {
+            // Skip damaged lines
+        }
+    }
+
+    H5X_LOG_DEBUG(logger_, "Loaded " + std::to_string(loaded) + " cached fitness scores");
+}
+
+void GeneticOptimizer::save_fitness_cache() {
+    if (params_.fitness_cache_file.empty()) {
+        return;
+    }
+
+    std::string tmp_path = params_.fitness_cache_file + ".tmp";
+    std::ofstream file(tmp_path);
+    if (!file) {
+        logger_.warning("Cannot write fitness cache: " + tmp_path);
+        return;
+    }
+
+    file << "# h5x fitness cache\n";
+    file << std::setprecision(17);
+    for (const auto& entry : fitness_cache_) {
+        file << entry.first << '\t' << entry.second << '\n';
+    }
+    file.close();
+
+    if (std::rename(tmp_path.c_str(), params_.fitness_cache_file.c_str()) != 0) {
+        logger_.warning("Cannot write fitness cache: " + params_.fitness_cache_file);
+    }
+}
+
 std::vector<Individual> GeneticOptimizer::selection(const std::vector<Individual>& population) {
     std::vector<Individual> selected;
 
@@ -326,9 +859,14 @@ void GeneticOptimizer::log_generation_stats(int generation, const std::vector<In
     }
     avg_fitness /= population.size();
 
-    logger_.info("Generation " + std::to_string(generation) + 
-                ": Best=" + std::to_string(best_fitness) +
-                ", Avg=" + std::to_string(avg_fitness));
+    H5X_LOG_INFO(logger_, "Generation " + std::to_string(generation) + 
+                         ": Best=" + std::to_string(best_fitness) +
+                         ", Avg=" + std::to_string(avg_fitness) +
+                         ", FitnessCacheHitRate=" + std::to_string(get_fitness_cache_hit_rate() * 100.0) + "%");
+}
+
+double GeneticOptimizer::get_fitness_cache_hit_rate() const {
+    return fitness_cache_lookups_ ? static_cast<double>(fitness_cache_hits_) / fitness_cache_lookups_ : 0.0;
 }
 
 double GeneticOptimizer::get_best_fitness() const {
@@ -338,90 +876,64 @@ double GeneticOptimizer::get_best_fitness() const {
     return *std::max_element(fitness_history_.begin(), fitness_history_.end());
 }
 
-double GeneticOptimizer::calculate_security_score(llvm::Module& original, llvm::Module& obfuscated) {
-    // Calculate security score based on actual module differences
-    double security_score = 0.0;
-    
-    // Count function complexity increase
-    size_t original_functions = 0;
-    size_t obfuscated_functions = 0;
-    
-    for (auto& func : original) {
-        if (!func.isDeclaration()) {
-            original_functions++;
+double GeneticOptimizer::calculate_security_score(const ModuleMetrics& original,
+                                                  const ModuleMetrics& obfuscated) const {
+    // Each component is in [0, 1]; components with nothing to measure in the
+    // original (no strings, no named functions) drop out of the average
+    double weighted = 0.0;
+    double total_weight = 0.0;
+    auto add = [&](double value, double weight) {
+        weighted += value * weight;
+        total_weight += weight;
+    };
+
+    // Control-flow obfuscation: growth of cyclomatic complexity
+    add(saturate_growth(original.cyclomatic_complexity(), obfuscated.cyclomatic_complexity()), 0.35);
+
+    // Data-flow obfuscation: growth of arithmetic, logic and comparisons
+    add(saturate_growth(static_cast<double>(original.data_flow_ops),
+                        static_cast<double>(obfuscated.data_flow_ops)), 0.25);
+
+    // String protection: share of original C strings no longer in the clear
+    if (!original.plaintext_strings.empty()) {
+        size_t hidden = 0;
+        for (const auto& text : original.plaintext_strings) {
+            hidden += obfuscated.plaintext_strings.count(text) ? 0 : 1;
         }
+        add(static_cast<double>(hidden) / original.plaintext_strings.size(), 0.25);
     }
-    
-    for (auto& func : obfuscated) {
-        if (!func.isDeclaration()) {
-            obfuscated_functions++;
+
+    // Symbol protection: share of original function names that disappeared
+    if (!original.function_names.empty()) {
+        size_t renamed = 0;
+        for (const auto& name : original.function_names) {
+            renamed += obfuscated.function_names.count(name) ? 0 : 1;
         }
+        add(static_cast<double>(renamed) / original.function_names.size(), 0.15);
     }
-    
-    // Base security score based on module changes
-    if (obfuscated_functions > original_functions) {
-        security_score += (obfuscated_functions - original_functions) * 10.0;
-    }
-    
-    // TODO: Add more sophisticated analysis
-    // For now, return a base score
-    security_score += 50.0;
-    
-    return std::min(100.0, security_score);
+
+    return total_weight > 0.0 ? 100.0 * weighted / total_weight : 0.0;
 }
 
-double GeneticOptimizer::calculate_performance_impact(llvm::Module& original, llvm::Module& obfuscated) {
-    // Calculate performance impact based on module differences
+double GeneticOptimizer::calculate_performance_impact(const ModuleMetrics& original,
+                                                      const ModuleMetrics& obfuscated) const {
+    // Growth of the estimated dynamic cost as performance impact
     double performance_impact = 0.0;
-    
-    // Count instructions in both modules
-    size_t original_instructions = 0;
-    size_t obfuscated_instructions = 0;
-    
-    for (auto& func : original) {
-        if (!func.isDeclaration()) {
-            for (auto& bb : func) {
-                original_instructions += bb.size();
-            }
-        }
-    }
-    
-    for (auto& func : obfuscated) {
-        if (!func.isDeclaration()) {
-            for (auto& bb : func) {
-                obfuscated_instructions += bb.size();
-            }
-        }
-    }
-    
-    // Calculate instruction bloat as performance impact
-    if (original_instructions > 0) {
-        double bloat_factor = static_cast<double>(obfuscated_instructions) / original_instructions;
+    if (original.cost > 0.0) {
+        double bloat_factor = obfuscated.cost / original.cost;
         performance_impact = (bloat_factor - 1.0) * 50.0; // Scale to percentage
     }
-    
-    return std::min(100.0, performance_impact);
-}
-
-double h5x::GeneticOptimizer::calculate_complexity_score(llvm::Module& module) {
-    // Calculate complexity based on control flow and instruction diversity
 
-    int total_basic_blocks = 0;
-    int total_instructions = 0;
-    int total_functions = 0;
-
-    for (const auto& func : module) {
-        if (!func.isDeclaration()) {
-            total_functions++;
-            for (const auto& bb : func) {
-                total_basic_blocks++;
-                total_instructions += bb.size();
-            }
-        }
-    }
+    return std::max(0.0, std::min(100.0, performance_impact));
+}
 
-    // Simple complexity heuristic
-    return total_instructions * 0.5 + total_basic_blocks * 2.0 + total_functions * 10.0;
+double GeneticOptimizer::calculate_complexity_score(const ModuleMetrics& original,
+                                                    const ModuleMetrics& obfuscated) const {
+    // Simple complexity heuristic, scored by how much it grew
+    auto complexity = [](const ModuleMetrics& metrics) {
+        return metrics.instructions * 0.5 + metrics.blocks * 2.0 + metrics.functions * 10.0;
+    };
+    return 100.0 * saturate_growth(complexity(original), complexity(obfuscated));
 }
 
 } // namespace h5x
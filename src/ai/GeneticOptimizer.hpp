@@ -5,7 +5,11 @@
 #include <string>
 #include <random>
 #include <functional>
+#include <unordered_map>
+#include <memory>
 #include "llvm/IR/Module.h"
+#include "PassPrefixTrie.hpp"
+#include "../passes/ControlFlowFlattening.hpp"
 #include "../utils/Logger.hpp"
 
 namespace h5x {
@@ -27,12 +31,27 @@ struct GeneticAlgorithmParams {
     double crossover_rate{0.8};
     int tournament_size{3};
     double elitism_ratio{0.1};
+    int num_threads{1};        // Fitness evaluation workers; <= 0 uses every core
+    uint64_t seed{0};          // 0 seeds from the clock
+    std::string fitness_cache_file;  // Empty keeps the fitness cache in memory only
+    size_t snapshot_budget_mb{0};    // Memory for prefix snapshots across all workers; 0 disables them
+    double proxy_prune_ratio{0.0};   // Share of each batch dropped after proxy scoring; 0 scores everything in full
+    size_t proxy_sample_functions{8};  // Largest functions kept in the proxy module
+    double security_weight{0.7};       // Fitness weight of security and complexity gains
+    double performance_weight{0.3};    // Fitness weight of low runtime overhead
+    FlatteningOptions flattening;      // Dispatcher layout candidates are flattened with
 };
 
+// Per-worker LLVMContext and module copy used by parallel fitness evaluation
+struct FitnessWorkers;
+
+// Static features of a module that fitness compares before and after obfuscation
+struct ModuleMetrics;
+
 class GeneticOptimizer {
 public:
     explicit GeneticOptimizer(Logger& logger);
-    ~GeneticOptimizer() = default;
+    ~GeneticOptimizer();
 
     bool initialize(const ObfuscationConfig& config);
     void update_configuration(const ObfuscationConfig& config);
@@ -41,7 +60,11 @@ public:
 
     // Genetic algorithm components
     std::vector<Individual> initialize_population();
-    double evaluate_fitness(const Individual& individual, llvm::Module& module);
+    // baseline holds the metrics of the unmodified module; measured here when null
+    double evaluate_fitness(const Individual& individual, llvm::Module& module,
+                            PassPrefixTrie* snapshots = nullptr, const ModuleMetrics* baseline = nullptr);
+    void evaluate_population(std::vector<Individual>& individuals, llvm::Module& module,
+                             FitnessWorkers* workers = nullptr);
     std::vector<Individual> selection(const std::vector<Individual>& population);
     Individual crossover(const Individual& parent1, const Individual& parent2);
     Individual mutate(const Individual& individual);
@@ -49,6 +72,11 @@ public:
     // Statistics and monitoring
     std::vector<double> get_fitness_history() const { return fitness_history_; }
     double get_best_fitness() const;
+    double get_fitness_cache_hit_rate() const;
+    uint64_t get_full_evaluations() const { return full_evaluations_; }
+    uint64_t get_proxy_pruned() const { return proxy_pruned_; }
+    const GeneticAlgorithmParams& get_params() const { return params_; }
+    void set_params(const GeneticAlgorithmParams& params);
 
 private:
     Logger& logger_;
@@ -71,15 +99,42 @@ private:
     std::vector<PassType> available_passes_;
     std::vector<double> fitness_history_;
 
+    // Fitness memo keyed on module fingerprint + pass sequence; shared across
+    // generations and, with fitness_cache_file, across runs
+    std::unordered_map<std::string, double> fitness_cache_;
+    std::string module_fingerprint_;
+    uint64_t fitness_cache_hits_{0};
+    uint64_t fitness_cache_lookups_{0};
+
+    // Seed for pass application during evaluation; fixed so scores are reproducible
+    uint64_t evaluation_seed_{0};
+    std::unique_ptr<PassPrefixTrie> snapshots_;   // Serial evaluation only
+
+    // Reduced copy of the module holding only its largest functions; scoring
+    // a candidate on it is the cheap proxy that decides who is scored in full.
+    // Lives in the caller's context and is released when the run ends
+    std::unique_ptr<llvm::Module> proxy_module_;
+
+    // Metrics of the input and proxy modules, measured once per run
+    std::unique_ptr<ModuleMetrics> baseline_metrics_;
+    std::unique_ptr<ModuleMetrics> proxy_baseline_metrics_;
+    uint64_t full_evaluations_{0};
+    uint64_t proxy_pruned_{0};
+
     // Fitness evaluation components
-    double calculate_security_score(llvm::Module& original, llvm::Module& obfuscated);
-    double calculate_performance_impact(llvm::Module& original, llvm::Module& obfuscated);
-    double calculate_complexity_score(llvm::Module& module);
+    void apply_pass(int pass, llvm::Module& module, uint64_t prefix_hash) const;
+    double calculate_security_score(const ModuleMetrics& original, const ModuleMetrics& obfuscated) const;
+    double calculate_performance_impact(const ModuleMetrics& original, const ModuleMetrics& obfuscated) const;
+    double calculate_complexity_score(const ModuleMetrics& original, const ModuleMetrics& obfuscated) const;
+    std::vector<size_t> select_by_proxy(std::vector<Individual>& batch, FitnessWorkers* workers);
 
     // Helper methods
     std::vector<int> generate_random_sequence();
     bool is_valid_sequence(const std::vector<int>& sequence);
     void log_generation_stats(int generation, const std::vector<Individual>& population);
+    std::string fitness_cache_key(const std::vector<int>& sequence) const;
+    void load_fitness_cache();
+    void save_fitness_cache();
 };
 
 } // namespace h5x
@@ -0,0 +1,150 @@
+#include "PassPrefixTrie.hpp"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+namespace h5x {
+
+PassPrefixTrie::PassPrefixTrie(size_t memory_budget_bytes)
+    : memory_budget_(memory_budget_bytes)
+{
+}
+
+PassPrefixTrie::~PassPrefixTrie() = default;
+
+std::unique_ptr<llvm::Module> PassPrefixTrie::materialize(const llvm::Module& base,
+                                                          const std::vector<int>& sequence,
+                                                          const ApplyFn& apply) {
+    if (base_ != &base) {
+        clear();
+        base_ = &base;
+    }
+
+    // Walk the sequence, remembering the deepest stored snapshot
+    std::vector<Node*> path;
+    Node* node = &root_;
+    size_t resume = 0;
+    for (size_t i = 0; i < sequence.size(); ++i) {
+        auto& child = node->children[sequence[i]];
+        if (!child) {
+            child = std::make_unique<Node>();
+        }
+        node = child.get();
+        path.push_back(node);
+        if (node->snapshot) {
+            resume = i + 1;
+        }
+    }
+
+    std::unique_ptr<llvm::Module> module;
+    if (resume > 0) {
+        Node* start = path[resume - 1];
+        start->last_used = ++clock_;
+        module = llvm::CloneModule(*start->snapshot);
+        stats_.passes_reused += resume;
+    } else {
+        module = llvm::CloneModule(base);
+    }
+
+    for (size_t i = resume; i < sequence.size(); ++i) {
+        apply(sequence[i], *module, prefix_hash(sequence, i + 1));
+        stats_.passes_applied++;
+
+        // The full sequence is not snapshotted: only identical sequences
+        // could reuse it, and the fitness cache already covers those
+        Node* reached = path[i];
+        reached->visits++;
+        if (i + 1 < sequence.size() && reached->visits >= 2 && !reached->snapshot) {
+            store_snapshot(*reached, *module);
+        }
+    }
+
+    return module;
+}
+
+void PassPrefixTrie::clear() {
+    root_.children.clear();
+    stats_.bytes_in_use = 0;
+}
+
+void PassPrefixTrie::store_snapshot(Node& node, const llvm::Module& module) {
+    size_t bytes = estimate_module_bytes(module);
+    if (bytes > memory_budget_) {
+        return;
+    }
+
+    while (stats_.bytes_in_use + bytes > memory_budget_) {
+        if (!evict_one()) {
+            return;
+        }
+    }
+
+    node.snapshot = llvm::CloneModule(module);
+    node.snapshot_bytes = bytes;
+    node.last_used = ++clock_;
+    stats_.bytes_in_use += bytes;
+    stats_.snapshots_stored++;
+}
+
+bool PassPrefixTrie::evict_one() {
+    std::vector<Node*> snapshots;
+    collect_snapshots(root_, snapshots);
+    if (snapshots.empty()) {
+        return false;
+    }
+
+    Node* victim = snapshots.front();
+    for (Node* candidate : snapshots) {
+        if (candidate->last_used < victim->last_used) {
+            victim = candidate;
+        }
+    }
+
+    stats_.bytes_in_use -= victim->snapshot_bytes;
+    stats_.snapshots_evicted++;
+    victim->snapshot.reset();
+    victim->snapshot_bytes = 0;
+    return true;
+}
+
+void PassPrefixTrie::collect_snapshots(Node& node, std::vector<Node*>& out) {
+    if (node.snapshot) {
+        out.push_back(&node);
+    }
+    for (auto& child : node.children) {
+        collect_snapshots(*child.second, out);
+    }
+}
+
+size_t PassPrefixTrie::estimate_module_bytes(const llvm::Module& module) {
+    // Approximate sizes of the IR objects; close enough for budgeting
+    size_t bytes = 1024;
+    for (const auto& global : module.globals()) {
+        bytes += 128;
+        if (global.hasInitializer()) {
+            if (auto* data = llvm::dyn_cast<llvm::ConstantDataSequential>(global.getInitializer())) {
+                bytes += data->getNumElements() * data->getElementByteSize();
+            }
+        }
+    }
+    for (const auto& function : module) {
+        bytes += 256;
+        for (const auto& bb : function) {
+            bytes += 96;
+            for (const auto& inst : bb) {
+                bytes += 80 + 32 * inst.getNumOperands();
+            }
+        }
+    }
+    return bytes;
+}
+
+uint64_t PassPrefixTrie::prefix_hash(const std::vector<int>& sequence, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length && i < sequence.size(); ++i) {
+        hash = (hash ^ static_cast<uint64_t>(sequence[i] + 1)) * 0x100000001b3ULL;
+    }
+    return (hash ^ length) * 0x100000001b3ULL;
+}
+
+} // namespace h5x
@@ -0,0 +1,78 @@
+#ifndef H5X_PASS_PREFIX_TRIE_HPP
+#define H5X_PASS_PREFIX_TRIE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+#include "llvm/IR/Module.h"
+
+namespace h5x {
+
+struct PrefixTrieStats {
+    uint64_t passes_applied{0};
+    uint64_t passes_reused{0};     // Skipped by resuming from a snapshot
+    uint64_t snapshots_stored{0};
+    uint64_t snapshots_evicted{0};
+    size_t bytes_in_use{0};
+};
+
+// Trie of transformed module snapshots keyed by pass prefix. Evaluating a
+// sequence resumes from the snapshot of its longest cached prefix and only
+// applies the remaining passes. A prefix is snapshotted the second time it
+// is reached, i.e. once sharing has actually been observed, and snapshots
+// are evicted least-recently-used to stay within the memory budget.
+//
+// Snapshots live in the base module's LLVMContext, so a trie must only be
+// used by the thread that owns that context.
+class PassPrefixTrie {
+public:
+    // Applies pass at position depth of the sequence; prefix_hash identifies
+    // the prefix ending at that pass and is stable across runs
+    using ApplyFn = std::function<void(int pass, llvm::Module& module, uint64_t prefix_hash)>;
+
+    explicit PassPrefixTrie(size_t memory_budget_bytes);
+    ~PassPrefixTrie();
+
+    PassPrefixTrie(const PassPrefixTrie&) = delete;
+    PassPrefixTrie& operator=(const PassPrefixTrie&) = delete;
+
+    // Returns a copy of base with every pass of sequence applied
+    std::unique_ptr<llvm::Module> materialize(const llvm::Module& base, const std::vector<int>& sequence,
+                                              const ApplyFn& apply);
+
+    // Drops every snapshot (e.g. when the base module changes)
+    void clear();
+
+    const PrefixTrieStats& get_stats() const { return stats_; }
+
+    // Rough in-memory footprint of a module
+    static size_t estimate_module_bytes(const llvm::Module& module);
+
+    // Stable hash of sequence[0..length)
+    static uint64_t prefix_hash(const std::vector<int>& sequence, size_t length);
+
+private:
+    struct Node {
+        std::map<int, std::unique_ptr<Node>> children;
+        std::unique_ptr<llvm::Module> snapshot;
+        size_t snapshot_bytes{0};
+        uint64_t visits{0};
+        uint64_t last_used{0};
+    };
+
+    void store_snapshot(Node& node, const llvm::Module& module);
+    bool evict_one();
+    void collect_snapshots(Node& node, std::vector<Node*>& out);
+
+    Node root_;
+    const llvm::Module* base_{nullptr};
+    size_t memory_budget_;
+    uint64_t clock_{0};
+    PrefixTrieStats stats_;
+};
+
+} // namespace h5x
+
+#endif // H5X_PASS_PREFIX_TRIE_HPP
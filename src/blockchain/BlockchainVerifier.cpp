@@ -1,5 +1,9 @@
 #include "BlockchainVerifier.hpp"
 #include "../core/H5XObfuscationEngine.hpp"
+#include "../utils/HashUtils.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
@@ -11,6 +15,35 @@
 
 namespace h5x {
 
+namespace {
+
+// H5XHashStorage.batchStoreHashes rejects larger batches
+const size_t kMaxBatchHashes = 50;
+
+// First 4 bytes of keccak256("batchStoreHashes(bytes32[])")
+const char* const kBatchStoreHashesSelector = "09916cfd";
+
+std::string abi_word(uint64_t value) {
+    std::ostringstream ss;
+    ss << std::hex << std::setw(64) << std::setfill('0') << value;
+    return ss.str();
+}
+
+std::string hex_quantity(uint64_t value) {
+    std::ostringstream ss;
+    ss << "0x" << std::hex << value;
+    return ss.str();
+}
+
+uint64_t parse_hex_quantity(const Json::Value& value) {
+    if (!value.isString() || value.asString().empty()) {
+        return 0;
+    }
+    return std::stoull(value.asString(), nullptr, 16);
+}
+
+} // anonymous namespace
+
 // Simple hash storage contract ABI
 const std::string BlockchainVerifier::CONTRACT_ABI = R"([
     {
@@ -30,17 +63,20 @@ const std::string BlockchainVerifier::CONTRACT_ABI = R"([
 ])";
 
 BlockchainVerifier::BlockchainVerifier(Logger& logger)
-    : logger_(logger), initialized_(false), connected_(false), curl_handle_(nullptr)
+    : logger_(logger), initialized_(false), connected_(false), curl_handle_(nullptr),
+      submission_queue_([this](std::vector<QueuedHash> batch) { submit_queued_batch(std::move(batch)); })
 {
+    submission_queue_.set_limits(std::min(blockchain_config_.batch_size, kMaxBatchHashes),
+                                 blockchain_config_.batch_interval);
     curl_handle_ = curl_easy_init();
     if (!curl_handle_) {
         logger_.error("Failed to initialize CURL for blockchain operations");
     }
-    logger_.debug("BlockchainVerifier created with real Ganache support");
+    H5X_LOG_DEBUG(logger_, "BlockchainVerifier created with real Ganache support");
 }
 
 bool BlockchainVerifier::initialize(const ObfuscationConfig& config) {
-    logger_.info("Initializing BlockchainVerifier with Ganache integration...");
+    H5X_LOG_INFO(logger_, "Initializing BlockchainVerifier with Ganache integration...");
 
     try {
         if (!curl_handle_) {
@@ -56,16 +92,16 @@ bool BlockchainVerifier::initialize(const ObfuscationConfig& config) {
         // Check Ganache connection
         if (check_ganache_connection()) {
             connected_ = true;
-            logger_.info("Successfully connected to Ganache at " + blockchain_config_.rpc_endpoint);
+            H5X_LOG_INFO(logger_, "Successfully connected to Ganache at " + blockchain_config_.rpc_endpoint);
         } else {
             logger_.error("Failed to connect to Ganache - ensure it's running on " + blockchain_config_.rpc_endpoint);
             return false;
         }
 
         initialized_ = true;
-        logger_.info("BlockchainVerifier initialized successfully");
-        logger_.info("Network: " + blockchain_config_.network + " (Chain ID: " + std::to_string(blockchain_config_.chain_id) + ")");
-        logger_.info("Contract: " + blockchain_config_.contract_address);
+        H5X_LOG_INFO(logger_, "BlockchainVerifier initialized successfully");
+        H5X_LOG_INFO(logger_, "Network: " + blockchain_config_.network + " (Chain ID: " + std::to_string(blockchain_config_.chain_id) + ")");
+        H5X_LOG_INFO(logger_, "Contract: " + blockchain_config_.contract_address);
 
         return true;
 
@@ -77,27 +113,27 @@ bool BlockchainVerifier::initialize(const ObfuscationConfig& config) {
 
 void BlockchainVerifier::update_configuration(const ObfuscationConfig& config) {
     load_blockchain_configuration(config);
-    logger_.info("BlockchainVerifier configuration updated");
+    H5X_LOG_INFO(logger_, "BlockchainVerifier configuration updated");
 }
 
 VerificationResult BlockchainVerifier::verify_binary(const std::string& binary_path) {
-    logger_.info("=== BlockchainVerifier::verify_binary called ===");
-    logger_.info("Binary path: " + binary_path);
+    H5X_LOG_INFO(logger_, "=== BlockchainVerifier::verify_binary called ===");
+    H5X_LOG_INFO(logger_, "Binary path: " + binary_path);
     
     VerificationResult result;
     result.network = blockchain_config_.network;
-    logger_.info("Network: " + result.network);
+    H5X_LOG_INFO(logger_, "Network: " + result.network);
 
     if (!initialized_) {
         logger_.error("BlockchainVerifier not initialized");
         result.error_message = "BlockchainVerifier not initialized";
         return result;
     }
-    logger_.info("BlockchainVerifier is initialized");
+    H5X_LOG_INFO(logger_, "BlockchainVerifier is initialized");
 
-    logger_.info("Connection status: " + std::string(connected_ ? "CONNECTED" : "DISCONNECTED"));
+    H5X_LOG_INFO(logger_, "Connection status: " + std::string(connected_ ? "CONNECTED" : "DISCONNECTED"));
 
-    logger_.info("Verifying binary: " + binary_path);
+    H5X_LOG_INFO(logger_, "Verifying binary: " + binary_path);
 
     try {
         // Calculate binary hash
@@ -107,38 +143,41 @@ VerificationResult BlockchainVerifier::verify_binary(const std::string& binary_p
             return result;
         }
 
-        logger_.info("Binary hash: " + result.hash);
+        H5X_LOG_INFO(logger_, "Binary hash: " + result.hash);
 
         // Check if verification already exists
-        auto existing = verification_cache_.find(result.hash);
-        if (existing != verification_cache_.end()) {
-            logger_.info("Found existing verification for hash");
-            return existing->second;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            auto existing = verification_cache_.find(result.hash);
+            if (existing != verification_cache_.end()) {
+                H5X_LOG_INFO(logger_, "Found existing verification for hash");
+                return existing->second;
+            }
         }
 
         // Format metadata
         std::string metadata = format_metadata(binary_path);
 
         // Submit to blockchain (or simulate if offline)
-        logger_.info("About to submit to blockchain - connected: " + std::string(connected_ ? "true" : "false"));
+        H5X_LOG_INFO(logger_, "About to submit to blockchain - connected: " + std::string(connected_ ? "true" : "false"));
         
         if (connected_) {
-            logger_.info("Attempting blockchain submission...");
+            H5X_LOG_INFO(logger_, "Attempting blockchain submission...");
             if (submit_to_blockchain(result.hash, metadata)) {
                 result.transaction_id = generate_transaction_id();
                 result.verified = true;
-                logger_.info("Verification submitted to blockchain: " + result.transaction_id);
+                H5X_LOG_INFO(logger_, "Verification submitted to blockchain: " + result.transaction_id);
             } else {
                 logger_.error("Blockchain submission failed");
                 result.error_message = "Failed to submit verification to blockchain";
                 return result;
             }
         } else {
-            logger_.info("Creating offline verification...");
+            H5X_LOG_INFO(logger_, "Creating offline verification...");
             // Offline simulation
             result.transaction_id = "offline_" + generate_transaction_id();
             result.verified = true;
-            logger_.info("Offline verification created: " + result.transaction_id);
+            H5X_LOG_INFO(logger_, "Offline verification created: " + result.transaction_id);
         }
 
         // Store verification data
@@ -148,12 +187,15 @@ VerificationResult BlockchainVerifier::verify_binary(const std::string& binary_p
             ).count()
         );
 
-        result.block_number = 12345678 + verification_cache_.size(); // Simulated block number
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            result.block_number = 12345678 + verification_cache_.size(); // Simulated block number
 
-        // Cache the result
-        verification_cache_[result.hash] = result;
+            // Cache the result
+            verification_cache_[result.hash] = result;
+        }
 
-        logger_.info("Binary verification completed successfully");
+        H5X_LOG_INFO(logger_, "Binary verification completed successfully");
 
     } catch (const std::exception& e) {
         result.error_message = "Verification failed: " + std::string(e.what());
@@ -165,13 +207,19 @@ VerificationResult BlockchainVerifier::verify_binary(const std::string& binary_p
 
 std::string BlockchainVerifier::calculate_binary_hash(const std::string& binary_path) {
     try {
-        auto binary_data = read_binary_file(binary_path);
-        if (binary_data.empty()) {
+        // An empty binary is an error, as it was when the file was read whole
+        std::error_code ec;
+        if (std::filesystem::file_size(binary_path, ec) == 0 && !ec) {
             logger_.error("Failed to read binary file: " + binary_path);
             return "";
         }
 
-        return sha256_hash(binary_data);
+        // Streams the file; memory use does not grow with the binary size
+        std::string hash = HashUtils::sha256_file(binary_path);
+        if (hash.empty()) {
+            logger_.error("Failed to read binary file: " + binary_path);
+        }
+        return hash;
 
     } catch (const std::exception& e) {
         logger_.error("Hash calculation failed: " + std::string(e.what()));
@@ -179,6 +227,171 @@ std::string BlockchainVerifier::calculate_binary_hash(const std::string& binary_
     }
 }
 
+std::string BlockchainVerifier::queue_binary(const std::string& binary_path) {
+    if (!initialized_) {
+        logger_.error("BlockchainVerifier not initialized");
+        return "";
+    }
+
+    std::string hash = calculate_binary_hash(binary_path);
+    if (hash.empty()) {
+        return "";
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (verification_cache_.count(hash)) {
+            return hash;
+        }
+    }
+
+    // Full or overdue batches are submitted by the queue's flusher thread
+    submission_queue_.push(hash, binary_path);
+    return hash;
+}
+
+std::vector<VerificationResult> BlockchainVerifier::flush_submission_queue() {
+    std::vector<QueuedHash> due = submission_queue_.take_all();
+    if (due.empty()) {
+        return {};
+    }
+    return submit_batch(due);
+}
+
+size_t BlockchainVerifier::pending_submissions() const {
+    return submission_queue_.size();
+}
+
+std::vector<VerificationResult> BlockchainVerifier::take_failed_submissions() {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    std::vector<VerificationResult> failed;
+    failed.swap(failed_submissions_);
+    return failed;
+}
+
+void BlockchainVerifier::submit_queued_batch(std::vector<QueuedHash> batch) {
+    std::vector<VerificationResult> results = submit_batch(batch);
+
+    // Results are in batch order
+    std::vector<QueuedHash> retry;
+    std::vector<VerificationResult> failed;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (results[i].verified) {
+            continue;
+        }
+        if (++batch[i].attempts < kMaxSubmitAttempts) {
+            retry.push_back(std::move(batch[i]));
+        } else {
+            logger_.error("Giving up on hash " + results[i].hash + " after " +
+                          std::to_string(kMaxSubmitAttempts) + " attempts: " + results[i].error_message);
+            failed.push_back(results[i]);
+        }
+    }
+
+    if (!failed.empty()) {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        failed_submissions_.insert(failed_submissions_.end(), failed.begin(), failed.end());
+    }
+    if (!retry.empty()) {
+        logger_.warning("Queueing " + std::to_string(retry.size()) + " failed hashes for another attempt");
+        submission_queue_.requeue(std::move(retry));
+    }
+}
+
+std::vector<VerificationResult> BlockchainVerifier::submit_batch(const std::vector<QueuedHash>& batch) {
+    size_t limit = std::max<size_t>(1, std::min(blockchain_config_.batch_size, kMaxBatchHashes));
+    H5X_LOG_INFO(logger_, "Submitting " + std::to_string(batch.size()) + " queued hashes in batches of " +
+                          std::to_string(limit));
+
+    // Send every transaction first, then wait for all of them together
+    std::vector<std::string> batch_tx(batch.size());
+    std::vector<std::string> transactions;
+    if (connected_) {
+        for (size_t start = 0; start < batch.size(); start += limit) {
+            size_t end = std::min(batch.size(), start + limit);
+            std::vector<std::string> hashes;
+            for (size_t i = start; i < end; ++i) {
+                hashes.push_back(batch[i].hash);
+            }
+
+            std::string tx_hash = send_batch_transaction(hashes);
+            if (tx_hash.empty()) {
+                logger_.error("Failed to send batch of " + std::to_string(hashes.size()) + " hashes");
+                continue;
+            }
+            transactions.push_back(tx_hash);
+            std::fill(batch_tx.begin() + start, batch_tx.begin() + end, tx_hash);
+        }
+    }
+    auto receipts = wait_for_confirmations(transactions);
+
+    std::string timestamp = std::to_string(
+        std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+        ).count()
+    );
+
+    std::vector<VerificationResult> results;
+    results.reserve(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        VerificationResult result;
+        result.hash = batch[i].hash;
+        result.network = blockchain_config_.network;
+        result.timestamp = timestamp;
+
+        if (!connected_) {
+            result.transaction_id = "offline_" + generate_transaction_id();
+            result.verified = true;
+        } else if (batch_tx[i].empty()) {
+            result.error_message = "Failed to submit verification to blockchain";
+        } else {
+            const TransactionReceipt& receipt = receipts[batch_tx[i]];
+            result.transaction_id = batch_tx[i];
+            if (receipt.confirmed) {
+                size_t batch_hashes = std::count(batch_tx.begin(), batch_tx.end(), batch_tx[i]);
+                result.verified = true;
+                result.block_number = receipt.block_number;
+                result.gas_used = receipt.gas_used / batch_hashes;
+            } else {
+                result.error_message = "Batch transaction failed or timed out";
+            }
+        }
+        results.push_back(result);
+    }
+
+    size_t verified = 0;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        for (const auto& result : results) {
+            if (result.verified) {
+                verification_cache_[result.hash] = result;
+                verified++;
+            }
+        }
+    }
+
+    H5X_LOG_INFO(logger_, "Batch submission finished: " + std::to_string(verified) + "/" +
+                          std::to_string(results.size()) + " hashes recorded in " +
+                          std::to_string(transactions.size()) + " transactions");
+    return results;
+}
+
+std::string BlockchainVerifier::encode_batch_store_call(const std::vector<std::string>& hashes) {
+    // Dynamic array argument: offset of the array, its length, then the elements
+    std::string data = std::string("0x") + kBatchStoreHashesSelector + abi_word(32) + abi_word(hashes.size());
+    for (const auto& hash : hashes) {
+        std::string digest = hash.compare(0, 2, "0x") == 0 ? hash.substr(2) : hash;
+        if (digest.size() != 64 ||
+            digest.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+            return "";
+        }
+        std::transform(digest.begin(), digest.end(), digest.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        data += digest;
+    }
+    return data;
+}
+
 bool BlockchainVerifier::store_verification_data(
     const std::string& binary_path,
     const std::string& metadata
@@ -199,8 +412,11 @@ bool BlockchainVerifier::store_verification_data(
             ).count()
         );
 
-        verification_cache_[hash] = result;
-        logger_.info("Verification data stored for hash: " + hash);
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            verification_cache_[hash] = result;
+        }
+        H5X_LOG_INFO(logger_, "Verification data stored for hash: " + hash);
 
         return true;
 
@@ -211,14 +427,16 @@ bool BlockchainVerifier::store_verification_data(
 }
 
 bool BlockchainVerifier::connect_to_network() {
-    logger_.info("Connecting to blockchain network: " + blockchain_config_.network);
+    H5X_LOG_INFO(logger_, "Connecting to blockchain network: " + blockchain_config_.network);
 
     try {
         connection_endpoint_ = blockchain_config_.rpc_endpoint;
         current_network_ = blockchain_config_.network;
+        submission_queue_.set_limits(std::min(blockchain_config_.batch_size, kMaxBatchHashes),
+                                     blockchain_config_.batch_interval);
 
         // Real connection test to Ganache
-        logger_.info("Testing connection to RPC endpoint: " + connection_endpoint_);
+        H5X_LOG_INFO(logger_, "Testing connection to RPC endpoint: " + connection_endpoint_);
         
         // Test connection with eth_blockNumber RPC call
         CURL* curl = curl_easy_init();
@@ -248,9 +466,9 @@ bool BlockchainVerifier::connect_to_network() {
             curl_easy_cleanup(curl);
             
             if (res == CURLE_OK && response_code == 200 && !response.empty()) {
-                logger_.info("Successfully connected to " + blockchain_config_.network);
-                logger_.info("RPC endpoint: " + connection_endpoint_);
-                logger_.info("Connection test response: " + response);
+                H5X_LOG_INFO(logger_, "Successfully connected to " + blockchain_config_.network);
+                H5X_LOG_INFO(logger_, "RPC endpoint: " + connection_endpoint_);
+                H5X_LOG_INFO(logger_, "Connection test response: " + response);
                 connected_ = true;
             } else {
                 logger_.warning("Failed to connect to blockchain network - curl code: " + std::to_string(res) + ", HTTP code: " + std::to_string(response_code));
@@ -276,9 +494,9 @@ bool BlockchainVerifier::submit_to_blockchain(const std::string& hash, const std
         return false;
     }
 
-    logger_.info("Submitting verification to Ganache blockchain...");
-    logger_.info("Hash: " + hash);
-    logger_.info("Contract: " + blockchain_config_.contract_address);
+    H5X_LOG_INFO(logger_, "Submitting verification to Ganache blockchain...");
+    H5X_LOG_INFO(logger_, "Hash: " + hash);
+    H5X_LOG_INFO(logger_, "Contract: " + blockchain_config_.contract_address);
 
     try {
         // Create and submit real transaction to Ganache
@@ -289,11 +507,11 @@ bool BlockchainVerifier::submit_to_blockchain(const std::string& hash, const std
             return false;
         }
 
-        logger_.info("Transaction submitted: " + tx_hash);
+        H5X_LOG_INFO(logger_, "Transaction submitted: " + tx_hash);
         
         // Wait for confirmation
         if (wait_for_confirmation(tx_hash)) {
-            logger_.info("Verification successfully recorded on blockchain");
+            H5X_LOG_INFO(logger_, "Verification successfully recorded on blockchain");
             return true;
         } else {
             logger_.error("Transaction failed or timed out");
@@ -312,12 +530,15 @@ std::vector<VerificationResult> BlockchainVerifier::query_verification_history(
     std::vector<VerificationResult> history;
 
     try {
-        auto it = verification_cache_.find(binary_hash);
-        if (it != verification_cache_.end()) {
-            history.push_back(it->second);
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            auto it = verification_cache_.find(binary_hash);
+            if (it != verification_cache_.end()) {
+                history.push_back(it->second);
+            }
         }
 
-        logger_.info("Found " + std::to_string(history.size()) + " verification records for hash");
+        H5X_LOG_INFO(logger_, "Found " + std::to_string(history.size()) + " verification records for hash");
 
     } catch (const std::exception& e) {
         logger_.error("Query verification history failed: " + std::string(e.what()));
@@ -334,9 +555,9 @@ bool BlockchainVerifier::validate_integrity(
         std::string actual_hash = calculate_binary_hash(binary_path);
         bool valid = (actual_hash == expected_hash);
 
-        logger_.info(std::string("Integrity validation: ") + (valid ? "PASSED" : "FAILED"));
-        logger_.info("Expected: " + expected_hash);
-        logger_.info("Actual: " + actual_hash);
+        H5X_LOG_INFO(logger_, std::string("Integrity validation: ") + (valid ? "PASSED" : "FAILED"));
+        H5X_LOG_INFO(logger_, "Expected: " + expected_hash);
+        H5X_LOG_INFO(logger_, "Actual: " + actual_hash);
 
         return valid;
 
@@ -347,6 +568,12 @@ bool BlockchainVerifier::validate_integrity(
 }
 
 std::string BlockchainVerifier::get_network_status() {
+    size_t cached = 0;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        cached = verification_cache_.size();
+    }
+
     std::ostringstream status;
 
     status << "Blockchain Network Status:\n";
@@ -354,7 +581,7 @@ std::string BlockchainVerifier::get_network_status() {
     status << "  Connected: " << (connected_ ? "Yes" : "No") << "\n";
     status << "  RPC Endpoint: " << connection_endpoint_ << "\n";
     status << "  Contract Address: " << blockchain_config_.contract_address << "\n";
-    status << "  Cached Verifications: " << verification_cache_.size() << "\n";
+    status << "  Cached Verifications: " << cached << "\n";
 
     return status.str();
 }
@@ -375,10 +602,12 @@ bool BlockchainVerifier::load_blockchain_configuration(const ObfuscationConfig&
         // Set connection endpoint
         connection_endpoint_ = blockchain_config_.rpc_endpoint;
         current_network_ = blockchain_config_.network;
+        submission_queue_.set_limits(std::min(blockchain_config_.batch_size, kMaxBatchHashes),
+                                     blockchain_config_.batch_interval);
 
-        logger_.info("Ganache blockchain configuration loaded");
-        logger_.info("RPC Endpoint: " + blockchain_config_.rpc_endpoint);
-        logger_.info("Chain ID: " + std::to_string(blockchain_config_.chain_id));
+        H5X_LOG_INFO(logger_, "Ganache blockchain configuration loaded");
+        H5X_LOG_INFO(logger_, "RPC Endpoint: " + blockchain_config_.rpc_endpoint);
+        H5X_LOG_INFO(logger_, "Chain ID: " + std::to_string(blockchain_config_.chain_id));
         return true;
 
     } catch (const std::exception& e) {
@@ -417,41 +646,6 @@ std::string BlockchainVerifier::format_metadata(const std::string& binary_path)
     return metadata.str();
 }
 
-std::string BlockchainVerifier::sha256_hash(const std::vector<uint8_t>& data) {
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hash_len;
-    
-    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-    EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
-    EVP_DigestUpdate(ctx, data.data(), data.size());
-    EVP_DigestFinal_ex(ctx, hash, &hash_len);
-    EVP_MD_CTX_free(ctx);
-
-    std::ostringstream ss;
-    for (unsigned int i = 0; i < hash_len; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
-    }
-
-    return ss.str();
-}
-
-std::vector<uint8_t> BlockchainVerifier::read_binary_file(const std::string& filepath) {
-    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
-        throw std::runtime_error("Cannot open file: " + filepath);
-    }
-
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    std::vector<uint8_t> buffer(size);
-    if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-        throw std::runtime_error("Failed to read file: " + filepath);
-    }
-
-    return buffer;
-}
-
 bool BlockchainVerifier::check_ganache_connection() {
     Json::Value payload;
     payload["jsonrpc"] = "2.0";
@@ -479,7 +673,7 @@ bool BlockchainVerifier::check_ganache_connection() {
             // Convert hex chain ID to decimal
             int actual_chain_id = std::stoi(chain_id, nullptr, 16);
             if (actual_chain_id == blockchain_config_.chain_id) {
-                logger_.info("Ganache chain ID verified: " + std::to_string(actual_chain_id));
+                H5X_LOG_INFO(logger_, "Ganache chain ID verified: " + std::to_string(actual_chain_id));
                 return true;
             } else {
                 logger_.warning("Chain ID mismatch. Expected: " + std::to_string(blockchain_config_.chain_id) + 
@@ -513,52 +707,88 @@ std::string h5x::BlockchainVerifier::keccak256_hash(const std::string& input) {
 }
 
 bool h5x::BlockchainVerifier::wait_for_confirmation(const std::string& transaction_id) {
-    logger_.info("Waiting for transaction confirmation: " + transaction_id);
+    H5X_LOG_INFO(logger_, "Waiting for transaction confirmation: " + transaction_id);
+    return wait_for_confirmations({transaction_id})[transaction_id].confirmed;
+}
 
-    // Poll Ganache for transaction receipt
-    for (int i = 0; i < 30; ++i) { // 30 second timeout
-        Json::Value payload;
-        payload["jsonrpc"] = "2.0";
-        payload["method"] = "eth_getTransactionReceipt";
-        payload["params"].append(transaction_id);
-        payload["id"] = 1;
+std::unordered_map<std::string, BlockchainVerifier::TransactionReceipt>
+BlockchainVerifier::wait_for_confirmations(const std::vector<std::string>& transaction_ids) {
+    std::unordered_map<std::string, TransactionReceipt> receipts;
+    std::vector<std::string> pending = transaction_ids;
+
+    // One JSON-RPC batch request per poll covers every pending transaction
+    for (int i = 0; i < 30 && !pending.empty(); ++i) { // 30 second timeout
+        Json::Value payload(Json::arrayValue);
+        for (size_t j = 0; j < pending.size(); ++j) {
+            Json::Value request;
+            request["jsonrpc"] = "2.0";
+            request["method"] = "eth_getTransactionReceipt";
+            request["params"].append(pending[j]);
+            request["id"] = static_cast<Json::UInt64>(j);
+            payload.append(request);
+        }
 
         auto response = make_rpc_call(payload);
-        
+        std::vector<bool> settled(pending.size(), false);
+
         if (response.response_code == 200) {
             try {
                 Json::Value json_response;
                 Json::Reader reader;
-                if (reader.parse(response.data, json_response) && json_response.isMember("result")) {
-                    const auto& result = json_response["result"];
-                    if (!result.isNull() && result.isMember("status")) {
+                if (reader.parse(response.data, json_response) && json_response.isArray()) {
+                    for (const auto& reply : json_response) {
+                        size_t index = reply["id"].asUInt64();
+                        const auto& result = reply["result"];
+                        if (index >= pending.size() || result.isNull() || !result.isMember("status")) {
+                            continue;
+                        }
+
                         std::string status = result["status"].asString();
+                        TransactionReceipt& receipt = receipts[pending[index]];
+                        settled[index] = true;
                         if (status == "0x1") {
-                            logger_.info("Transaction confirmed successfully");
-                            return true;
-                        } else if (status == "0x0") {
-                            logger_.error("Transaction failed on blockchain");
-                            return false;
+                            receipt.confirmed = true;
+                            receipt.block_number = parse_hex_quantity(result["blockNumber"]);
+                            receipt.gas_used = static_cast<double>(parse_hex_quantity(result["gasUsed"]));
+                            H5X_LOG_INFO(logger_, "Transaction confirmed successfully: " + pending[index]);
+                        } else {
+                            logger_.error("Transaction failed on blockchain: " + pending[index]);
                         }
                     }
                 }
             } catch (const std::exception& e) {
-                logger_.debug("Error parsing receipt: " + std::string(e.what()));
+                H5X_LOG_DEBUG(logger_, "Error parsing receipt: " + std::string(e.what()));
             }
         }
-        
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        logger_.debug("Waiting for confirmation... (" + std::to_string(i + 1) + "/30)");
+
+        std::vector<std::string> still_pending;
+        for (size_t j = 0; j < pending.size(); ++j) {
+            if (!settled[j]) {
+                still_pending.push_back(pending[j]);
+            }
+        }
+        pending.swap(still_pending);
+
+        if (!pending.empty()) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            H5X_LOG_DEBUG(logger_, "Waiting for " + std::to_string(pending.size()) + " confirmations... (" +
+                                   std::to_string(i + 1) + "/30)");
+        }
     }
 
-    logger_.warning("Transaction confirmation timeout");
-    return false;
+    for (const auto& transaction_id : pending) {
+        logger_.warning("Transaction confirmation timeout: " + transaction_id);
+        receipts.emplace(transaction_id, TransactionReceipt{});
+    }
+    return receipts;
 }
 
 h5x::BlockchainVerifier::CurlResponse h5x::BlockchainVerifier::make_rpc_call(const Json::Value& payload) {
     CurlResponse response;
     response.response_code = 0;
 
+    // The flusher thread and callers share the handle
+    std::lock_guard<std::mutex> rpc_lock(rpc_mutex_);
     if (!curl_handle_) {
         return response;
     }
@@ -600,7 +830,7 @@ size_t h5x::BlockchainVerifier::WriteCallback(void* contents, size_t size, size_
 }
 
 std::string BlockchainVerifier::create_transaction(const std::string& hash) {
-    logger_.info("Creating blockchain transaction for hash: " + hash);
+    H5X_LOG_INFO(logger_, "Creating blockchain transaction for hash: " + hash);
     
     // For Ganache, we'll send a simple transaction with the hash as data
     Json::Value payload;
@@ -609,7 +839,7 @@ std::string BlockchainVerifier::create_transaction(const std::string& hash) {
     
     Json::Value tx_params;
     // Use the first account from your Ganache GUI
-    tx_params["from"] = "0x7270fa312791Ac238909E54Fa100cbB7DA3452E8";
+    tx_params["from"] = blockchain_config_.sender_address;
     tx_params["to"] = "0xd36f7d33344e28b8c84ce3542963f2404a0cf391"; // Second account from your Ganache GUI
     tx_params["value"] = "0x1"; // Send 1 wei
     tx_params["gas"] = "0x15F90"; // 90000 gas (for transaction with data)
@@ -622,12 +852,12 @@ std::string BlockchainVerifier::create_transaction(const std::string& hash) {
     payload["params"].append(tx_params);
     payload["id"] = 1;
 
-    logger_.info("Sending transaction with data: " + data);
+    H5X_LOG_INFO(logger_, "Sending transaction with data: " + data);
     
     auto response = make_rpc_call(payload);
     
-    logger_.info("Transaction response code: " + std::to_string(response.response_code));
-    logger_.info("Transaction response data: " + response.data);
+    H5X_LOG_INFO(logger_, "Transaction response code: " + std::to_string(response.response_code));
+    H5X_LOG_INFO(logger_, "Transaction response data: " + response.data);
     
     if (response.response_code == 200) {
         try {
@@ -636,7 +866,7 @@ std::string BlockchainVerifier::create_transaction(const std::string& hash) {
             if (reader.parse(response.data, json_response)) {
                 if (json_response.isMember("result")) {
                     std::string tx_hash = json_response["result"].asString();
-                    logger_.info("Transaction created successfully: " + tx_hash);
+                    H5X_LOG_INFO(logger_, "Transaction created successfully: " + tx_hash);
                     return tx_hash;
                 } else if (json_response.isMember("error")) {
                     logger_.error("Transaction error: " + json_response["error"]["message"].asString());
@@ -650,6 +880,51 @@ std::string BlockchainVerifier::create_transaction(const std::string& hash) {
     return "";
 }
 
+std::string BlockchainVerifier::send_batch_transaction(const std::vector<std::string>& hashes) {
+    std::string data = encode_batch_store_call(hashes);
+    if (data.empty()) {
+        logger_.error("Cannot encode batch: hashes must be 32-byte hex digests");
+        return "";
+    }
+
+    Json::Value tx_params;
+    tx_params["from"] = blockchain_config_.sender_address;
+    tx_params["to"] = blockchain_config_.contract_address;
+    tx_params["gas"] = hex_quantity(blockchain_config_.batch_base_gas +
+                                    blockchain_config_.batch_gas_per_hash * hashes.size());
+    tx_params["data"] = data;
+
+    try {
+        tx_params["gasPrice"] = hex_quantity(std::stoull(blockchain_config_.gas_price));
+
+        Json::Value payload;
+        payload["jsonrpc"] = "2.0";
+        payload["method"] = "eth_sendTransaction";
+        payload["params"].append(tx_params);
+        payload["id"] = 1;
+
+        auto response = make_rpc_call(payload);
+        if (response.response_code == 200) {
+            Json::Value json_response;
+            Json::Reader reader;
+            if (reader.parse(response.data, json_response)) {
+                if (json_response.isMember("result")) {
+                    std::string tx_hash = json_response["result"].asString();
+                    H5X_LOG_INFO(logger_, "Batch transaction for " + std::to_string(hashes.size()) +
+                                          " hashes sent: " + tx_hash);
+                    return tx_hash;
+                } else if (json_response.isMember("error")) {
+                    logger_.error("Batch transaction error: " + json_response["error"]["message"].asString());
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        logger_.error("Batch transaction failed: " + std::string(e.what()));
+    }
+
+    return "";
+}
+
 std::string BlockchainVerifier::encode_function_call(const std::string& function_sig, const std::string& hash) {
     // Simple function encoding for storeHash(bytes32)
     // Function selector for storeHash(bytes32) would be first 4 bytes of keccak256("storeHash(bytes32)")
@@ -3,10 +3,13 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <curl/curl.h>
 #include <json/json.h>
+#include "SubmissionQueue.hpp"
 #include "../utils/Logger.hpp"
 
 namespace h5x {
@@ -33,6 +36,14 @@ struct BlockchainConfig {
     std::string gas_price{"20000000000"};  // 20 gwei in wei
     int chain_id{1337};
     int confirmation_blocks{1};
+    std::string sender_address{"0x7270fa312791Ac238909E54Fa100cbB7DA3452E8"};
+
+    // Submission queue: one batchStoreHashes transaction per batch_size
+    // hashes, or sooner once the oldest queued hash has waited batch_interval
+    size_t batch_size{50};                              // Contract accepts at most 50
+    std::chrono::milliseconds batch_interval{5000};
+    uint64_t batch_base_gas{60000};
+    uint64_t batch_gas_per_hash{80000};
 };
 
 class BlockchainVerifier {
@@ -49,6 +60,25 @@ public:
     std::string calculate_binary_hash(const std::string& binary_path);
     bool submit_to_blockchain(const std::string& hash, const std::string& metadata);
 
+    // Batched submission. queue_binary hashes the file and queues it; it
+    // returns the hash (empty on failure). A background flusher submits the
+    // queue once it is full or its oldest entry is due, so queueing never
+    // waits for the network. flush_submission_queue sends everything still
+    // queued and returns the results of this flush. Results of every flush
+    // are also available through query_verification_history. Both may be
+    // called from several threads. Hashes the flusher fails to submit are
+    // queued again; after kMaxSubmitAttempts failures they are given up and
+    // returned by take_failed_submissions.
+    std::string queue_binary(const std::string& binary_path);
+    std::vector<VerificationResult> flush_submission_queue();
+    size_t pending_submissions() const;
+    std::vector<VerificationResult> take_failed_submissions();
+
+    static const unsigned kMaxSubmitAttempts = 3;
+
+    // ABI call data for batchStoreHashes(bytes32[]) with hex SHA-256 digests
+    static std::string encode_batch_store_call(const std::vector<std::string>& hashes);
+
     std::vector<VerificationResult> query_verification_history(const std::string& binary_hash);
     bool validate_integrity(const std::string& binary_path, const std::string& expected_hash);
 
@@ -91,13 +121,33 @@ private:
     std::string encode_function_call(const std::string& function_sig, const std::string& hash);
 
     // Cryptographic functions
-    std::string sha256_hash(const std::vector<uint8_t>& data);
     std::string keccak256_hash(const std::string& input);
-    std::vector<uint8_t> read_binary_file(const std::string& filepath);
     std::string generate_transaction_id();
 
+    // Batched submission
+    struct TransactionReceipt {
+        bool confirmed{false};
+        uint64_t block_number{0};
+        double gas_used{0.0};
+    };
+    std::vector<VerificationResult> submit_batch(const std::vector<QueuedHash>& batch);
+    void submit_queued_batch(std::vector<QueuedHash> batch);
+    std::string send_batch_transaction(const std::vector<std::string>& hashes);
+    std::unordered_map<std::string, TransactionReceipt> wait_for_confirmations(
+        const std::vector<std::string>& transaction_ids);
+
+    // queue_mutex_ guards the verification cache and the failed submissions;
+    // rpc_mutex_ serialises every request on curl_handle_, which the flusher
+    // thread and callers share
+    std::mutex queue_mutex_;
+    std::mutex rpc_mutex_;
+
     // Local verification cache
     std::unordered_map<std::string, VerificationResult> verification_cache_;
+    std::vector<VerificationResult> failed_submissions_;
+
+    // Declared last: its flusher calls submit_queued_batch, so it stops first
+    SubmissionQueue submission_queue_;
 };
 
 } // namespace h5x
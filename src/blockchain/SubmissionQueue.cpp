@@ -0,0 +1,122 @@
+#include "SubmissionQueue.hpp"
+#include <algorithm>
+
+namespace h5x {
+
+SubmissionQueue::SubmissionQueue(SubmitFn submit)
+    : submit_(std::move(submit))
+{
+}
+
+SubmissionQueue::~SubmissionQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_cv_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+}
+
+void SubmissionQueue::set_limits(size_t batch_size, std::chrono::milliseconds interval) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch_size_ = std::max<size_t>(1, batch_size);
+        interval_ = interval;
+    }
+    wake_cv_.notify_all();
+}
+
+bool SubmissionQueue::push(const std::string& hash, const std::string& binary_path) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool queued = std::any_of(queue_.begin(), queue_.end(),
+                                  [&](const QueuedHash& entry) { return entry.hash == hash; });
+        if (queued) {
+            return false;
+        }
+
+        queue_.push_back({hash, binary_path, std::chrono::steady_clock::now()});
+        if (!flusher_.joinable()) {
+            flusher_ = std::thread(&SubmissionQueue::flusher_loop, this);
+        }
+        // The flusher only needs to re-arm its timer for the first entry
+        wake = queue_.size() == 1 || queue_.size() >= batch_size_;
+    }
+    if (wake) {
+        wake_cv_.notify_all();
+    }
+    return true;
+}
+
+void SubmissionQueue::requeue(std::vector<QueuedHash> entries) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        for (auto& entry : entries) {
+            bool queued = std::any_of(queue_.begin(), queue_.end(),
+                                      [&](const QueuedHash& other) { return other.hash == entry.hash; });
+            if (queued) {
+                continue;
+            }
+            entry.queued_at = now;
+            queue_.push_back(std::move(entry));
+        }
+        if (queue_.empty()) {
+            return;
+        }
+        if (!flusher_.joinable()) {
+            flusher_ = std::thread(&SubmissionQueue::flusher_loop, this);
+        }
+    }
+    wake_cv_.notify_all();
+}
+
+std::vector<QueuedHash> SubmissionQueue::take_all() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this] { return !submitting_; });
+
+    std::vector<QueuedHash> batch;
+    batch.swap(queue_);
+    return batch;
+}
+
+size_t SubmissionQueue::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+void SubmissionQueue::flusher_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (queue_.empty()) {
+            wake_cv_.wait(lock);
+            continue;
+        }
+
+        auto due = queue_.front().queued_at + interval_;
+        if (queue_.size() < batch_size_ && std::chrono::steady_clock::now() < due) {
+            wake_cv_.wait_until(lock, due);
+            continue;
+        }
+
+        std::vector<QueuedHash> batch;
+        batch.swap(queue_);
+        submitting_ = true;
+        lock.unlock();
+
+        try {
+            submit_(std::move(batch));
+        } catch (...) {
+            // The callback reports its own failures; keep flushing later batches
+        }
+
+        lock.lock();
+        submitting_ = false;
+        idle_cv_.notify_all();
+    }
+}
+
+} // namespace h5x
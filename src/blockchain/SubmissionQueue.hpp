@@ -0,0 +1,70 @@
+#ifndef H5X_SUBMISSION_QUEUE_HPP
+#define H5X_SUBMISSION_QUEUE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace h5x {
+
+struct QueuedHash {
+    std::string hash;
+    std::string binary_path;
+    std::chrono::steady_clock::time_point queued_at;
+    unsigned attempts{0};   // Failed submissions so far
+};
+
+// Hashes waiting for a batch transaction. A background flusher hands the
+// queue to the submit callback once it holds batch_size entries or its
+// oldest entry has waited interval, so push() never blocks on the network.
+// The flusher starts with the first push; entries still queued when the
+// queue is destroyed are dropped, so callers flush explicitly with take_all.
+class SubmissionQueue {
+public:
+    using SubmitFn = std::function<void(std::vector<QueuedHash> batch)>;
+
+    explicit SubmissionQueue(SubmitFn submit);
+    ~SubmissionQueue();
+
+    SubmissionQueue(const SubmissionQueue&) = delete;
+    SubmissionQueue& operator=(const SubmissionQueue&) = delete;
+
+    void set_limits(size_t batch_size, std::chrono::milliseconds interval);
+
+    // False if the hash is already queued
+    bool push(const std::string& hash, const std::string& binary_path);
+
+    // Queues entries whose submission failed, keeping their attempt counts.
+    // Each waits a full interval again, unless the batch fills first. Safe
+    // to call from the submit callback.
+    void requeue(std::vector<QueuedHash> entries);
+
+    // Removes everything still queued, after waiting for a batch the
+    // flusher is submitting, so the caller's submission comes last
+    std::vector<QueuedHash> take_all();
+
+    size_t size() const;
+
+private:
+    void flusher_loop();
+
+    SubmitFn submit_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_cv_;   // Queue filled, first entry queued, limits changed or stopping
+    std::condition_variable idle_cv_;   // Flusher finished a batch
+    std::vector<QueuedHash> queue_;
+    size_t batch_size_{50};
+    std::chrono::milliseconds interval_{5000};
+    bool submitting_{false};
+    bool stopping_{false};
+    std::thread flusher_;
+};
+
+} // namespace h5x
+
+#endif // H5X_SUBMISSION_QUEUE_HPP
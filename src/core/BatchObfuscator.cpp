@@ -0,0 +1,186 @@
+#include "BatchObfuscator.hpp"
+#include "H5XObfuscationEngine.hpp"
+#include "CachedResult.hpp"
+#include "../blockchain/BlockchainVerifier.hpp"
+#include "../utils/ThreadPool.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+namespace h5x {
+
+BatchObfuscator::BatchObfuscator(Logger& logger)
+    : logger_(logger)
+{
+}
+
+size_t BatchObfuscator::plan_worker_count(const ObfuscationConfig& config, size_t job_count,
+                                          size_t engine_memory_mb) {
+    size_t workers = ThreadPool::resolve_worker_count(config.max_threads);
+
+    if (config.memory_limit_mb > 0 && engine_memory_mb > 0) {
+        size_t memory_bound = static_cast<size_t>(config.memory_limit_mb) / engine_memory_mb;
+        workers = std::min(workers, std::max<size_t>(1, memory_bound));
+    }
+
+    return std::max<size_t>(1, std::min(workers, job_count));
+}
+
+BatchSummary BatchObfuscator::run(const std::vector<BatchJob>& jobs, const BatchOptions& options,
+                                  const ProgressCallback& progress) {
+    BatchSummary summary;
+    summary.results.resize(jobs.size());
+
+    if (jobs.empty()) {
+        return summary;
+    }
+
+    summary.workers_used = plan_worker_count(options.config, jobs.size(), options.engine_memory_mb);
+    H5X_LOG_INFO(logger_, "Batch obfuscation: " + std::to_string(jobs.size()) + " files on " +
+                          std::to_string(summary.workers_used) + " workers");
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    ObfuscationConfig engine_config = options.config;
+    bool engine_verify = options.blockchain_verify;
+    std::unique_ptr<BlockchainVerifier> verifier;
+    if (options.blockchain_verify) {
+        verifier = std::make_unique<BlockchainVerifier>(logger_);
+        if (verifier->initialize(options.config)) {
+            engine_config.enable_blockchain_verification = false;
+            engine_verify = false;
+        } else {
+            logger_.warning("Batched blockchain submission unavailable; verifying files individually");
+            verifier.reset();
+        }
+    }
+
+    // One lazily created engine per worker; engines are never shared
+    std::vector<std::unique_ptr<H5XObfuscationEngine>> engines(summary.workers_used);
+    std::mutex progress_mutex;
+    size_t completed = 0;
+
+    auto acquire_engine = [&](size_t worker_id) -> H5XObfuscationEngine* {
+        auto& engine = engines[worker_id];
+        if (engine) {
+            return engine.get();
+        }
+
+        auto fresh = std::make_unique<H5XObfuscationEngine>();
+        if (!fresh->initialize(options.config_file)) {
+            return nullptr;
+        }
+        fresh->setConfig(engine_config);
+        fresh->enableAIOptimization(options.ai_optimize);
+        fresh->enableBlockchainVerification(engine_verify);
+        fresh->enableReportGeneration(options.generate_report);
+
+        engine = std::move(fresh);
+        return engine.get();
+    };
+
+    ThreadPool pool(summary.workers_used);
+    pool.parallel_for(jobs.size(), [&](size_t index, size_t worker_id) {
+        const BatchJob& job = jobs[index];
+        BatchFileResult& result = summary.results[index];
+        result.input_path = job.input_path;
+        result.output_path = job.output_path;
+        result.worker_id = worker_id;
+
+        auto file_start = std::chrono::high_resolution_clock::now();
+
+        try {
+            std::filesystem::path output_dir = std::filesystem::path(job.output_path).parent_path();
+            if (!output_dir.empty()) {
+                std::filesystem::create_directories(output_dir);
+            }
+
+            std::string cache_key;
+            if (options.cache) {
+                cache_key = ObfuscationCache::source_key(job.input_path, options.config, options.tool_version);
+                if (options.cache->lookup(cache_key, job.output_path)) {
+                    result.success = true;
+                    result.cache_hit = true;
+                }
+            }
+
+            if (!result.cache_hit) {
+                H5XObfuscationEngine* engine = acquire_engine(worker_id);
+                if (!engine) {
+                    result.error_message = "Failed to initialize H5X engine";
+                } else if (engine->obfuscateFile(job.input_path, job.output_path, options.level)) {
+                    result.success = true;
+                    if (options.cache) {
+                        options.cache->store(cache_key, job.output_path,
+                                             report_to_json_string(engine->getLastReport()));
+                    }
+                } else {
+                    result.error_message = engine->getLastError();
+                }
+            }
+
+            if (result.success && verifier) {
+                result.binary_hash = verifier->queue_binary(job.output_path);
+            }
+        } catch (const std::exception& e) {
+            result.error_message = e.what();
+            // The engine may be left half-way through a module; start clean
+            engines[worker_id].reset();
+        } catch (...) {
+            result.error_message = "Unknown error";
+            engines[worker_id].reset();
+        }
+
+        result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - file_start);
+
+        if (!result.success) {
+            logger_.error("Batch: " + job.input_path + " failed: " + result.error_message);
+        }
+
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        ++completed;
+        if (progress) {
+            progress(result, completed, jobs.size());
+        }
+    });
+
+    if (verifier) {
+        // Whatever the size/time triggers left behind goes out now
+        verifier->flush_submission_queue();
+        for (auto& result : summary.results) {
+            if (result.binary_hash.empty()) {
+                continue;
+            }
+            auto history = verifier->query_verification_history(result.binary_hash);
+            if (!history.empty() && history.back().verified) {
+                result.blockchain_verified = true;
+                result.transaction_id = history.back().transaction_id;
+                summary.blockchain_verified++;
+            }
+        }
+    }
+
+    for (const auto& result : summary.results) {
+        if (result.success) {
+            summary.successful++;
+        } else {
+            summary.failed++;
+        }
+    }
+
+    summary.wall_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    if (options.cache) {
+        summary.cache_stats = options.cache->get_stats();
+    }
+
+    H5X_LOG_INFO(logger_, "Batch obfuscation finished: " + std::to_string(summary.successful) + " succeeded, " +
+                          std::to_string(summary.failed) + " failed in " +
+                          std::to_string(summary.wall_time.count()) + "ms");
+
+    return summary;
+}
+
+} // namespace h5x
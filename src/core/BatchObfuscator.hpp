@@ -0,0 +1,88 @@
+#ifndef H5X_BATCH_OBFUSCATOR_HPP
+#define H5X_BATCH_OBFUSCATOR_HPP
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include "ObfuscationCache.hpp"
+#include "../utils/ConfigParser.hpp"
+#include "../utils/Logger.hpp"
+
+namespace h5x {
+
+struct BatchJob {
+    std::string input_path;
+    std::string output_path;
+};
+
+struct BatchFileResult {
+    std::string input_path;
+    std::string output_path;
+    bool success{false};
+    std::string error_message;
+    std::chrono::milliseconds duration{0};
+    size_t worker_id{0};
+    bool cache_hit{false};
+
+    // Set when blockchain_verify is on and the output was queued for submission
+    std::string binary_hash;
+    bool blockchain_verified{false};
+    std::string transaction_id;
+};
+
+struct BatchSummary {
+    // Results are stored in job order, independent of completion order
+    std::vector<BatchFileResult> results;
+    size_t successful{0};
+    size_t failed{0};
+    size_t workers_used{0};
+    std::chrono::milliseconds wall_time{0};
+    CacheStats cache_stats;
+    size_t blockchain_verified{0};
+};
+
+struct BatchOptions {
+    ObfuscationConfig config;
+    std::string config_file;
+    int level{3};
+    bool ai_optimize{false};
+    bool blockchain_verify{false};
+    bool generate_report{false};
+
+    // Resident memory reserved for one warm engine (LLVMContext, pass state)
+    size_t engine_memory_mb{512};
+
+    // Optional artifact cache shared by all workers
+    ObfuscationCache* cache{nullptr};
+    std::string tool_version;
+};
+
+// Runs obfuscateFile over many inputs on a work-stealing pool. Every worker
+// owns its H5XObfuscationEngine (and therefore its LLVMContext); a failing or
+// throwing file only affects its own result.
+//
+// With blockchain_verify, output hashes go to one shared BlockchainVerifier
+// queue and are recorded with batchStoreHashes rather than one transaction
+// per file; engines only verify individually if that verifier is unavailable.
+class BatchObfuscator {
+public:
+    using ProgressCallback = std::function<void(const BatchFileResult& result, size_t completed, size_t total)>;
+
+    explicit BatchObfuscator(Logger& logger);
+    ~BatchObfuscator() = default;
+
+    BatchSummary run(const std::vector<BatchJob>& jobs, const BatchOptions& options,
+                     const ProgressCallback& progress = nullptr);
+
+    // Worker count honouring max_threads and memory_limit_mb
+    static size_t plan_worker_count(const ObfuscationConfig& config, size_t job_count,
+                                    size_t engine_memory_mb);
+
+private:
+    Logger& logger_;
+};
+
+} // namespace h5x
+
+#endif // H5X_BATCH_OBFUSCATOR_HPP
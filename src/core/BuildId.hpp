@@ -0,0 +1,13 @@
+#ifndef H5X_BUILD_ID_HPP
+#define H5X_BUILD_ID_HPP
+
+namespace h5x {
+
+// Identifies this build of h5x_core: a hash of the library sources and
+// headers, generated by cmake/BuildId.cmake. Cache keys include it, so
+// artifacts produced by a different build are never reused
+const char* build_id();
+
+} // namespace h5x
+
+#endif // H5X_BUILD_ID_HPP
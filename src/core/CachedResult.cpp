@@ -0,0 +1,95 @@
+#include "CachedResult.hpp"
+#include "H5XObfuscationEngine.hpp"
+#include "../blockchain/BlockchainVerifier.hpp"
+#include <json/json.h>
+#include <fstream>
+#include <memory>
+
+namespace h5x {
+
+Json::Value report_to_json(const ObfuscationReport& report) {
+    Json::Value json;
+    json["inputFile"] = report.inputFile;
+    json["outputFile"] = report.outputFile;
+    json["originalSize"] = static_cast<Json::UInt64>(report.originalSize);
+    json["obfuscatedSize"] = static_cast<Json::UInt64>(report.obfuscatedSize);
+    json["sizeIncrease"] = report.sizeIncrease;
+    json["securityScore"] = report.securityScore;
+    json["processingTime"] = report.processingTime;
+    json["functionsProcessed"] = report.functionsProcessed;
+    json["stringsObfuscated"] = report.stringsObfuscated;
+    json["instructionsModified"] = report.instructionsModified;
+    json["passesApplied"] = Json::Value(Json::arrayValue);
+    for (const auto& pass : report.passesApplied) {
+        json["passesApplied"].append(pass);
+    }
+    json["aiOptimizationUsed"] = report.aiOptimizationUsed;
+    json["fitnessScore"] = report.fitnessScore;
+    json["generations"] = report.generations;
+    json["blockchainVerificationUsed"] = report.blockchainVerificationUsed;
+    json["transactionHash"] = report.transactionHash;
+    json["blockHash"] = report.blockHash;
+    return json;
+}
+
+std::string report_to_json_string(const ObfuscationReport& report) {
+    Json::StreamWriterBuilder builder;
+    return Json::writeString(builder, report_to_json(report));
+}
+
+ObfuscationReport cached_report(const std::string& stored, const std::string& input_path,
+                                const std::string& output_path) {
+    ObfuscationReport report;
+    Json::Value json;
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    if (!stored.empty() && reader->parse(stored.data(), stored.data() + stored.size(), &json, &errors) &&
+        json.isObject()) {
+        report.originalSize = json.get("originalSize", 0).asUInt64();
+        report.obfuscatedSize = json.get("obfuscatedSize", 0).asUInt64();
+        report.sizeIncrease = json.get("sizeIncrease", 0.0).asDouble();
+        report.securityScore = json.get("securityScore", 0.0).asDouble();
+        report.processingTime = json.get("processingTime", 0.0).asDouble();
+        report.functionsProcessed = json.get("functionsProcessed", 0).asInt();
+        report.stringsObfuscated = json.get("stringsObfuscated", 0).asInt();
+        report.instructionsModified = json.get("instructionsModified", 0).asInt();
+        for (const auto& pass : json["passesApplied"]) {
+            report.passesApplied.push_back(pass.asString());
+        }
+        report.aiOptimizationUsed = json.get("aiOptimizationUsed", false).asBool();
+        report.fitnessScore = json.get("fitnessScore", 0.0).asDouble();
+        report.generations = json.get("generations", 0).asInt();
+    }
+    report.inputFile = input_path;
+    report.outputFile = output_path;
+    return report;
+}
+
+bool verify_cached_artifact(Logger& logger, const ObfuscationConfig& config,
+                            const std::string& artifact_path, ObfuscationReport& report) {
+    BlockchainVerifier verifier(logger);
+    if (!verifier.initialize(config)) {
+        return false;
+    }
+
+    VerificationResult result = verifier.verify_binary(artifact_path);
+    if (!result.verified) {
+        logger.error("Blockchain verification of cached artifact failed: " + result.error_message);
+        return false;
+    }
+    report.blockchainVerificationUsed = true;
+    report.transactionHash = result.transaction_id;
+    return true;
+}
+
+bool write_cached_report(const ObfuscationReport& report, const std::string& output_path) {
+    std::ofstream file(output_path + ".report.json");
+    if (!file) {
+        return false;
+    }
+    file << report_to_json_string(report) << "\n";
+    return static_cast<bool>(file);
+}
+
+} // namespace h5x
@@ -0,0 +1,43 @@
+#ifndef H5X_CACHED_RESULT_HPP
+#define H5X_CACHED_RESULT_HPP
+
+#include <string>
+#include "../utils/ConfigParser.hpp"
+#include "../utils/Logger.hpp"
+
+namespace Json {
+class Value;
+}
+
+namespace h5x {
+
+struct ObfuscationReport;
+
+// What a cache hit still has to do. The cache stores the engine's report
+// next to each artifact, so a hit can return the same report; blockchain
+// verification and report files belong to the run, not the artifact, and
+// are redone on every hit.
+
+// The report as the server sends it and the cache stores it
+Json::Value report_to_json(const ObfuscationReport& report);
+std::string report_to_json_string(const ObfuscationReport& report);
+
+// Report stored with a cached artifact, retargeted at this run's input and
+// output. Blockchain fields are cleared: verification is per run. An empty
+// or unreadable report (entries stored before reports were) gives only the
+// file names
+ObfuscationReport cached_report(const std::string& stored, const std::string& input_path,
+                                const std::string& output_path);
+
+// Records a cached artifact on chain, as the engine does after obfuscating,
+// and fills in the report's blockchain fields. False if it could not be
+// recorded
+bool verify_cached_artifact(Logger& logger, const ObfuscationConfig& config,
+                            const std::string& artifact_path, ObfuscationReport& report);
+
+// Writes <output>.report.json for a cache hit
+bool write_cached_report(const ObfuscationReport& report, const std::string& output_path);
+
+} // namespace h5x
+
+#endif // H5X_CACHED_RESULT_HPP
@@ -0,0 +1,635 @@
+#include "IncrementalObfuscator.hpp"
+#include "../utils/HashUtils.hpp"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include <json/json.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+using namespace llvm;
+namespace fs = std::filesystem;
+
+namespace h5x {
+
+namespace {
+
+const char* const kManifestFile = "manifest.json";
+const char* const kModuleFile = "obfuscated.bc";
+const int kManifestVersion = 1;
+
+void collect_constant_globals(const Constant* constant, std::vector<GlobalValue*>& globals,
+                              SmallPtrSet<const Constant*, 32>& visited) {
+    if (!visited.insert(constant).second) {
+        return;
+    }
+    if (auto* gv = dyn_cast<GlobalValue>(constant)) {
+        globals.push_back(const_cast<GlobalValue*>(gv));
+        return;
+    }
+    for (const Use& op : constant->operands()) {
+        if (auto* c = dyn_cast<Constant>(op.get())) {
+            collect_constant_globals(c, globals, visited);
+        }
+    }
+}
+
+// Globals referenced by a function body, in first-use order
+std::vector<GlobalValue*> referenced_globals(const Function& function) {
+    std::vector<GlobalValue*> globals;
+    SmallPtrSet<const Constant*, 32> visited;
+
+    if (function.hasPersonalityFn()) {
+        collect_constant_globals(function.getPersonalityFn(), globals, visited);
+    }
+    for (const BasicBlock& bb : function) {
+        for (const Instruction& inst : bb) {
+            for (const Use& op : inst.operands()) {
+                if (auto* c = dyn_cast<Constant>(op.get())) {
+                    collect_constant_globals(c, globals, visited);
+                }
+            }
+        }
+    }
+    return globals;
+}
+
+std::vector<GlobalValue*> referenced_globals(const GlobalVariable& variable) {
+    std::vector<GlobalValue*> globals;
+    SmallPtrSet<const Constant*, 32> visited;
+    if (variable.hasInitializer()) {
+        collect_constant_globals(variable.getInitializer(), globals, visited);
+    }
+    return globals;
+}
+
+// h5x_* module constructors that initialise variable (startup string
+// decryption), with their priorities
+std::vector<std::pair<Function*, int>> startup_helpers(const GlobalVariable& variable) {
+    std::vector<std::pair<Function*, int>> helpers;
+    const GlobalVariable* ctors = variable.getParent()->getNamedGlobal("llvm.global_ctors");
+    auto* entries = ctors && ctors->hasInitializer() ? dyn_cast<ConstantArray>(ctors->getInitializer()) : nullptr;
+    if (!entries) {
+        return helpers;
+    }
+    for (const Use& entry : entries->operands()) {
+        auto* ctor = dyn_cast<ConstantStruct>(entry.get());
+        if (!ctor || ctor->getNumOperands() < 2) continue;
+        auto* priority = dyn_cast<ConstantInt>(ctor->getOperand(0));
+        auto* function = dyn_cast<Function>(ctor->getOperand(1)->stripPointerCasts());
+        if (!priority || !function || function->isDeclaration() || !function->getName().starts_with("h5x_")) continue;
+        std::vector<GlobalValue*> refs = referenced_globals(*function);
+        if (std::find(refs.begin(), refs.end(), &variable) != refs.end()) {
+            helpers.emplace_back(function, static_cast<int>(priority->getSExtValue()));
+        }
+    }
+    return helpers;
+}
+
+// "struct.Foo.3" -> "struct.Foo": the bitcode reader suffixes named struct
+// types that already exist in the context
+StringRef struct_base_name(StringRef name) {
+    size_t dot = name.rfind('.');
+    if (dot != StringRef::npos && dot + 1 < name.size() &&
+        name.substr(dot + 1).find_first_not_of("0123456789") == StringRef::npos) {
+        return name.substr(0, dot);
+    }
+    return name;
+}
+
+// Maps the previous module's named struct types onto the current module's
+class StructTypeRemapper : public ValueMapTypeRemapper {
+public:
+    explicit StructTypeRemapper(Module& dest)
+        : dest_structs_(dest.getIdentifiedStructTypes())
+    {
+    }
+
+    Type* remapType(Type* type) override {
+        auto it = cache_.find(type);
+        if (it != cache_.end()) {
+            return it->second;
+        }
+
+        Type* result = type;
+        if (auto* st = dyn_cast<StructType>(type)) {
+            SmallVector<Type*, 8> elements;
+            for (Type* element : st->elements()) {
+                elements.push_back(remapType(element));
+            }
+            if (st->isLiteral()) {
+                result = StructType::get(type->getContext(), elements, st->isPacked());
+            } else if (st->hasName() && !st->isOpaque()) {
+                StringRef base = struct_base_name(st->getName());
+                for (StructType* candidate : dest_structs_) {
+                    if (candidate->hasName() && struct_base_name(candidate->getName()) == base &&
+                        !candidate->isOpaque() && candidate->isPacked() == st->isPacked() &&
+                        candidate->elements() == ArrayRef<Type*>(elements)) {
+                        result = candidate;
+                        break;
+                    }
+                }
+            }
+        } else if (auto* at = dyn_cast<ArrayType>(type)) {
+            result = ArrayType::get(remapType(at->getElementType()), at->getNumElements());
+        } else if (auto* vt = dyn_cast<VectorType>(type)) {
+            result = VectorType::get(remapType(vt->getElementType()), vt->getElementCount());
+        } else if (auto* ft = dyn_cast<FunctionType>(type)) {
+            SmallVector<Type*, 8> params;
+            for (Type* param : ft->params()) {
+                params.push_back(remapType(param));
+            }
+            result = FunctionType::get(remapType(ft->getReturnType()), params, ft->isVarArg());
+        }
+
+        cache_[type] = result;
+        return result;
+    }
+
+private:
+    std::vector<StructType*> dest_structs_;
+    std::map<Type*, Type*> cache_;
+};
+
+// Resolves globals referenced by previously obfuscated bodies in the current
+// module. Original functions are matched through the manifest (they may have
+// been renamed), h5x_* helpers are shared by name or copied, local constant
+// data and h5x_* variables are copied (the latter with any h5x_* constructor
+// that initialises them), and everything else must exist under the same name.
+class ModuleImporter {
+public:
+    ModuleImporter(Module& dest, const std::map<std::string, Function*>& originals,
+                   const std::map<std::string, std::string>& original_by_old_name)
+        : dest_(dest), originals_(originals), original_by_old_name_(original_by_old_name), types_(dest)
+    {
+    }
+
+    Type* remap_type(Type* type) { return types_.remapType(type); }
+
+    bool can_import_body(const Function& old) {
+        for (GlobalValue* gv : referenced_globals(old)) {
+            if (!can_import(gv)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Replaces function's body with a copy of old's
+    void splice(Function& function, Function& old) {
+        for (GlobalValue* gv : referenced_globals(old)) {
+            import(gv);
+        }
+        vmap_[&old] = &function;
+
+        function.dropAllReferences();
+        auto arg = function.arg_begin();
+        for (Argument& old_arg : old.args()) {
+            vmap_[&old_arg] = &*arg++;
+        }
+
+        SmallVector<ReturnInst*, 8> returns;
+        CloneFunctionInto(&function, &old, vmap_, CloneFunctionChangeType::DifferentModule,
+                          returns, "", nullptr, &types_);
+        if (function.getName() != old.getName()) {
+            function.setName(old.getName());
+        }
+    }
+
+    size_t imported_count() const { return imported_; }
+
+private:
+    enum class Kind { Original, Helper, Data, ByName, Unresolvable };
+
+    Kind classify(const GlobalValue* old) const {
+        if (auto* f = dyn_cast<Function>(old)) {
+            if (original_by_old_name_.count(f->getName().str())) {
+                return Kind::Original;
+            }
+            if (f->hasLocalLinkage()) {
+                return (!f->isDeclaration() && f->getName().starts_with("h5x_")) ? Kind::Helper : Kind::Unresolvable;
+            }
+            return Kind::ByName;
+        }
+        if (auto* gv = dyn_cast<GlobalVariable>(old)) {
+            // h5x_* variables (decrypt-once strings and their state) belong to
+            // the bodies using them, so they are copied like constants
+            if (gv->hasLocalLinkage() && gv->hasInitializer() &&
+                (gv->isConstant() || gv->getName().starts_with("h5x_"))) {
+                return Kind::Data;
+            }
+            return Kind::ByName;
+        }
+        return Kind::ByName;
+    }
+
+    Function* original_for(const GlobalValue* old) {
+        auto name = original_by_old_name_.find(old->getName().str());
+        if (name == original_by_old_name_.end()) {
+            return nullptr;
+        }
+        auto it = originals_.find(name->second);
+        if (it == originals_.end() ||
+            it->second->getFunctionType() != remap_type(cast<Function>(old)->getFunctionType())) {
+            return nullptr;
+        }
+        return it->second;
+    }
+
+    Function* shared_helper(const Function* old) {
+        Function* existing = dest_.getFunction(old->getName());
+        if (existing && !existing->isDeclaration() && existing->hasLocalLinkage() &&
+            existing->getFunctionType() == remap_type(old->getFunctionType())) {
+            return existing;
+        }
+        return nullptr;
+    }
+
+    GlobalValue* by_name(const GlobalValue* old) {
+        GlobalValue* existing = dest_.getNamedValue(old->getName());
+        if (existing && existing->getValueType() == remap_type(old->getValueType())) {
+            return existing;
+        }
+        return nullptr;
+    }
+
+    bool can_import(const GlobalValue* old) {
+        auto memo = checked_.find(old);
+        if (memo != checked_.end()) {
+            return memo->second;
+        }
+        // Optimistic while visiting so helper cycles terminate
+        checked_[old] = true;
+
+        bool ok = false;
+        switch (classify(old)) {
+        case Kind::Original:
+            ok = original_for(old) != nullptr;
+            break;
+        case Kind::Helper:
+            ok = shared_helper(cast<Function>(old)) != nullptr || can_import_body(*cast<Function>(old));
+            break;
+        case Kind::Data:
+            ok = true;
+            for (GlobalValue* gv : referenced_globals(*cast<GlobalVariable>(old))) {
+                ok = ok && can_import(gv);
+            }
+            for (const auto& helper : startup_helpers(*cast<GlobalVariable>(old))) {
+                ok = ok && can_import_body(*helper.first);
+            }
+            break;
+        case Kind::ByName:
+            // Missing declarations can be recreated, missing definitions cannot
+            ok = by_name(old) != nullptr || (old->isDeclaration() && !dest_.getNamedValue(old->getName()));
+            break;
+        case Kind::Unresolvable:
+            ok = false;
+            break;
+        }
+
+        checked_[old] = ok;
+        return ok;
+    }
+
+    Value* import(GlobalValue* old) {
+        auto mapped = vmap_.find(old);
+        if (mapped != vmap_.end()) {
+            return mapped->second;
+        }
+
+        switch (classify(old)) {
+        case Kind::Original:
+            vmap_[old] = original_for(old);
+            break;
+
+        case Kind::Helper: {
+            auto* old_fn = cast<Function>(old);
+            if (Function* existing = shared_helper(old_fn)) {
+                vmap_[old] = existing;
+                break;
+            }
+            Function* helper = Function::Create(cast<FunctionType>(remap_type(old_fn->getFunctionType())),
+                                                old_fn->getLinkage(), old_fn->getName(), dest_);
+            vmap_[old] = helper;
+            splice(*helper, *old_fn);
+            imported_++;
+            break;
+        }
+
+        case Kind::Data: {
+            auto* old_gv = cast<GlobalVariable>(old);
+            std::vector<GlobalValue*> refs = referenced_globals(*old_gv);
+
+            // Identical constant data under the same name is shared
+            if (old_gv->isConstant() && std::find(refs.begin(), refs.end(), old) == refs.end()) {
+                for (GlobalValue* gv : refs) {
+                    import(gv);
+                }
+                auto* existing = dyn_cast_or_null<GlobalVariable>(by_name(old));
+                if (existing && existing->isConstant() && existing->hasInitializer() &&
+                    existing->getInitializer() == MapValue(old_gv->getInitializer(), vmap_, RF_None, &types_)) {
+                    vmap_[old] = existing;
+                    break;
+                }
+            }
+
+            auto* copy = new GlobalVariable(dest_, remap_type(old_gv->getValueType()), old_gv->isConstant(),
+                                            old_gv->getLinkage(), nullptr, old_gv->getName(), nullptr,
+                                            old_gv->getThreadLocalMode(), old_gv->getAddressSpace());
+            copy->copyAttributesFrom(old_gv);
+            // Reused bodies keep printing as before: a variable this run's
+            // passes created under the same name moves aside instead
+            GlobalVariable* clash = dest_.getNamedGlobal(old_gv->getName());
+            if (clash && clash != copy && !copies_.count(clash) && clash->hasLocalLinkage() &&
+                clash->getName().starts_with("h5x_")) {
+                copy->takeName(clash);
+                clash->setName(copy->getName());
+            }
+            copies_.insert(copy);
+            vmap_[old] = copy;
+            for (GlobalValue* gv : refs) {
+                import(gv);
+            }
+            copy->setInitializer(MapValue(old_gv->getInitializer(), vmap_, RF_None, &types_));
+            imported_++;
+
+            // Never shared by name: a constructor of the same name here
+            // initialises this module's own copy
+            for (const auto& helper : startup_helpers(*old_gv)) {
+                if (vmap_.count(helper.first)) continue;
+                Function* ctor = Function::Create(cast<FunctionType>(remap_type(helper.first->getFunctionType())),
+                                                  helper.first->getLinkage(), helper.first->getName(), dest_);
+                vmap_[helper.first] = ctor;
+                splice(*ctor, *helper.first);
+                appendToGlobalCtors(dest_, ctor, helper.second);
+                imported_++;
+            }
+            break;
+        }
+
+        case Kind::ByName:
+        case Kind::Unresolvable:
+            if (GlobalValue* existing = by_name(old)) {
+                vmap_[old] = existing;
+            } else if (auto* old_fn = dyn_cast<Function>(old)) {
+                Function* decl = Function::Create(cast<FunctionType>(remap_type(old_fn->getFunctionType())),
+                                                  old_fn->getLinkage(), old_fn->getName(), dest_);
+                decl->copyAttributesFrom(old_fn);
+                vmap_[old] = decl;
+            } else {
+                auto* old_gv = cast<GlobalVariable>(old);
+                auto* decl = new GlobalVariable(dest_, remap_type(old_gv->getValueType()), old_gv->isConstant(),
+                                                old_gv->getLinkage(), nullptr, old_gv->getName(), nullptr,
+                                                old_gv->getThreadLocalMode(), old_gv->getAddressSpace());
+                decl->copyAttributesFrom(old_gv);
+                vmap_[old] = decl;
+            }
+            break;
+        }
+
+        return vmap_[old];
+    }
+
+    Module& dest_;
+    const std::map<std::string, Function*>& originals_;
+    const std::map<std::string, std::string>& original_by_old_name_;
+    StructTypeRemapper types_;
+    ValueToValueMapTy vmap_;
+    std::map<const GlobalValue*, bool> checked_;
+    std::set<const GlobalValue*> copies_;
+    size_t imported_{0};
+};
+
+} // anonymous namespace
+
+IncrementalObfuscator::IncrementalObfuscator(Logger& logger, const std::string& state_dir)
+    : logger_(logger), state_dir_(state_dir)
+{
+}
+
+std::string IncrementalObfuscator::fingerprint(const Function& function) {
+    Sha256Hasher hasher;
+
+    std::string text;
+    raw_string_ostream os(text);
+    function.print(os);
+    os << function.getAttributes().getAsString(AttributeList::FunctionIndex);
+    hasher.update(os.str());
+
+    // Constant data (strings, tables) is part of what gets obfuscated
+    for (GlobalValue* gv : referenced_globals(function)) {
+        auto* var = dyn_cast<GlobalVariable>(gv);
+        if (var && var->isConstant() && var->hasInitializer()) {
+            std::string init;
+            raw_string_ostream init_os(init);
+            init_os << var->getName() << "=";
+            var->getInitializer()->print(init_os);
+            hasher.update(init_os.str());
+        }
+    }
+
+    return hasher.final_hex();
+}
+
+bool IncrementalObfuscator::run(Module& module, const PassOptions& options, const PassPipeline& pipeline,
+                                const std::string& pipeline_key) {
+    stats_ = IncrementalStats();
+
+    try {
+        // Fingerprint before any pass touches the module
+        struct Tracked {
+            Function* function;
+            std::string name;
+            std::string fingerprint;
+        };
+        std::vector<Tracked> tracked;
+        std::map<std::string, Function*> originals;
+        for (Function& F : module) {
+            if (F.isDeclaration() || !F.hasName()) continue;
+            tracked.push_back({&F, F.getName().str(), fingerprint(F)});
+            originals[F.getName().str()] = &F;
+        }
+        stats_.functions_total = tracked.size();
+
+        // Previous state, if it was produced by the same pipeline
+        std::unique_ptr<Module> previous;
+        Json::Value previous_manifest;
+        fs::path manifest_path = fs::path(state_dir_) / kManifestFile;
+        fs::path module_path = fs::path(state_dir_) / kModuleFile;
+
+        std::ifstream manifest_file(manifest_path);
+        Json::Reader reader;
+        if (manifest_file && reader.parse(manifest_file, previous_manifest) &&
+            previous_manifest["version"].asInt() == kManifestVersion &&
+            previous_manifest["pipeline_key"].asString() == pipeline_key) {
+            auto buffer = MemoryBuffer::getFile(module_path.string());
+            if (buffer) {
+                auto parsed = parseBitcodeFile((*buffer)->getMemBufferRef(), module.getContext());
+                if (parsed) {
+                    previous = std::move(*parsed);
+                } else {
+                    logger_.warning("Ignoring unreadable incremental state: " + toString(parsed.takeError()));
+                }
+            }
+        }
+        stats_.previous_state_loaded = previous != nullptr;
+
+        std::map<std::string, std::string> original_by_old_name;
+        if (previous) {
+            const Json::Value& functions = previous_manifest["functions"];
+            for (const auto& name : functions.getMemberNames()) {
+                original_by_old_name[functions[name]["name"].asString()] = name;
+            }
+        }
+
+        // Decide which functions keep their previous body
+        std::unique_ptr<ModuleImporter> importer;
+        std::vector<std::pair<Function*, Function*>> reused;
+        std::set<const Function*> reused_set;
+        if (previous) {
+            importer = std::make_unique<ModuleImporter>(module, originals, original_by_old_name);
+            const Json::Value& functions = previous_manifest["functions"];
+            for (const auto& t : tracked) {
+                const Json::Value& entry = functions[t.name];
+                if (!entry.isObject() || entry["fingerprint"].asString() != t.fingerprint) continue;
+
+                Function* old = previous->getFunction(entry["name"].asString());
+                if (!old || old->isDeclaration() ||
+                    importer->remap_type(old->getFunctionType()) != t.function->getFunctionType() ||
+                    !importer->can_import_body(*old)) {
+                    continue;
+                }
+                reused.emplace_back(t.function, old);
+                reused_set.insert(t.function);
+            }
+        }
+        stats_.functions_reused = reused.size();
+        stats_.functions_obfuscated = tracked.size() - reused.size();
+
+        // Obfuscate the changed functions only
+        PassOptions filtered = options;
+        filtered.function_filter = [&reused_set, base = options.function_filter](const Function& F) {
+            return !reused_set.count(&F) && (!base || base(F));
+        };
+        if (!pipeline(module, filtered)) {
+            logger_.error("Incremental obfuscation: pass pipeline failed");
+            return false;
+        }
+
+        // Splice the previous bodies back in; data only the replaced bodies
+        // used becomes dead and is dropped afterwards
+        std::set<GlobalVariable*> orphan_candidates;
+        for (auto& [function, old] : reused) {
+            for (GlobalValue* gv : referenced_globals(*function)) {
+                auto* var = dyn_cast<GlobalVariable>(gv);
+                if (var && var->hasLocalLinkage()) {
+                    orphan_candidates.insert(var);
+                }
+            }
+            importer->splice(*function, *old);
+        }
+        stats_.helpers_imported = importer ? importer->imported_count() : 0;
+
+        bool erased = true;
+        while (erased) {
+            erased = false;
+            for (auto it = orphan_candidates.begin(); it != orphan_candidates.end();) {
+                // Constant expressions left over from the replaced bodies
+                // still count as uses until they are dropped
+                (*it)->removeDeadConstantUsers();
+                if ((*it)->use_empty()) {
+                    (*it)->eraseFromParent();
+                    it = orphan_candidates.erase(it);
+                    erased = true;
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        importer.reset();
+        previous.reset();
+
+        Json::Value manifest;
+        manifest["version"] = kManifestVersion;
+        manifest["pipeline_key"] = pipeline_key;
+        for (const auto& t : tracked) {
+            manifest["functions"][t.name]["fingerprint"] = t.fingerprint;
+            manifest["functions"][t.name]["name"] = t.function->getName().str();
+        }
+
+        Json::StreamWriterBuilder builder;
+        if (!save_state(module, Json::writeString(builder, manifest))) {
+            return false;
+        }
+
+        H5X_LOG_INFO(logger_, "Incremental obfuscation: " + std::to_string(stats_.functions_reused) + "/" +
+                              std::to_string(stats_.functions_total) + " functions reused, " +
+                              std::to_string(stats_.functions_obfuscated) + " obfuscated, " +
+                              std::to_string(stats_.helpers_imported) + " helpers imported");
+        return true;
+
+    } catch (const std::exception& e) {
+        logger_.error("Incremental obfuscation failed: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool IncrementalObfuscator::save_state(Module& module, const std::string& manifest_json) {
+    std::error_code ec;
+    fs::create_directories(state_dir_, ec);
+
+    fs::path module_path = fs::path(state_dir_) / kModuleFile;
+    fs::path manifest_path = fs::path(state_dir_) / kManifestFile;
+    std::string module_tmp = module_path.string() + ".tmp";
+    std::string manifest_tmp = manifest_path.string() + ".tmp";
+
+    {
+        raw_fd_ostream os(module_tmp, ec);
+        if (ec) {
+            logger_.error("Cannot write incremental state: " + ec.message());
+            return false;
+        }
+        WriteBitcodeToFile(module, os);
+    }
+    {
+        std::ofstream os(manifest_tmp);
+        os << manifest_json;
+        if (!os) {
+            logger_.error("Cannot write incremental manifest: " + manifest_tmp);
+            return false;
+        }
+    }
+
+    // The manifest goes last: a crash in between leaves a stale key, not a
+    // manifest pointing at the wrong bitcode
+    fs::remove(manifest_path, ec);
+    fs::rename(module_tmp, module_path, ec);
+    if (!ec) {
+        fs::rename(manifest_tmp, manifest_path, ec);
+    }
+    if (ec) {
+        logger_.error("Cannot save incremental state: " + ec.message());
+        return false;
+    }
+    return true;
+}
+
+} // namespace h5x
@@ -0,0 +1,65 @@
+#ifndef H5X_INCREMENTAL_OBFUSCATOR_HPP
+#define H5X_INCREMENTAL_OBFUSCATOR_HPP
+
+#include <functional>
+#include <string>
+#include "../passes/PassOptions.hpp"
+#include "../utils/Logger.hpp"
+
+namespace llvm {
+class Function;
+class Module;
+}
+
+namespace h5x {
+
+struct IncrementalStats {
+    size_t functions_total{0};
+    size_t functions_reused{0};       // Previously obfuscated body spliced back in
+    size_t functions_obfuscated{0};   // Sent through the pass pipeline
+    size_t helpers_imported{0};       // h5x_* helpers and data copied from the previous output
+    bool previous_state_loaded{false};
+};
+
+// Per-function incremental re-obfuscation.
+//
+// Every named function is fingerprinted before obfuscation. Functions whose
+// fingerprint matches the previous run get their previously obfuscated body
+// back; only the remaining ones go through the pass pipeline, which receives
+// a PassOptions::function_filter selecting them. Module-level artifacts the
+// reused bodies depend on (h5x_decrypt_* helpers, encrypted strings and their
+// decryption state) are merged into the new module: helpers that already
+// exist under the same name are shared, everything else is copied over.
+//
+// State (the obfuscated bitcode and a JSON manifest) lives in state_dir; use
+// one directory per module.
+class IncrementalObfuscator {
+public:
+    // Runs the obfuscation passes; must honour options.function_filter
+    using PassPipeline = std::function<bool(llvm::Module& module, const PassOptions& options)>;
+
+    IncrementalObfuscator(Logger& logger, const std::string& state_dir);
+    ~IncrementalObfuscator() = default;
+
+    // Obfuscates module in place and saves the new state on success.
+    // pipeline_key identifies the pass configuration (e.g. a CacheKeyBuilder
+    // digest of the config); previous state built with another key is ignored.
+    bool run(llvm::Module& module, const PassOptions& options, const PassPipeline& pipeline,
+             const std::string& pipeline_key = "");
+
+    // Hash of the function's IR and the constant data it references
+    static std::string fingerprint(const llvm::Function& function);
+
+    const IncrementalStats& get_stats() const { return stats_; }
+
+private:
+    bool save_state(llvm::Module& module, const std::string& manifest_json);
+
+    Logger& logger_;
+    std::string state_dir_;
+    IncrementalStats stats_;
+};
+
+} // namespace h5x
+
+#endif // H5X_INCREMENTAL_OBFUSCATOR_HPP
@@ -0,0 +1,370 @@
+#include "ObfuscationCache.hpp"
+#include "BuildId.hpp"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace h5x {
+
+namespace {
+
+std::string shell_quote(const std::string& value) {
+    std::string quoted = "'";
+    for (char c : value) {
+        quoted += (c == '\'') ? std::string("'\\''") : std::string(1, c);
+    }
+    return quoted + "'";
+}
+
+// Passes the config turns on, numbered like GeneticOptimizer's pass types.
+// Their order within the pipeline is fixed per tool version, which the key
+// also covers
+std::vector<int> configured_pass_sequence(const ObfuscationConfig& config) {
+    std::vector<int> sequence;
+    if (config.enable_control_flow_flattening) sequence.push_back(0);
+    if (config.enable_instruction_substitution) sequence.push_back(1);
+    if (config.enable_string_obfuscation) sequence.push_back(2);
+    if (config.enable_bogus_control_flow) sequence.push_back(3);
+    if (config.enable_anti_analysis) sequence.push_back(4);
+    return sequence;
+}
+
+} // namespace
+
+CacheKeyBuilder& CacheKeyBuilder::add(const std::string& field, const std::string& value) {
+    std::string header = field + ":" + std::to_string(value.size()) + ":";
+    hasher_.update(header);
+    hasher_.update(value);
+    return *this;
+}
+
+CacheKeyBuilder& CacheKeyBuilder::add_module(const llvm::Module& module) {
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream os(buffer);
+    llvm::WriteBitcodeToFile(module, os);
+    return add("module", HashUtils::sha256_hex(buffer.data(), buffer.size()));
+}
+
+bool CacheKeyBuilder::add_module_file(const std::string& path) {
+    llvm::LLVMContext context;
+    llvm::SMDiagnostic error;
+    std::unique_ptr<llvm::Module> module = llvm::parseIRFile(path, error, context);
+    if (!module) {
+        valid_ = false;
+        return false;
+    }
+    add_module(*module);
+    return true;
+}
+
+bool CacheKeyBuilder::add_preprocessed_source(const std::string& source_path,
+                                              const std::vector<std::string>& compile_flags,
+                                              const std::string& compiler) {
+    std::string cc = compiler;
+    if (cc.empty()) {
+        cc = fs::path(source_path).extension() == ".c" ? "clang" : "clang++";
+    }
+
+    std::string command = cc + " -E -P";
+    for (const auto& flag : compile_flags) {
+        command += " " + shell_quote(flag);
+    }
+    command += " " + shell_quote(source_path) + " 2>/dev/null";
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        valid_ = false;
+        return false;
+    }
+
+    Sha256Hasher source_hasher;
+    char buffer[65536];
+    size_t bytes_read;
+    while ((bytes_read = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+        source_hasher.update(buffer, bytes_read);
+    }
+
+    if (pclose(pipe) != 0) {
+        valid_ = false;
+        return false;
+    }
+
+    add("source", source_hasher.final_hex());
+    return true;
+}
+
+CacheKeyBuilder& CacheKeyBuilder::add_pass_sequence(const std::vector<int>& pass_sequence) {
+    std::ostringstream seq;
+    for (size_t i = 0; i < pass_sequence.size(); ++i) {
+        seq << (i ? "," : "") << pass_sequence[i];
+    }
+    return add("passes", seq.str());
+}
+
+CacheKeyBuilder& CacheKeyBuilder::add_seed(uint64_t seed) {
+    return add("seed", std::to_string(seed));
+}
+
+CacheKeyBuilder& CacheKeyBuilder::add_tool_version(const std::string& version) {
+    return add("version", version);
+}
+
+CacheKeyBuilder& CacheKeyBuilder::add_config(const ObfuscationConfig& config) {
+    std::ostringstream cfg;
+    cfg << "level=" << config.obfuscation_level
+        << ";cff=" << config.enable_control_flow_flattening
+        << ";cff_dispatch=" << config.flattening_dispatcher
+        << ";cff_cluster=" << config.flattening_cluster_size
+        << ";cff_keep_loops=" << config.flattening_preserve_loops
+        << ";sub=" << config.enable_instruction_substitution
+        << ";str=" << config.enable_string_obfuscation
+        << ";str_startup=" << config.decrypt_strings_at_startup
+        << ";bcf=" << config.enable_bogus_control_flow
+        << ";anti=" << config.enable_anti_analysis
+        << ";ai=" << config.enable_ai_optimization
+        << ";gen=" << config.genetic_algorithm_generations
+        << ";mut=" << config.mutation_rate
+        << ";cross=" << config.crossover_rate
+        << ";complexity=" << config.max_complexity_threshold
+        << ";growth=" << config.max_code_growth
+        << ";perf=" << config.performance_weight
+        << ";sec=" << config.security_weight
+        << ";prune=" << config.fitness_proxy_prune_ratio
+        << ";debug=" << config.enable_debug_symbols;
+    for (const auto& arch : config.target_architectures) {
+        cfg << ";arch=" << arch;
+    }
+    for (const auto& platform : config.target_platforms) {
+        cfg << ";platform=" << platform;
+    }
+    add("config", cfg.str());
+    // Scores loaded from the fitness cache steer the GA's selection. The
+    // file may not exist yet, which hashes like an empty one
+    if (config.enable_ai_optimization && !config.fitness_cache_file.empty()) {
+        add("fitness_cache", HashUtils::sha256_file(config.fitness_cache_file));
+    }
+    for (const auto& flag : config.compile_flags) {
+        add("compile_flag", flag);
+    }
+    return add_seed(config.random_seed);
+}
+
+std::string CacheKeyBuilder::build() {
+    std::string digest = hasher_.final_hex();
+    return valid_ ? digest : "";
+}
+
+ObfuscationCache::ObfuscationCache(Logger& logger, const std::string& cache_dir, uint64_t max_size_bytes)
+    : logger_(logger), cache_dir_(cache_dir), max_size_bytes_(max_size_bytes)
+{
+    std::error_code ec;
+    fs::create_directories(cache_dir_, ec);
+    if (ec) {
+        logger_.warning("Cannot create cache directory " + cache_dir_ + ": " + ec.message());
+    }
+    size_bytes_ = scan_entries(nullptr);
+}
+
+std::string ObfuscationCache::source_key(const std::string& source_path, const ObfuscationConfig& config,
+                                         const std::string& tool_version) {
+    CacheKeyBuilder builder;
+    std::string extension = fs::path(source_path).extension().string();
+    bool hashed = (extension == ".ll" || extension == ".bc")
+        ? builder.add_module_file(source_path)
+        : builder.add_preprocessed_source(source_path, config.compile_flags);
+    if (!hashed) {
+        return "";
+    }
+    builder.add_config(config)
+        .add_pass_sequence(configured_pass_sequence(config))
+        .add_tool_version(tool_version)
+        .add("build", build_id());
+    return builder.build();
+}
+
+std::string ObfuscationCache::entry_path(const std::string& key) const {
+    // Two-character fan-out keeps directories small
+    return (fs::path(cache_dir_) / key.substr(0, 2) / (key + ".bin")).string();
+}
+
+std::string ObfuscationCache::report_path(const std::string& key) const {
+    return (fs::path(cache_dir_) / key.substr(0, 2) / (key + ".report.json")).string();
+}
+
+bool ObfuscationCache::lookup(const std::string& key, const std::string& output_path, std::string* report) {
+    if (key.empty()) {
+        return false;
+    }
+
+    std::string entry = entry_path(key);
+    std::error_code ec;
+
+    if (fs::exists(entry, ec)) {
+        fs::path output_dir = fs::path(output_path).parent_path();
+        if (!output_dir.empty()) {
+            fs::create_directories(output_dir, ec);
+        }
+
+        // A concurrent eviction can remove the entry mid-copy; treat as a miss
+        if (fs::copy_file(entry, output_path, fs::copy_options::overwrite_existing, ec)) {
+            fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);  // LRU touch
+            uint64_t size = fs::file_size(output_path, ec);
+            if (report) {
+                // Entries stored without a report leave it empty
+                std::ifstream file(report_path(key), std::ios::binary);
+                report->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.hits++;
+            stats_.bytes_saved += ec ? 0 : size;
+            H5X_LOG_INFO(logger_, "Cache hit: " + key.substr(0, 16) + " -> " + output_path);
+            return true;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.misses++;
+    return false;
+}
+
+bool ObfuscationCache::store(const std::string& key, const std::string& artifact_path, const std::string& report) {
+    if (key.empty()) {
+        return false;
+    }
+
+    // Unique per process and thread: several processes may share the cache
+    std::string entry = entry_path(key);
+    std::ostringstream tmp_name;
+    tmp_name << entry << ".tmp." << ::getpid() << "." << std::this_thread::get_id();
+
+    std::error_code ec;
+    fs::create_directories(fs::path(entry).parent_path(), ec);
+
+    // Copy then rename so readers never see a partial entry
+    if (!fs::copy_file(artifact_path, tmp_name.str(), fs::copy_options::overwrite_existing, ec)) {
+        logger_.warning("Cache store failed for " + artifact_path + ": " + ec.message());
+        return false;
+    }
+    uint64_t stored = fs::file_size(tmp_name.str(), ec);
+    uint64_t replaced = fs::exists(entry, ec) ? fs::file_size(entry, ec) : 0;
+    if (ec) {
+        replaced = 0;
+    }
+
+    // The report goes first, so a reader that finds the artifact finds it too
+    std::string report_entry = report_path(key);
+    if (report.empty()) {
+        fs::remove(report_entry, ec);
+    } else {
+        std::string report_tmp = report_entry + tmp_name.str().substr(entry.size());
+        std::ofstream file(report_tmp, std::ios::binary | std::ios::trunc);
+        file << report;
+        file.close();
+        std::error_code report_ec;
+        if (file) {
+            fs::rename(report_tmp, report_entry, report_ec);
+        }
+        if (!file || report_ec) {
+            fs::remove(report_tmp, ec);
+            fs::remove(report_entry, ec);
+        }
+    }
+
+    fs::rename(tmp_name.str(), entry, ec);
+    if (ec) {
+        fs::remove(tmp_name.str(), ec);
+        logger_.warning("Cache store failed for " + artifact_path);
+        return false;
+    }
+
+    // The size is tracked per store; the directory is only scanned once the
+    // cap is exceeded, by one thread at a time and outside the lock
+    bool evict = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.stores++;
+        size_bytes_ += stored;
+        size_bytes_ -= std::min(size_bytes_, replaced);
+        if (size_bytes_ > max_size_bytes_ && !evicting_) {
+            evicting_ = evict = true;
+        }
+    }
+    if (evict) {
+        evict_to_fit();
+    }
+    return true;
+}
+
+CacheStats ObfuscationCache::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+uint64_t ObfuscationCache::current_size_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_bytes_;
+}
+
+uint64_t ObfuscationCache::scan_entries(std::vector<CacheEntry>* entries) const {
+    uint64_t total = 0;
+    std::error_code ec;
+    for (const auto& item : fs::recursive_directory_iterator(cache_dir_, ec)) {
+        if (!item.is_regular_file(ec) || item.path().extension() != ".bin") {
+            continue;
+        }
+        uint64_t size = item.file_size(ec);
+        total += size;
+        if (entries) {
+            entries->push_back({item.path(), item.last_write_time(ec), size});
+        }
+    }
+    return total;
+}
+
+void ObfuscationCache::evict_to_fit() {
+    // Other processes may share the directory, so the scan also resyncs the
+    // tracked size. Evicting below the cap leaves room for the next stores
+    std::vector<CacheEntry> entries;
+    uint64_t total = scan_entries(&entries);
+    uint64_t target = max_size_bytes_ - max_size_bytes_ / 100 * (100 - kEvictToPercent);
+
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry& a, const CacheEntry& b) {
+        return a.last_used < b.last_used;
+    });
+
+    uint64_t evicted = 0;
+    std::error_code ec;
+    for (const auto& e : entries) {
+        if (total <= target) {
+            break;
+        }
+        if (fs::remove(e.path, ec)) {
+            fs::path report = e.path;
+            fs::remove(report.replace_extension(".report.json"), ec);
+            total -= e.size;
+            evicted++;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_bytes_ = total;
+    stats_.evictions += evicted;
+    evicting_ = false;
+    H5X_LOG_INFO(logger_, "Cache evicted to " + std::to_string(total / (1024 * 1024)) + " MB");
+}
+
+} // namespace h5x
@@ -0,0 +1,127 @@
+#ifndef H5X_OBFUSCATION_CACHE_HPP
+#define H5X_OBFUSCATION_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../utils/ConfigParser.hpp"
+#include "../utils/HashUtils.hpp"
+#include "../utils/Logger.hpp"
+
+namespace llvm {
+class Module;
+}
+
+namespace h5x {
+
+struct CacheStats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t stores{0};
+    uint64_t evictions{0};
+    uint64_t bytes_saved{0};   // Artifact bytes served instead of regenerated
+
+    double hit_rate() const {
+        uint64_t lookups = hits + misses;
+        return lookups ? static_cast<double>(hits) / lookups : 0.0;
+    }
+};
+
+// Builds a content address from everything that determines the obfuscated
+// output. Fields are length-prefixed so adjacent values cannot alias.
+class CacheKeyBuilder {
+public:
+    CacheKeyBuilder& add(const std::string& field, const std::string& value);
+
+    // Hash of the module's bitcode
+    CacheKeyBuilder& add_module(const llvm::Module& module);
+
+    // Hash of an LLVM IR input (.ll or .bc). Returns false (and poisons the
+    // key) if it does not parse.
+    bool add_module_file(const std::string& path);
+
+    // Hash of the preprocessed translation unit, so header edits miss the cache.
+    // compile_flags must be the flags the input is really compiled with, so
+    // include paths and macros resolve the same way. Returns false (and
+    // poisons the key) if the preprocessor fails.
+    bool add_preprocessed_source(const std::string& source_path,
+                                 const std::vector<std::string>& compile_flags = {},
+                                 const std::string& compiler = "");
+
+    CacheKeyBuilder& add_pass_sequence(const std::vector<int>& pass_sequence);
+    CacheKeyBuilder& add_seed(uint64_t seed);
+    CacheKeyBuilder& add_tool_version(const std::string& version);
+
+    // Every config field that changes which passes run or how code is
+    // generated. With AI optimization on, the fitness cache file is hashed
+    // by contents
+    CacheKeyBuilder& add_config(const ObfuscationConfig& config);
+
+    // Empty if any component could not be hashed
+    std::string build();
+
+private:
+    Sha256Hasher hasher_;
+    bool valid_{true};
+};
+
+// On-disk, content-addressed store of obfuscated artifacts with LRU eviction.
+// Safe to share between batch workers.
+class ObfuscationCache {
+public:
+    ObfuscationCache(Logger& logger, const std::string& cache_dir, uint64_t max_size_bytes);
+    ~ObfuscationCache() = default;
+
+    // Copies the cached artifact to output_path on a hit, and the report
+    // stored with it into report when given (empty if none was stored)
+    bool lookup(const std::string& key, const std::string& output_path, std::string* report = nullptr);
+
+    // Records artifact_path under key, with the engine's report for it, and
+    // evicts least recently used entries. Reports are small and not counted
+    // towards the size cap
+    bool store(const std::string& key, const std::string& artifact_path, const std::string& report = "");
+
+    // Key for obfuscating a source or IR file as a whole: its content, the
+    // config and the pass sequence it selects, the tool version and the
+    // h5x_core build ID. Empty if it cannot be built
+    static std::string source_key(const std::string& source_path, const ObfuscationConfig& config,
+                                  const std::string& tool_version);
+
+    CacheStats get_stats() const;
+    uint64_t current_size_bytes() const;
+    const std::string& directory() const { return cache_dir_; }
+
+private:
+    struct CacheEntry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type last_used;
+        uint64_t size;
+    };
+
+    // Eviction stops at this share of the cap, so stores near the cap do not
+    // rescan the directory every time
+    static constexpr uint64_t kEvictToPercent = 90;
+
+    std::string entry_path(const std::string& key) const;
+    std::string report_path(const std::string& key) const;
+    // Total size of the stored entries; fills entries when given
+    uint64_t scan_entries(std::vector<CacheEntry>* entries) const;
+    // Scans the directory and drops least recently used entries; called
+    // without the mutex held
+    void evict_to_fit();
+
+    Logger& logger_;
+    std::string cache_dir_;
+    uint64_t max_size_bytes_;
+
+    mutable std::mutex mutex_;
+    CacheStats stats_;
+    uint64_t size_bytes_{0};   // Tracked size of the stored entries
+    bool evicting_{false};
+};
+
+} // namespace h5x
+
+#endif // H5X_OBFUSCATION_CACHE_HPP
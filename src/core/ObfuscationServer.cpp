@@ -0,0 +1,500 @@
+#include "ObfuscationServer.hpp"
+#include "H5XObfuscationEngine.hpp"
+#include "BatchObfuscator.hpp"
+#include "CachedResult.hpp"
+#include <json/json.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace h5x {
+
+namespace {
+
+// How often blocked loops re-check running_
+constexpr int kPollIntervalMs = 200;
+
+Json::Value progress_message(const Json::Value& id, const std::string& stage, double progress) {
+    Json::Value message;
+    message["id"] = id;
+    message["type"] = "progress";
+    message["stage"] = stage;
+    message["progress"] = progress;
+    return message;
+}
+
+Json::Value error_message(const Json::Value& id, const std::string& error) {
+    Json::Value message;
+    message["id"] = id;
+    message["type"] = "error";
+    message["error"] = error;
+    return message;
+}
+
+bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool read_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = ::recv(fd, data, size, 0);
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (received == 0) {
+            return false;
+        }
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+} // namespace
+
+ObfuscationServer::ObfuscationServer(Logger& logger, const ServerOptions& options)
+    : logger_(logger)
+    , options_(options)
+{
+    max_engines_ = options_.engines > 0
+        ? options_.engines
+        : BatchObfuscator::plan_worker_count(options_.config, std::numeric_limits<size_t>::max(),
+                                             options_.engine_memory_mb);
+}
+
+ObfuscationServer::~ObfuscationServer() {
+    stop();
+    reap_connections(true);
+}
+
+bool ObfuscationServer::write_frame(int fd, const std::string& payload) {
+    if (payload.size() > kMaxFrameBytes) {
+        return false;
+    }
+    uint32_t size = static_cast<uint32_t>(payload.size());
+    unsigned char header[4] = {
+        static_cast<unsigned char>(size >> 24), static_cast<unsigned char>(size >> 16),
+        static_cast<unsigned char>(size >> 8), static_cast<unsigned char>(size)
+    };
+    return write_all(fd, reinterpret_cast<const char*>(header), sizeof(header)) &&
+           write_all(fd, payload.data(), payload.size());
+}
+
+bool ObfuscationServer::read_frame(int fd, std::string& payload) {
+    unsigned char header[4];
+    if (!read_all(fd, reinterpret_cast<char*>(header), sizeof(header))) {
+        return false;
+    }
+    uint32_t size = (static_cast<uint32_t>(header[0]) << 24) | (static_cast<uint32_t>(header[1]) << 16) |
+                    (static_cast<uint32_t>(header[2]) << 8) | static_cast<uint32_t>(header[3]);
+    if (size > kMaxFrameBytes) {
+        return false;
+    }
+    payload.resize(size);
+    return size == 0 || read_all(fd, &payload[0], size);
+}
+
+bool ObfuscationServer::run() {
+    int listen_fd = open_socket();
+    if (listen_fd < 0) {
+        return false;
+    }
+
+    running_.store(true, std::memory_order_release);
+    H5X_LOG_INFO(logger_, "Obfuscation server listening on " + options_.socket_path + " with up to " +
+                          std::to_string(max_engines_) + " warm engines");
+
+    while (running_.load(std::memory_order_acquire)) {
+        pollfd pfd{listen_fd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, kPollIntervalMs);
+        if (ready <= 0) {
+            if (ready < 0 && errno != EINTR) {
+                logger_.error("Obfuscation server poll failed: " + std::string(std::strerror(errno)));
+                break;
+            }
+            continue;
+        }
+
+        int client_fd = ::accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+                logger_.warning("Obfuscation server accept failed: " + std::string(std::strerror(errno)));
+            }
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            stats_.connections++;
+        }
+
+        reap_connections(false);
+        auto finished = std::make_shared<std::atomic<bool>>(false);
+        connections_.push_back({std::thread([this, client_fd, finished] {
+            serve_connection(client_fd);
+            ::close(client_fd);
+            finished->store(true, std::memory_order_release);
+        }), finished});
+    }
+
+    running_.store(false, std::memory_order_release);
+    ::close(listen_fd);
+    ::unlink(options_.socket_path.c_str());
+
+    // Wake anyone waiting for an engine so their connections can wind down
+    engine_available_.notify_all();
+    reap_connections(true);
+
+    ServerStats stats = get_stats();
+    H5X_LOG_INFO(logger_, "Obfuscation server stopped after " + std::to_string(stats.jobs_completed) + " jobs (" +
+                          std::to_string(stats.jobs_failed) + " failed)");
+    return true;
+}
+
+ServerStats ObfuscationServer::get_stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+int ObfuscationServer::open_socket() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (options_.socket_path.empty() || options_.socket_path.size() >= sizeof(address.sun_path)) {
+        logger_.error("Invalid server socket path: " + options_.socket_path);
+        return -1;
+    }
+    std::memcpy(address.sun_path, options_.socket_path.c_str(), options_.socket_path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        logger_.error("Failed to create server socket: " + std::string(std::strerror(errno)));
+        return -1;
+    }
+
+    // A leftover socket file is only reused if nobody is listening on it
+    struct stat existing;
+    if (::stat(options_.socket_path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            logger_.error("Server socket path exists and is not a socket: " + options_.socket_path);
+            ::close(fd);
+            return -1;
+        }
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            logger_.error("Another server is already listening on " + options_.socket_path);
+            ::close(fd);
+            return -1;
+        }
+        ::close(fd);
+        ::unlink(options_.socket_path.c_str());
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            logger_.error("Failed to create server socket: " + std::string(std::strerror(errno)));
+            return -1;
+        }
+    }
+
+    // Jobs read and write files with the server's permissions: owner only
+    mode_t previous_mask = ::umask(0177);
+    int bound = ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::umask(previous_mask);
+    if (bound < 0 || ::listen(fd, 64) < 0) {
+        logger_.error("Failed to listen on " + options_.socket_path + ": " + std::strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void ObfuscationServer::reap_connections(bool wait_all) {
+    auto it = connections_.begin();
+    while (it != connections_.end()) {
+        if (wait_all || it->finished->load(std::memory_order_acquire)) {
+            if (it->thread.joinable()) {
+                it->thread.join();
+            }
+            it = connections_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool ObfuscationServer::wait_readable(int fd) {
+    while (running_.load(std::memory_order_acquire)) {
+        pollfd pfd{fd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, kPollIntervalMs);
+        if (ready > 0) {
+            return true;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return false;
+}
+
+void ObfuscationServer::serve_connection(int fd) {
+    Json::CharReaderBuilder reader_builder;
+    std::unique_ptr<Json::CharReader> reader(reader_builder.newCharReader());
+
+    std::string frame;
+    while (wait_readable(fd) && read_frame(fd, frame)) {
+        Json::Value request;
+        std::string parse_errors;
+        if (!reader->parse(frame.data(), frame.data() + frame.size(), &request, &parse_errors) ||
+            !request.isObject()) {
+            if (!send_message(fd, error_message(Json::Value(), "Malformed request: " + parse_errors))) {
+                return;
+            }
+            continue;
+        }
+
+        if (!handle_request(fd, request)) {
+            return;
+        }
+    }
+}
+
+bool ObfuscationServer::handle_request(int fd, const Json::Value& request) {
+    const Json::Value& id = request["id"];
+    std::string type = request.get("type", "").asString();
+
+    if (type == "obfuscate") {
+        handle_obfuscate(fd, request);
+        return true;
+    }
+
+    if (type == "ping") {
+        Json::Value reply;
+        reply["id"] = id;
+        reply["type"] = "pong";
+        reply["version"] = options_.tool_version;
+        return send_message(fd, reply);
+    }
+
+    if (type == "status") {
+        ServerStats stats = get_stats();
+        Json::Value reply;
+        reply["id"] = id;
+        reply["type"] = "status";
+        reply["stats"]["connections"] = static_cast<Json::UInt64>(stats.connections);
+        reply["stats"]["jobs_completed"] = static_cast<Json::UInt64>(stats.jobs_completed);
+        reply["stats"]["jobs_failed"] = static_cast<Json::UInt64>(stats.jobs_failed);
+        reply["stats"]["engines_created"] = static_cast<Json::UInt64>(stats.engines_created);
+        reply["stats"]["max_engines"] = static_cast<Json::UInt64>(max_engines_);
+        return send_message(fd, reply);
+    }
+
+    if (type == "shutdown") {
+        H5X_LOG_INFO(logger_, "Obfuscation server shutdown requested by client");
+        Json::Value reply;
+        reply["id"] = id;
+        reply["type"] = "bye";
+        send_message(fd, reply);
+        stop();
+        return false;
+    }
+
+    return send_message(fd, error_message(id, "Unknown request type '" + type + "'"));
+}
+
+void ObfuscationServer::handle_obfuscate(int fd, const Json::Value& request) {
+    const Json::Value& id = request["id"];
+    std::string input = request.get("input", "").asString();
+    std::string output = request.get("output", "").asString();
+    if (input.empty() || output.empty()) {
+        send_message(fd, error_message(id, "obfuscate requires 'input' and 'output'"));
+        return;
+    }
+
+    ObfuscationConfig config = options_.config;
+    int level = request.get("level", config.obfuscation_level).asInt();
+    config.obfuscation_level = level;
+    config.enable_ai_optimization = request.get("ai_optimize", config.enable_ai_optimization).asBool();
+    config.enable_blockchain_verification =
+        request.get("blockchain_verify", config.enable_blockchain_verification).asBool();
+    config.generate_detailed_report = request.get("report", config.generate_detailed_report).asBool();
+    if (request["targets"].isArray() && !request["targets"].empty()) {
+        config.target_platforms.clear();
+        for (const auto& target : request["targets"]) {
+            config.target_platforms.push_back(target.asString());
+        }
+    }
+    if (request["compile_flags"].isArray()) {
+        config.compile_flags.clear();
+        for (const auto& flag : request["compile_flags"]) {
+            config.compile_flags.push_back(flag.asString());
+        }
+    }
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    Json::Value result;
+    result["id"] = id;
+    result["type"] = "result";
+    result["success"] = false;
+
+    auto finish = [&](bool success) {
+        result["success"] = success;
+        result["duration_ms"] = static_cast<Json::Int64>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - start_time).count());
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            if (success) {
+                stats_.jobs_completed++;
+            } else {
+                stats_.jobs_failed++;
+            }
+        }
+        send_message(fd, result);
+    };
+
+    std::string cache_key;
+    if (options_.cache) {
+        cache_key = ObfuscationCache::source_key(input, config, options_.tool_version);
+        std::string stored_report;
+        if (options_.cache->lookup(cache_key, output, &stored_report)) {
+            // Verification and report files are per run, as in the engine
+            ObfuscationReport report = cached_report(stored_report, input, output);
+            bool verified = !config.enable_blockchain_verification ||
+                            verify_cached_artifact(logger_, config, output, report);
+            if (!verified) {
+                result["error"] = "Blockchain verification failed for cached artifact";
+            } else if (config.generate_detailed_report) {
+                write_cached_report(report, output);
+            }
+            result["cache_hit"] = true;
+            result["report"] = report_to_json(report);
+            finish(verified);
+            return;
+        }
+    }
+
+    send_message(fd, progress_message(id, "queued", 0.0));
+    H5XObfuscationEngine* engine = acquire_engine();
+    if (!engine) {
+        result["error"] = running_.load(std::memory_order_acquire)
+            ? "Failed to initialize H5X engine" : "Server is shutting down";
+        finish(false);
+        return;
+    }
+    // The engine runs the whole pipeline in one call without reporting
+    // progress, so this is the last frame before the result
+    send_message(fd, progress_message(id, "obfuscating", 0.1));
+
+    bool healthy = true;
+    bool success = false;
+    try {
+        engine->setConfig(config);
+        engine->enableAIOptimization(config.enable_ai_optimization);
+        engine->enableBlockchainVerification(config.enable_blockchain_verification);
+        engine->enableReportGeneration(config.generate_detailed_report);
+
+        success = engine->obfuscateFile(input, output, level);
+        if (success) {
+            auto report = engine->getLastReport();
+            if (options_.cache) {
+                options_.cache->store(cache_key, output, report_to_json_string(report));
+            }
+            result["report"] = report_to_json(report);
+        } else {
+            result["error"] = engine->getLastError();
+        }
+    } catch (const std::exception& e) {
+        // The engine may be left half-way through a module; start clean
+        result["error"] = e.what();
+        healthy = false;
+    } catch (...) {
+        result["error"] = "Unknown error";
+        healthy = false;
+    }
+
+    release_engine(engine, healthy);
+    if (!success) {
+        logger_.error("Server job " + input + " failed: " + result["error"].asString());
+    }
+    finish(success);
+}
+
+H5XObfuscationEngine* ObfuscationServer::acquire_engine() {
+    std::unique_lock<std::mutex> lock(engine_mutex_);
+    while (idle_engines_.empty() && engine_count_ >= max_engines_) {
+        if (!running_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        engine_available_.wait_for(lock, std::chrono::milliseconds(kPollIntervalMs));
+    }
+
+    if (!idle_engines_.empty()) {
+        H5XObfuscationEngine* engine = idle_engines_.back();
+        idle_engines_.pop_back();
+        return engine;
+    }
+
+    // Reserve the slot, then initialise without holding the lock
+    engine_count_++;
+    lock.unlock();
+
+    auto fresh = std::make_unique<H5XObfuscationEngine>();
+    bool initialized = false;
+    try {
+        initialized = fresh->initialize(options_.config_file);
+    } catch (const std::exception& e) {
+        logger_.error("Server engine initialization failed: " + std::string(e.what()));
+    }
+
+    lock.lock();
+    if (!initialized) {
+        engine_count_--;
+        engine_available_.notify_one();
+        return nullptr;
+    }
+
+    H5XObfuscationEngine* engine = fresh.get();
+    engines_.push_back(std::move(fresh));
+    {
+        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+        stats_.engines_created++;
+    }
+    return engine;
+}
+
+void ObfuscationServer::release_engine(H5XObfuscationEngine* engine, bool healthy) {
+    std::lock_guard<std::mutex> lock(engine_mutex_);
+    if (healthy) {
+        idle_engines_.push_back(engine);
+    } else {
+        engines_.erase(std::remove_if(engines_.begin(), engines_.end(),
+                                      [engine](const std::unique_ptr<H5XObfuscationEngine>& owned) {
+                                          return owned.get() == engine;
+                                      }),
+                       engines_.end());
+        engine_count_--;
+    }
+    engine_available_.notify_one();
+}
+
+bool ObfuscationServer::send_message(int fd, const Json::Value& message) {
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return write_frame(fd, Json::writeString(builder, message));
+}
+
+} // namespace h5x
@@ -0,0 +1,128 @@
+#ifndef H5X_OBFUSCATION_SERVER_HPP
+#define H5X_OBFUSCATION_SERVER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ObfuscationCache.hpp"
+#include "../utils/ConfigParser.hpp"
+#include "../utils/Logger.hpp"
+
+namespace Json {
+class Value;
+}
+
+namespace h5x {
+
+class H5XObfuscationEngine;
+
+struct ServerOptions {
+    std::string socket_path{"/tmp/h5x.sock"};
+    std::string config_file;
+    ObfuscationConfig config;
+
+    // Warm engines kept alive; 0 plans from max_threads and memory_limit_mb
+    size_t engines{0};
+    size_t engine_memory_mb{512};
+
+    // Optional artifact cache shared by all jobs
+    ObfuscationCache* cache{nullptr};
+    std::string tool_version;
+};
+
+struct ServerStats {
+    uint64_t connections{0};
+    uint64_t jobs_completed{0};
+    uint64_t jobs_failed{0};
+    uint64_t engines_created{0};
+};
+
+// Long-running obfuscation service behind `h5x-cli serve`. Engines are
+// initialised once and reused across jobs, so a request skips process
+// startup, LLVM target registration and config parsing.
+//
+// Clients talk over a Unix domain socket. Every message in either direction
+// is one frame: a 4-byte big-endian length followed by that many bytes of
+// JSON. A connection carries any number of requests, answered in order:
+//
+//   {"id": 7, "type": "obfuscate", "input": "a.cpp", "output": "a_obf", "level": 3}
+//     -> {"id": 7, "type": "progress", "stage": "queued", "progress": 0.0}
+//     -> {"id": 7, "type": "progress", "stage": "obfuscating", "progress": 0.1}
+//     -> {"id": 7, "type": "result", "success": true, "report": {...}}
+//   {"type": "ping"} -> {"type": "pong", ...}
+//   {"type": "status"} -> {"type": "status", "stats": {...}}
+//   {"type": "shutdown"} -> {"type": "bye"}, then the server stops
+//
+// Progress is coarse: one frame when the job is queued and one when an
+// engine starts on it. The engine does not report per-pass progress, so
+// nothing is sent between "obfuscating" and the result.
+//
+// Malformed requests are answered with {"type": "error", "error": "..."}.
+class ObfuscationServer {
+public:
+    ObfuscationServer(Logger& logger, const ServerOptions& options);
+    ~ObfuscationServer();
+
+    ObfuscationServer(const ObfuscationServer&) = delete;
+    ObfuscationServer& operator=(const ObfuscationServer&) = delete;
+
+    // Binds the socket and serves until stop() or a shutdown request.
+    // Returns false if the socket could not be set up.
+    bool run();
+
+    // Safe to call from a signal handler
+    void stop() { running_.store(false, std::memory_order_release); }
+
+    ServerStats get_stats() const;
+
+    // Frames larger than this are rejected and close the connection
+    static constexpr uint32_t kMaxFrameBytes = 16u * 1024 * 1024;
+
+    // Blocking frame I/O on a connected socket; false on EOF or error
+    static bool write_frame(int fd, const std::string& payload);
+    static bool read_frame(int fd, std::string& payload);
+
+private:
+    struct Connection {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+
+    int open_socket();
+    void reap_connections(bool wait_all);
+    void serve_connection(int fd);
+    bool handle_request(int fd, const Json::Value& request);
+    void handle_obfuscate(int fd, const Json::Value& request);
+
+    // Borrows a warm engine, creating one while under the engine limit
+    H5XObfuscationEngine* acquire_engine();
+    void release_engine(H5XObfuscationEngine* engine, bool healthy);
+
+    bool send_message(int fd, const Json::Value& message);
+    bool wait_readable(int fd);
+
+    Logger& logger_;
+    ServerOptions options_;
+    size_t max_engines_{1};
+    std::atomic<bool> running_{false};
+
+    std::mutex engine_mutex_;
+    std::condition_variable engine_available_;
+    std::vector<std::unique_ptr<H5XObfuscationEngine>> engines_;
+    std::vector<H5XObfuscationEngine*> idle_engines_;
+    size_t engine_count_{0};                // Created or being created
+
+    std::vector<Connection> connections_;   // Only touched by the accept loop
+
+    mutable std::mutex stats_mutex_;
+    ServerStats stats_;
+};
+
+} // namespace h5x
+
+#endif // H5X_OBFUSCATION_SERVER_HPP
@@ -1,9 +1,11 @@
 #include "AntiAnalysisPass.hpp"
+#include "FunctionPlanning.hpp"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/Support/raw_ostream.h"
 #include <vector>
@@ -28,8 +30,8 @@ PreservedAnalyses AntiAnalysisPass::run(Module &M, ModuleAnalysisManager &AM) {
 
 bool AntiAnalysisPass::obfuscateFunctionNames(Module &M) {
     bool modified = false;
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    // Renames feed the per-function seeds of later steps, so honour the seed here too
+    std::mt19937 gen(static_cast<std::mt19937::result_type>(resolveBaseSeed(options_.seed)));
     std::uniform_int_distribution<> dis(0, 35);
     
     auto generateRandomName = [&]() -> std::string {
@@ -44,6 +46,7 @@ bool AntiAnalysisPass::obfuscateFunctionNames(Module &M) {
     for (Function &F : M) {
         // Don't rename main, system functions, or externally visible functions
         if (F.getName() == "main" || 
+            !isFunctionSelected(options_, F) ||
             F.getName().starts_with("__") ||
             F.getName().starts_with("llvm.") ||
             F.hasExternalLinkage()) {
@@ -61,24 +64,29 @@ bool AntiAnalysisPass::obfuscateFunctionNames(Module &M) {
 
 bool AntiAnalysisPass::addJunkInstructions(Module &M) {
     bool modified = false;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(0.0, 1.0);
     
-    for (Function &F : M) {
-        if (F.isDeclaration()) continue;
-        
-        std::vector<Instruction*> insertionPoints;
-        for (BasicBlock &BB : F) {
-            for (Instruction &I : BB) {
-                if (!I.isTerminator() && dis(gen) < 0.1) { // 10% chance
-                    insertionPoints.push_back(&I);
+    // Pick insertion points first; nothing is modified while planning
+    auto plans = planFunctions<std::vector<Instruction*>>(M, options_, resolveBaseSeed(options_.seed),
+        [this](Function &F, std::mt19937 &gen, std::vector<Instruction*> &insertionPoints) {
+            std::uniform_real_distribution<> dis(0.0, 1.0);
+            for (BasicBlock &BB : F) {
+                bool blockSelected = isBlockSelected(options_, BB);
+                for (Instruction &I : BB) {
+                    if (!I.isTerminator() && dis(gen) < 0.1 && blockSelected) { // 10% chance
+                        insertionPoints.push_back(&I);
+                    }
                 }
             }
-        }
+            return !insertionPoints.empty();
+        });
+    
+    // Insert junk in module order
+    for (auto &entry : plans) {
+        if (!entry.selected) continue;
         
-        for (Instruction *insertPoint : insertionPoints) {
-            if (addJunkAfterInstruction(*insertPoint)) {
+        std::mt19937 gen = applyRng(entry.seed);
+        for (Instruction *insertPoint : entry.plan) {
+            if (addJunkAfterInstruction(*insertPoint, gen)) {
                 modified = true;
             }
         }
@@ -87,12 +95,12 @@ bool AntiAnalysisPass::addJunkInstructions(Module &M) {
     return modified;
 }
 
-bool AntiAnalysisPass::addJunkAfterInstruction(Instruction &I) {
+bool AntiAnalysisPass::addJunkAfterInstruction(Instruction &I, std::mt19937 &gen) {
     LLVMContext &Ctx = I.getContext();
-    IRBuilder<> Builder(I.getNextNode());
+    // Junk after a PHI would split the block's PHI group
+    Instruction *insertBefore = isa<PHINode>(I) ? &*I.getParent()->getFirstInsertionPt() : I.getNextNode();
+    IRBuilder<> Builder(insertBefore);
     
-    std::random_device rd;
-    std::mt19937 gen(rd());
     std::uniform_int_distribution<> typeDis(0, 3);
     std::uniform_int_distribution<> valueDis(1, 1000);
     
@@ -108,8 +116,9 @@ bool AntiAnalysisPass::addJunkAfterInstruction(Instruction &I) {
         break;
     }
     case 1: {
-        // Add stack allocation and deallocation
-        Value *junkVar = Builder.CreateAlloca(Type::getInt32Ty(Ctx), nullptr, "junk_var");
+        // Add a stack slot (in the entry block, so loops do not grow the stack)
+        IRBuilder<> EntryBuilder(&*I.getFunction()->getEntryBlock().getFirstInsertionPt());
+        Value *junkVar = EntryBuilder.CreateAlloca(Type::getInt32Ty(Ctx), nullptr, "junk_var");
         Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Ctx), valueDis(gen)), junkVar);
         Value *junkLoad = Builder.CreateLoad(Type::getInt32Ty(Ctx), junkVar, "junk_load");
         (void)junkLoad; // Suppress unused variable warning
@@ -138,31 +147,37 @@ bool AntiAnalysisPass::addJunkAfterInstruction(Instruction &I) {
 
 bool AntiAnalysisPass::addFakeJumps(Module &M) {
     bool modified = false;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(0.0, 1.0);
     
-    for (Function &F : M) {
-        if (F.isDeclaration() || F.size() < 2) continue;
-        
-        std::vector<BasicBlock*> blocks;
-        for (BasicBlock &BB : F) {
-            blocks.push_back(&BB);
-        }
-        
-        for (BasicBlock *BB : blocks) {
-            if (dis(gen) < 0.15) { // 15% chance to add fake jump
-                if (addFakeJumpToBlock(*BB)) {
-                    modified = true;
+    // Salted so block choice is independent of the junk-instruction stream
+    uint64_t baseSeed = resolveBaseSeed(options_.seed) ^ 0x6a09e667f3bcc908ULL;
+    auto plans = planFunctions<std::vector<BasicBlock*>>(M, options_, baseSeed,
+        [this](Function &F, std::mt19937 &gen, std::vector<BasicBlock*> &blocks) {
+            if (F.size() < 2) return false;
+            
+            std::uniform_real_distribution<> dis(0.0, 1.0);
+            for (BasicBlock &BB : F) {
+                if (dis(gen) < 0.15 && isBlockSelected(options_, BB)) { // 15% chance to add fake jump
+                    blocks.push_back(&BB);
                 }
             }
+            return !blocks.empty();
+        });
+    
+    for (auto &entry : plans) {
+        if (!entry.selected) continue;
+        
+        std::mt19937 gen = applyRng(entry.seed);
+        for (BasicBlock *BB : entry.plan) {
+            if (addFakeJumpToBlock(*BB, gen)) {
+                modified = true;
+            }
         }
     }
     
     return modified;
 }
 
-bool AntiAnalysisPass::addFakeJumpToBlock(BasicBlock &BB) {
+bool AntiAnalysisPass::addFakeJumpToBlock(BasicBlock &BB, std::mt19937 &gen) {
     // Don't modify blocks with complex terminators
     if (isa<InvokeInst>(BB.getTerminator()) ||
         isa<SwitchInst>(BB.getTerminator()) ||
@@ -181,8 +196,6 @@ bool AntiAnalysisPass::addFakeJumpToBlock(BasicBlock &BB) {
     
     // Create an always-false condition using opaque predicates
     // (x & 1) == 2 is always false since x & 1 can only be 0 or 1
-    std::random_device rd;
-    std::mt19937 gen(rd());
     std::uniform_int_distribution<> valueDis(2, 100);
     
     Value *x = ConstantInt::get(Type::getInt32Ty(Ctx), valueDis(gen));
@@ -204,9 +217,11 @@ bool AntiAnalysisPass::addFakeJumpToBlock(BasicBlock &BB) {
     Builder.CreateAdd(junkLoad, ConstantInt::get(Type::getInt32Ty(Ctx), 1), "fake_add");
     Builder.CreateUnreachable();
     
-    // Move original terminator to real continue block
-    Builder.SetInsertPoint(realContinue);
-    terminator->moveAfter(&realContinue->back());
+    // Move original terminator to real continue block (it starts out empty)
+    terminator->moveBefore(*realContinue, realContinue->end());
+    for (BasicBlock *succ : successors(realContinue)) {
+        succ->replacePhiUsesWith(&BB, realContinue);
+    }
     
     return true;
 }
@@ -3,20 +3,26 @@
 
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Module.h"
+#include "PassOptions.hpp"
+#include <random>
 
 namespace h5x {
 
 class AntiAnalysisPass : public llvm::PassInfoMixin<AntiAnalysisPass> {
 public:
+    explicit AntiAnalysisPass(PassOptions options = PassOptions()) : options_(options) {}
+
     llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
 
 private:
     bool obfuscateFunctionNames(llvm::Module &M);
     bool addJunkInstructions(llvm::Module &M);
-    bool addJunkAfterInstruction(llvm::Instruction &I);
+    bool addJunkAfterInstruction(llvm::Instruction &I, std::mt19937 &gen);
     bool addFakeJumps(llvm::Module &M);
-    bool addFakeJumpToBlock(llvm::BasicBlock &BB);
+    bool addFakeJumpToBlock(llvm::BasicBlock &BB, std::mt19937 &gen);
     bool removeDebugInfo(llvm::Module &M);
+
+    PassOptions options_;
 };
 
 } // namespace h5x
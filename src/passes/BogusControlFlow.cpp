@@ -1,9 +1,11 @@
 #include "BogusControlFlow.hpp"
+#include "FunctionPlanning.hpp"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <vector>
@@ -15,38 +17,44 @@ namespace h5x {
 
 PreservedAnalyses BogusControlFlowPass::run(Module &M, ModuleAnalysisManager &AM) {
     bool modified = false;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(0.0, 1.0);
-    
-    for (Function &F : M) {
-        // Skip external functions, system functions, and small functions
-        if (F.isDeclaration() || 
-            F.getName().starts_with("__") || 
-            F.size() < 2) {
-            continue;
-        }
-        
-        std::vector<BasicBlock*> originalBlocks;
-        for (BasicBlock &BB : F) {
-            originalBlocks.push_back(&BB);
-        }
-        
-        // Add bogus control flow to random blocks
-        for (BasicBlock *BB : originalBlocks) {
-            // 30% chance to add bogus control flow to each block
-            if (dis(gen) < 0.3) {
-                if (addBogusControlFlow(*BB)) {
-                    modified = true;
+    
+    // Select blocks first; nothing is modified while planning
+    auto plans = planFunctions<std::vector<BasicBlock*>>(M, options_, resolveBaseSeed(options_.seed),
+        [this](Function &F, std::mt19937 &gen, std::vector<BasicBlock*> &selectedBlocks) {
+            // Skip external functions, system functions, and small functions
+            if (F.isDeclaration() || 
+                F.getName().starts_with("__") || 
+                F.size() < 2) {
+                return false;
+            }
+            
+            std::uniform_real_distribution<> dis(0.0, 1.0);
+            for (BasicBlock &BB : F) {
+                // 30% chance to add bogus control flow to each block; the
+                // draw comes first so filtering keeps the other choices
+                if (dis(gen) < 0.3 && isBlockSelected(options_, BB)) {
+                    selectedBlocks.push_back(&BB);
                 }
             }
+            return !selectedBlocks.empty();
+        });
+    
+    // Add bogus control flow to the selected blocks in module order
+    for (auto &entry : plans) {
+        if (!entry.selected) continue;
+        
+        std::mt19937 gen = applyRng(entry.seed);
+        for (BasicBlock *BB : entry.plan) {
+            if (addBogusControlFlow(*BB, gen)) {
+                modified = true;
+            }
         }
     }
     
     return modified ? PreservedAnalyses::none() : PreservedAnalyses::all();
 }
 
-bool BogusControlFlowPass::addBogusControlFlow(BasicBlock &BB) {
+bool BogusControlFlowPass::addBogusControlFlow(BasicBlock &BB, std::mt19937 &gen) {
     // Don't modify blocks with PHI nodes or complex terminators
     if (!BB.phis().empty() || 
         isa<InvokeInst>(BB.getTerminator()) ||
@@ -69,12 +77,18 @@ bool BogusControlFlowPass::addBogusControlFlow(BasicBlock &BB) {
     
     if (!insertPoint) return false;
     
+    // The original tail of the block moves to the join block; collect it
+    // before the predicate is inserted in front of it
+    std::vector<Instruction*> instructionsToMove;
+    for (Instruction *I = insertPoint->getNextNode(); I && I != BB.getTerminator(); I = I->getNextNode()) {
+        instructionsToMove.push_back(I);
+    }
+    Instruction *terminator = BB.getTerminator();
+    
     // Create opaque predicates (always true or always false, but hard to analyze)
     IRBuilder<> Builder(insertPoint->getNextNode());
     
     // Create an opaque predicate: (x * (x + 1)) % 2 == 0 (always true for integers)
-    std::random_device rd;
-    std::mt19937 gen(rd());
     std::uniform_int_distribution<> valueDis(1, 100);
     
     Value *x = ConstantInt::get(Type::getInt32Ty(Ctx), valueDis(gen));
@@ -91,9 +105,14 @@ bool BogusControlFlowPass::addBogusControlFlow(BasicBlock &BB) {
     // Create the bogus conditional branch
     Builder.CreateCondBr(isEven, bogusTrue, bogusFalse);
     
+    // Stack slots live in the entry block; an alloca in a loop body grows
+    // the stack on every iteration
+    IRBuilder<> EntryBuilder(&*F->getEntryBlock().getFirstInsertionPt());
+    Value *bogusVar1 = EntryBuilder.CreateAlloca(Type::getInt32Ty(Ctx), nullptr, "bogus_var1");
+    Value *bogusVar2 = EntryBuilder.CreateAlloca(Type::getInt32Ty(Ctx), nullptr, "bogus_var2");
+    
     // Fill bogus true block with meaningless operations
     Builder.SetInsertPoint(bogusTrue);
-    Value *bogusVar1 = Builder.CreateAlloca(Type::getInt32Ty(Ctx), nullptr, "bogus_var1");
     Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Ctx), 42), bogusVar1);
     Value *bogusLoad1 = Builder.CreateLoad(Type::getInt32Ty(Ctx), bogusVar1, "bogus_load1");
     Value *bogusAdd = Builder.CreateAdd(bogusLoad1, ConstantInt::get(Type::getInt32Ty(Ctx), 13), "bogus_add");
@@ -102,7 +121,6 @@ bool BogusControlFlowPass::addBogusControlFlow(BasicBlock &BB) {
     
     // Fill bogus false block with different meaningless operations
     Builder.SetInsertPoint(bogusFalse);
-    Value *bogusVar2 = Builder.CreateAlloca(Type::getInt32Ty(Ctx), nullptr, "bogus_var2");
     Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Ctx), 17), bogusVar2);
     Value *bogusLoad2 = Builder.CreateLoad(Type::getInt32Ty(Ctx), bogusVar2, "bogus_load2");
     Value *bogusMul = Builder.CreateMul(bogusLoad2, ConstantInt::get(Type::getInt32Ty(Ctx), 3), "bogus_mul");
@@ -112,26 +130,18 @@ bool BogusControlFlowPass::addBogusControlFlow(BasicBlock &BB) {
     // Bogus join block - continue with original flow
     Builder.SetInsertPoint(bogusJoin);
     
-    // Move the rest of the original block after our insertion point to the join block
-    std::vector<Instruction*> instructionsToMove;
-    Instruction *startFrom = insertPoint->getNextNode();
-    
-    while (startFrom && startFrom != BB.getTerminator()) {
-        instructionsToMove.push_back(startFrom);
-        startFrom = startFrom->getNextNode();
-    }
-    
-    // Move instructions to bogus join block
+    // Move the rest of the original block to the join block (it starts out empty)
     for (Instruction *I : instructionsToMove) {
-        I->moveAfter(bogusJoin->getTerminator() ? 
-                     bogusJoin->getTerminator()->getPrevNode() : 
-                     &bogusJoin->back());
+        I->moveBefore(*bogusJoin, bogusJoin->end());
     }
     
-    // Move the original terminator to bogus join block
-    if (BB.getTerminator()) {
-        Instruction *terminator = BB.getTerminator();
-        terminator->moveAfter(&bogusJoin->back());
+    // Move the original terminator to bogus join block; successors now
+    // receive control from the join block
+    if (terminator) {
+        terminator->moveBefore(*bogusJoin, bogusJoin->end());
+        for (BasicBlock *succ : successors(bogusJoin)) {
+            succ->replacePhiUsesWith(&BB, bogusJoin);
+        }
     }
     
     // Add branch from bogus join to continue normal execution
@@ -3,15 +3,21 @@
 
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Module.h"
+#include "PassOptions.hpp"
+#include <random>
 
 namespace h5x {
 
 class BogusControlFlowPass : public llvm::PassInfoMixin<BogusControlFlowPass> {
 public:
+    explicit BogusControlFlowPass(PassOptions options = PassOptions()) : options_(options) {}
+
     llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
 
 private:
-    bool addBogusControlFlow(llvm::BasicBlock &BB);
+    bool addBogusControlFlow(llvm::BasicBlock &BB, std::mt19937 &gen);
+
+    PassOptions options_;
 };
 
 } // namespace h5x
@@ -1,192 +1,385 @@
 #include "ControlFlowFlattening.hpp"
+#include "FunctionPlanning.hpp"
+#include "../utils/ConfigParser.hpp"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <map>
 #include <random>
+#include <set>
 
 using namespace llvm;
 
 namespace h5x {
 
+namespace {
+
+// State of the block a branch goes to; a select for conditional branches
+Value *nextState(IRBuilder<> &Builder, BranchInst &branch, std::map<BasicBlock*, int> &blockToState,
+                 IntegerType *stateTy) {
+    Value *next = ConstantInt::get(stateTy, blockToState[branch.getSuccessor(0)]);
+    if (branch.isConditional()) {
+        next = Builder.CreateSelect(branch.getCondition(), next,
+                                    ConstantInt::get(stateTy, blockToState[branch.getSuccessor(1)]), "next_state");
+    }
+    return next;
+}
+
+// Innermost-loop header of a kept block; null for dispatched code
+const BasicBlock *keptHeader(const std::unordered_map<const BasicBlock*, const BasicBlock*> &keptLoops,
+                             const BasicBlock *BB) {
+    auto it = keptLoops.find(BB);
+    return it == keptLoops.end() ? nullptr : it->second;
+}
+
+// Blocks ending in a branch, other than the entry
+std::vector<BasicBlock*> branchingBlocks(Function &F) {
+    std::vector<BasicBlock*> blocks;
+    for (BasicBlock &BB : F) {
+        if (&BB != &F.getEntryBlock() && isa<BranchInst>(BB.getTerminator())) {
+            blocks.push_back(&BB);
+        }
+    }
+    return blocks;
+}
+
+// Emits the hand-off of a next state at the builder's position and returns
+// the dispatcher to jump to. home is the dispatched block the edge leaves
+// from (the loop header for kept blocks), targets the blocks it may reach
+using StateRoute = function_ref<BasicBlock*(IRBuilder<> &Builder, BasicBlock *home, Value *next,
+                                            ArrayRef<BasicBlock*> targets)>;
+
+// Sends the edges of branch that leave kept code through the dispatcher.
+// Edges inside a kept loop stay direct; an exit from one gets a block of its
+// own, so the loop's own edge is untouched
+void dispatchBranch(BranchInst &branch, std::map<BasicBlock*, int> &blockToState, IntegerType *stateTy,
+                    const std::unordered_map<const BasicBlock*, const BasicBlock*> &keptLoops, StateRoute route) {
+    BasicBlock *BB = branch.getParent();
+    const BasicBlock *header = keptHeader(keptLoops, BB);
+    BasicBlock *home = header ? const_cast<BasicBlock*>(header) : BB;
+    
+    SmallVector<unsigned, 2> dispatched;
+    for (unsigned i = 0; i < branch.getNumSuccessors(); ++i) {
+        if (!header || keptHeader(keptLoops, branch.getSuccessor(i)) != header) {
+            dispatched.push_back(i);
+        }
+    }
+    if (dispatched.empty()) {
+        return;
+    }
+    
+    if (dispatched.size() == branch.getNumSuccessors()) {
+        IRBuilder<> Builder(&branch);
+        SmallVector<BasicBlock*, 2> targets(successors(BB));
+        Value *next = nextState(Builder, branch, blockToState, stateTy);
+        Builder.CreateBr(route(Builder, home, next, targets));
+        branch.eraseFromParent();
+        return;
+    }
+    
+    for (unsigned i : dispatched) {
+        BasicBlock *target = branch.getSuccessor(i);
+        BasicBlock *exitBlock = BasicBlock::Create(BB->getContext(), "loop_exit", BB->getParent(), target);
+        IRBuilder<> Builder(exitBlock);
+        Value *next = ConstantInt::get(stateTy, blockToState[target]);
+        Builder.CreateBr(route(Builder, home, next, {target}));
+        branch.setSuccessor(i, exitBlock);
+    }
+}
+
+} // anonymous namespace
+
+FlatteningOptions FlatteningOptions::fromConfig(const ObfuscationConfig &config) {
+    FlatteningOptions flattening;
+    if (config.flattening_dispatcher == "clustered") {
+        flattening.dispatcher = DispatcherLayout::Clustered;
+    }
+    flattening.clusterSize = static_cast<unsigned>(std::max(2, config.flattening_cluster_size));
+    flattening.preserveInnermostLoops = config.flattening_preserve_loops;
+    return flattening;
+}
+
 PreservedAnalyses ControlFlowFlatteningPass::run(Module &M, ModuleAnalysisManager &AM) {
     bool modified = false;
     
-    for (Function &F : M) {
-        // Skip external functions, system functions, and main function
-        if (F.isDeclaration() || 
-            F.getName().starts_with("__") || 
-            F.getName() == "main" ||
-            F.size() < 3) { // Need at least 3 blocks to flatten
-            continue;
+    // Check eligibility before any function is changed
+    struct NoPlan {};
+    auto plans = planFunctions<NoPlan>(M, options_, resolveBaseSeed(options_.seed),
+        [this](Function &F, std::mt19937 &, NoPlan &) { return isEligible(F); });
+    
+    // Flatten the eligible functions in module order
+    for (auto &entry : plans) {
+        if (entry.selected && flattenFunction(*entry.function)) {
+            modified = true;
         }
-        
-        // Skip functions with complex control flow that might break
-        bool hasComplexFlow = false;
+    }
+    
+    return modified ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+bool ControlFlowFlatteningPass::isEligible(Function &F) const {
+    // Skip external functions, system functions, and main function
+    if (F.isDeclaration() || 
+        F.getName().starts_with("__") || 
+        F.getName() == "main" ||
+        F.size() < 3) { // Need at least 3 blocks to flatten
+        return false;
+    }
+    
+    // Only plain branches and returns are rewritten; anything else (invokes,
+    // switches, indirect branches, already flattened code) is left alone
+    for (BasicBlock &BB : F) {
+        Instruction *terminator = BB.getTerminator();
+        if (!terminator || BB.hasAddressTaken() ||
+            !(isa<BranchInst>(terminator) || isa<ReturnInst>(terminator) ||
+              isa<UnreachableInst>(terminator))) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void ControlFlowFlatteningPass::demoteCrossBlockValues(Function &F, const LoopMembership &keptLoops) {
+    // Once every edge goes through the dispatcher, a definition no longer
+    // dominates uses in other blocks; such values move to stack slots. Kept
+    // loops are only entered through their header, so values living inside
+    // one stay in registers, as do PHIs past the header
+    BasicBlock &entryBlock = F.getEntryBlock();
+    
+    // Demoting a PHI leaves a reload that may itself escape, so repeat
+    // until nothing crosses a block boundary
+    while (true) {
+        std::vector<PHINode*> phis;
+        std::vector<Instruction*> escaping;
         for (BasicBlock &BB : F) {
-            if (isa<InvokeInst>(BB.getTerminator()) ||
-                isa<ResumeInst>(BB.getTerminator()) ||
-                isa<CatchReturnInst>(BB.getTerminator())) {
-                hasComplexFlow = true;
-                break;
+            const BasicBlock *header = keptHeader(keptLoops, &BB);
+            for (Instruction &I : BB) {
+                if (auto *phi = dyn_cast<PHINode>(&I)) {
+                    if (!header || header == &BB) {
+                        phis.push_back(phi);
+                    }
+                    continue;
+                }
+                if (&BB == &entryBlock && isa<AllocaInst>(I)) {
+                    continue;
+                }
+                for (User *user : I.users()) {
+                    auto *userInst = cast<Instruction>(user);
+                    bool sameLoop = header && keptHeader(keptLoops, userInst->getParent()) == header;
+                    if (!sameLoop && (userInst->getParent() != &BB || isa<PHINode>(userInst))) {
+                        escaping.push_back(&I);
+                        break;
+                    }
+                }
             }
         }
-        if (hasComplexFlow) continue;
         
-        if (flattenFunction(F)) {
-            modified = true;
+        if (phis.empty() && escaping.empty()) {
+            break;
+        }
+        for (Instruction *I : escaping) {
+            DemoteRegToStack(*I, false, entryBlock.getTerminator());
+        }
+        for (PHINode *phi : phis) {
+            DemotePHIToStack(phi, entryBlock.getTerminator());
         }
     }
-    
-    return modified ? PreservedAnalyses::none() : PreservedAnalyses::all();
 }
 
 bool ControlFlowFlatteningPass::flattenFunction(Function &F) {
     // Don't flatten functions that are too small or have problematic patterns
     if (F.size() < 3) return false;
     
-    std::vector<BasicBlock*> originalBlocks;
-    for (BasicBlock &BB : F) {
-        originalBlocks.push_back(&BB);
+    // The entry block keeps only its static allocas; the rest of it becomes
+    // the first dispatched block
+    BasicBlock *entryBlock = &F.getEntryBlock();
+    BasicBlock::iterator splitPoint = entryBlock->begin();
+    while (isa<AllocaInst>(*splitPoint)) {
+        ++splitPoint;
     }
+    entryBlock->splitBasicBlock(splitPoint, "flat_first");
     
-    // Skip if entry block has PHI nodes (complex to handle)
-    if (!F.getEntryBlock().phis().empty()) {
-        return false;
+    // Innermost loops keep their edges, so only their headers are dispatched
+    LoopMembership keptLoops;
+    if (flattening_.preserveInnermostLoops) {
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        for (Loop *L : LI.getLoopsInPreorder()) {
+            if (!L->isInnermost()) continue;
+            for (BasicBlock *BB : L->blocks()) {
+                keptLoops[BB] = L->getHeader();
+            }
+        }
     }
     
-    // Create dispatcher block and switch variable
-    BasicBlock *entryBlock = &F.getEntryBlock();
+    demoteCrossBlockValues(F, keptLoops);
+    
+    // Every block but the entry and kept loop bodies is dispatched, the
+    // first one first
+    auto isDispatched = [&](BasicBlock *BB) {
+        const BasicBlock *header = keptHeader(keptLoops, BB);
+        return BB != entryBlock && (!header || header == BB);
+    };
+    std::vector<BasicBlock*> originalBlocks;
+    if (flattening_.dispatcher == DispatcherLayout::Clustered) {
+        // Reverse post-order keeps blocks that follow each other together;
+        // unreachable blocks go last
+        std::set<BasicBlock*> visited;
+        for (BasicBlock *BB : ReversePostOrderTraversal<Function*>(&F)) {
+            visited.insert(BB);
+            if (isDispatched(BB)) originalBlocks.push_back(BB);
+        }
+        for (BasicBlock &BB : F) {
+            if (!visited.count(&BB) && isDispatched(&BB)) originalBlocks.push_back(&BB);
+        }
+        buildClusteredDispatcher(F, originalBlocks, keptLoops);
+    } else {
+        for (BasicBlock &BB : F) {
+            if (isDispatched(&BB)) originalBlocks.push_back(&BB);
+        }
+        buildFlatDispatcher(F, originalBlocks, keptLoops);
+    }
+    
+    return true;
+}
+
+void ControlFlowFlatteningPass::buildFlatDispatcher(Function &F, const std::vector<BasicBlock*> &blocks,
+                                                    const LoopMembership &keptLoops) {
     LLVMContext &Ctx = F.getContext();
+    IntegerType *stateTy = Type::getInt32Ty(Ctx);
+    BasicBlock *entryBlock = &F.getEntryBlock();
+    std::vector<BasicBlock*> branching = branchingBlocks(F);
+    
+    // Assign state numbers to each block
+    std::map<BasicBlock*, int> blockToState;
+    int stateCounter = 0;
+    for (BasicBlock *BB : blocks) {
+        blockToState[BB] = stateCounter++;
+    }
     
-    // Create the main dispatcher block
+    // Create switch variable (state machine variable) and enter the dispatcher
     BasicBlock *dispatcherBlock = BasicBlock::Create(Ctx, "dispatcher", &F);
+    IRBuilder<> Builder(entryBlock->getTerminator());
+    AllocaInst *switchVar = Builder.CreateAlloca(stateTy, nullptr, "switch_var");
+    Builder.CreateStore(ConstantInt::get(stateTy, blockToState[blocks.front()]), switchVar);
+    Builder.CreateBr(dispatcherBlock);
+    entryBlock->getTerminator()->eraseFromParent();
     
-    // Create switch variable (state machine variable)
-    IRBuilder<> Builder(entryBlock);
-    Builder.SetInsertPoint(entryBlock->getTerminator());
+    // Unknown states cannot occur
+    BasicBlock *defaultBlock = BasicBlock::Create(Ctx, "dispatch_default", &F);
+    new UnreachableInst(Ctx, defaultBlock);
     
-    AllocaInst *switchVar = Builder.CreateAlloca(
-        Type::getInt32Ty(Ctx), nullptr, "switch_var"
-    );
+    Builder.SetInsertPoint(dispatcherBlock);
+    Value *switchValue = Builder.CreateLoad(stateTy, switchVar, "switch_val");
+    SwitchInst *switchInst = Builder.CreateSwitch(switchValue, defaultBlock, blocks.size());
     
-    // Initialize switch variable to 0 (entry state)
-    Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Ctx), 0), switchVar);
+    // Every branch now stores its successor's state and returns to the
+    // dispatcher; returns and unreachables stay where they are. The switch
+    // carries no branch weights: they would tell a reader which blocks are hot
+    for (BasicBlock *BB : blocks) {
+        switchInst->addCase(ConstantInt::get(stateTy, blockToState[BB]), BB);
+    }
     
-    // Replace entry block terminator with jump to dispatcher
-    Instruction *entryTerm = entryBlock->getTerminator();
-    Builder.SetInsertPoint(entryTerm);
-    Builder.CreateBr(dispatcherBlock);
-    entryTerm->eraseFromParent();
+    auto route = [&](IRBuilder<> &B, BasicBlock *, Value *next, ArrayRef<BasicBlock*>) {
+        B.CreateStore(next, switchVar);
+        return dispatcherBlock;
+    };
+    for (BasicBlock *BB : branching) {
+        dispatchBranch(*cast<BranchInst>(BB->getTerminator()), blockToState, stateTy, keptLoops, route);
+    }
+}
+
+void ControlFlowFlatteningPass::buildClusteredDispatcher(Function &F, const std::vector<BasicBlock*> &blocks,
+                                                         const LoopMembership &keptLoops) {
+    LLVMContext &Ctx = F.getContext();
+    IntegerType *stateTy = Type::getInt32Ty(Ctx);
+    BasicBlock *entryBlock = &F.getEntryBlock();
+    std::vector<BasicBlock*> branching = branchingBlocks(F);
     
-    // Assign state numbers to each block
+    // Clusters are runs of consecutive blocks. With power-of-two clusters the
+    // cluster is the state's high bits and each cluster's cases are dense
+    unsigned shift = Log2_32_Ceil(std::max(flattening_.clusterSize, 2u));
+    size_t clusterSize = size_t(1) << shift;
+    std::vector<std::vector<BasicBlock*>> members;
+    for (size_t i = 0; i < blocks.size(); i += clusterSize) {
+        size_t end = std::min(i + clusterSize, blocks.size());
+        members.emplace_back(blocks.begin() + i, blocks.begin() + end);
+    }
+    size_t clusterCount = members.size();
     std::map<BasicBlock*, int> blockToState;
-    int stateCounter = 1; // 0 is reserved for entry
-    
-    for (BasicBlock *BB : originalBlocks) {
-        if (BB != entryBlock) {
-            blockToState[BB] = stateCounter++;
+    for (size_t c = 0; c < clusterCount; ++c) {
+        for (size_t i = 0; i < members[c].size(); ++i) {
+            blockToState[members[c][i]] = static_cast<int>((c << shift) | i);
         }
     }
+    auto clusterOf = [&](BasicBlock *BB) { return static_cast<size_t>(blockToState[BB]) >> shift; };
     
-    // Create the switch instruction in dispatcher
-    Builder.SetInsertPoint(dispatcherBlock);
-    Value *switchValue = Builder.CreateLoad(Type::getInt32Ty(Ctx), switchVar, "switch_val");
+    // Unknown states cannot occur
+    BasicBlock *defaultBlock = BasicBlock::Create(Ctx, "dispatch_default", &F);
+    new UnreachableInst(Ctx, defaultBlock);
     
-    // Create end block for function exit
-    BasicBlock *endBlock = BasicBlock::Create(Ctx, "end", &F);
+    BasicBlock *dispatcherBlock = BasicBlock::Create(Ctx, "dispatcher", &F, defaultBlock);
+    IRBuilder<> Builder(dispatcherBlock);
+    PHINode *state = Builder.CreatePHI(stateTy, 0, "state");
+    SwitchInst *topSwitch = Builder.CreateSwitch(Builder.CreateLShr(state, shift, "cluster"), defaultBlock,
+                                                 clusterCount);
     
-    SwitchInst *switchInst = Builder.CreateSwitch(switchValue, endBlock, originalBlocks.size());
+    std::vector<BasicBlock*> clusterBlocks;
+    std::vector<PHINode*> clusterStates;
+    std::vector<SwitchInst*> clusterSwitches;
+    for (size_t c = 0; c < clusterCount; ++c) {
+        BasicBlock *clusterBlock = BasicBlock::Create(Ctx, "cluster_dispatcher", &F, defaultBlock);
+        Builder.SetInsertPoint(clusterBlock);
+        PHINode *clusterState = Builder.CreatePHI(stateTy, 0, "cluster_state");
+        clusterState->addIncoming(state, dispatcherBlock);
+        clusterSwitches.push_back(Builder.CreateSwitch(clusterState, defaultBlock, 1u << shift));
+        clusterStates.push_back(clusterState);
+        clusterBlocks.push_back(clusterBlock);
+        topSwitch->addCase(ConstantInt::get(stateTy, c), clusterBlock);
+    }
     
-    // Add case for entry block (state 0)
-    switchInst->addCase(ConstantInt::get(Type::getInt32Ty(Ctx), 0), entryBlock);
+    IRBuilder<> EntryBuilder(entryBlock->getTerminator());
+    EntryBuilder.CreateBr(dispatcherBlock);
+    entryBlock->getTerminator()->eraseFromParent();
+    state->addIncoming(ConstantInt::get(stateTy, blockToState[blocks.front()]), entryBlock);
     
-    // Process each original block
-    for (BasicBlock *BB : originalBlocks) {
-        if (BB == entryBlock) continue;
-        
-        // Add case to switch
-        int state = blockToState[BB];
-        switchInst->addCase(ConstantInt::get(Type::getInt32Ty(Ctx), state), BB);
-        
-        // Modify block terminator to update switch variable and jump to dispatcher
-        Instruction *terminator = BB->getTerminator();
-        Builder.SetInsertPoint(terminator);
-        
-        if (auto *brInst = dyn_cast<BranchInst>(terminator)) {
-            if (brInst->isUnconditional()) {
-                // Unconditional branch: set next state and jump to dispatcher
-                BasicBlock *nextBB = brInst->getSuccessor(0);
-                if (blockToState.find(nextBB) != blockToState.end()) {
-                    int nextState = blockToState[nextBB];
-                    Builder.CreateStore(
-                        ConstantInt::get(Type::getInt32Ty(Ctx), nextState), switchVar
-                    );
-                    Builder.CreateBr(dispatcherBlock);
-                } else {
-                    // Jumping to entry or exit
-                    Builder.CreateBr(nextBB);
-                }
-            } else {
-                // Conditional branch: create conditional update of switch variable
-                Value *condition = brInst->getCondition();
-                BasicBlock *trueBB = brInst->getSuccessor(0);
-                BasicBlock *falseBB = brInst->getSuccessor(1);
-                
-                // Create blocks for true and false cases
-                BasicBlock *trueCase = BasicBlock::Create(Ctx, "true_case", &F);
-                BasicBlock *falseCase = BasicBlock::Create(Ctx, "false_case", &F);
-                
-                Builder.CreateCondBr(condition, trueCase, falseCase);
-                
-                // True case
-                Builder.SetInsertPoint(trueCase);
-                if (blockToState.find(trueBB) != blockToState.end()) {
-                    Builder.CreateStore(
-                        ConstantInt::get(Type::getInt32Ty(Ctx), blockToState[trueBB]), switchVar
-                    );
-                    Builder.CreateBr(dispatcherBlock);
-                } else {
-                    Builder.CreateBr(trueBB);
-                }
-                
-                // False case
-                Builder.SetInsertPoint(falseCase);
-                if (blockToState.find(falseBB) != blockToState.end()) {
-                    Builder.CreateStore(
-                        ConstantInt::get(Type::getInt32Ty(Ctx), blockToState[falseBB]), switchVar
-                    );
-                    Builder.CreateBr(dispatcherBlock);
-                } else {
-                    Builder.CreateBr(falseBB);
-                }
-            }
-        } else if (auto *retInst = dyn_cast<ReturnInst>(terminator)) {
-            // Return instruction: jump to end block
-            Builder.CreateBr(endBlock);
+    // A branch whose successors share its cluster skips the top switch; the
+    // next state is carried in the phis either way. As in the flat layout,
+    // no switch carries branch weights
+    for (size_t c = 0; c < clusterCount; ++c) {
+        for (BasicBlock *BB : members[c]) {
+            clusterSwitches[c]->addCase(ConstantInt::get(stateTy, blockToState[BB]), BB);
         }
-        
-        // Remove original terminator
-        terminator->eraseFromParent();
     }
     
-    // Create end block with return
-    Builder.SetInsertPoint(endBlock);
-    if (F.getReturnType()->isVoidTy()) {
-        Builder.CreateRetVoid();
-    } else {
-        // For non-void functions, we need to handle return values more carefully
-        // For now, return a default value (this is a limitation)
-        Value *defaultRet = Constant::getNullValue(F.getReturnType());
-        Builder.CreateRet(defaultRet);
+    auto route = [&](IRBuilder<> &B, BasicBlock *home, Value *next, ArrayRef<BasicBlock*> targets) {
+        size_t cluster = clusterOf(home);
+        bool local = std::all_of(targets.begin(), targets.end(),
+                                 [&](BasicBlock *target) { return clusterOf(target) == cluster; });
+        if (local) {
+            clusterStates[cluster]->addIncoming(next, B.GetInsertBlock());
+            return clusterBlocks[cluster];
+        }
+        state->addIncoming(next, B.GetInsertBlock());
+        return dispatcherBlock;
+    };
+    for (BasicBlock *BB : branching) {
+        dispatchBranch(*cast<BranchInst>(BB->getTerminator()), blockToState, stateTy, keptLoops, route);
     }
-    
-    return true;
 }
 
-} // namespace h5x
\ No newline at end of file
+} // namespace h5x
@@ -3,15 +3,59 @@
 
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Module.h"
+#include "PassOptions.hpp"
+#include <unordered_map>
+#include <vector>
 
 namespace h5x {
 
+struct ObfuscationConfig;
+
+enum class DispatcherLayout {
+    // One switch over every block; the state lives in a stack slot
+    Flat,
+    // Blocks are grouped into clusters of consecutive blocks in reverse
+    // post-order. A top switch on the state's high bits picks the cluster,
+    // whose own dense switch picks the block; transitions inside a cluster
+    // go straight back to its switch. The state is an SSA value
+    Clustered
+};
+
+struct FlatteningOptions {
+    DispatcherLayout dispatcher{DispatcherLayout::Flat};
+    unsigned clusterSize{16};   // Blocks per cluster, rounded up to a power of two
+    // Innermost loops keep their own edges and only their headers are
+    // dispatched, so they can still be vectorised and unrolled; the code
+    // around them is flattened as usual
+    bool preserveInnermostLoops{false};
+
+    // flattening_dispatcher ("flat" or "clustered"), flattening_cluster_size
+    // and flattening_preserve_loops; an unknown layout falls back to flat
+    static FlatteningOptions fromConfig(const ObfuscationConfig &config);
+};
+
 class ControlFlowFlatteningPass : public llvm::PassInfoMixin<ControlFlowFlatteningPass> {
 public:
+    explicit ControlFlowFlatteningPass(PassOptions options = PassOptions(),
+                                       FlatteningOptions flattening = FlatteningOptions())
+        : options_(options), flattening_(flattening) {}
+
     llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
     
 private:
+    // Blocks of kept loops, mapped to their loop's header
+    using LoopMembership = std::unordered_map<const llvm::BasicBlock*, const llvm::BasicBlock*>;
+
+    bool isEligible(llvm::Function &F) const;
     bool flattenFunction(llvm::Function &F);
+    void demoteCrossBlockValues(llvm::Function &F, const LoopMembership &keptLoops);
+    void buildFlatDispatcher(llvm::Function &F, const std::vector<llvm::BasicBlock*> &blocks,
+                             const LoopMembership &keptLoops);
+    void buildClusteredDispatcher(llvm::Function &F, const std::vector<llvm::BasicBlock*> &blocks,
+                                  const LoopMembership &keptLoops);
+
+    PassOptions options_;
+    FlatteningOptions flattening_;
 };
 
 } // namespace h5x
@@ -0,0 +1,41 @@
+#include "FunctionPlanning.hpp"
+
+using namespace llvm;
+
+namespace h5x {
+
+namespace {
+
+// splitmix64 finaliser; llvm::hash_combine is not stable across builds
+uint64_t mix(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+} // anonymous namespace
+
+uint64_t resolveBaseSeed(uint64_t seed) {
+    if (seed != 0) {
+        return seed;
+    }
+    std::random_device rd;
+    return (static_cast<uint64_t>(rd()) << 32) | rd();
+}
+
+uint64_t deriveFunctionSeed(uint64_t baseSeed, const Function &F, size_t index) {
+    // Named functions keep their seed when unrelated functions are added;
+    // anonymous ones fall back to their position in the module
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    if (F.hasName()) {
+        for (char c : F.getName()) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+        }
+    } else {
+        hash ^= index;
+    }
+    return mix(baseSeed ^ mix(hash));
+}
+
+} // namespace h5x
@@ -0,0 +1,81 @@
+#ifndef H5X_FUNCTION_PLANNING_HPP
+#define H5X_FUNCTION_PLANNING_HPP
+
+#include "PassOptions.hpp"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace h5x {
+
+// Function-by-function pass execution.
+//
+// Passes split their work in two phases: a planning phase that only reads IR
+// (eligibility, block and instruction selection, random choices) and an
+// apply phase that performs the IR mutations, both in module order. Each
+// function draws from its own RNG seeded from the base seed and the function
+// name, so its result does not depend on which other functions the module
+// holds or the filter admits.
+
+template <typename PlanT>
+struct FunctionPlan {
+    llvm::Function *function{nullptr};
+    uint64_t seed{0};
+    bool selected{false};
+    PlanT plan{};
+};
+
+// Resolves PassOptions::seed (0 means "pick one now")
+uint64_t resolveBaseSeed(uint64_t seed);
+
+// Stable per-function seed derived from the base seed and the function name
+uint64_t deriveFunctionSeed(uint64_t baseSeed, const llvm::Function &F, size_t index);
+
+// Whether PassOptions::function_filter admits F
+inline bool isFunctionSelected(const PassOptions &options, const llvm::Function &F) {
+    return !options.function_filter || options.function_filter(F);
+}
+
+// Whether PassOptions::block_filter admits BB
+inline bool isBlockSelected(const PassOptions &options, const llvm::BasicBlock &BB) {
+    return !options.block_filter || options.block_filter(BB);
+}
+
+// Plans every defined function admitted by the filter. The planner must not
+// modify IR; it fills in the plan and returns whether the function should be
+// transformed. Plans are returned in module order, ready for the apply phase.
+template <typename PlanT>
+std::vector<FunctionPlan<PlanT>> planFunctions(
+    llvm::Module &M, const PassOptions &options, uint64_t baseSeed,
+    const std::function<bool(llvm::Function &, std::mt19937 &, PlanT &)> &planner) {
+    std::vector<FunctionPlan<PlanT>> plans;
+    size_t index = 0;
+    for (llvm::Function &F : M) {
+        if (F.isDeclaration()) continue;
+        // Count filtered functions too so seeds do not depend on the filter
+        size_t position = index++;
+        if (!isFunctionSelected(options, F)) continue;
+        FunctionPlan<PlanT> entry;
+        entry.function = &F;
+        entry.seed = deriveFunctionSeed(baseSeed, F, position);
+        plans.push_back(std::move(entry));
+    }
+
+    for (FunctionPlan<PlanT> &entry : plans) {
+        std::mt19937 gen(static_cast<std::mt19937::result_type>(entry.seed));
+        entry.selected = planner(*entry.function, gen, entry.plan);
+    }
+
+    return plans;
+}
+
+// RNG for the apply phase of one function; independent of the planning stream
+inline std::mt19937 applyRng(uint64_t functionSeed) {
+    return std::mt19937(static_cast<std::mt19937::result_type>(functionSeed ^ 0x9e3779b97f4a7c15ULL));
+}
+
+} // namespace h5x
+
+#endif // H5X_FUNCTION_PLANNING_HPP
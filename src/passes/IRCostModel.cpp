@@ -0,0 +1,261 @@
+#include "IRCostModel.hpp"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+using namespace llvm;
+
+namespace h5x {
+
+namespace {
+
+// Cycles lost when a branch goes the way the predictor did not expect
+const double kMispredictPenalty = 15.0;
+
+// Load or store of a promotable stack slot
+const double kRegisterCopyLatency = 0.5;
+
+// History-based predictors also catch most patterns in the less likely
+// direction; this share of those outcomes is still mispredicted
+const double kUnpredictableShare = 0.2;
+
+// Analyses BlockFrequencyInfo needs, built once per function
+struct FrequencyAnalysis {
+    explicit FrequencyAnalysis(Function &F)
+        : dominators(F), loops(dominators), probabilities(F, loops, nullptr, &dominators),
+          frequencies(F, probabilities, loops) {}
+
+    // Executions of BB per call of its function
+    double relativeFrequency(const BasicBlock *BB) const {
+        uint64_t entry = frequencies.getEntryFreq();
+        return entry ? static_cast<double>(frequencies.getBlockFreq(BB).getFrequency()) / entry : 0.0;
+    }
+
+    // Outcomes other than the most likely successor are the candidates for
+    // a mispredict
+    double mispredictRate(const BasicBlock *BB) const {
+        const Instruction *terminator = BB->getTerminator();
+        unsigned successors = terminator ? terminator->getNumSuccessors() : 0;
+        if (successors < 2) return 0.0;
+        double likeliest = 0.0;
+        for (unsigned i = 0; i < successors; ++i) {
+            BranchProbability probability = probabilities.getEdgeProbability(BB, i);
+            likeliest = std::max(likeliest, static_cast<double>(probability.getNumerator()) /
+                                            probability.getDenominator());
+        }
+        return (1.0 - likeliest) * kUnpredictableShare;
+    }
+
+    DominatorTree dominators;
+    LoopInfo loops;
+    BranchProbabilityInfo probabilities;
+    BlockFrequencyInfo frequencies;
+};
+
+// Stack slots that mem2reg will turn back into registers; accesses to them
+// cost about as much as a register copy once the binary is optimised
+std::unordered_set<const Value *> promotableSlots(Function &F) {
+    std::unordered_set<const Value *> slots;
+    for (Instruction &I : F.getEntryBlock()) {
+        if (auto *alloca = dyn_cast<AllocaInst>(&I)) {
+            if (isAllocaPromotable(alloca)) slots.insert(alloca);
+        }
+    }
+    return slots;
+}
+
+const Value *accessedSlot(const Instruction &I) {
+    if (const auto *load = dyn_cast<LoadInst>(&I)) return load->getPointerOperand();
+    if (const auto *store = dyn_cast<StoreInst>(&I)) return store->getPointerOperand();
+    return nullptr;
+}
+
+} // anonymous namespace
+
+double IRCostModel::instructionLatency(const Instruction &I) {
+    if (isa<DbgInfoIntrinsic>(I) || I.isLifetimeStartOrEnd() || isa<AssumeInst>(I)) {
+        return 0.0;
+    }
+    if (const auto *call = dyn_cast<CallBase>(&I)) {
+        if (isa<IntrinsicInst>(call)) return 1.0;
+        // Call, return and argument set-up; the callee is costed separately
+        return 5.0 + call->arg_size();
+    }
+
+    switch (I.getOpcode()) {
+        case Instruction::PHI:
+        case Instruction::Alloca:
+        case Instruction::Unreachable:
+        case Instruction::BitCast:
+        case Instruction::PtrToInt:
+        case Instruction::IntToPtr:
+        case Instruction::AddrSpaceCast:
+            return 0.0;
+        case Instruction::GetElementPtr:
+            return cast<GetElementPtrInst>(I).hasAllConstantIndices() ? 0.0 : 1.0;
+        case Instruction::Br:
+            return cast<BranchInst>(I).isConditional() ? 1.0 : 0.5;
+        case Instruction::Switch:
+        case Instruction::IndirectBr:
+            return 2.0;
+        case Instruction::Load:
+            return 4.0;
+        case Instruction::Store:
+            return 1.0;
+        case Instruction::AtomicRMW:
+        case Instruction::AtomicCmpXchg:
+            return 20.0;
+        case Instruction::Fence:
+            return 30.0;
+        case Instruction::Mul:
+            return 3.0;
+        case Instruction::UDiv:
+        case Instruction::SDiv:
+        case Instruction::URem:
+        case Instruction::SRem:
+            return 25.0;
+        case Instruction::FAdd:
+        case Instruction::FSub:
+        case Instruction::FMul:
+        case Instruction::FPTrunc:
+        case Instruction::FPExt:
+        case Instruction::FPToUI:
+        case Instruction::FPToSI:
+        case Instruction::UIToFP:
+        case Instruction::SIToFP:
+            return 4.0;
+        case Instruction::FCmp:
+            return 3.0;
+        case Instruction::FDiv:
+            return 15.0;
+        case Instruction::FRem:
+            return 30.0;
+        default:
+            return 1.0;
+    }
+}
+
+std::unordered_map<const BasicBlock *, double> IRCostModel::blockFrequencies(Function &F) {
+    std::unordered_map<const BasicBlock *, double> result;
+    if (F.isDeclaration()) return result;
+
+    FrequencyAnalysis analysis(F);
+    for (const BasicBlock &BB : F) {
+        result[&BB] = analysis.relativeFrequency(&BB);
+    }
+    return result;
+}
+
+FunctionCost IRCostModel::analyzeFunction(Function &F) const {
+    return analyze(F, nullptr);
+}
+
+FunctionCost IRCostModel::analyze(Function &F, std::vector<CallSite> *calls) const {
+    FunctionCost cost;
+    if (F.isDeclaration()) return cost;
+
+    FrequencyAnalysis analysis(F);
+    std::unordered_set<const Value *> slots = promotableSlots(F);
+    for (const BasicBlock &BB : F) {
+        double frequency = analysis.relativeFrequency(&BB);
+        double latency = 0.0;
+        for (const Instruction &I : BB) {
+            const Value *slot = accessedSlot(I);
+            latency += slot && slots.count(slot) ? kRegisterCopyLatency : instructionLatency(I);
+            cost.instructions++;
+
+            const auto *call = dyn_cast<CallBase>(&I);
+            const Function *callee = call ? call->getCalledFunction() : nullptr;
+            if (calls && callee && !callee->isDeclaration()) {
+                calls->push_back({callee, frequency});
+            }
+        }
+        latency += kMispredictPenalty * analysis.mispredictRate(&BB);
+
+        cost.staticCost += latency;
+        cost.selfCost += latency * frequency;
+    }
+    cost.inclusiveCost = cost.selfCost;
+    return cost;
+}
+
+ModuleCost IRCostModel::analyzeModule(Module &M) const {
+    ModuleCost result;
+    std::unordered_map<const Function *, std::vector<CallSite>> calls;
+    std::unordered_set<const Function *> called;
+    for (Function &F : M) {
+        if (F.isDeclaration()) continue;
+        std::vector<CallSite> &sites = calls[&F];
+        FunctionCost cost = analyze(F, &sites);
+        result.staticCost += cost.staticCost;
+        result.instructions += cost.instructions;
+        result.functions[&F] = cost;
+        for (const CallSite &site : sites) {
+            if (site.callee != &F) called.insert(site.callee);
+        }
+    }
+
+    // Depth-first over the call graph; a call back into a function still on
+    // the stack adds nothing, since that function's cost is being summed
+    enum class Visit { InProgress, Done };
+    std::unordered_map<const Function *, Visit> visits;
+    std::vector<const Function *> postOrder;
+    std::function<double(const Function *)> inclusive = [&](const Function *F) -> double {
+        auto visit = visits.find(F);
+        FunctionCost &cost = result.functions.find(F)->second;
+        if (visit != visits.end()) {
+            return visit->second == Visit::Done ? cost.inclusiveCost : 0.0;
+        }
+        visits[F] = Visit::InProgress;
+        double total = cost.selfCost;
+        for (const CallSite &site : calls[F]) {
+            total += site.frequency * inclusive(site.callee);
+        }
+        cost.inclusiveCost = total;
+        visits[F] = Visit::Done;
+        postOrder.push_back(F);
+        return total;
+    };
+
+    for (const Function &F : M) {
+        if (F.isDeclaration()) continue;
+        double total = inclusive(&F);
+        FunctionCost &cost = result.functions[&F];
+        if (called.count(&F)) {
+            cost.executions = 0.0;
+            continue;
+        }
+        auto entryCount = F.getEntryCount();
+        cost.executions = entryCount ? static_cast<double>(entryCount->getCount()) : 1.0;
+        result.dynamicCost += total * cost.executions;
+    }
+
+    // Reverse post-order is topological once the edges cut above (callees
+    // that finished no later than their caller) are skipped
+    std::unordered_map<const Function *, size_t> position;
+    for (size_t i = 0; i < postOrder.size(); ++i) {
+        position[postOrder[postOrder.size() - 1 - i]] = i;
+    }
+    for (auto F = postOrder.rbegin(); F != postOrder.rend(); ++F) {
+        double executions = result.functions[*F].executions;
+        for (const CallSite &site : calls[*F]) {
+            if (position[site.callee] <= position[*F]) continue;
+            result.functions[site.callee].executions += executions * site.frequency;
+        }
+    }
+    return result;
+}
+
+double IRCostModel::estimateSlowdown(const ModuleCost &before, const ModuleCost &after) {
+    return before.dynamicCost > 0.0 ? after.dynamicCost / before.dynamicCost : 1.0;
+}
+
+} // namespace h5x
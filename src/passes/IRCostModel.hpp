@@ -0,0 +1,74 @@
+#ifndef H5X_IR_COST_MODEL_HPP
+#define H5X_IR_COST_MODEL_HPP
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace h5x {
+
+// Static estimate of the runtime cost of IR.
+//
+// Every instruction has a latency from a per-opcode table, roughly in cycles
+// of a modern out-of-order core. A block's latency is weighted by its
+// execution frequency relative to the function entry, as computed by
+// BlockFrequencyInfo from BranchProbabilityInfo; branch weights from a
+// profile are honoured, otherwise the static heuristics apply (a loop runs
+// about 32 times per entry). Conditional branches and switches also pay an
+// expected mispredict penalty derived from their edge probabilities, which
+// is what makes a flattening dispatcher expensive.
+//
+// Comparing the cost of a module before and after a pass predicts that
+// pass's slowdown without compiling or running anything.
+
+struct FunctionCost {
+    double selfCost{0.0};        // Expected latency of one call, callees excluded
+    double inclusiveCost{0.0};   // selfCost plus the callees defined in the module
+    double staticCost{0.0};      // Sum of latencies, every block counted once
+    double executions{1.0};      // Expected calls per run of the module (analyzeModule only)
+    size_t instructions{0};
+};
+
+struct ModuleCost {
+    double dynamicCost{0.0};     // Inclusive cost of the entry points, weighted by entry count
+    double staticCost{0.0};
+    size_t instructions{0};
+    std::unordered_map<const llvm::Function *, FunctionCost> functions;
+};
+
+class IRCostModel {
+public:
+    // Latency of one execution of I, mispredicts excluded
+    static double instructionLatency(const llvm::Instruction &I);
+
+    // Execution frequency of every block per call, relative to the entry (1.0)
+    static std::unordered_map<const llvm::BasicBlock *, double> blockFrequencies(llvm::Function &F);
+
+    // Cost of one call to F, which must be a definition; inclusiveCost equals
+    // selfCost since callees are only resolved at module level
+    FunctionCost analyzeFunction(llvm::Function &F) const;
+
+    // Costs every defined function. Calls to functions defined in M add the
+    // callee's inclusive cost at the call site's frequency (recursion is cut
+    // at the back edge). Functions without callers in M are the entry points;
+    // executions propagates their entry counts down the same call edges
+    ModuleCost analyzeModule(llvm::Module &M) const;
+
+    // after / before in dynamic cost; 1.0 means no predicted slowdown
+    static double estimateSlowdown(const ModuleCost &before, const ModuleCost &after);
+
+private:
+    struct CallSite {
+        const llvm::Function *callee;
+        double frequency;
+    };
+
+    FunctionCost analyze(llvm::Function &F, std::vector<CallSite> *calls) const;
+};
+
+} // namespace h5x
+
+#endif // H5X_IR_COST_MODEL_HPP
@@ -1,4 +1,5 @@
 #include "InstructionSubstitution.hpp"
+#include "FunctionPlanning.hpp"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Function.h"
@@ -13,30 +14,34 @@ namespace h5x {
 
 PreservedAnalyses InstructionSubstitutionPass::run(Module &M, ModuleAnalysisManager &AM) {
     bool modified = false;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, 3);
     
-    for (Function &F : M) {
-        if (F.isDeclaration() || F.getName().starts_with("__")) {
-            continue; // Skip external and system functions
-        }
-        
-        std::vector<Instruction*> toReplace;
-        
-        // Collect instructions to replace
-        for (BasicBlock &BB : F) {
-            for (Instruction &I : BB) {
-                if (auto *BO = dyn_cast<BinaryOperator>(&I)) {
-                    // Only substitute certain operations to avoid breaking the program
-                    if (BO->getOpcode() == Instruction::Add ||
-                        BO->getOpcode() == Instruction::Sub ||
-                        BO->getOpcode() == Instruction::Mul) {
-                        toReplace.push_back(&I);
+    // Collect instructions to replace first; nothing is modified while planning
+    auto plans = planFunctions<std::vector<Instruction*>>(M, options_, resolveBaseSeed(options_.seed),
+        [this](Function &F, std::mt19937 &, std::vector<Instruction*> &toReplace) {
+            if (F.isDeclaration() || F.getName().starts_with("__")) {
+                return false; // Skip external and system functions
+            }
+            
+            for (BasicBlock &BB : F) {
+                if (!isBlockSelected(options_, BB)) continue;
+                for (Instruction &I : BB) {
+                    if (auto *BO = dyn_cast<BinaryOperator>(&I)) {
+                        // Only substitute certain operations to avoid breaking the program
+                        if (BO->getOpcode() == Instruction::Add ||
+                            BO->getOpcode() == Instruction::Sub ||
+                            BO->getOpcode() == Instruction::Mul) {
+                            toReplace.push_back(&I);
+                        }
                     }
                 }
             }
-        }
+            return !toReplace.empty();
+        });
+    
+    // Rewrite in module order
+    for (auto &entry : plans) {
+        if (!entry.selected) continue;
+        std::vector<Instruction*> &toReplace = entry.plan;
         
         // Apply substitutions
         IRBuilder<> Builder(M.getContext());
@@ -3,12 +3,18 @@
 
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Module.h"
+#include "PassOptions.hpp"
 
 namespace h5x {
 
 class InstructionSubstitutionPass : public llvm::PassInfoMixin<InstructionSubstitutionPass> {
 public:
+    explicit InstructionSubstitutionPass(PassOptions options = PassOptions()) : options_(options) {}
+
     llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+
+private:
+    PassOptions options_;
 };
 
 } // namespace h5x
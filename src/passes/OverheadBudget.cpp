@@ -0,0 +1,239 @@
+#include "OverheadBudget.hpp"
+#include "FunctionPlanning.hpp"
+#include "../utils/ConfigParser.hpp"
+#include "llvm/IR/CFG.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include <algorithm>
+#include <unordered_set>
+
+using namespace llvm;
+
+namespace h5x {
+
+namespace {
+
+// Trials before a pass that still does not fit is skipped
+const size_t kMaxTrials = 4;
+
+size_t cyclomaticComplexity(const Function &F) {
+    size_t edges = 0;
+    size_t blocks = 0;
+    for (const BasicBlock &BB : F) {
+        ++blocks;
+        edges += succ_size(&BB);
+    }
+    return edges + 2 > blocks ? edges + 2 - blocks : 1;
+}
+
+bool exceeds(double value, double limit) {
+    return limit > 0.0 && value > limit;
+}
+
+} // anonymous namespace
+
+BudgetLimits BudgetLimits::fromConfig(const ObfuscationConfig &config) {
+    BudgetLimits limits;
+    if (config.performance_weight > 0.0) {
+        double overhead = std::max(0.0, config.security_weight) / config.performance_weight;
+        limits.moduleSlowdown = 1.0 + overhead;
+        limits.functionSlowdown = 1.0 + 2.0 * overhead;
+    }
+    limits.codeGrowth = std::max(0.0, config.max_code_growth);
+    limits.functionComplexity = static_cast<size_t>(std::max(0, config.max_complexity_threshold));
+    return limits;
+}
+
+OverheadBudget::OverheadBudget(Module &M, const BudgetLimits &limits) : module_(M), limits_(limits) {
+    ModuleCost cost = model_.analyzeModule(M);
+    baseDynamicCost_ = cost.dynamicCost;
+    baseInstructions_ = cost.instructions;
+    for (const auto &entry : cost.functions) {
+        FunctionBaseline &baseline = baselines_[entry.first];
+        baseline.selfCost = entry.second.selfCost;
+        baseline.instructions = entry.second.instructions;
+        baseline.complexity = cyclomaticComplexity(*entry.first);
+    }
+    current_ = std::move(cost.functions);
+}
+
+OverheadBudget::Usage OverheadBudget::measure(Module &M) const {
+    ModuleCost cost = model_.analyzeModule(M);
+    Usage usage;
+    usage.moduleSlowdown = baseDynamicCost_ > 0.0 ? cost.dynamicCost / baseDynamicCost_ : 1.0;
+    usage.codeGrowth = baseInstructions_ ? static_cast<double>(cost.instructions) / baseInstructions_ : 1.0;
+    usage.functions = std::move(cost.functions);
+    return usage;
+}
+
+bool OverheadBudget::withinFunctionLimits(const FunctionBaseline &baseline, const FunctionCost &cost,
+                                          const Function &F) const {
+    if (baseline.selfCost > 0.0 && exceeds(cost.selfCost / baseline.selfCost, limits_.functionSlowdown)) {
+        return false;
+    }
+    if (baseline.instructions &&
+        exceeds(static_cast<double>(cost.instructions) / baseline.instructions, limits_.codeGrowth)) {
+        return false;
+    }
+    size_t complexityLimit = std::max(limits_.functionComplexity, baseline.complexity);
+    return !limits_.functionComplexity || cyclomaticComplexity(F) <= complexityLimit;
+}
+
+bool OverheadBudget::exhausted(const Function &F) const {
+    auto baseline = baselines_.find(&F);
+    auto cost = current_.find(&F);
+    if (baseline == baselines_.end() || cost == current_.end()) return false;
+    // Used up when the function sits at a limit, since no pass makes code cheaper
+    const FunctionBaseline &base = baseline->second;
+    if (base.selfCost > 0.0 && limits_.functionSlowdown > 0.0 &&
+        cost->second.selfCost >= limits_.functionSlowdown * base.selfCost) {
+        return true;
+    }
+    if (base.instructions && limits_.codeGrowth > 0.0 &&
+        cost->second.instructions >= limits_.codeGrowth * base.instructions) {
+        return true;
+    }
+    return limits_.functionComplexity &&
+           cyclomaticComplexity(F) >= std::max(limits_.functionComplexity, base.complexity);
+}
+
+double OverheadBudget::getFunctionSlowdown(const Function &F) const {
+    auto baseline = baselines_.find(&F);
+    auto cost = current_.find(&F);
+    if (baseline == baselines_.end() || cost == current_.end() || baseline->second.selfCost <= 0.0) return 1.0;
+    return cost->second.selfCost / baseline->second.selfCost;
+}
+
+const PassBudgetOutcome &OverheadBudget::run(const std::string &pass, const PassOptions &options,
+                                             const PassRunner &runner) {
+    PassBudgetOutcome outcome;
+    outcome.pass = pass;
+
+    PassOptions resolved = options;
+    resolved.seed = resolveBaseSeed(options.seed);
+
+    std::unordered_set<const Function *> excluded;
+    for (Function &F : module_) {
+        if (!F.isDeclaration() && exhausted(F)) excluded.insert(&F);
+    }
+    auto admitted = [&]() {
+        std::vector<Function *> functions;
+        for (Function &F : module_) {
+            if (!F.isDeclaration() && !excluded.count(&F) && isFunctionSelected(options, F)) {
+                functions.push_back(&F);
+            }
+        }
+        return functions;
+    };
+    auto rollBack = [&](const Function *F) {
+        excluded.insert(F);
+        outcome.rolledBack.push_back(F->getName().str());
+    };
+
+    bool fits = false;
+    while (outcome.trials < kMaxTrials) {
+        std::vector<Function *> candidates = admitted();
+        if (candidates.empty()) {
+            fits = true;
+            break;
+        }
+
+        ValueToValueMapTy vmap;
+        std::unique_ptr<Module> trial = CloneModule(module_, vmap);
+        ++outcome.trials;
+
+        // The caller's filters are keyed on the real module's IR
+        std::unordered_map<const Function *, const Function *> functionOrigin;
+        std::unordered_map<const BasicBlock *, const BasicBlock *> blockOrigin;
+        for (Function &F : module_) {
+            if (F.isDeclaration()) continue;
+            functionOrigin[cast<Function>(vmap[&F])] = &F;
+            for (BasicBlock &BB : F) {
+                blockOrigin[cast<BasicBlock>(vmap[&BB])] = &BB;
+            }
+        }
+        PassOptions trialOptions = resolved;
+        trialOptions.function_filter = [&](const Function &F) {
+            auto origin = functionOrigin.find(&F);
+            return origin != functionOrigin.end() && !excluded.count(origin->second) &&
+                   isFunctionSelected(options, *origin->second);
+        };
+        // Planners only ask about blocks that existed before the pass
+        trialOptions.block_filter = [&](const BasicBlock &BB) {
+            if (!options.block_filter) return true;
+            auto origin = blockOrigin.find(&BB);
+            return origin != blockOrigin.end() && options.block_filter(*origin->second);
+        };
+        runner(*trial, trialOptions);
+        Usage usage = measure(*trial);
+
+        std::vector<const Function *> overLimit;
+        for (Function *F : candidates) {
+            auto baseline = baselines_.find(F);
+            if (baseline == baselines_.end()) continue;
+            auto *transformed = cast<Function>(vmap[F]);
+            if (!withinFunctionLimits(baseline->second, usage.functions[transformed], *transformed)) {
+                overLimit.push_back(F);
+            }
+        }
+        if (!overLimit.empty()) {
+            for (const Function *F : overLimit) rollBack(F);
+            continue;
+        }
+
+        bool slow = exceeds(usage.moduleSlowdown, limits_.moduleSlowdown);
+        bool large = exceeds(usage.codeGrowth, limits_.codeGrowth);
+        if (!slow && !large) {
+            fits = true;
+            break;
+        }
+
+        // Undo the functions adding the most until the excess is covered;
+        // the next trial checks the estimate
+        double excess = slow ? (usage.moduleSlowdown - limits_.moduleSlowdown) * baseDynamicCost_
+                             : (usage.codeGrowth - limits_.codeGrowth) * baseInstructions_;
+        std::vector<std::pair<double, Function *>> added;
+        for (Function *F : candidates) {
+            const FunctionCost &after = usage.functions[cast<Function>(vmap[F])];
+            const FunctionCost &before = current_[F];
+            double delta = slow ? after.executions * after.selfCost - before.executions * before.selfCost
+                                : static_cast<double>(after.instructions) - static_cast<double>(before.instructions);
+            if (delta > 0.0) added.emplace_back(delta, F);
+        }
+        std::stable_sort(added.begin(), added.end(), [](const auto &a, const auto &b) {
+            return a.first > b.first;
+        });
+        if (added.empty()) break;
+        for (const auto &entry : added) {
+            if (excess <= 0.0) break;
+            rollBack(entry.second);
+            excess -= entry.first;
+        }
+    }
+
+    if (!fits) {
+        for (Function *F : admitted()) rollBack(F);
+    }
+
+    std::vector<Function *> survivors = admitted();
+    outcome.functionsAdmitted = survivors.size();
+    if (!survivors.empty()) {
+        PassOptions finalOptions = resolved;
+        finalOptions.function_filter = [&](const Function &F) {
+            return !excluded.count(&F) && isFunctionSelected(options, F);
+        };
+        runner(module_, finalOptions);
+
+        Usage usage = measure(module_);
+        moduleSlowdown_ = usage.moduleSlowdown;
+        codeGrowth_ = usage.codeGrowth;
+        current_ = std::move(usage.functions);
+    }
+    outcome.moduleSlowdown = moduleSlowdown_;
+    outcome.codeGrowth = codeGrowth_;
+
+    outcomes_.push_back(std::move(outcome));
+    return outcomes_.back();
+}
+
+} // namespace h5x
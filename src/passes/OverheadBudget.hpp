@@ -0,0 +1,101 @@
+#ifndef H5X_OVERHEAD_BUDGET_HPP
+#define H5X_OVERHEAD_BUDGET_HPP
+
+#include "IRCostModel.hpp"
+#include "PassOptions.hpp"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace h5x {
+
+struct ObfuscationConfig;
+
+// Runtime and code-size budget across a pass pipeline.
+//
+// Costs are IRCostModel estimates relative to the module as it was when the
+// budget was created, so every pass draws from the same allowance. A pass
+// first runs on a copy of the module; functions whose own cost, size or
+// complexity it pushes over the per-function limits are rolled back by
+// excluding them, and if the module as a whole is over its limits the
+// functions adding the most are excluded next. Once a trial fits, the pass
+// runs on the real module with the same seed and the surviving functions,
+// which reproduces the accepted trial exactly.
+
+struct BudgetLimits {
+    double moduleSlowdown{0.0};     // Max dynamic cost over the original module; 0 = unlimited
+    double functionSlowdown{0.0};   // Max cost of one call of a function, callees excluded
+    double codeGrowth{0.0};         // Max instruction-count growth, per function and for the module
+    size_t functionComplexity{0};   // Max cyclomatic complexity, unless the original was higher
+
+    // security_weight / performance_weight is the overhead the module may
+    // gain (0.7 / 0.3 allows 3.33x); one function may take twice that.
+    // max_complexity_threshold caps complexity and max_code_growth size
+    static BudgetLimits fromConfig(const ObfuscationConfig &config);
+};
+
+struct PassBudgetOutcome {
+    std::string pass;
+    size_t trials{0};                       // Runs on a copy of the module
+    size_t functionsAdmitted{0};
+    std::vector<std::string> rolledBack;    // Functions the pass was undone for
+    double moduleSlowdown{1.0};             // After the pass, over the original module
+    double codeGrowth{1.0};
+};
+
+class OverheadBudget {
+public:
+    using PassRunner = std::function<void(llvm::Module &, const PassOptions &)>;
+
+    // Records the baseline costs of M; M must outlive the budget
+    OverheadBudget(llvm::Module &M, const BudgetLimits &limits);
+
+    // Runs runner (which must construct and run one pass with the options it
+    // is given) within the remaining budget. options.function_filter and
+    // block_filter still apply; seed 0 is resolved once so trial and final
+    // run agree
+    const PassBudgetOutcome &run(const std::string &pass, const PassOptions &options, const PassRunner &runner);
+
+    double getModuleSlowdown() const { return moduleSlowdown_; }
+    double getCodeGrowth() const { return codeGrowth_; }
+    // Cost of one call of F over its original; 1.0 for functions added since
+    double getFunctionSlowdown(const llvm::Function &F) const;
+    const std::vector<PassBudgetOutcome> &getOutcomes() const { return outcomes_; }
+
+private:
+    struct FunctionBaseline {
+        double selfCost{0.0};
+        size_t instructions{0};
+        size_t complexity{0};
+    };
+
+    struct Usage {
+        double moduleSlowdown{1.0};
+        double codeGrowth{1.0};
+        std::unordered_map<const llvm::Function *, FunctionCost> functions;
+    };
+
+    Usage measure(llvm::Module &M) const;
+    bool withinFunctionLimits(const FunctionBaseline &baseline, const FunctionCost &cost,
+                              const llvm::Function &F) const;
+    bool exhausted(const llvm::Function &F) const;
+
+    llvm::Module &module_;
+    BudgetLimits limits_;
+    IRCostModel model_;
+    double baseDynamicCost_{0.0};
+    size_t baseInstructions_{0};
+    std::unordered_map<const llvm::Function *, FunctionBaseline> baselines_;
+    std::unordered_map<const llvm::Function *, FunctionCost> current_;
+    double moduleSlowdown_{1.0};
+    double codeGrowth_{1.0};
+    std::vector<PassBudgetOutcome> outcomes_;
+};
+
+} // namespace h5x
+
+#endif // H5X_OVERHEAD_BUDGET_HPP
@@ -0,0 +1,31 @@
+#ifndef H5X_PASS_OPTIONS_HPP
+#define H5X_PASS_OPTIONS_HPP
+
+#include <cstdint>
+#include <functional>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+}
+
+namespace h5x {
+
+// Knobs shared by the function-level obfuscation passes
+struct PassOptions {
+    // Base seed for the per-function RNGs; 0 draws a fresh seed on every run
+    uint64_t seed{0};
+
+    // Restricts transformations to functions for which this returns true;
+    // empty means every function. Used by incremental re-obfuscation.
+    std::function<bool(const llvm::Function &)> function_filter;
+
+    // Restricts block-level transformations (bogus flow, substitution, junk
+    // code) to blocks for which this returns true; empty means every block.
+    // Used to keep profiled hot paths fast.
+    std::function<bool(const llvm::BasicBlock &)> block_filter;
+};
+
+} // namespace h5x
+
+#endif // H5X_PASS_OPTIONS_HPP
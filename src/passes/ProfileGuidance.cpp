@@ -0,0 +1,276 @@
+#include "ProfileGuidance.hpp"
+#include "IRCostModel.hpp"
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/SampleProfile.h"
+#include "llvm/Transforms/Instrumentation/PGOInstrumentation.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace llvm;
+
+namespace h5x {
+
+namespace {
+
+// The default handler exits the process on errors; keep the first one
+// instead so a bad profile is reported like any other failure
+struct ProfileDiagnostics : public DiagnosticHandler {
+    explicit ProfileDiagnostics(std::string &firstError) : error(firstError) {}
+
+    bool handleDiagnostics(const DiagnosticInfo &info) override {
+        if (info.getSeverity() == DS_Error && error.empty()) {
+            raw_string_ostream os(error);
+            DiagnosticPrinterRawOStream printer(os);
+            info.print(printer);
+            os.flush();
+        }
+        return true;
+    }
+
+    std::string &error;
+};
+
+struct FunctionProfile {
+    Function *function{nullptr};
+    double runtime{0.0};                 // Count-weighted latency of all blocks
+    double coldRuntime{0.0};             // Of the blocks outside the hot share
+    std::vector<const BasicBlock *> coldBlocks;
+};
+
+} // anonymous namespace
+
+const char *tierName(ObfuscationTier tier) {
+    switch (tier) {
+        case ObfuscationTier::Full: return "full";
+        case ObfuscationTier::Thinned: return "thinned";
+        case ObfuscationTier::Skipped: return "skipped";
+    }
+    return "full";
+}
+
+double ProfileGuidance::expectedOverhead(GuidedPass pass) {
+    // Measured with h5x_bench_runtime on loop-heavy demos at -O2
+    switch (pass) {
+        case GuidedPass::ControlFlowFlattening: return 2.5;
+        case GuidedPass::InstructionSubstitution: return 1.5;
+        case GuidedPass::BogusControlFlow: return 0.5;
+        case GuidedPass::AntiAnalysis: return 0.1;
+        case GuidedPass::StringObfuscation: return 0.0;   // Paid at string uses, not per block
+    }
+    return 0.0;
+}
+
+bool ProfileGuidance::loadProfile(Module &M, const std::string &path, std::string &error) {
+    auto buffer = MemoryBuffer::getFile(path);
+    if (!buffer) {
+        error = "Cannot read profile " + path + ": " + buffer.getError().message();
+        return false;
+    }
+
+    // The sample loader only reads functions that opt in, as clang's
+    // -fprofile-sample-use would have marked them
+    bool instrumented = IndexedInstrProfReader::hasFormat(**buffer);
+    if (!instrumented) {
+        for (Function &F : M) {
+            if (!F.isDeclaration()) F.addFnAttr("use-sample-profile");
+        }
+    }
+
+    LLVMContext &context = M.getContext();
+    std::string diagnostic;
+    std::unique_ptr<DiagnosticHandler> previousHandler = context.getDiagnosticHandler();
+    context.setDiagnosticHandler(std::make_unique<ProfileDiagnostics>(diagnostic));
+
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    PassBuilder PB;
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    ModulePassManager MPM;
+    if (instrumented) {
+        MPM.addPass(PGOInstrumentationUse(path));
+    } else {
+        MPM.addPass(SampleProfileLoaderPass(path));
+    }
+    MPM.run(M, MAM);
+
+    context.setDiagnosticHandler(std::move(previousHandler));
+
+    if (!diagnostic.empty()) {
+        error = "Cannot apply profile " + path + ": " + diagnostic;
+        return false;
+    }
+    bool annotated = std::any_of(M.begin(), M.end(), [](const Function &F) {
+        return !F.isDeclaration() && F.getEntryCount();
+    });
+    if (!annotated) {
+        error = "Profile " + path + " has no counts for this module; it must come from a build of the same IR";
+        return false;
+    }
+    return true;
+}
+
+const GuidanceReport &ProfileGuidance::plan(Module &M, const std::vector<GuidedPass> &passes,
+                                            double overheadBudget, double hotBlockShare) {
+    auto plan = std::make_shared<Plan>();
+    report_ = GuidanceReport();
+    report_.overheadBudget = overheadBudget;
+
+    // Flattening is all-or-nothing per function; the rest work block by block
+    double functionFactor = 0.0;
+    double blockFactor = 0.0;
+    for (GuidedPass pass : passes) {
+        (pass == GuidedPass::ControlFlowFlattening ? functionFactor : blockFactor) += expectedOverhead(pass);
+    }
+
+    std::vector<FunctionProfile> profiles;
+    double totalRuntime = 0.0;
+    for (Function &F : M) {
+        auto entryCount = F.getEntryCount();
+        if (F.isDeclaration() || !entryCount || entryCount->getCount() == 0) continue;
+
+        auto frequencies = IRCostModel::blockFrequencies(F);
+        std::vector<std::pair<const BasicBlock *, double>> blocks;
+        FunctionProfile profile;
+        profile.function = &F;
+        for (const BasicBlock &BB : F) {
+            double latency = 0.0;
+            for (const Instruction &I : BB) {
+                latency += IRCostModel::instructionLatency(I);
+            }
+            double runtime = static_cast<double>(entryCount->getCount()) * frequencies[&BB] * latency;
+            blocks.emplace_back(&BB, runtime);
+            profile.runtime += runtime;
+        }
+
+        // The hottest blocks covering hotBlockShare of the runtime are hot;
+        // ties keep block order so the plan is deterministic
+        std::stable_sort(blocks.begin(), blocks.end(), [](const auto &a, const auto &b) {
+            return a.second > b.second;
+        });
+        double covered = 0.0;
+        for (const auto &block : blocks) {
+            if (covered < hotBlockShare * profile.runtime) {
+                covered += block.second;
+                continue;
+            }
+            profile.coldBlocks.push_back(block.first);
+            profile.coldRuntime += block.second;
+        }
+
+        totalRuntime += profile.runtime;
+        profiles.push_back(std::move(profile));
+    }
+
+    if (totalRuntime <= 0.0) {
+        plan_ = plan;
+        return report_;
+    }
+    report_.profiled = true;
+
+    auto overhead = [&](const FunctionProfile &profile, ObfuscationTier tier) {
+        switch (tier) {
+            case ObfuscationTier::Full:
+                return profile.runtime / totalRuntime * (functionFactor + blockFactor);
+            case ObfuscationTier::Thinned:
+                return profile.coldRuntime / totalRuntime * blockFactor;
+            case ObfuscationTier::Skipped:
+                return 0.0;
+        }
+        return 0.0;
+    };
+
+    std::vector<ObfuscationTier> tiers(profiles.size(), ObfuscationTier::Full);
+    double projected = 0.0;
+    for (const auto &profile : profiles) {
+        projected += overhead(profile, ObfuscationTier::Full);
+    }
+    report_.unguidedOverhead = projected;
+
+    // Hottest first: thin until within budget, then skip if still over
+    std::vector<size_t> order(profiles.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&profiles](size_t a, size_t b) {
+        return profiles[a].runtime > profiles[b].runtime;
+    });
+    for (ObfuscationTier tier : {ObfuscationTier::Thinned, ObfuscationTier::Skipped}) {
+        for (size_t index : order) {
+            if (projected <= overheadBudget) break;
+            projected -= overhead(profiles[index], tiers[index]) - overhead(profiles[index], tier);
+            tiers[index] = tier;
+        }
+    }
+    report_.projectedOverhead = std::max(0.0, projected);
+
+    for (size_t index : order) {
+        const FunctionProfile &profile = profiles[index];
+        if (tiers[index] == ObfuscationTier::Full) continue;
+
+        plan->tiers[profile.function] = tiers[index];
+        if (tiers[index] == ObfuscationTier::Thinned) {
+            plan->coldBlocks.insert(profile.coldBlocks.begin(), profile.coldBlocks.end());
+        }
+
+        FunctionDowngrade downgrade;
+        downgrade.function = profile.function->getName().str();
+        downgrade.tier = tiers[index];
+        downgrade.runtimeShare = profile.runtime / totalRuntime;
+        downgrade.avoidedOverhead = overhead(profile, ObfuscationTier::Full) - overhead(profile, tiers[index]);
+        report_.downgrades.push_back(downgrade);
+    }
+
+    plan_ = plan;
+    return report_;
+}
+
+ObfuscationTier ProfileGuidance::getTier(const Function &F) const {
+    auto tier = plan_->tiers.find(&F);
+    return tier == plan_->tiers.end() ? ObfuscationTier::Full : tier->second;
+}
+
+PassOptions ProfileGuidance::optionsFor(GuidedPass pass, const PassOptions &base) const {
+    PassOptions options = base;
+    std::shared_ptr<const Plan> plan = plan_;
+    auto tierOf = [plan](const Function &F) {
+        auto tier = plan->tiers.find(&F);
+        return tier == plan->tiers.end() ? ObfuscationTier::Full : tier->second;
+    };
+
+    // Thinned functions are not flattened; skipped ones are left alone by all
+    bool flattening = pass == GuidedPass::ControlFlowFlattening;
+    options.function_filter = [tierOf, flattening, baseFilter = base.function_filter](const Function &F) {
+        if (baseFilter && !baseFilter(F)) return false;
+        ObfuscationTier tier = tierOf(F);
+        return tier == ObfuscationTier::Full || (tier == ObfuscationTier::Thinned && !flattening);
+    };
+
+    // Blocks created after planning (splits) are not known to be cold, so
+    // thinned functions only admit the blocks the plan listed
+    options.block_filter = [plan, tierOf, baseFilter = base.block_filter](const BasicBlock &BB) {
+        if (baseFilter && !baseFilter(BB)) return false;
+        switch (tierOf(*BB.getParent())) {
+            case ObfuscationTier::Full: return true;
+            case ObfuscationTier::Thinned: return plan->coldBlocks.count(&BB) != 0;
+            case ObfuscationTier::Skipped: return false;
+        }
+        return true;
+    };
+    return options;
+}
+
+} // namespace h5x
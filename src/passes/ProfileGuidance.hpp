@@ -0,0 +1,98 @@
+#ifndef H5X_PROFILE_GUIDANCE_HPP
+#define H5X_PROFILE_GUIDANCE_HPP
+
+#include "PassOptions.hpp"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace h5x {
+
+// Profile-guided obfuscation.
+//
+// With execution counts on the module (from an instrumentation or sample
+// profile, or IR already built with -fprofile-use), every function's share of
+// the profiled runtime is known. Obfuscating a function multiplies the cost
+// of its blocks by roughly the factor each pass is known to add, so the
+// projected slowdown of the whole program follows from the shares. While the
+// projection is over the overhead budget, the hottest functions are
+// downgraded: first thinned (not flattened, and the blocks carrying most of
+// their runtime are left alone by block-level passes), then skipped entirely.
+// Functions without counts are never downgraded.
+
+enum class GuidedPass {
+    ControlFlowFlattening,
+    BogusControlFlow,
+    InstructionSubstitution,
+    StringObfuscation,
+    AntiAnalysis
+};
+
+enum class ObfuscationTier {
+    Full,
+    Thinned,   // No flattening; hot blocks excluded from block-level passes
+    Skipped    // Left unobfuscated
+};
+
+const char *tierName(ObfuscationTier tier);
+
+struct FunctionDowngrade {
+    std::string function;
+    ObfuscationTier tier{ObfuscationTier::Full};
+    double runtimeShare{0.0};       // Of the profiled runtime
+    double avoidedOverhead{0.0};    // Projected slowdown no longer paid, as a fraction of runtime
+};
+
+struct GuidanceReport {
+    bool profiled{false};           // Module carried execution counts
+    double overheadBudget{0.0};
+    double unguidedOverhead{0.0};   // Projected slowdown with every function obfuscated
+    double projectedOverhead{0.0};  // After the downgrades
+    std::vector<FunctionDowngrade> downgrades;   // Hottest first
+};
+
+class ProfileGuidance {
+public:
+    // Annotates M with the counts in path: an indexed instrumentation profile
+    // (.profdata from -fprofile-generate) or a sample profile. Functions the
+    // profile does not match keep no counts. Returns false, with error set,
+    // if the file cannot be read or no function received counts
+    static bool loadProfile(llvm::Module &M, const std::string &path, std::string &error);
+
+    // Chooses a tier for every function so that the projected slowdown of
+    // the given passes stays within overheadBudget (0.05 = 5% of runtime).
+    // hotBlockShare is the share of a thinned function's runtime whose
+    // blocks stay untouched
+    const GuidanceReport &plan(llvm::Module &M, const std::vector<GuidedPass> &passes,
+                               double overheadBudget, double hotBlockShare = 0.9);
+
+    // base restricted to what the plan allows for pass; safe to use after
+    // this object is gone, and from concurrent planning threads
+    PassOptions optionsFor(GuidedPass pass, const PassOptions &base) const;
+
+    ObfuscationTier getTier(const llvm::Function &F) const;
+    const GuidanceReport &getReport() const { return report_; }
+
+    // Extra cost a pass adds to the code it transforms, relative to that
+    // code's original cost (2.5 = the transformed code runs 3.5x as long)
+    static double expectedOverhead(GuidedPass pass);
+
+private:
+    struct Plan {
+        std::unordered_map<const llvm::Function *, ObfuscationTier> tiers;
+        // Blocks block-level passes may still touch in thinned functions
+        std::unordered_set<const llvm::BasicBlock *> coldBlocks;
+    };
+
+    std::shared_ptr<const Plan> plan_{std::make_shared<Plan>()};
+    GuidanceReport report_;
+};
+
+} // namespace h5x
+
+#endif // H5X_PROFILE_GUIDANCE_HPP
@@ -1,11 +1,15 @@
 #include "StringObfuscation.hpp"
+#include "FunctionPlanning.hpp"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 #include <vector>
 #include <string>
 #include <random>
@@ -14,8 +18,49 @@ using namespace llvm;
 
 namespace h5x {
 
+namespace {
+
+// Bytes decrypted per step of the vector loop; one SSE2/NEON register
+const unsigned kDecryptVectorWidth = 16;
+
+// Ahead of default-priority (65535) constructors, which may already use the
+// strings; 0-100 are reserved for the compiler and runtime
+const int kStartupDecryptPriority = 101;
+
+// XORs data[0, vectorEnd) with keyVector, one vector per iteration.
+// vectorEnd must be a multiple of the vector width. Continues the block the
+// builder is in and leaves the builder in the block after the loop.
+void emitVectorXorLoop(IRBuilder<> &Builder, Value *data, Value *vectorEnd, Value *keyVector) {
+    LLVMContext &Ctx = Builder.getContext();
+    Function *F = Builder.GetInsertBlock()->getParent();
+    Type *i8Ty = Type::getInt8Ty(Ctx);
+    Type *i64Ty = Type::getInt64Ty(Ctx);
+    Type *vectorTy = keyVector->getType();
+    
+    BasicBlock *preheaderBB = Builder.GetInsertBlock();
+    BasicBlock *loopBB = BasicBlock::Create(Ctx, "vector_loop", F);
+    BasicBlock *bodyBB = BasicBlock::Create(Ctx, "vector_body", F);
+    BasicBlock *doneBB = BasicBlock::Create(Ctx, "vector_done", F);
+    Builder.CreateBr(loopBB);
+    
+    Builder.SetInsertPoint(loopBB);
+    PHINode *index = Builder.CreatePHI(i64Ty, 2, "vector_index");
+    index->addIncoming(ConstantInt::get(i64Ty, 0), preheaderBB);
+    Builder.CreateCondBr(Builder.CreateICmpULT(index, vectorEnd, "more_vectors"), bodyBB, doneBB);
+    
+    Builder.SetInsertPoint(bodyBB);
+    Value *vectorPtr = Builder.CreateInBoundsGEP(i8Ty, data, index, "vector_ptr");
+    Value *encVector = Builder.CreateAlignedLoad(vectorTy, vectorPtr, Align(1), "enc_vector");
+    Builder.CreateAlignedStore(Builder.CreateXor(encVector, keyVector, "dec_vector"), vectorPtr, Align(1));
+    index->addIncoming(Builder.CreateAdd(index, ConstantInt::get(i64Ty, kDecryptVectorWidth), "next_vector"), bodyBB);
+    Builder.CreateBr(loopBB);
+    
+    Builder.SetInsertPoint(doneBB);
+}
+
+} // anonymous namespace
+
 PreservedAnalyses StringObfuscationPass::run(Module &M, ModuleAnalysisManager &AM) {
-    bool modified = false;
     std::vector<GlobalVariable*> stringGlobals;
     
     // Collect all string constants
@@ -29,147 +74,291 @@ PreservedAnalyses StringObfuscationPass::run(Module &M, ModuleAnalysisManager &A
         }
     }
     
-    // Obfuscate each string
-    for (GlobalVariable *GV : stringGlobals) {
-        if (obfuscateString(*GV, M)) {
-            modified = true;
+    std::vector<StringEntry> entries = collectEntries(stringGlobals);
+    if (entries.empty()) return PreservedAnalyses::all();
+    
+    // Keys come from one seeded stream in module order
+    std::mt19937 gen(static_cast<std::mt19937::result_type>(resolveBaseSeed(options_.seed)));
+    if (decryption_ == StringDecryption::AtStartup) {
+        obfuscateAtStartup(entries, M, gen);
+    } else {
+        obfuscateOnFirstUse(entries, M, gen);
+    }
+    return PreservedAnalyses::none();
+}
+
+// One entry per distinct literal, in module order. Only uses in functions
+// this run transforms are rewritten; strings referenced only by skipped
+// functions stay as they are
+std::vector<StringObfuscationPass::StringEntry>
+StringObfuscationPass::collectEntries(const std::vector<GlobalVariable*> &strings) const {
+    std::vector<StringEntry> entries;
+    StringMap<size_t> entryByText;
+    for (GlobalVariable *GV : strings) {
+        std::vector<Instruction*> users;
+        for (User *U : GV->users()) {
+            if (auto *I = dyn_cast<Instruction>(U)) {
+                if (isFunctionSelected(options_, *I->getFunction())) {
+                    users.push_back(I);
+                }
+            }
         }
+        if (options_.function_filter && users.empty()) continue;
+        
+        StringRef text = cast<ConstantDataArray>(GV->getInitializer())->getAsCString();
+        auto inserted = entryByText.try_emplace(text, entries.size());
+        if (inserted.second) {
+            entries.push_back(StringEntry{text.str(), {}});
+        }
+        entries[inserted.first->second].uses.emplace_back(GV, std::move(users));
     }
-    
-    return modified ? PreservedAnalyses::none() : PreservedAnalyses::all();
+    return entries;
 }
 
-bool StringObfuscationPass::obfuscateString(GlobalVariable &GV, Module &M) {
-    auto *CA = dyn_cast<ConstantDataArray>(GV.getInitializer());
-    if (!CA || !CA->isCString()) return false;
-    
-    std::string originalStr = CA->getAsCString().str();
-    if (originalStr.empty() || originalStr.size() < 2) return false;
-    
+// All literals share one writable table, each under its own key and
+// followed by its NUL, plus one state byte per literal
+void StringObfuscationPass::obfuscateOnFirstUse(const std::vector<StringEntry> &entries, Module &M,
+                                                std::mt19937 &gen) {
     LLVMContext &Ctx = M.getContext();
+    Type *i8Ty = Type::getInt8Ty(Ctx);
+    Type *i64Ty = Type::getInt64Ty(Ctx);
     
-    // Generate XOR key
-    std::random_device rd;
-    std::mt19937 gen(rd());
     std::uniform_int_distribution<> keyDis(1, 255);
-    uint8_t xorKey = keyDis(gen);
-    
-    // Create encrypted string
-    std::vector<uint8_t> encryptedData;
-    for (char c : originalStr) {
-        encryptedData.push_back(static_cast<uint8_t>(c) ^ xorKey);
+    std::vector<uint8_t> keys;
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> table;
+    for (const StringEntry &entry : entries) {
+        uint8_t xorKey = static_cast<uint8_t>(keyDis(gen));
+        keys.push_back(xorKey);
+        offsets.push_back(table.size());
+        for (char c : entry.text) {
+            table.push_back(static_cast<uint8_t>(c) ^ xorKey);
+        }
+        table.push_back(0); // Null terminator
     }
-    encryptedData.push_back(0); // Null terminator
     
-    // Create new global for encrypted data  
-    ArrayType *encryptedType = ArrayType::get(Type::getInt8Ty(Ctx), encryptedData.size());
-    Constant *encryptedInit = ConstantDataArray::get(Ctx, encryptedData);
-    
-    GlobalVariable *encryptedGV = new GlobalVariable(
-        M, encryptedType, true, GlobalValue::PrivateLinkage,
-        encryptedInit, GV.getName() + "_enc"
+    ArrayType *tableType = ArrayType::get(i8Ty, table.size());
+    GlobalVariable *tableGV = new GlobalVariable(
+        M, tableType, false, GlobalValue::PrivateLinkage,
+        ConstantDataArray::get(Ctx, table), "h5x_string_table"
+    );
+    ArrayType *statesType = ArrayType::get(i8Ty, entries.size());
+    GlobalVariable *statesGV = new GlobalVariable(
+        M, statesType, false, GlobalValue::PrivateLinkage,
+        ConstantAggregateZero::get(statesType), "h5x_string_states"
     );
     
-    // Create decryption function
-    Function *decryptFunc = createDecryptFunction(M, xorKey);
-    
-    // Replace all uses of the original string with calls to decrypt function
-    std::vector<User*> users(GV.users().begin(), GV.users().end());
-    
-    for (User *U : users) {
-        if (auto *I = dyn_cast<Instruction>(U)) {
-            IRBuilder<> Builder(I);
-            
-            // Create GEP to encrypted string
-            Value *indices[] = {
-                ConstantInt::get(Type::getInt32Ty(Ctx), 0),
-                ConstantInt::get(Type::getInt32Ty(Ctx), 0)
-            };
-            Value *encryptedPtr = Builder.CreateInBoundsGEP(
-                encryptedType, encryptedGV, indices, "enc_ptr"
-            );
-            
-            // Call decrypt function
-            Value *decryptedStr = Builder.CreateCall(decryptFunc, {encryptedPtr}, "decrypted");
-            
-            // Replace the use
-            I->replaceUsesOfWith(&GV, decryptedStr);
+    Function *decryptFunc = createDecryptOnceFunction(M);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Constant *dataIndices[] = {ConstantInt::get(i64Ty, 0), ConstantInt::get(i64Ty, offsets[i])};
+        Constant *stateIndices[] = {ConstantInt::get(i64Ty, 0), ConstantInt::get(i64Ty, i)};
+        Value *args[] = {
+            ConstantExpr::getInBoundsGetElementPtr(tableType, tableGV, dataIndices),
+            ConstantExpr::getInBoundsGetElementPtr(statesType, statesGV, stateIndices),
+            ConstantInt::get(i64Ty, entries[i].text.size()),
+            ConstantInt::get(i8Ty, keys[i])
+        };
+        
+        // Replace the selected uses of the original string with the decrypted copy
+        for (const auto &use : entries[i].uses) {
+            for (Instruction *I : use.second) {
+                IRBuilder<> Builder(I);
+                Value *decryptedStr = Builder.CreateCall(decryptFunc, args, "decrypted");
+                I->replaceUsesOfWith(use.first, decryptedStr);
+            }
         }
     }
-    
-    return true;
 }
 
-Function* StringObfuscationPass::createDecryptFunction(Module &M, uint8_t xorKey) {
+// char* h5x_decrypt_once(char* data, char* state, i64 length, i8 key)
+// Fast path only; inlined into every use so a decrypted string costs an
+// acquire load and a predictable branch
+Function* StringObfuscationPass::createDecryptOnceFunction(Module &M) {
     LLVMContext &Ctx = M.getContext();
     
-    // Check if decrypt function already exists
-    std::string funcName = "h5x_decrypt_" + std::to_string(xorKey);
-    if (Function *existingFunc = M.getFunction(funcName)) {
+    if (Function *existingFunc = M.getFunction("h5x_decrypt_once")) {
         return existingFunc;
     }
     
-    // Create function type: char* decrypt(char* encrypted)
-    Type* charPtrTy = PointerType::get(Type::getInt8Ty(Ctx), 0);
+    Type *charPtrTy = PointerType::get(Type::getInt8Ty(Ctx), 0);
     FunctionType *funcType = FunctionType::get(
         charPtrTy,
-        {charPtrTy},
+        {charPtrTy, charPtrTy, Type::getInt64Ty(Ctx), Type::getInt8Ty(Ctx)},
         false
     );
+    Function *onceFunc = Function::Create(funcType, Function::InternalLinkage, "h5x_decrypt_once", M);
+    onceFunc->addFnAttr(Attribute::AlwaysInline);
+    Function *slowFunc = createDecryptSlowPath(M);
     
-    Function *decryptFunc = Function::Create(
-        funcType, Function::InternalLinkage, funcName, M
-    );
-    
-    // Create basic blocks
-    BasicBlock *entryBB = BasicBlock::Create(Ctx, "entry", decryptFunc);
-    BasicBlock *loopBB = BasicBlock::Create(Ctx, "loop", decryptFunc);
-    BasicBlock *exitBB = BasicBlock::Create(Ctx, "exit", decryptFunc);
+    BasicBlock *entryBB = BasicBlock::Create(Ctx, "entry", onceFunc);
+    BasicBlock *readyBB = BasicBlock::Create(Ctx, "ready", onceFunc);
+    BasicBlock *slowBB = BasicBlock::Create(Ctx, "slow", onceFunc);
     
     IRBuilder<> Builder(entryBB);
+    Value *data = onceFunc->getArg(0);
+    Value *state = onceFunc->getArg(1);
+    LoadInst *current = Builder.CreateAlignedLoad(Type::getInt8Ty(Ctx), state, Align(1), "state");
+    current->setAtomic(AtomicOrdering::Acquire);
+    Value *isReady = Builder.CreateICmpEQ(current, ConstantInt::get(Type::getInt8Ty(Ctx), 2), "is_ready");
+    Builder.CreateCondBr(isReady, readyBB, slowBB, MDBuilder(Ctx).createBranchWeights(2000, 1));
     
-    // Get function argument
-    Value *encryptedPtr = decryptFunc->getArg(0);
+    Builder.SetInsertPoint(readyBB);
+    Builder.CreateRet(data);
     
-    // Allocate buffer for decrypted string (simple approach: assume max 1024 chars)
-    Value *bufferSize = ConstantInt::get(Type::getInt32Ty(Ctx), 1024);
-    Value *decryptedBuffer = Builder.CreateAlloca(Type::getInt8Ty(Ctx), bufferSize, "buffer");
+    Builder.SetInsertPoint(slowBB);
+    Builder.CreateRet(Builder.CreateCall(slowFunc, {data, state, onceFunc->getArg(2), onceFunc->getArg(3)}));
     
-    // Initialize loop variables
-    Value *index = Builder.CreateAlloca(Type::getInt32Ty(Ctx), nullptr, "index");
-    Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Ctx), 0), index);
+    return onceFunc;
+}
+
+// First use: the thread moving the state from 0 to 1 decrypts, publishes 2,
+// and any thread arriving meanwhile waits for it
+Function* StringObfuscationPass::createDecryptSlowPath(Module &M) {
+    LLVMContext &Ctx = M.getContext();
+    
+    if (Function *existingFunc = M.getFunction("h5x_decrypt_slow")) {
+        return existingFunc;
+    }
+    
+    Type *i8Ty = Type::getInt8Ty(Ctx);
+    Type *i64Ty = Type::getInt64Ty(Ctx);
+    Type *charPtrTy = PointerType::get(i8Ty, 0);
+    FunctionType *funcType = FunctionType::get(charPtrTy, {charPtrTy, charPtrTy, i64Ty, i8Ty}, false);
+    Function *slowFunc = Function::Create(funcType, Function::InternalLinkage, "h5x_decrypt_slow", M);
+    slowFunc->addFnAttr(Attribute::NoInline);
+    slowFunc->addFnAttr(Attribute::Cold);
+    
+    BasicBlock *entryBB = BasicBlock::Create(Ctx, "entry", slowFunc);
+    BasicBlock *claimedBB = BasicBlock::Create(Ctx, "claimed", slowFunc);
+    BasicBlock *waitBB = BasicBlock::Create(Ctx, "wait", slowFunc);
+    BasicBlock *readyBB = BasicBlock::Create(Ctx, "ready", slowFunc);
+    
+    Value *data = slowFunc->getArg(0);
+    Value *state = slowFunc->getArg(1);
+    Value *length = slowFunc->getArg(2);
+    Value *xorKey = slowFunc->getArg(3);
+    
+    IRBuilder<> Builder(entryBB);
+    Value *claim = Builder.CreateAtomicCmpXchg(
+        state, ConstantInt::get(i8Ty, 0), ConstantInt::get(i8Ty, 1), MaybeAlign(1),
+        AtomicOrdering::AcquireRelease, AtomicOrdering::Acquire
+    );
+    Builder.CreateCondBr(Builder.CreateExtractValue(claim, 1, "won"), claimedBB, waitBB);
     
+    // Bounded by the length, since an encrypted byte may be zero
+    Builder.SetInsertPoint(claimedBB);
+    Value *vectorEnd = Builder.CreateAnd(length, ConstantInt::get(i64Ty, ~uint64_t(kDecryptVectorWidth - 1)),
+                                         "vector_end");
+    Value *keyVector = Builder.CreateVectorSplat(kDecryptVectorWidth, xorKey, "key_vector");
+    emitVectorXorLoop(Builder, data, vectorEnd, keyVector);
+    BasicBlock *vectorDoneBB = Builder.GetInsertBlock();
+    BasicBlock *loopBB = BasicBlock::Create(Ctx, "loop", slowFunc, waitBB);
+    BasicBlock *bodyBB = BasicBlock::Create(Ctx, "body", slowFunc, waitBB);
+    BasicBlock *publishBB = BasicBlock::Create(Ctx, "publish", slowFunc, waitBB);
     Builder.CreateBr(loopBB);
     
-    // Loop body
+    // Scalar tail
     Builder.SetInsertPoint(loopBB);
-    Value *currentIndex = Builder.CreateLoad(Type::getInt32Ty(Ctx), index, "current_idx");
+    PHINode *index = Builder.CreatePHI(i64Ty, 2, "index");
+    index->addIncoming(vectorEnd, vectorDoneBB);
+    Builder.CreateCondBr(Builder.CreateICmpULT(index, length, "more"), bodyBB, publishBB);
+    
+    Builder.SetInsertPoint(bodyBB);
+    Value *charPtr = Builder.CreateInBoundsGEP(i8Ty, data, index, "char_ptr");
+    Value *encChar = Builder.CreateLoad(i8Ty, charPtr, "enc_char");
+    Builder.CreateStore(Builder.CreateXor(encChar, xorKey, "dec_char"), charPtr);
+    index->addIncoming(Builder.CreateAdd(index, ConstantInt::get(i64Ty, 1), "next_index"), bodyBB);
+    Builder.CreateBr(loopBB);
+    
+    Builder.SetInsertPoint(publishBB);
+    StoreInst *publish = Builder.CreateAlignedStore(ConstantInt::get(i8Ty, 2), state, Align(1));
+    publish->setAtomic(AtomicOrdering::Release);
+    Builder.CreateRet(data);
+    
+    Builder.SetInsertPoint(waitBB);
+    LoadInst *current = Builder.CreateAlignedLoad(i8Ty, state, Align(1), "state");
+    current->setAtomic(AtomicOrdering::Acquire);
+    Builder.CreateCondBr(Builder.CreateICmpEQ(current, ConstantInt::get(i8Ty, 2), "is_ready"), readyBB, waitBB);
+    
+    Builder.SetInsertPoint(readyBB);
+    Builder.CreateRet(data);
+    
+    return slowFunc;
+}
+
+void StringObfuscationPass::obfuscateAtStartup(const std::vector<StringEntry> &entries, Module &M,
+                                               std::mt19937 &gen) {
+    LLVMContext &Ctx = M.getContext();
+    
+    // Every literal goes into one blob, NUL included
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> blob;
+    for (const StringEntry &entry : entries) {
+        offsets.push_back(blob.size());
+        blob.insert(blob.end(), entry.text.begin(), entry.text.end());
+        blob.push_back(0);
+    }
     
-    // Load encrypted character
-    Value *encCharPtr = Builder.CreateInBoundsGEP(Type::getInt8Ty(Ctx), encryptedPtr, currentIndex, "enc_char_ptr");
-    Value *encChar = Builder.CreateLoad(Type::getInt8Ty(Ctx), encCharPtr, "enc_char");
+    // One key vector for the whole sweep
+    std::uniform_int_distribution<> keyDis(1, 255);
+    std::vector<uint8_t> key(kDecryptVectorWidth);
+    for (uint8_t &byte : key) {
+        byte = static_cast<uint8_t>(keyDis(gen));
+    }
+    for (size_t i = 0; i < blob.size(); ++i) {
+        blob[i] ^= key[i % kDecryptVectorWidth];
+    }
     
-    // Check for null terminator
-    Value *isNull = Builder.CreateICmpEQ(encChar, ConstantInt::get(Type::getInt8Ty(Ctx), 0), "is_null");
+    ArrayType *blobType = ArrayType::get(Type::getInt8Ty(Ctx), blob.size());
+    GlobalVariable *blobGV = new GlobalVariable(
+        M, blobType, false, GlobalValue::PrivateLinkage,
+        ConstantDataArray::get(Ctx, blob), "h5x_string_blob"
+    );
+    blobGV->setAlignment(Align(kDecryptVectorWidth));
     
-    // Decrypt character
-    Value *decChar = Builder.CreateXor(encChar, ConstantInt::get(Type::getInt8Ty(Ctx), xorKey), "dec_char");
+    // Uses point straight into the blob; there is nothing left to do per use
+    Type *i64Ty = Type::getInt64Ty(Ctx);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Constant *indices[] = {ConstantInt::get(i64Ty, 0), ConstantInt::get(i64Ty, offsets[i])};
+        Constant *address = ConstantExpr::getInBoundsGetElementPtr(blobType, blobGV, indices);
+        for (const auto &use : entries[i].uses) {
+            for (Instruction *I : use.second) {
+                I->replaceUsesOfWith(use.first, address);
+            }
+        }
+    }
     
-    // Store decrypted character
-    Value *decCharPtr = Builder.CreateInBoundsGEP(Type::getInt8Ty(Ctx), decryptedBuffer, currentIndex, "dec_char_ptr");
-    Builder.CreateStore(decChar, decCharPtr);
+    appendToGlobalCtors(M, createStartupDecryptor(M, *blobGV, key), kStartupDecryptPriority);
+}
+
+// void h5x_decrypt_strings(): whole vectors in a loop, then the tail
+// unrolled, since the blob size and the key are known here
+Function* StringObfuscationPass::createStartupDecryptor(Module &M, GlobalVariable &blob,
+                                                        const std::vector<uint8_t> &key) {
+    LLVMContext &Ctx = M.getContext();
+    Type *i8Ty = Type::getInt8Ty(Ctx);
+    Type *i64Ty = Type::getInt64Ty(Ctx);
     
-    // Increment index and continue or exit
-    Value *nextIndex = Builder.CreateAdd(currentIndex, ConstantInt::get(Type::getInt32Ty(Ctx), 1), "next_idx");
-    Builder.CreateStore(nextIndex, index);
+    Function *decryptor = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                                           Function::InternalLinkage, "h5x_decrypt_strings", M);
+    decryptor->addFnAttr(Attribute::Cold);
     
-    Builder.CreateCondBr(isNull, exitBB, loopBB);
+    IRBuilder<> Builder(BasicBlock::Create(Ctx, "entry", decryptor));
+    uint64_t size = cast<ArrayType>(blob.getValueType())->getNumElements();
+    uint64_t vectorEnd = size & ~uint64_t(kDecryptVectorWidth - 1);
+    Value *data = Builder.CreateInBoundsGEP(blob.getValueType(), &blob,
+                                            {ConstantInt::get(i64Ty, 0), ConstantInt::get(i64Ty, 0)}, "blob");
+    emitVectorXorLoop(Builder, data, ConstantInt::get(i64Ty, vectorEnd), ConstantDataVector::get(Ctx, key));
     
-    // Exit block
-    Builder.SetInsertPoint(exitBB);
-    Builder.CreateRet(decryptedBuffer);
+    for (uint64_t i = vectorEnd; i < size; ++i) {
+        Value *charPtr = Builder.CreateInBoundsGEP(i8Ty, data, ConstantInt::get(i64Ty, i), "char_ptr");
+        Value *encChar = Builder.CreateLoad(i8Ty, charPtr, "enc_char");
+        Value *decChar = Builder.CreateXor(encChar, ConstantInt::get(i8Ty, key[i % kDecryptVectorWidth]), "dec_char");
+        Builder.CreateStore(decChar, charPtr);
+    }
+    Builder.CreateRetVoid();
     
-    return decryptFunc;
+    return decryptor;
 }
 
-} // namespace h5x
\ No newline at end of file
+} // namespace h5x
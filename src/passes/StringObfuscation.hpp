@@ -3,16 +3,53 @@
 
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Module.h"
+#include "PassOptions.hpp"
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace h5x {
 
+enum class StringDecryption {
+    // Strings share one writable table, each under its own XOR key, and are
+    // decrypted in place the first time any thread reaches one of their
+    // uses; a per-string state byte (0 encrypted, 1 in progress, 2
+    // plaintext) makes later uses a single load and branch
+    OnFirstUse,
+    // All strings share one blob under a 16-byte key, decrypted in a single
+    // vector sweep by a module constructor; uses cost nothing, but every
+    // string is in plaintext from startup on
+    AtStartup
+};
+
+// Encrypts C string constants. Identical literals are stored once, and one
+// set of decrypt helpers serves the whole module
 class StringObfuscationPass : public llvm::PassInfoMixin<StringObfuscationPass> {
 public:
+    explicit StringObfuscationPass(PassOptions options = PassOptions(),
+                                   StringDecryption decryption = StringDecryption::OnFirstUse)
+        : options_(options), decryption_(decryption) {}
+
     llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
 
 private:
-    bool obfuscateString(llvm::GlobalVariable &GV, llvm::Module &M);
-    llvm::Function* createDecryptFunction(llvm::Module &M, uint8_t xorKey);
+    // A distinct literal and, per global holding it, the uses to rewrite
+    struct StringEntry {
+        std::string text;
+        std::vector<std::pair<llvm::GlobalVariable*, std::vector<llvm::Instruction*>>> uses;
+    };
+
+    std::vector<StringEntry> collectEntries(const std::vector<llvm::GlobalVariable*> &strings) const;
+    void obfuscateOnFirstUse(const std::vector<StringEntry> &entries, llvm::Module &M, std::mt19937 &gen);
+    void obfuscateAtStartup(const std::vector<StringEntry> &entries, llvm::Module &M, std::mt19937 &gen);
+    llvm::Function* createDecryptOnceFunction(llvm::Module &M);
+    llvm::Function* createDecryptSlowPath(llvm::Module &M);
+    llvm::Function* createStartupDecryptor(llvm::Module &M, llvm::GlobalVariable &blob,
+                                           const std::vector<uint8_t> &key);
+
+    PassOptions options_;
+    StringDecryption decryption_;
 };
 
 } // namespace h5x
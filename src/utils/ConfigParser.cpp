@@ -53,22 +53,38 @@ bool ConfigParser::saveToFile(const ObfuscationConfig& config, const std::string
         file << "{\n";
         file << "  \"obfuscation_level\": " << config.obfuscation_level << ",\n";
         file << "  \"enable_control_flow_flattening\": " << (config.enable_control_flow_flattening ? "true" : "false") << ",\n";
+        file << "  \"flattening_dispatcher\": \"" << config.flattening_dispatcher << "\",\n";
+        file << "  \"flattening_cluster_size\": " << config.flattening_cluster_size << ",\n";
+        file << "  \"flattening_preserve_loops\": " << (config.flattening_preserve_loops ? "true" : "false") << ",\n";
         file << "  \"enable_instruction_substitution\": " << (config.enable_instruction_substitution ? "true" : "false") << ",\n";
         file << "  \"enable_string_obfuscation\": " << (config.enable_string_obfuscation ? "true" : "false") << ",\n";
+        file << "  \"decrypt_strings_at_startup\": " << (config.decrypt_strings_at_startup ? "true" : "false") << ",\n";
         file << "  \"enable_bogus_control_flow\": " << (config.enable_bogus_control_flow ? "true" : "false") << ",\n";
         file << "  \"enable_anti_analysis\": " << (config.enable_anti_analysis ? "true" : "false") << ",\n";
+        file << "  \"random_seed\": " << config.random_seed << ",\n";
         file << "  \"enable_ai_optimization\": " << (config.enable_ai_optimization ? "true" : "false") << ",\n";
         file << "  \"genetic_algorithm_generations\": " << config.genetic_algorithm_generations << ",\n";
         file << "  \"mutation_rate\": " << config.mutation_rate << ",\n";
         file << "  \"crossover_rate\": " << config.crossover_rate << ",\n";
+        file << "  \"fitness_cache_file\": \"" << config.fitness_cache_file << "\",\n";
+        file << "  \"fitness_proxy_prune_ratio\": " << config.fitness_proxy_prune_ratio << ",\n";
         file << "  \"enable_blockchain_verification\": " << (config.enable_blockchain_verification ? "true" : "false") << ",\n";
         file << "  \"blockchain_network\": \"" << config.blockchain_network << "\",\n";
         file << "  \"verification_contract_address\": \"" << config.verification_contract_address << "\",\n";
         file << "  \"max_complexity_threshold\": " << config.max_complexity_threshold << ",\n";
         file << "  \"performance_weight\": " << config.performance_weight << ",\n";
         file << "  \"security_weight\": " << config.security_weight << ",\n";
+        file << "  \"max_code_growth\": " << config.max_code_growth << ",\n";
         file << "  \"max_threads\": " << config.max_threads << ",\n";
         file << "  \"memory_limit_mb\": " << config.memory_limit_mb << ",\n";
+        file << "  \"enable_cache\": " << (config.enable_cache ? "true" : "false") << ",\n";
+        file << "  \"cache_directory\": \"" << config.cache_directory << "\",\n";
+        file << "  \"cache_size_limit_mb\": " << config.cache_size_limit_mb << ",\n";
+        file << "  \"compile_flags\": [";
+        for (size_t i = 0; i < config.compile_flags.size(); ++i) {
+            file << (i ? ", " : "") << "\"" << config.compile_flags[i] << "\"";
+        }
+        file << "],\n";
         file << "  \"generate_detailed_report\": " << (config.generate_detailed_report ? "true" : "false") << ",\n";
         file << "  \"enable_debug_symbols\": " << (config.enable_debug_symbols ? "true" : "false") << ",\n";
         file << "  \"output_directory\": \"" << config.output_directory << "\"\n";
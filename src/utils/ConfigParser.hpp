@@ -2,6 +2,7 @@
 #define H5X_CONFIG_PARSER_HPP
 
 #include <string>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <chrono>
@@ -12,16 +13,23 @@ struct ObfuscationConfig {
     // Core obfuscation settings
     int obfuscation_level{2};
     bool enable_control_flow_flattening{true};
+    std::string flattening_dispatcher{"flat"};  // "flat" or "clustered" (per-cluster sub-dispatchers)
+    int flattening_cluster_size{16};            // Blocks per cluster with the clustered dispatcher
+    bool flattening_preserve_loops{false};      // Innermost loops stay intact; only their headers are dispatched
     bool enable_instruction_substitution{true};
     bool enable_string_obfuscation{true};
+    bool decrypt_strings_at_startup{false};  // One constructor decrypts every string; uses cost nothing
     bool enable_bogus_control_flow{false};
     bool enable_anti_analysis{false};
+    uint64_t random_seed{0};  // 0 = fresh randomness on every run
 
     // AI optimization settings
     bool enable_ai_optimization{false};
     int genetic_algorithm_generations{20};
     double mutation_rate{0.1};
     double crossover_rate{0.8};
+    std::string fitness_cache_file;  // Persists GA fitness scores between runs; empty = memory only
+    double fitness_proxy_prune_ratio{0.0};  // Share of GA candidates dropped by the proxy before full scoring
 
     // Blockchain verification
     bool enable_blockchain_verification{false};
@@ -29,12 +37,21 @@ struct ObfuscationConfig {
     std::string verification_contract_address{"0x5FbDB2315678afecb367f032d93F642f64180aa3"};
 
     // Performance tuning
-    int max_complexity_threshold{1000};
-    double performance_weight{0.3};
+    int max_complexity_threshold{1000};  // Cyclomatic complexity a pass may grow a function to
+    double performance_weight{0.3};     // With security_weight, sets the runtime overhead budget
     double security_weight{0.7};
+    double max_code_growth{10.0};       // Instruction-count growth allowed per function and module; 0 = unlimited
     int max_threads{4};
     int memory_limit_mb{6144};
 
+    // Content-addressed cache of obfuscated artifacts
+    bool enable_cache{false};
+    std::string cache_directory{"./output/.h5x-cache"};
+    int cache_size_limit_mb{2048};
+
+    // Flags the input is compiled with (-I, -D, -std, ...)
+    std::vector<std::string> compile_flags;
+
     // Cross-platform settings
     std::vector<std::string> target_architectures{"arm64"};
     std::vector<std::string> target_platforms{"darwin"};
@@ -0,0 +1,148 @@
+#include "HashUtils.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <openssl/evp.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define H5X_HASH_USE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace h5x {
+
+namespace {
+
+// Files are mapped one window at a time and each window is unmapped once
+// hashed, so resident memory stays bounded however large the file is
+const size_t kMapWindowBytes = size_t(64) << 20;
+const size_t kReadChunkBytes = size_t(1) << 20;
+
+bool hash_stream(const std::string& path, Sha256Hasher& hasher) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    std::vector<char> buffer(kReadChunkBytes);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hasher.update(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    return !file.bad();
+}
+
+#ifdef H5X_HASH_USE_MMAP
+// False if the file cannot be mapped (pipes, some network file systems);
+// the caller then falls back to buffered reads
+bool hash_mapped(const std::string& path, Sha256Hasher& hasher) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    bool ok = true;
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    for (uint64_t offset = 0; offset < size; offset += kMapWindowBytes) {
+        size_t length = static_cast<size_t>(std::min<uint64_t>(kMapWindowBytes, size - offset));
+        void* window = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+        if (window == MAP_FAILED) {
+            ok = false;
+            break;
+        }
+        ::madvise(window, length, MADV_SEQUENTIAL);
+#ifdef POSIX_FADV_WILLNEED
+        // Start reading the next window while this one is hashed
+        uint64_t next = offset + length;
+        if (next < size) {
+            ::posix_fadvise(fd, static_cast<off_t>(next),
+                            static_cast<off_t>(std::min<uint64_t>(kMapWindowBytes, size - next)),
+                            POSIX_FADV_WILLNEED);
+        }
+#endif
+        hasher.update(window, length);
+        ::munmap(window, length);
+    }
+
+    ::close(fd);
+    return ok;
+}
+#endif
+
+} // anonymous namespace
+
+Sha256Hasher::Sha256Hasher()
+    : ctx_(EVP_MD_CTX_new())
+{
+    if (!ctx_ || EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr) != 1) {
+        EVP_MD_CTX_free(ctx_);
+        throw std::runtime_error("Failed to initialize SHA-256 context");
+    }
+}
+
+Sha256Hasher::~Sha256Hasher() {
+    EVP_MD_CTX_free(ctx_);
+}
+
+void Sha256Hasher::update(const void* data, size_t size) {
+    if (size > 0) {
+        EVP_DigestUpdate(ctx_, data, size);
+    }
+}
+
+std::string Sha256Hasher::final_hex() {
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hash_len = 0;
+    EVP_DigestFinal_ex(ctx_, hash, &hash_len);
+
+    std::ostringstream ss;
+    for (unsigned int i = 0; i < hash_len; i++) {
+        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+    }
+    return ss.str();
+}
+
+std::string HashUtils::sha256_hex(const void* data, size_t size) {
+    Sha256Hasher hasher;
+    hasher.update(data, size);
+    return hasher.final_hex();
+}
+
+std::string HashUtils::sha256_hex(const std::string& data) {
+    return sha256_hex(data.data(), data.size());
+}
+
+std::string HashUtils::sha256_file(const std::string& path) {
+#ifdef H5X_HASH_USE_MMAP
+    {
+        Sha256Hasher hasher;
+        if (hash_mapped(path, hasher)) {
+            return hasher.final_hex();
+        }
+    }
+#endif
+
+    Sha256Hasher hasher;
+    if (!hash_stream(path, hasher)) {
+        return "";
+    }
+    return hasher.final_hex();
+}
+
+} // namespace h5x
@@ -0,0 +1,43 @@
+#ifndef H5X_HASH_UTILS_HPP
+#define H5X_HASH_UTILS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+namespace h5x {
+
+// Incremental SHA-256 over OpenSSL EVP
+class Sha256Hasher {
+public:
+    Sha256Hasher();
+    ~Sha256Hasher();
+
+    Sha256Hasher(const Sha256Hasher&) = delete;
+    Sha256Hasher& operator=(const Sha256Hasher&) = delete;
+
+    void update(const void* data, size_t size);
+    void update(const std::string& data) { update(data.data(), data.size()); }
+
+    // Lower-case hex digest; the hasher must not be updated afterwards
+    std::string final_hex();
+
+private:
+    EVP_MD_CTX* ctx_;
+};
+
+class HashUtils {
+public:
+    static std::string sha256_hex(const void* data, size_t size);
+    static std::string sha256_hex(const std::string& data);
+
+    // Streams the file through memory-mapped windows (buffered reads where
+    // mapping is unavailable). Empty string if the file cannot be read
+    static std::string sha256_file(const std::string& path);
+};
+
+} // namespace h5x
+
+#endif // H5X_HASH_UTILS_HPP
@@ -1,7 +1,189 @@
 #include "Logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <ctime>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define H5X_LOG_CRASH_HANDLER 1
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace h5x {
 
+namespace {
+
+// line is fully formatted by the logging thread, so the crash handler can
+// write it without formatting or allocating
+struct LogRecord {
+    LogLevel level{LogLevel::INFO};
+    std::chrono::system_clock::time_point time;
+    std::string line;
+};
+
+// Single-producer/single-consumer ring: the owning thread pushes, the
+// writer reads in place and then releases. Indices grow monotonically and
+// are masked on access.
+class LogRing {
+public:
+    explicit LogRing(size_t capacity) : slots_(capacity), mask_(capacity - 1) {}
+
+    // Leaves record untouched when the ring is full
+    bool tryPush(LogRecord& record) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        slots_[tail & mask_] = std::move(record);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool full() const {
+        return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_acquire) > mask_;
+    }
+
+    // Records in [readBegin(), readEnd()) are not overwritten until release()
+    size_t readBegin() const { return head_.load(std::memory_order_acquire); }
+    size_t readEnd() const { return tail_.load(std::memory_order_acquire); }
+    const LogRecord& at(size_t index) const { return slots_[index & mask_]; }
+    void release(size_t end) { head_.store(end, std::memory_order_release); }
+
+    bool empty() const { return readBegin() == readEnd(); }
+
+    std::atomic<bool> owned{true};   // Cleared when the owning thread exits or moves on
+    LogRing* next{nullptr};          // Backend's ring list; set before the ring is published
+
+private:
+    std::vector<LogRecord> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// The calling thread's ring for the backend it last logged to
+struct ThreadRing {
+    uint64_t backend_id{0};
+    std::shared_ptr<LogRing> ring;
+
+    ~ThreadRing() {
+        if (ring) {
+            ring->owned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadRing t_ring;
+std::atomic<uint64_t> g_next_backend_id{1};
+
+#ifdef H5X_LOG_CRASH_HANDLER
+// Crash handling: write out the async rings, then let the signal proceed
+std::atomic<Logger*> g_crash_logger{nullptr};
+const int kCrashSignals[] = {
+    SIGSEGV, SIGABRT, SIGFPE, SIGILL,
+#ifdef SIGBUS
+    SIGBUS,
+#endif
+};
+using SignalHandler = void (*)(int);
+SignalHandler g_previous_handlers[sizeof(kCrashSignals) / sizeof(kCrashSignals[0])];
+std::once_flag g_crash_handlers_installed;
+
+void handleCrashSignal(int sig) {
+    if (Logger* logger = g_crash_logger.exchange(nullptr)) {
+        logger->flushOnCrash();
+    }
+
+    for (size_t i = 0; i < sizeof(kCrashSignals) / sizeof(kCrashSignals[0]); ++i) {
+        if (kCrashSignals[i] == sig) {
+            SignalHandler previous = g_previous_handlers[i];
+            std::signal(sig, previous == SIG_ERR || previous == nullptr ? SIG_DFL : previous);
+        }
+    }
+    std::raise(sig);
+}
+
+void installCrashHandlers() {
+    std::call_once(g_crash_handlers_installed, [] {
+        for (size_t i = 0; i < sizeof(kCrashSignals) / sizeof(kCrashSignals[0]); ++i) {
+            g_previous_handlers[i] = std::signal(kCrashSignals[i], handleCrashSignal);
+        }
+    });
+}
+
+// write(2) until everything is out; async-signal-safe
+void writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+#endif
+
+} // anonymous namespace
+
+struct AsyncLogBackend {
+    AsyncLogOptions options;
+    size_t ring_capacity{0};
+    uint64_t id{0};
+
+    // Rings are never freed while the backend lives, so the crash handler
+    // can walk ring_list without a lock; rings of exited threads are reused
+    std::mutex rings_mutex;
+    std::vector<std::shared_ptr<LogRing>> rings;
+    std::atomic<LogRing*> ring_list{nullptr};
+
+    std::thread writer;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::condition_variable space;     // Writer released ring slots
+    std::condition_variable flushed;
+    bool stop{false};
+    bool drain_requested{false};
+    uint64_t flush_requested{0};
+    uint64_t flush_completed{0};
+
+    std::atomic<uint64_t> dropped{0};
+    uint64_t dropped_reported{0};
+
+    std::shared_ptr<LogRing> claimRing() {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        for (auto& ring : rings) {
+            if (!ring->owned.load(std::memory_order_acquire) && ring->empty()) {
+                ring->owned.store(true, std::memory_order_relaxed);
+                return ring;
+            }
+        }
+
+        auto ring = std::make_shared<LogRing>(ring_capacity);
+        ring->next = ring_list.load(std::memory_order_relaxed);
+        rings.push_back(ring);
+        ring_list.store(ring.get(), std::memory_order_release);
+        return ring;
+    }
+};
+
+Logger::Logger() = default;
+
+Logger::~Logger() {
+    disableAsync();
+    if (log_file_.is_open()) log_file_.close();
+#ifdef H5X_LOG_CRASH_HANDLER
+    if (crash_fd_ >= 0) ::close(crash_fd_);
+#endif
+}
+
 void Logger::initialize(const std::string& log_file, LogLevel level) {
     std::lock_guard<std::mutex> lock(log_mutex_);
 
@@ -9,7 +191,7 @@ void Logger::initialize(const std::string& log_file, LogLevel level) {
         return;
     }
 
-    current_level_ = level;
+    current_level_.store(level, std::memory_order_relaxed);
 
     // Create logs directory if it doesn't exist
     std::filesystem::create_directories("logs");
@@ -19,6 +201,9 @@ void Logger::initialize(const std::string& log_file, LogLevel level) {
         std::cerr << "Failed to open log file: " << log_file << std::endl;
         return;
     }
+#ifdef H5X_LOG_CRASH_HANDLER
+    crash_fd_ = ::open(log_file.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+#endif
 
     initialized_ = true;
 
@@ -26,19 +211,23 @@ void Logger::initialize(const std::string& log_file, LogLevel level) {
     std::string timestamp = getCurrentTimestamp();
     std::ostringstream log_entry;
     log_entry << "[" << timestamp << "] [INFO ] H5X Logger initialized - " << log_file;
-    
+
     if (log_file_.is_open()) {
         log_file_ << log_entry.str() << std::endl;
         log_file_.flush();
     }
-    
+
     if (console_output_) {
         std::cout << log_entry.str() << std::endl;
     }
 }
 
 void Logger::log(LogLevel level, const std::string& message) {
-    if (level < current_level_) {
+    if (!isEnabled(level)) {
+        return;
+    }
+
+    if (async_enabled_.load(std::memory_order_acquire) && enqueueAsync(level, message)) {
         return;
     }
 
@@ -66,14 +255,253 @@ void Logger::log(LogLevel level, const std::string& message) {
     }
 }
 
-std::string Logger::getCurrentTimestamp() {
+void Logger::enableAsync(const AsyncLogOptions& options) {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    if (async_enabled_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    auto backend = std::make_unique<AsyncLogBackend>();
+    backend->options = options;
+    backend->ring_capacity = 2;
+    while (backend->ring_capacity < options.ring_capacity) {
+        backend->ring_capacity <<= 1;
+    }
+    backend->id = g_next_backend_id.fetch_add(1);
+
+    // disableAsync waited for every producer of the previous backend, and
+    // none can reach the new one before async_enabled_ is set below
+    async_ = std::move(backend);
+    async_->writer = std::thread(&Logger::writerLoop, this);
+    async_enabled_.store(true);
+
+#ifdef H5X_LOG_CRASH_HANDLER
+    g_crash_logger.store(this);
+    installCrashHandlers();
+#endif
+}
+
+void Logger::disableAsync() {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    if (!async_enabled_.exchange(false)) {
+        return;
+    }
+
+#ifdef H5X_LOG_CRASH_HANDLER
+    Logger* self = this;
+    g_crash_logger.compare_exchange_strong(self, nullptr);
+#endif
+
+    {
+        std::lock_guard<std::mutex> wake_lock(async_->wake_mutex);
+        async_->stop = true;
+    }
+    async_->wake.notify_all();
+    async_->space.notify_all();   // Blocked producers fall back to synchronous logging
+
+    // Producers that saw async logging enabled may still be pushing; the
+    // backend must outlive them and the final drain must see their messages
+    while (active_producers_.load() != 0) {
+        std::this_thread::yield();
+    }
+    async_->writer.join();
+    drainAsync();
+}
+
+void Logger::flush() {
+    std::lock_guard<std::mutex> async_lock(async_mutex_);
+    if (!async_enabled_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(log_mutex_);
+        if (log_file_.is_open()) {
+            log_file_.flush();
+        }
+        return;
+    }
+
+    AsyncLogBackend& backend = *async_;
+    std::unique_lock<std::mutex> lock(backend.wake_mutex);
+    uint64_t ticket = ++backend.flush_requested;
+    backend.wake.notify_one();
+    backend.flushed.wait(lock, [&] { return backend.flush_completed >= ticket || backend.stop; });
+}
+
+uint64_t Logger::droppedMessages() const {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    return async_ ? async_->dropped.load() : 0;
+}
+
+void Logger::flushOnCrash() {
+#ifdef H5X_LOG_CRASH_HANDLER
+    if (!async_enabled_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    // Ring order only; sorting across threads would need memory
+    for (LogRing* ring = async_->ring_list.load(std::memory_order_acquire); ring; ring = ring->next) {
+        size_t end = ring->readEnd();
+        for (size_t i = ring->readBegin(); i != end; ++i) {
+            const LogRecord& record = ring->at(i);
+            if (crash_fd_ >= 0) {
+                writeAll(crash_fd_, record.line.data(), record.line.size());
+            }
+            if (console_output_) {
+                writeAll(record.level >= LogLevel::ERROR ? STDERR_FILENO : STDOUT_FILENO,
+                         record.line.data(), record.line.size());
+            }
+        }
+    }
+#endif
+}
+
+bool Logger::enqueueAsync(LogLevel level, const std::string& message) {
+    // Counted so disableAsync knows when no producer still uses the backend
+    active_producers_.fetch_add(1);
+    if (!async_enabled_.load()) {
+        active_producers_.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+    AsyncLogBackend& backend = *async_;
+
+    if (t_ring.backend_id != backend.id) {
+        if (t_ring.ring) {
+            t_ring.ring->owned.store(false, std::memory_order_release);
+        }
+        t_ring.ring = backend.claimRing();
+        t_ring.backend_id = backend.id;
+    }
+    LogRing& ring = *t_ring.ring;
+
     auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
+    LogRecord record{level, now, "[" + formatTimestamp(now) + "] [" + levelToString(level) + "] " + message + "\n"};
+
+    bool queued = ring.tryPush(record);
+    if (!queued && backend.options.overflow == LogOverflowPolicy::DROP) {
+        backend.dropped.fetch_add(1, std::memory_order_relaxed);
+        queued = true;
+    } else if (!queued) {
+        // Wait for the writer to release slots; it notifies under wake_mutex
+        std::unique_lock<std::mutex> lock(backend.wake_mutex);
+        backend.drain_requested = true;
+        backend.wake.notify_one();
+        backend.space.wait(lock, [&] {
+            return !ring.full() || !async_enabled_.load(std::memory_order_acquire);
+        });
+        lock.unlock();
+        queued = ring.tryPush(record);   // False only while async logging is being disabled
+    } else if (level >= LogLevel::ERROR) {
+        std::lock_guard<std::mutex> lock(backend.wake_mutex);
+        backend.drain_requested = true;
+        backend.wake.notify_one();
+    }
+
+    active_producers_.fetch_sub(1, std::memory_order_release);
+    return queued;
+}
+
+void Logger::writerLoop() {
+    AsyncLogBackend& backend = *async_;
+
+    std::unique_lock<std::mutex> lock(backend.wake_mutex);
+    while (true) {
+        backend.wake.wait_for(lock, backend.options.flush_interval, [&] {
+            return backend.stop || backend.drain_requested ||
+                   backend.flush_requested != backend.flush_completed;
+        });
+        bool stopping = backend.stop;
+        uint64_t target = backend.flush_requested;
+        backend.drain_requested = false;
+        lock.unlock();
+
+        drainAsync();
+
+        lock.lock();
+        backend.flush_completed = target;
+        backend.flushed.notify_all();
+        backend.space.notify_all();
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+size_t Logger::drainAsync() {
+    AsyncLogBackend& backend = *async_;
+
+    // Records are written from the rings in place and released afterwards,
+    // so the crash handler always finds complete lines
+    std::vector<const LogRecord*> batch;
+    std::vector<std::pair<LogRing*, size_t>> read_ends;
+    for (LogRing* ring = backend.ring_list.load(std::memory_order_acquire); ring; ring = ring->next) {
+        size_t end = ring->readEnd();
+        for (size_t i = ring->readBegin(); i != end; ++i) {
+            batch.push_back(&ring->at(i));
+        }
+        read_ends.emplace_back(ring, end);
+    }
+
+    // Each thread's messages are already in order; interleave threads by time
+    std::stable_sort(batch.begin(), batch.end(), [](const LogRecord* a, const LogRecord* b) {
+        return a->time < b->time;
+    });
+
+    LogRecord dropped_notice;
+    uint64_t dropped = backend.dropped.load(std::memory_order_relaxed);
+    if (dropped > backend.dropped_reported) {
+        dropped_notice.level = LogLevel::WARNING;
+        dropped_notice.line = "[" + getCurrentTimestamp() + "] [" + levelToString(LogLevel::WARNING) +
+                              "] Logger dropped " + std::to_string(dropped - backend.dropped_reported) +
+                              " messages (ring buffer full)\n";
+        batch.push_back(&dropped_notice);
+        backend.dropped_reported = dropped;
+    }
+
+    if (!batch.empty()) {
+        std::lock_guard<std::mutex> lock(log_mutex_);
+        bool to_file = initialized_ && log_file_.is_open();
+        for (const LogRecord* record : batch) {
+            if (to_file) {
+                log_file_ << record->line;
+            }
+            if (console_output_) {
+                (record->level >= LogLevel::ERROR ? std::cerr : std::cout) << record->line;
+            }
+        }
+
+        // One flush per batch instead of one per line
+        if (to_file) {
+            log_file_.flush();
+        }
+        if (console_output_) {
+            std::cout.flush();
+        }
+    }
+
+    for (auto& [ring, end] : read_ends) {
+        ring->release(end);
+    }
+
+    return batch.size();
+}
+
+std::string Logger::getCurrentTimestamp() {
+    return formatTimestamp(std::chrono::system_clock::now());
+}
+
+std::string Logger::formatTimestamp(std::chrono::system_clock::time_point time) {
+    auto time_t = std::chrono::system_clock::to_time_t(time);
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now.time_since_epoch()) % 1000;
+        time.time_since_epoch()) % 1000;
+
+    // Called from every logging thread in async mode; localtime is not reentrant
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &time_t);
+#else
+    localtime_r(&time_t, &local);
+#endif
 
     std::ostringstream oss;
-    oss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
+    oss << std::put_time(&local, "%Y-%m-%d %H:%M:%S");
     oss << '.' << std::setfill('0') << std::setw(3) << ms.count();
 
     return oss.str();
@@ -4,11 +4,19 @@
 #include <string>
 #include <fstream>
 #include <mutex>
+#include <atomic>
+#include <memory>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
 #include <iostream>
 
+// Messages below this level (0 = DEBUG ... 4 = CRITICAL) are compiled out of
+// the H5X_LOG_* macros entirely; set through the H5X_MIN_LOG_LEVEL CMake option
+#ifndef H5X_MIN_LOG_LEVEL
+#define H5X_MIN_LOG_LEVEL 0
+#endif
+
 namespace h5x {
 
 enum class LogLevel {
@@ -19,6 +27,20 @@ enum class LogLevel {
     CRITICAL = 4
 };
 
+// What a logging thread does when its ring buffer is full
+enum class LogOverflowPolicy {
+    DROP,    // Discard the message and count it
+    BLOCK    // Wait for the writer to make room
+};
+
+struct AsyncLogOptions {
+    size_t ring_capacity{4096};                        // Messages per logging thread; rounded up to a power of two
+    std::chrono::milliseconds flush_interval{50};      // Longest a message waits before being written
+    LogOverflowPolicy overflow{LogOverflowPolicy::BLOCK};
+};
+
+struct AsyncLogBackend;
+
 class Logger {
 public:
     static Logger& getInstance() {
@@ -34,25 +56,78 @@ public:
     void error(const std::string& message) { log(LogLevel::ERROR, message); }
     void critical(const std::string& message) { log(LogLevel::CRITICAL, message); }
 
-    void setLevel(LogLevel level) { current_level_ = level; }
+    // Cheap check for callers that would otherwise build a message for nothing
+    bool isEnabled(LogLevel level) const {
+        return level >= current_level_.load(std::memory_order_relaxed);
+    }
+
+    void setLevel(LogLevel level) { current_level_.store(level, std::memory_order_relaxed); }
     void setConsoleOutput(bool enable) { console_output_ = enable; }
 
+    // Asynchronous mode: log() formats the line and moves it into a
+    // lock-free per-thread ring; a background writer writes and flushes in
+    // batches. Pending messages are written on disableAsync(), on
+    // destruction and (best effort) when the process crashes on a signal.
+    void enableAsync(const AsyncLogOptions& options = AsyncLogOptions());
+    void disableAsync();
+    bool isAsync() const { return async_enabled_.load(std::memory_order_acquire); }
+
+    // Blocks until everything logged before the call has been written
+    void flush();
+
+    // Messages discarded under LogOverflowPolicy::DROP
+    uint64_t droppedMessages() const;
+
+    // Writes pending async messages from the calling thread with write(2)
+    // only: no locks, no allocation. Async-signal-safe; used by the crash
+    // handler. Lines the writer is handling at that moment may appear twice.
+    void flushOnCrash();
+
 public:
-    Logger() = default;
-    ~Logger() { if (log_file_.is_open()) log_file_.close(); }
+    Logger();
+    ~Logger();
 
 private:
 
     std::string getCurrentTimestamp();
+    std::string formatTimestamp(std::chrono::system_clock::time_point time);
     std::string levelToString(LogLevel level);
 
+    bool enqueueAsync(LogLevel level, const std::string& message);
+    void writerLoop();
+    size_t drainAsync();
+
     std::ofstream log_file_;
     std::mutex log_mutex_;
-    LogLevel current_level_ = LogLevel::INFO;
+    std::atomic<LogLevel> current_level_{LogLevel::INFO};
     bool console_output_ = true;
     bool initialized_ = false;
+
+    int crash_fd_ = -1;                      // Log file opened for write(2) in the crash handler
+
+    // async_ is only replaced while async_enabled_ is false and no producer
+    // is inside enqueueAsync (counted by active_producers_)
+    mutable std::mutex async_mutex_;         // Serialises enableAsync/disableAsync/flush
+    std::atomic<bool> async_enabled_{false};
+    std::atomic<int> active_producers_{0};
+    std::unique_ptr<AsyncLogBackend> async_;
 };
 
 } // namespace h5x
 
+// Level-checked logging: the message expression is only evaluated when the
+// level is enabled, and levels below H5X_MIN_LOG_LEVEL cost nothing at all.
+//   H5X_LOG_DEBUG(logger_, "Loaded " + std::to_string(count) + " entries");
+#define H5X_LOG(logger, level, message)                                               \
+    do {                                                                              \
+        if (static_cast<int>(level) >= H5X_MIN_LOG_LEVEL && (logger).isEnabled(level)) { \
+            (logger).log((level), (message));                                         \
+        }                                                                             \
+    } while (0)
+
+#define H5X_LOG_DEBUG(logger, message) H5X_LOG(logger, ::h5x::LogLevel::DEBUG, message)
+#define H5X_LOG_INFO(logger, message) H5X_LOG(logger, ::h5x::LogLevel::INFO, message)
+#define H5X_LOG_WARNING(logger, message) H5X_LOG(logger, ::h5x::LogLevel::WARNING, message)
+#define H5X_LOG_ERROR(logger, message) H5X_LOG(logger, ::h5x::LogLevel::ERROR, message)
+
 #endif // H5X_LOGGER_HPP
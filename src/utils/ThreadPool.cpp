@@ -0,0 +1,149 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <exception>
+
+namespace h5x {
+
+ThreadPool::ThreadPool(size_t num_workers) {
+    num_workers = std::max<size_t>(1, num_workers);
+
+    queues_.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+        queues_.push_back(std::make_unique<WorkQueue>());
+    }
+
+    workers_.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        stopping_ = true;
+    }
+    wake_cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    size_t target;
+    {
+        // Count the task before it becomes visible so queued_ never underflows
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        ++queued_;
+        ++pending_;
+        target = next_queue_++ % queues_.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+        queues_[target]->tasks.push_back(std::move(task));
+    }
+
+    wake_cv_.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    idle_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t, size_t)>& body) {
+    std::exception_ptr first_error;
+    std::mutex error_mutex;
+
+    for (size_t index = 0; index < count; ++index) {
+        submit([&, index](size_t worker_id) {
+            try {
+                body(index, worker_id);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!first_error) {
+                    first_error = std::current_exception();
+                }
+            }
+        });
+    }
+
+    wait_idle();
+
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
+
+size_t ThreadPool::resolve_worker_count(int requested) {
+    if (requested > 0) {
+        return static_cast<size_t>(requested);
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool ThreadPool::pop_task(size_t worker_id, Task& task) {
+    // Own queue first (LIFO keeps caches warm)
+    {
+        WorkQueue& own = *queues_[worker_id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest task from a sibling
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        WorkQueue& victim = *queues_[(worker_id + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t worker_id) {
+    while (true) {
+        Task task;
+        if (pop_task(worker_id, task)) {
+            {
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                --queued_;
+            }
+
+            try {
+                task(worker_id);
+            } catch (...) {
+                // Tasks own their error reporting; never let one kill the worker
+            }
+
+            bool idle = false;
+            {
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                idle = (--pending_ == 0);
+            }
+            if (idle) {
+                idle_cv_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        wake_cv_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+        if (stopping_ && queued_ == 0) {
+            return;
+        }
+    }
+}
+
+} // namespace h5x
@@ -0,0 +1,63 @@
+#ifndef H5X_THREAD_POOL_HPP
+#define H5X_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace h5x {
+
+// Fixed-size work-stealing pool. Every worker owns a deque: tasks are pushed
+// round-robin, the owner pops from the back and idle workers steal from the
+// front of their siblings' queues. Tasks receive the index of the worker that
+// runs them so callers can keep per-worker state (engines, LLVM contexts).
+class ThreadPool {
+public:
+    using Task = std::function<void(size_t worker_id)>;
+
+    explicit ThreadPool(size_t num_workers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task);
+    void wait_idle();
+    size_t size() const { return workers_.size(); }
+
+    // Runs body(index, worker_id) for every index in [0, count) and blocks
+    // until all of them finished. The first exception thrown is rethrown.
+    void parallel_for(size_t count, const std::function<void(size_t, size_t)>& body);
+
+    // Maps a configured thread count (<= 0 means "all cores") to a worker count.
+    static size_t resolve_worker_count(int requested);
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool pop_task(size_t worker_id, Task& task);
+    void worker_loop(size_t worker_id);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex state_mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable idle_cv_;
+    size_t queued_{0};
+    size_t pending_{0};
+    size_t next_queue_{0};
+    bool stopping_{false};
+};
+
+} // namespace h5x
+
+#endif // H5X_THREAD_POOL_HPP
@@ -1,6 +1,14 @@
 #include <gtest/gtest.h>
 #include "ai/GeneticOptimizer.hpp"
+#include "utils/ConfigParser.hpp"
+#include "utils/Logger.hpp"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <filesystem>
 #include <fstream>
+#include <tuple>
 
 namespace h5x {
 namespace test {
@@ -81,5 +89,207 @@ TEST_F(AITest, GeneticOptimizerParameterValidation) {
     EXPECT_NO_THROW(optimizer->setMutationRate(0.99));
 }
 
+TEST(GeneticOptimizerParallelTest, ParallelEvaluationMatchesSerial) {
+    // Same seed, different worker counts: identical search and result
+    auto runWithThreads = [](int threads) {
+        llvm::LLVMContext ctx;
+        llvm::Module mod("ga_module", ctx);
+        for (int i = 0; i < 8; ++i) {
+            auto *funcType = llvm::FunctionType::get(llvm::Type::getInt32Ty(ctx), {llvm::Type::getInt32Ty(ctx)}, false);
+            auto *func = llvm::Function::Create(funcType, llvm::Function::InternalLinkage,
+                                                "func_" + std::to_string(i), mod);
+            llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", func));
+            builder.CreateRet(builder.CreateMul(func->getArg(0), builder.getInt32(i + 2)));
+        }
+
+        ObfuscationConfig config;
+        config.genetic_algorithm_generations = 5;
+        config.random_seed = 99;
+        config.max_threads = threads;
+
+        GeneticOptimizer optimizer(Logger::getInstance());
+        optimizer.initialize(config);
+        auto best = optimizer.optimize_pass_sequence(mod);
+        return std::make_pair(best, optimizer.get_fitness_history());
+    };
+
+    auto serial = runWithThreads(1);
+    auto parallel = runWithThreads(4);
+    EXPECT_EQ(serial.first, parallel.first);
+    EXPECT_EQ(serial.second, parallel.second);
+}
+
+TEST(GeneticOptimizerParallelTest, PersistedFitnessCacheIsReused) {
+    const std::string cacheFile = "test_fitness_cache.tsv";
+    std::filesystem::remove(cacheFile);
+
+    llvm::LLVMContext ctx;
+    llvm::Module mod("ga_module", ctx);
+    auto *funcType = llvm::FunctionType::get(llvm::Type::getInt32Ty(ctx), {llvm::Type::getInt32Ty(ctx)}, false);
+    auto *func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, "square", mod);
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", func));
+    builder.CreateRet(builder.CreateMul(func->getArg(0), func->getArg(0)));
+
+    ObfuscationConfig config;
+    config.genetic_algorithm_generations = 5;
+    config.random_seed = 7;
+    config.max_threads = 1;
+    config.fitness_cache_file = cacheFile;
+
+    GeneticOptimizer first(Logger::getInstance());
+    first.initialize(config);
+    auto firstBest = first.optimize_pass_sequence(mod);
+
+    // A fresh optimizer with the same seed replays the search from the file
+    GeneticOptimizer second(Logger::getInstance());
+    second.initialize(config);
+    auto secondBest = second.optimize_pass_sequence(mod);
+
+    EXPECT_EQ(firstBest, secondBest);
+    EXPECT_LT(first.get_fitness_cache_hit_rate(), 1.0);
+    EXPECT_DOUBLE_EQ(second.get_fitness_cache_hit_rate(), 1.0);
+
+    std::filesystem::remove(cacheFile);
+}
+
+TEST(GeneticOptimizerFitnessTest, FitnessMeasuresTransformedModule) {
+    llvm::LLVMContext ctx;
+    llvm::Module mod("ga_module", ctx);
+    llvm::IRBuilder<> builder(ctx);
+    auto *putsType = llvm::FunctionType::get(builder.getInt32Ty(), {llvm::PointerType::getUnqual(ctx)}, false);
+    auto puts = mod.getOrInsertFunction("puts", putsType);
+    auto *funcType = llvm::FunctionType::get(builder.getInt32Ty(), {builder.getInt32Ty()}, false);
+    auto *func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, "check", mod);
+    auto *entry = llvm::BasicBlock::Create(ctx, "entry", func);
+    auto *yes = llvm::BasicBlock::Create(ctx, "yes", func);
+    auto *no = llvm::BasicBlock::Create(ctx, "no", func);
+    builder.SetInsertPoint(entry);
+    builder.CreateCondBr(builder.CreateICmpSGT(func->getArg(0), builder.getInt32(10)), yes, no);
+    builder.SetInsertPoint(yes);
+    auto *message = builder.CreateGlobalString("license ok");
+    builder.CreateCall(puts, {message});
+    builder.CreateRet(builder.CreateAdd(func->getArg(0), builder.getInt32(1)));
+    builder.SetInsertPoint(no);
+    builder.CreateRet(builder.getInt32(0));
+
+    GeneticOptimizer optimizer(Logger::getInstance());
+
+    // Constant propagation changes nothing here: no security, no overhead
+    double unchanged = optimizer.evaluate_fitness(Individual({6}), mod);
+    EXPECT_DOUBLE_EQ(unchanged, 30.0);
+
+    // Encrypting the string is measured on the transformed copy only
+    double encrypted = optimizer.evaluate_fitness(Individual({2}), mod);
+    EXPECT_GT(encrypted, unchanged);
+    auto *text = llvm::cast<llvm::ConstantDataSequential>(message->getInitializer());
+    EXPECT_EQ(text->getAsCString(), "license ok");
+}
+
+TEST(GeneticOptimizerFitnessTest, FitnessWeightsFollowConfig) {
+    llvm::LLVMContext ctx;
+    llvm::Module mod("ga_module", ctx);
+    auto *funcType = llvm::FunctionType::get(llvm::Type::getInt32Ty(ctx), {llvm::Type::getInt32Ty(ctx)}, false);
+    auto *func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, "inc", mod);
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", func));
+    builder.CreateRet(builder.CreateAdd(func->getArg(0), builder.getInt32(1)));
+
+    // A no-op sequence only scores on performance, so its fitness is the
+    // performance share of the weights
+    ObfuscationConfig config;
+    config.performance_weight = 1.0;
+    config.security_weight = 0.0;
+    GeneticOptimizer optimizer(Logger::getInstance());
+    optimizer.initialize(config);
+    EXPECT_DOUBLE_EQ(optimizer.evaluate_fitness(Individual({6}), mod), 100.0);
+
+    config.performance_weight = 0.5;
+    config.security_weight = 0.5;
+    optimizer.update_configuration(config);
+    EXPECT_DOUBLE_EQ(optimizer.evaluate_fitness(Individual({6}), mod), 50.0);
+}
+
+TEST(GeneticOptimizerFitnessTest, ProxyPrunesBeforeFullEvaluation) {
+    auto run = [](double pruneRatio, int threads) {
+        llvm::LLVMContext ctx;
+        llvm::Module mod("ga_module", ctx);
+        for (int i = 0; i < 12; ++i) {
+            auto *funcType = llvm::FunctionType::get(llvm::Type::getInt32Ty(ctx), {llvm::Type::getInt32Ty(ctx)}, false);
+            auto *func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
+                                                "func_" + std::to_string(i), mod);
+            llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", func));
+            llvm::Value *value = func->getArg(0);
+            for (int j = 0; j <= i; ++j) {
+                value = builder.CreateXor(builder.CreateMul(value, builder.getInt32(j + 3)), func->getArg(0));
+            }
+            builder.CreateRet(value);
+        }
+
+        ObfuscationConfig config;
+        config.genetic_algorithm_generations = 3;
+        config.random_seed = 21;
+        config.max_threads = threads;
+        config.fitness_proxy_prune_ratio = pruneRatio;
+
+        GeneticOptimizer optimizer(Logger::getInstance());
+        optimizer.initialize(config);
+        auto best = optimizer.optimize_pass_sequence(mod);
+        return std::make_tuple(best, optimizer.get_full_evaluations(), optimizer.get_proxy_pruned());
+    };
+
+    auto full = run(0.0, 1);
+    auto pruned = run(0.5, 1);
+    EXPECT_EQ(std::get<2>(full), 0u);
+    EXPECT_GT(std::get<2>(pruned), 0u);
+    EXPECT_LT(std::get<1>(pruned), std::get<1>(full));
+
+    // Pruning decisions do not depend on the worker count
+    EXPECT_EQ(run(0.5, 4), pruned);
+}
+
+TEST(PassPrefixTrieTest, SnapshotsMatchFullReapplication) {
+    llvm::LLVMContext ctx;
+    llvm::Module mod("trie_module", ctx);
+    auto *funcType = llvm::FunctionType::get(llvm::Type::getInt32Ty(ctx), {llvm::Type::getInt32Ty(ctx)}, false);
+    auto *func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, "step", mod);
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(ctx, "entry", func));
+    builder.CreateRet(func->getArg(0));
+
+    // Deterministic stand-in for a pass: appends an add named after the step
+    auto apply = [](int pass, llvm::Module &m, uint64_t prefixHash) {
+        auto &ret = m.getFunction("step")->getEntryBlock().back();
+        llvm::IRBuilder<> b(&ret);
+        auto *value = b.CreateAdd(ret.getOperand(0), b.getInt32(pass * 100 + prefixHash % 97));
+        ret.setOperand(0, value);
+    };
+    auto print = [](const llvm::Module &m) {
+        std::string text;
+        llvm::raw_string_ostream os(text);
+        m.print(os, nullptr);
+        return os.str();
+    };
+
+    const std::vector<std::vector<int>> sequences = {
+        {0, 1, 2}, {0, 1, 3}, {0, 1, 4}, {0, 2}, {0, 1, 2, 3}, {5}};
+
+    PassPrefixTrie trie(64 * 1024 * 1024);
+    for (const auto &sequence : sequences) {
+        auto expected = llvm::CloneModule(mod);
+        for (size_t i = 0; i < sequence.size(); ++i) {
+            apply(sequence[i], *expected, PassPrefixTrie::prefix_hash(sequence, i + 1));
+        }
+        EXPECT_EQ(print(*trie.materialize(mod, sequence, apply)), print(*expected));
+    }
+    EXPECT_GT(trie.get_stats().passes_reused, 0u);
+    EXPECT_GT(trie.get_stats().snapshots_stored, 0u);
+
+    // A budget below one snapshot stores nothing but still evaluates correctly
+    PassPrefixTrie tiny(PassPrefixTrie::estimate_module_bytes(mod) / 2);
+    for (const auto &sequence : sequences) {
+        tiny.materialize(mod, sequence, apply);
+    }
+    EXPECT_EQ(tiny.get_stats().snapshots_stored, 0u);
+    EXPECT_EQ(tiny.get_stats().bytes_in_use, 0u);
+}
+
 } // namespace test
 } // namespace h5x
\ No newline at end of file
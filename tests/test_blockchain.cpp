@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include "blockchain/BlockchainVerifier.hpp"
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
 
 namespace h5x {
 namespace test {
@@ -76,5 +78,115 @@ TEST_F(BlockchainTest, BlockchainVerifierInvalidBinary) {
     EXPECT_TRUE(result.blockHash.empty());
 }
 
+TEST(BlockchainBatchTest, EncodeBatchStoreCall) {
+    const std::string first = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+    const std::string second = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+
+    std::string data = BlockchainVerifier::encode_batch_store_call({first, "0x" + second});
+    EXPECT_EQ(data, "0x09916cfd"
+                    "0000000000000000000000000000000000000000000000000000000000000020"
+                    "0000000000000000000000000000000000000000000000000000000000000002" +
+                    first + second);
+
+    // Anything that is not a 32-byte digest is rejected
+    EXPECT_EQ(BlockchainVerifier::encode_batch_store_call({"abc"}), "");
+    EXPECT_EQ(BlockchainVerifier::encode_batch_store_call({std::string(64, 'g')}), "");
+}
+
+// Records every batch the flusher submits
+struct RecordedBatches {
+    std::mutex mutex;
+    std::condition_variable submitted;
+    std::vector<std::vector<std::string>> batches;
+
+    SubmissionQueue::SubmitFn callback() {
+        return [this](std::vector<QueuedHash> batch) {
+            std::lock_guard<std::mutex> lock(mutex);
+            batches.emplace_back();
+            for (const auto& entry : batch) {
+                batches.back().push_back(entry.hash);
+            }
+            submitted.notify_all();
+        };
+    }
+
+    bool wait_for(size_t count, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return submitted.wait_for(lock, timeout, [&] { return batches.size() >= count; });
+    }
+};
+
+TEST(BlockchainBatchTest, SubmissionQueueFlushesFullBatches) {
+    RecordedBatches recorded;
+    SubmissionQueue queue(recorded.callback());
+    queue.set_limits(3, std::chrono::hours(1));
+
+    EXPECT_TRUE(queue.push("a", "a.bin"));
+    EXPECT_TRUE(queue.push("b", "b.bin"));
+    EXPECT_FALSE(queue.push("b", "b.bin"));   // Already queued
+    EXPECT_TRUE(queue.push("c", "c.bin"));
+
+    ASSERT_TRUE(recorded.wait_for(1, std::chrono::seconds(5)));
+    EXPECT_EQ(recorded.batches[0], (std::vector<std::string>{"a", "b", "c"}));
+
+    // Below the batch size nothing is sent until an explicit flush
+    EXPECT_TRUE(queue.push("d", "d.bin"));
+    EXPECT_FALSE(recorded.wait_for(2, std::chrono::milliseconds(100)));
+    EXPECT_EQ(queue.size(), 1u);
+    auto rest = queue.take_all();
+    ASSERT_EQ(rest.size(), 1u);
+    EXPECT_EQ(rest[0].hash, "d");
+    EXPECT_EQ(queue.size(), 0u);
+}
+
+TEST(BlockchainBatchTest, SubmissionQueueFlushesOverdueEntries) {
+    RecordedBatches recorded;
+    SubmissionQueue queue(recorded.callback());
+    queue.set_limits(50, std::chrono::milliseconds(50));
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(queue.push("a", "a.bin"));
+    EXPECT_TRUE(queue.push("b", "b.bin"));
+
+    // No further push arrives; the timer alone must flush the queue
+    ASSERT_TRUE(recorded.wait_for(1, std::chrono::seconds(5)));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+    EXPECT_EQ(recorded.batches[0], (std::vector<std::string>{"a", "b"}));
+    EXPECT_EQ(queue.size(), 0u);
+}
+
+TEST(BlockchainBatchTest, SubmissionQueueRetriesRequeuedEntries) {
+    std::mutex mutex;
+    std::condition_variable submitted;
+    std::vector<QueuedHash> second;
+    int calls = 0;
+
+    SubmissionQueue* queue_ptr = nullptr;
+    SubmissionQueue queue([&](std::vector<QueuedHash> batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (calls++ == 0) {
+            // First submission fails; hand the batch back from the callback
+            for (auto& entry : batch) {
+                entry.attempts++;
+            }
+            queue_ptr->requeue(std::move(batch));
+        } else {
+            second = std::move(batch);
+            submitted.notify_all();
+        }
+    });
+    queue_ptr = &queue;
+    queue.set_limits(50, std::chrono::milliseconds(20));
+
+    EXPECT_TRUE(queue.push("a", "a.bin"));
+
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(submitted.wait_for(lock, std::chrono::seconds(5), [&] { return calls >= 2; }));
+    ASSERT_EQ(second.size(), 1u);
+    EXPECT_EQ(second[0].hash, "a");
+    EXPECT_EQ(second[0].attempts, 1u);
+    EXPECT_EQ(queue.size(), 0u);
+}
+
 } // namespace test
 } // namespace h5x
\ No newline at end of file
@@ -1,8 +1,17 @@
 #include <gtest/gtest.h>
 #include "core/H5XObfuscationEngine.hpp"
+#include "core/CachedResult.hpp"
+#include "core/ObfuscationCache.hpp"
+#include "core/ObfuscationServer.hpp"
 #include "utils/ConfigParser.hpp"
+#include "utils/Logger.hpp"
 #include <filesystem>
+#include <cstring>
 #include <fstream>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 namespace h5x {
 namespace test {
@@ -127,5 +136,171 @@ TEST_F(H5XObfuscationEngineTest, ReportGeneration) {
     EXPECT_GT(report.sizeIncrease, 0.0);
 }
 
+TEST_F(H5XObfuscationEngineTest, CacheKeyDependsOnConfig) {
+    ObfuscationConfig config;
+    std::string key = ObfuscationCache::source_key(testInputFile, config, "test");
+    if (key.empty()) {
+        GTEST_SKIP() << "clang preprocessor not available";
+    }
+
+    EXPECT_EQ(key, ObfuscationCache::source_key(testInputFile, config, "test"));
+
+    config.random_seed = 42;
+    std::string seeded = ObfuscationCache::source_key(testInputFile, config, "test");
+    EXPECT_NE(key, seeded);
+
+    // The input is preprocessed with its real compile flags
+    config.compile_flags = {"-DH5X_CACHE_TEST=1"};
+    std::string flagged = ObfuscationCache::source_key(testInputFile, config, "test");
+    EXPECT_NE(seeded, flagged);
+
+    // Budget limits decide which functions keep their obfuscation
+    config.max_code_growth = 2.0;
+    EXPECT_NE(flagged, ObfuscationCache::source_key(testInputFile, config, "test"));
+    config.max_code_growth = ObfuscationConfig().max_code_growth;
+
+    // So does the flattening layout
+    config.flattening_dispatcher = "clustered";
+    EXPECT_NE(flagged, ObfuscationCache::source_key(testInputFile, config, "test"));
+    config.flattening_dispatcher = "flat";
+    config.flattening_preserve_loops = true;
+    EXPECT_NE(flagged, ObfuscationCache::source_key(testInputFile, config, "test"));
+    config.flattening_preserve_loops = false;
+
+    // Fitness pruning and cached fitness scores steer the GA
+    config.fitness_proxy_prune_ratio = 0.5;
+    EXPECT_NE(flagged, ObfuscationCache::source_key(testInputFile, config, "test"));
+    config.fitness_proxy_prune_ratio = 0.0;
+    config.enable_ai_optimization = true;
+    config.fitness_cache_file = testOutputDir + "fitness_cache.json";
+    std::string unscored = ObfuscationCache::source_key(testInputFile, config, "test");
+    EXPECT_FALSE(unscored.empty());   // Not written yet
+    std::ofstream(config.fitness_cache_file) << "{\"entries\": []}";
+    EXPECT_NE(unscored, ObfuscationCache::source_key(testInputFile, config, "test"));
+}
+
+TEST_F(H5XObfuscationEngineTest, CacheStoreLookupAndEvict) {
+    std::string cacheDir = testOutputDir + "cache";
+    ObfuscationCache cache(Logger::getInstance(), cacheDir, 1500);
+
+    std::string artifact = testOutputDir + "artifact.bin";
+    std::ofstream(artifact, std::ios::binary) << std::string(1000, 'x');
+
+    EXPECT_FALSE(cache.lookup("aa01", testOutputDir + "out.bin"));
+    EXPECT_TRUE(cache.store("aa01", artifact));
+    EXPECT_TRUE(cache.lookup("aa01", testOutputDir + "out.bin"));
+    EXPECT_EQ(std::filesystem::file_size(testOutputDir + "out.bin"), 1000u);
+
+    // Second entry exceeds the cap; the least recently used one goes
+    EXPECT_TRUE(cache.store("bb02", artifact));
+    EXPECT_LE(cache.current_size_bytes(), 1500u);
+
+    CacheStats stats = cache.get_stats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.bytes_saved, 1000u);
+    EXPECT_EQ(stats.evictions, 1u);
+}
+
+TEST_F(H5XObfuscationEngineTest, CacheKeepsReportWithArtifact) {
+    ObfuscationCache cache(Logger::getInstance(), testOutputDir + "report_cache", 1 << 20);
+
+    std::string artifact = testOutputDir + "artifact.bin";
+    std::ofstream(artifact, std::ios::binary) << std::string(100, 'x');
+
+    ObfuscationReport report;
+    report.inputFile = "old.cpp";
+    report.securityScore = 80.0;
+    report.passesApplied = {"ControlFlowFlattening"};
+    report.blockchainVerificationUsed = true;
+    report.transactionHash = "0xabc";
+    ASSERT_TRUE(cache.store("cc03", artifact, report_to_json_string(report)));
+
+    std::string stored;
+    ASSERT_TRUE(cache.lookup("cc03", testOutputDir + "out.bin", &stored));
+    ObfuscationReport hit = cached_report(stored, "new.cpp", testOutputDir + "out.bin");
+    EXPECT_EQ(hit.inputFile, "new.cpp");
+    EXPECT_EQ(hit.securityScore, 80.0);
+    EXPECT_EQ(hit.passesApplied, std::vector<std::string>{"ControlFlowFlattening"});
+    // Verification belongs to the run that made it
+    EXPECT_FALSE(hit.blockchainVerificationUsed);
+    EXPECT_TRUE(hit.transactionHash.empty());
+
+    // Storing without a report drops the old one
+    ASSERT_TRUE(cache.store("cc03", artifact));
+    ASSERT_TRUE(cache.lookup("cc03", testOutputDir + "out.bin", &stored));
+    EXPECT_TRUE(stored.empty());
+}
+
+TEST_F(H5XObfuscationEngineTest, ServerFramesRoundTrip) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    std::string large(300000, 'x');
+    EXPECT_TRUE(ObfuscationServer::write_frame(fds[0], "{\"type\":\"ping\"}"));
+    EXPECT_TRUE(ObfuscationServer::write_frame(fds[0], ""));
+    std::thread writer([&] { EXPECT_TRUE(ObfuscationServer::write_frame(fds[0], large)); });
+
+    std::string frame;
+    EXPECT_TRUE(ObfuscationServer::read_frame(fds[1], frame));
+    EXPECT_EQ(frame, "{\"type\":\"ping\"}");
+    EXPECT_TRUE(ObfuscationServer::read_frame(fds[1], frame));
+    EXPECT_TRUE(frame.empty());
+    EXPECT_TRUE(ObfuscationServer::read_frame(fds[1], frame));
+    EXPECT_EQ(frame, large);
+    writer.join();
+
+    // Oversized length prefix is rejected instead of allocated
+    const unsigned char huge[4] = {0xff, 0xff, 0xff, 0xff};
+    ASSERT_EQ(write(fds[0], huge, sizeof(huge)), 4);
+    EXPECT_FALSE(ObfuscationServer::read_frame(fds[1], frame));
+
+    close(fds[0]);
+    EXPECT_FALSE(ObfuscationServer::read_frame(fds[1], frame));
+    close(fds[1]);
+}
+
+TEST_F(H5XObfuscationEngineTest, ServerAnswersPingAndShutdown) {
+    ServerOptions options;
+    options.socket_path = testOutputDir + "h5x.sock";
+    options.engines = 1;
+    options.tool_version = "test";
+    ObfuscationServer server(Logger::getInstance(), options);
+
+    bool served = false;
+    std::thread thread([&] { served = server.run(); });
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, options.socket_path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool connected = false;
+    for (int attempt = 0; attempt < 100 && !connected; ++attempt) {
+        connected = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        if (!connected) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    ASSERT_TRUE(connected);
+
+    std::string reply;
+    ASSERT_TRUE(ObfuscationServer::write_frame(fd, "{\"id\":1,\"type\":\"ping\"}"));
+    ASSERT_TRUE(ObfuscationServer::read_frame(fd, reply));
+    EXPECT_NE(reply.find("\"pong\""), std::string::npos);
+
+    ASSERT_TRUE(ObfuscationServer::write_frame(fd, "{\"id\":2,\"type\":\"obfuscate\"}"));
+    ASSERT_TRUE(ObfuscationServer::read_frame(fd, reply));
+    EXPECT_NE(reply.find("\"error\""), std::string::npos);
+
+    ASSERT_TRUE(ObfuscationServer::write_frame(fd, "{\"type\":\"shutdown\"}"));
+    ASSERT_TRUE(ObfuscationServer::read_frame(fd, reply));
+    EXPECT_NE(reply.find("\"bye\""), std::string::npos);
+    close(fd);
+
+    thread.join();
+    EXPECT_TRUE(served);
+    EXPECT_FALSE(std::filesystem::exists(options.socket_path));
+}
+
 } // namespace test
 } // namespace h5x
\ No newline at end of file
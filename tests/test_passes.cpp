@@ -2,12 +2,27 @@
 #include "passes/InstructionSubstitution.hpp"
 #include "passes/StringObfuscation.hpp"
 #include "passes/BogusControlFlow.hpp"
+#include "passes/ControlFlowFlattening.hpp"
+#include "passes/IRCostModel.hpp"
+#include "passes/OverheadBudget.hpp"
+#include "passes/ProfileGuidance.hpp"
+#include "core/IncrementalObfuscator.hpp"
+#include "utils/Logger.hpp"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+#include <filesystem>
+#include <functional>
 
 using namespace llvm;
 
@@ -35,6 +50,41 @@ protected:
         
         builder.CreateRet(mulResult);
     }
+
+    // name(n): i counts from 0 while i < n and is returned. step computes the
+    // next i in the body; by default it is i + 1
+    struct CountingLoop {
+        Function *function;
+        BasicBlock *entry, *head, *body, *exit;
+        PHINode *i;
+        BranchInst *loopBranch;
+    };
+    using LoopStep = std::function<Value *(IRBuilder<> &builder, Value *i, Value *n)>;
+
+    CountingLoop createCountingLoop(const std::string &name, const LoopStep &step = nullptr) {
+        FunctionType *funcType = FunctionType::get(Type::getInt32Ty(*context), {Type::getInt32Ty(*context)}, false);
+        CountingLoop loop;
+        loop.function = Function::Create(funcType, Function::ExternalLinkage, name, *module);
+        loop.entry = BasicBlock::Create(*context, "entry", loop.function);
+        loop.head = BasicBlock::Create(*context, "head", loop.function);
+        loop.body = BasicBlock::Create(*context, "body", loop.function);
+        loop.exit = BasicBlock::Create(*context, "exit", loop.function);
+        Value *n = loop.function->getArg(0);
+
+        IRBuilder<> builder(loop.entry);
+        builder.CreateBr(loop.head);
+        builder.SetInsertPoint(loop.head);
+        loop.i = builder.CreatePHI(builder.getInt32Ty(), 2, "i");
+        loop.loopBranch = builder.CreateCondBr(builder.CreateICmpSLT(loop.i, n), loop.body, loop.exit);
+        builder.SetInsertPoint(loop.body);
+        Value *inc = step ? step(builder, loop.i, n) : builder.CreateAdd(loop.i, builder.getInt32(1), "inc");
+        builder.CreateBr(loop.head);
+        builder.SetInsertPoint(loop.exit);
+        builder.CreateRet(loop.i);
+        loop.i->addIncoming(builder.getInt32(0), loop.entry);
+        loop.i->addIncoming(inc, loop.body);
+        return loop;
+    }
     
     std::unique_ptr<LLVMContext> context;
     std::unique_ptr<Module> module;
@@ -85,6 +135,156 @@ TEST_F(LLVMPassTest, StringObfuscationPass) {
     EXPECT_GT(globalCount, 1); // Should have more than just the original string
 }
 
+TEST_F(LLVMPassTest, StringObfuscationDecryptsOnceInPlace) {
+    Constant *text = ConstantDataArray::getString(*context, "hello, world");
+    Constant *otherText = ConstantDataArray::getString(*context, "bye");
+    auto *message = new GlobalVariable(*module, text->getType(), true, GlobalValue::PrivateLinkage, text, "message");
+    auto *copy = new GlobalVariable(*module, text->getType(), true, GlobalValue::PrivateLinkage, text, "copy");
+    auto *other = new GlobalVariable(*module, otherText->getType(), true, GlobalValue::PrivateLinkage, otherText, "other");
+    FunctionCallee puts = module->getOrInsertFunction("puts",
+        FunctionType::get(Type::getInt32Ty(*context), {PointerType::getUnqual(text->getType())}, false));
+    Function *printer = Function::Create(FunctionType::get(Type::getInt32Ty(*context), false),
+                                         Function::ExternalLinkage, "printer", *module);
+    IRBuilder<> builder(BasicBlock::Create(*context, "entry", printer));
+    builder.CreateCall(puts, {message});
+    builder.CreateCall(puts, {copy});
+    builder.CreateRet(builder.CreateCall(puts, {other}));
+
+    PassOptions options;
+    options.seed = 7;
+    ModuleAnalysisManager MAM;
+    StringObfuscationPass(options).run(*module, MAM);
+    EXPECT_FALSE(verifyModule(*module, &errs()));
+
+    // Every use goes through the one inlinable fast path
+    std::vector<CallInst *> decrypts;
+    for (Instruction &I : printer->getEntryBlock()) {
+        auto *call = dyn_cast<CallInst>(&I);
+        if (call && call->getCalledFunction()->getName() == "h5x_decrypt_once") decrypts.push_back(call);
+    }
+    ASSERT_EQ(decrypts.size(), 3u);
+    Function *once = decrypts[0]->getCalledFunction();
+    EXPECT_TRUE(once->hasFnAttribute(Attribute::AlwaysInline));
+    EXPECT_EQ(message->getNumUses(), 0u);
+    EXPECT_EQ(copy->getNumUses(), 0u);
+
+    // Identical literals share an entry of one writable table; each entry
+    // has its own key and a state byte starting at 0
+    EXPECT_EQ(decrypts[0]->getArgOperand(0), decrypts[1]->getArgOperand(0));
+    EXPECT_EQ(decrypts[0]->getArgOperand(1), decrypts[1]->getArgOperand(1));
+    EXPECT_NE(decrypts[0]->getArgOperand(1), decrypts[2]->getArgOperand(1));
+    GlobalVariable *table = module->getNamedGlobal("h5x_string_table");
+    GlobalVariable *states = module->getNamedGlobal("h5x_string_states");
+    ASSERT_NE(table, nullptr);
+    ASSERT_NE(states, nullptr);
+    EXPECT_FALSE(table->isConstant());
+    EXPECT_FALSE(states->isConstant());
+    EXPECT_TRUE(states->getInitializer()->isNullValue());
+    EXPECT_EQ(cast<ArrayType>(states->getValueType())->getNumElements(), 2u);
+    EXPECT_EQ(decrypts[0]->getArgOperand(0)->stripPointerCasts(), table);
+    EXPECT_EQ(cast<ConstantInt>(decrypts[0]->getArgOperand(2))->getZExtValue(), 12u);
+    EXPECT_EQ(cast<ConstantInt>(decrypts[2]->getArgOperand(2))->getZExtValue(), 3u);
+
+    // The slow path claims the string with a compare-exchange and XORs it
+    // in place, whole vectors first; applying the entry's key to the table
+    // gives the plaintext back
+    Function *slow = nullptr;
+    for (Instruction &I : instructions(*once)) {
+        if (auto *call = dyn_cast<CallInst>(&I)) slow = call->getCalledFunction();
+    }
+    ASSERT_NE(slow, nullptr);
+    EXPECT_TRUE(slow->hasFnAttribute(Attribute::NoInline));
+    bool claims = false;
+    bool vectorised = false;
+    for (Instruction &I : instructions(*slow)) {
+        claims |= isa<AtomicCmpXchgInst>(I);
+        vectorised |= I.getOpcode() == Instruction::Xor && I.getType()->isVectorTy();
+    }
+    EXPECT_TRUE(claims);
+    EXPECT_TRUE(vectorised);
+    auto decrypt = [&](CallInst *call, size_t offset) {
+        StringRef ciphertext = cast<ConstantDataArray>(table->getInitializer())->getRawDataValues();
+        size_t length = cast<ConstantInt>(call->getArgOperand(2))->getZExtValue();
+        auto key = static_cast<uint8_t>(cast<ConstantInt>(call->getArgOperand(3))->getZExtValue());
+        std::string decrypted;
+        for (size_t i = 0; i < length; ++i) {
+            decrypted.push_back(static_cast<char>(ciphertext[offset + i] ^ key));
+        }
+        EXPECT_EQ(ciphertext[offset + length], '\0');
+        return decrypted;
+    };
+    EXPECT_EQ(decrypt(decrypts[0], 0), "hello, world");
+    EXPECT_EQ(decrypt(decrypts[2], 13), "bye");
+    EXPECT_EQ(cast<ArrayType>(table->getValueType())->getNumElements(), 17u);
+}
+
+TEST_F(LLVMPassTest, StringObfuscationDecryptsAtStartup) {
+    Constant *first = ConstantDataArray::getString(*context, "hello, world");
+    Constant *second = ConstantDataArray::getString(*context, "a longer second string");
+    auto *greeting = new GlobalVariable(*module, first->getType(), true, GlobalValue::PrivateLinkage, first, "greeting");
+    auto *farewell = new GlobalVariable(*module, second->getType(), true, GlobalValue::PrivateLinkage, second, "farewell");
+    FunctionCallee puts = module->getOrInsertFunction("puts",
+        FunctionType::get(Type::getInt32Ty(*context), {PointerType::getUnqual(first->getType())}, false));
+    Function *printer = Function::Create(FunctionType::get(Type::getInt32Ty(*context), false),
+                                         Function::ExternalLinkage, "printer", *module);
+    IRBuilder<> builder(BasicBlock::Create(*context, "entry", printer));
+    CallInst *printGreeting = builder.CreateCall(puts, {greeting});
+    CallInst *printFarewell = builder.CreateCall(puts, {farewell});
+    builder.CreateRet(printFarewell);
+
+    PassOptions options;
+    options.seed = 7;
+    ModuleAnalysisManager MAM;
+    StringObfuscationPass(options, StringDecryption::AtStartup).run(*module, MAM);
+    EXPECT_FALSE(verifyModule(*module, &errs()));
+
+    // Both strings live in one writable blob, NULs included
+    GlobalVariable *blob = module->getNamedGlobal("h5x_string_blob");
+    ASSERT_NE(blob, nullptr);
+    EXPECT_FALSE(blob->isConstant());
+    EXPECT_EQ(blob->getAlign().valueOrOne().value(), 16u);
+    StringRef ciphertext = cast<ConstantDataArray>(blob->getInitializer())->getRawDataValues();
+    ASSERT_EQ(ciphertext.size(), 36u);
+
+    // Uses are constant addresses into the blob, with no call left
+    EXPECT_EQ(greeting->getNumUses(), 0u);
+    EXPECT_EQ(farewell->getNumUses(), 0u);
+    auto offsetOf = [&](CallInst *call) {
+        auto *address = dyn_cast<ConstantExpr>(call->getArgOperand(0));
+        EXPECT_NE(address, nullptr);
+        EXPECT_EQ(address->getOperand(0), blob);
+        return cast<ConstantInt>(address->getOperand(address->getNumOperands() - 1))->getZExtValue();
+    };
+    EXPECT_EQ(offsetOf(printGreeting), 0u);
+    EXPECT_EQ(offsetOf(printFarewell), 13u);
+    size_t calls = 0;
+    for (Instruction &I : printer->getEntryBlock()) calls += isa<CallInst>(I);
+    EXPECT_EQ(calls, 2u);
+
+    // One constructor decrypts the whole blob, whole vectors then the tail
+    GlobalVariable *ctors = module->getNamedGlobal("llvm.global_ctors");
+    ASSERT_NE(ctors, nullptr);
+    auto *entry = cast<ConstantStruct>(cast<ConstantArray>(ctors->getInitializer())->getOperand(0));
+    auto *decryptor = dyn_cast<Function>(entry->getOperand(1));
+    ASSERT_NE(decryptor, nullptr);
+    EXPECT_EQ(decryptor->getName(), "h5x_decrypt_strings");
+    EXPECT_EQ(cast<ConstantInt>(entry->getOperand(0))->getZExtValue(), 101u);
+
+    ConstantDataVector *key = nullptr;
+    for (Instruction &I : instructions(*decryptor)) {
+        if (I.getOpcode() == Instruction::Xor && I.getType()->isVectorTy()) {
+            key = dyn_cast<ConstantDataVector>(I.getOperand(1));
+        }
+    }
+    ASSERT_NE(key, nullptr);
+    ASSERT_EQ(key->getNumElements(), 16u);
+    std::string decrypted;
+    for (size_t i = 0; i < ciphertext.size(); ++i) {
+        decrypted.push_back(static_cast<char>(ciphertext[i] ^ key->getElementAsInteger(i % 16)));
+    }
+    EXPECT_EQ(decrypted, std::string("hello, world\0a longer second string\0", 36));
+}
+
 TEST_F(LLVMPassTest, BogusControlFlowPass) {
     BogusControlFlowPass pass;
     ModuleAnalysisManager MAM;
@@ -102,5 +302,443 @@ TEST_F(LLVMPassTest, BogusControlFlowPass) {
     EXPECT_GE(transformedBlocks, originalBlocks);
 }
 
+TEST_F(LLVMPassTest, ControlFlowFlatteningKeepsLoopsValid) {
+    // sum(n) = 0 + 1 + ... + (n - 1), with PHIs carried around the loop
+    CountingLoop loop = createCountingLoop("sum");
+    Function *sum = loop.function;
+    IRBuilder<> builder(loop.head->getFirstNonPHI());
+    PHINode *acc = builder.CreatePHI(builder.getInt32Ty(), 2, "acc");
+    builder.SetInsertPoint(loop.body->getTerminator());
+    Value *next = builder.CreateAdd(acc, loop.i, "next");
+    acc->addIncoming(builder.getInt32(0), loop.entry);
+    acc->addIncoming(next, loop.body);
+    cast<ReturnInst>(loop.exit->getTerminator())->setOperand(0, acc);
+
+    PassOptions options;
+    options.seed = 42;
+    ModuleAnalysisManager MAM;
+    ControlFlowFlatteningPass(options).run(*module, MAM);
+
+    EXPECT_FALSE(verifyModule(*module, &errs()));
+    EXPECT_TRUE(pred_empty(&sum->getEntryBlock()));
+
+    // The return value must still come from the loop
+    bool returnsLoaded = false;
+    for (BasicBlock &BB : *sum) {
+        if (auto *ret = dyn_cast<ReturnInst>(BB.getTerminator())) {
+            returnsLoaded = !isa<Constant>(ret->getReturnValue());
+        }
+    }
+    EXPECT_TRUE(returnsLoaded);
+}
+
+TEST_F(LLVMPassTest, ControlFlowFlatteningEmitsNoBranchWeights) {
+    // A loop known to be hot must not make the dispatcher say so, in either layout
+    for (DispatcherLayout layout : {DispatcherLayout::Flat, DispatcherLayout::Clustered}) {
+        CountingLoop loop = createCountingLoop("count");
+        Function *count = loop.function;
+        loop.loopBranch->setMetadata(LLVMContext::MD_prof, MDBuilder(*context).createBranchWeights(1000, 1));
+
+        PassOptions options;
+        options.seed = 42;
+        FlatteningOptions flattening;
+        flattening.dispatcher = layout;
+        ModuleAnalysisManager MAM;
+        ControlFlowFlatteningPass(options, flattening).run(*module, MAM);
+        EXPECT_FALSE(verifyModule(*module, &errs()));
+
+        size_t switches = 0;
+        for (Instruction &I : instructions(*count)) {
+            if (!isa<SwitchInst>(I)) continue;
+            ++switches;
+            EXPECT_EQ(I.getMetadata(LLVMContext::MD_prof), nullptr);
+        }
+        EXPECT_GT(switches, 0u);
+        count->eraseFromParent();
+    }
+}
+
+TEST_F(LLVMPassTest, ControlFlowFlatteningClustersDispatch) {
+    // A chain of six if/else diamonds, each adding or doubling depending on
+    // one bit of the argument
+    FunctionType *funcType = FunctionType::get(Type::getInt32Ty(*context), {Type::getInt32Ty(*context)}, false);
+    Function *mix = Function::Create(funcType, Function::ExternalLinkage, "mix", *module);
+    IRBuilder<> builder(BasicBlock::Create(*context, "entry", mix));
+    Value *acc = builder.getInt32(1);
+    for (int bit = 0; bit < 6; ++bit) {
+        BasicBlock *addBlock = BasicBlock::Create(*context, "add", mix);
+        BasicBlock *doubleBlock = BasicBlock::Create(*context, "double", mix);
+        BasicBlock *join = BasicBlock::Create(*context, "join", mix);
+        Value *set = builder.CreateICmpNE(builder.CreateAnd(mix->getArg(0), builder.getInt32(1 << bit)),
+                                          builder.getInt32(0));
+        builder.CreateCondBr(set, addBlock, doubleBlock);
+        builder.SetInsertPoint(addBlock);
+        Value *added = builder.CreateAdd(acc, builder.getInt32(bit + 3));
+        builder.CreateBr(join);
+        builder.SetInsertPoint(doubleBlock);
+        Value *doubled = builder.CreateShl(acc, 1);
+        builder.CreateBr(join);
+        builder.SetInsertPoint(join);
+        PHINode *merged = builder.CreatePHI(builder.getInt32Ty(), 2);
+        merged->addIncoming(added, addBlock);
+        merged->addIncoming(doubled, doubleBlock);
+        acc = merged;
+    }
+    builder.CreateRet(acc);
+
+    PassOptions options;
+    options.seed = 42;
+    FlatteningOptions flattening;
+    flattening.dispatcher = DispatcherLayout::Clustered;
+    flattening.clusterSize = 4;
+    ModuleAnalysisManager MAM;
+    ControlFlowFlatteningPass(options, flattening).run(*module, MAM);
+    EXPECT_FALSE(verifyModule(*module, &errs()));
+
+    // The state is a phi rather than a stack slot
+    for (Instruction &I : instructions(*mix)) {
+        EXPECT_NE(I.getName(), "switch_var");
+    }
+    BasicBlock *dispatcher = nullptr;
+    std::vector<BasicBlock *> clusters;
+    for (BasicBlock &BB : *mix) {
+        if (BB.getName() == "dispatcher") dispatcher = &BB;
+        if (BB.getName().starts_with("cluster_dispatcher")) clusters.push_back(&BB);
+    }
+    ASSERT_NE(dispatcher, nullptr);
+    EXPECT_TRUE(isa<PHINode>(dispatcher->front()));
+
+    // 19 dispatched blocks in clusters of 4; each cluster switches over its
+    // own dense range of states, and some edges skip the top dispatcher
+    EXPECT_EQ(clusters.size(), 5u);
+    EXPECT_EQ(cast<SwitchInst>(dispatcher->getTerminator())->getNumCases(), clusters.size());
+    size_t cases = 0;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        auto *clusterSwitch = cast<SwitchInst>(clusters[c]->getTerminator());
+        EXPECT_LE(clusterSwitch->getNumCases(), 4u);
+        for (auto &switchCase : clusterSwitch->cases()) {
+            EXPECT_EQ(switchCase.getCaseValue()->getZExtValue() >> 2, c);
+        }
+        cases += clusterSwitch->getNumCases();
+        EXPECT_GT(pred_size(clusters[c]), 1u);
+    }
+    EXPECT_EQ(cases, 19u);
+}
+
+TEST_F(LLVMPassTest, ControlFlowFlatteningPreservesInnermostLoops) {
+    // tri(n) = sum over i < n of (0 + 1 + ... + (i - 1)), as nested loops
+    FunctionType *funcType = FunctionType::get(Type::getInt32Ty(*context), {Type::getInt32Ty(*context)}, false);
+    Function *tri = Function::Create(funcType, Function::ExternalLinkage, "tri", *module);
+    BasicBlock *entry = BasicBlock::Create(*context, "entry", tri);
+    BasicBlock *outer = BasicBlock::Create(*context, "outer", tri);
+    BasicBlock *innerPre = BasicBlock::Create(*context, "inner_pre", tri);
+    BasicBlock *inner = BasicBlock::Create(*context, "inner", tri);
+    BasicBlock *innerBody = BasicBlock::Create(*context, "inner_body", tri);
+    BasicBlock *outerLatch = BasicBlock::Create(*context, "outer_latch", tri);
+    BasicBlock *done = BasicBlock::Create(*context, "done", tri);
+
+    IRBuilder<> builder(entry);
+    builder.CreateBr(outer);
+    builder.SetInsertPoint(outer);
+    PHINode *i = builder.CreatePHI(builder.getInt32Ty(), 2, "i");
+    PHINode *acc = builder.CreatePHI(builder.getInt32Ty(), 2, "acc");
+    builder.CreateCondBr(builder.CreateICmpSLT(i, tri->getArg(0)), innerPre, done);
+    builder.SetInsertPoint(innerPre);
+    builder.CreateBr(inner);
+    builder.SetInsertPoint(inner);
+    PHINode *j = builder.CreatePHI(builder.getInt32Ty(), 2, "j");
+    PHINode *partial = builder.CreatePHI(builder.getInt32Ty(), 2, "partial");
+    builder.CreateCondBr(builder.CreateICmpSLT(j, i), innerBody, outerLatch);
+    builder.SetInsertPoint(innerBody);
+    Value *added = builder.CreateAdd(partial, j, "added");
+    Value *nextJ = builder.CreateAdd(j, builder.getInt32(1), "next_j");
+    builder.CreateBr(inner);
+    builder.SetInsertPoint(outerLatch);
+    Value *nextI = builder.CreateAdd(i, builder.getInt32(1), "next_i");
+    builder.CreateBr(outer);
+    builder.SetInsertPoint(done);
+    builder.CreateRet(acc);
+    i->addIncoming(builder.getInt32(0), entry);
+    i->addIncoming(nextI, outerLatch);
+    acc->addIncoming(builder.getInt32(0), entry);
+    acc->addIncoming(partial, outerLatch);
+    j->addIncoming(builder.getInt32(0), innerPre);
+    j->addIncoming(nextJ, innerBody);
+    partial->addIncoming(acc, innerPre);
+    partial->addIncoming(added, innerBody);
+
+    PassOptions options;
+    options.seed = 42;
+    FlatteningOptions flattening;
+    flattening.preserveInnermostLoops = true;
+    ModuleAnalysisManager MAM;
+    ControlFlowFlatteningPass(options, flattening).run(*module, MAM);
+    EXPECT_FALSE(verifyModule(*module, &errs()));
+
+    // The inner loop keeps its back edge and stays a natural loop; only its
+    // exit goes through the dispatcher
+    auto *backEdge = cast<BranchInst>(innerBody->getTerminator());
+    ASSERT_TRUE(backEdge->isUnconditional());
+    EXPECT_EQ(backEdge->getSuccessor(0), inner);
+    auto *exitBranch = cast<BranchInst>(inner->getTerminator());
+    ASSERT_TRUE(exitBranch->isConditional());
+    EXPECT_EQ(exitBranch->getSuccessor(0), innerBody);
+    EXPECT_EQ(exitBranch->getSuccessor(1)->getName(), "loop_exit");
+
+    DominatorTree DT(*tri);
+    LoopInfo LI(DT);
+    Loop *innerLoop = LI.getLoopFor(innerBody);
+    ASSERT_NE(innerLoop, nullptr);
+    EXPECT_EQ(innerLoop->getHeader(), inner);
+
+    // The outer loop is flattened: its latch returns to the dispatcher
+    EXPECT_EQ(outerLatch->getTerminator()->getSuccessor(0)->getName(), "dispatcher");
+}
+
+TEST_F(LLVMPassTest, IRCostModelWeightsBlocksByFrequency) {
+    // count(n): loop that runs n times, with the loop branch kept for weights
+    CountingLoop loop = createCountingLoop("count", [](IRBuilder<> &builder, Value *i, Value *) {
+        return builder.CreateAdd(builder.CreateMul(i, i), builder.getInt32(1), "inc");
+    });
+    Function *count = loop.function;
+    BasicBlock *entry = loop.entry;
+    BasicBlock *body = loop.body;
+    BranchInst *loopBranch = loop.loopBranch;
+
+    // Static heuristics: the loop body runs many times per call
+    auto frequencies = IRCostModel::blockFrequencies(*count);
+    EXPECT_DOUBLE_EQ(frequencies[entry], 1.0);
+    EXPECT_GT(frequencies[body], 4.0);
+
+    IRCostModel model;
+    FunctionCost loopCost = model.analyzeFunction(*count);
+    FunctionCost straightCost = model.analyzeFunction(*testFunction);
+    EXPECT_GT(loopCost.selfCost, loopCost.staticCost);
+    EXPECT_DOUBLE_EQ(straightCost.selfCost, straightCost.staticCost);
+
+    // Profile weights saying the loop rarely iterates make it cheap
+    loopBranch->setMetadata(LLVMContext::MD_prof, MDBuilder(*context).createBranchWeights(1, 99));
+    EXPECT_LT(IRCostModel::blockFrequencies(*count)[body], 0.1);
+    EXPECT_LT(model.analyzeFunction(*count).selfCost, loopCost.selfCost);
+    loopBranch->setMetadata(LLVMContext::MD_prof, nullptr);
+
+    // Calls are costed at their call site, and flattening is predicted to cost
+    Function *caller = Function::Create(FunctionType::get(Type::getInt32Ty(*context), false),
+                                        Function::ExternalLinkage, "caller", *module);
+    IRBuilder<> builder(BasicBlock::Create(*context, "entry", caller));
+    builder.CreateRet(builder.CreateCall(count, {builder.getInt32(8)}));
+    ModuleCost before = model.analyzeModule(*module);
+    EXPECT_GT(before.functions[caller].inclusiveCost, before.functions[count].inclusiveCost);
+    EXPECT_DOUBLE_EQ(before.functions[caller].executions, 1.0);
+    EXPECT_DOUBLE_EQ(before.functions[count].executions, 1.0);
+
+    PassOptions options;
+    options.seed = 42;
+    ModuleAnalysisManager MAM;
+    ControlFlowFlatteningPass(options).run(*module, MAM);
+    EXPECT_GT(IRCostModel::estimateSlowdown(before, model.analyzeModule(*module)), 1.0);
+}
+
+TEST_F(LLVMPassTest, ProfileGuidanceKeepsHotFunctionsFast) {
+    // Same loop in two functions; the profile says only one of them is hot
+    auto createLoop = [this](const std::string &name, uint64_t entryCount) {
+        CountingLoop loop = createCountingLoop(name, [](IRBuilder<> &builder, Value *i, Value *n) {
+            return builder.CreateAdd(builder.CreateXor(i, n), builder.getInt32(1), "inc");
+        });
+        loop.loopBranch->setMetadata(LLVMContext::MD_prof, MDBuilder(*context).createBranchWeights(1000, 1));
+        loop.function->setEntryCount(entryCount);
+        return loop.function;
+    };
+    Function *hot = createLoop("hot", 1000000);
+    Function *cold = createLoop("cold", 1);
+
+    ProfileGuidance guidance;
+    const GuidanceReport &report = guidance.plan(*module, {GuidedPass::ControlFlowFlattening,
+                                                           GuidedPass::InstructionSubstitution}, 0.05);
+    ASSERT_TRUE(report.profiled);
+    EXPECT_GT(report.unguidedOverhead, report.overheadBudget);
+    EXPECT_LE(report.projectedOverhead, report.overheadBudget);
+    ASSERT_EQ(report.downgrades.size(), 1u);
+    EXPECT_EQ(report.downgrades[0].function, "hot");
+    EXPECT_GT(report.downgrades[0].avoidedOverhead, 0.0);
+    EXPECT_NE(guidance.getTier(*hot), ObfuscationTier::Full);
+    EXPECT_EQ(guidance.getTier(*cold), ObfuscationTier::Full);
+
+    // The hot loop body keeps its instructions; the cold function is flattened
+    BasicBlock *hotBody = &*std::next(hot->begin(), 2);
+    size_t hotBodySize = hotBody->size();
+    size_t hotBlocks = hot->size();
+    size_t coldBlocks = cold->size();
+
+    PassOptions options;
+    options.seed = 42;
+    ModuleAnalysisManager MAM;
+    InstructionSubstitutionPass(guidance.optionsFor(GuidedPass::InstructionSubstitution, options)).run(*module, MAM);
+    ControlFlowFlatteningPass(guidance.optionsFor(GuidedPass::ControlFlowFlattening, options)).run(*module, MAM);
+
+    EXPECT_FALSE(verifyModule(*module, &errs()));
+    EXPECT_EQ(hotBody->size(), hotBodySize);
+    EXPECT_EQ(hot->size(), hotBlocks);
+    EXPECT_GT(cold->size(), coldBlocks);
+
+    std::string error;
+    EXPECT_FALSE(ProfileGuidance::loadProfile(*module, "missing.profdata", error));
+    EXPECT_FALSE(error.empty());
+}
+
+TEST_F(LLVMPassTest, OverheadBudgetRollsBackExpensiveFunctions) {
+    // handler(n): a hot loop that flattening slows down
+    Function *handler = createCountingLoop("handler", [](IRBuilder<> &builder, Value *i, Value *n) {
+        return builder.CreateAdd(builder.CreateXor(i, n), builder.getInt32(1), "inc");
+    }).function;
+
+    auto flatten = [](Module &M, const PassOptions &options) {
+        ModuleAnalysisManager MAM;
+        ControlFlowFlatteningPass(options).run(M, MAM);
+    };
+    PassOptions options;
+    options.seed = 42;
+
+    // The loop may not get 50% slower; the straight-line function is not slowed
+    size_t handlerBlocks = handler->size();
+    BudgetLimits limits;
+    limits.functionSlowdown = 1.5;
+    OverheadBudget budget(*module, limits);
+    const PassBudgetOutcome &outcome = budget.run("flattening", options, flatten);
+
+    EXPECT_FALSE(verifyModule(*module, &errs()));
+    EXPECT_EQ(handler->size(), handlerBlocks);
+    ASSERT_EQ(outcome.rolledBack.size(), 1u);
+    EXPECT_EQ(outcome.rolledBack[0], "handler");
+    EXPECT_DOUBLE_EQ(budget.getFunctionSlowdown(*handler), 1.0);
+    EXPECT_LE(budget.getFunctionSlowdown(*testFunction), limits.functionSlowdown);
+
+    // Without limits the same pass is accepted and replayed as tried
+    OverheadBudget unlimited(*module, BudgetLimits());
+    const PassBudgetOutcome &accepted = unlimited.run("flattening", options, flatten);
+    EXPECT_TRUE(accepted.rolledBack.empty());
+    EXPECT_EQ(accepted.trials, 1u);
+    EXPECT_GT(handler->size(), handlerBlocks);
+    EXPECT_GT(unlimited.getModuleSlowdown(), 1.0);
+    EXPECT_FALSE(verifyModule(*module, &errs()));
+
+    // With no room left in the module budget, everything that adds cost is undone
+    std::string printed;
+    raw_string_ostream before(printed);
+    module->print(before, nullptr);
+    BudgetLimits tight;
+    tight.moduleSlowdown = 1.0;
+    OverheadBudget exhausted(*module, tight);
+    const PassBudgetOutcome &skipped = exhausted.run("substitution", options, [](Module &M, const PassOptions &opts) {
+        ModuleAnalysisManager MAM;
+        InstructionSubstitutionPass(opts).run(M, MAM);
+    });
+    EXPECT_FALSE(skipped.rolledBack.empty());
+    EXPECT_DOUBLE_EQ(exhausted.getModuleSlowdown(), 1.0);
+    std::string after;
+    raw_string_ostream afterStream(after);
+    module->print(afterStream, nullptr);
+    EXPECT_EQ(before.str(), afterStream.str());
+}
+
+TEST_F(LLVMPassTest, PerFunctionSeedsIgnoreOtherFunctions) {
+    // Same seed: func_7 comes out the same whether or not the rest of the
+    // module is transformed alongside it
+    auto runWithFilter = [](bool onlyOne) {
+        LLVMContext ctx;
+        Module mod("seeded_module", ctx);
+        for (int i = 0; i < 16; ++i) {
+            FunctionType *funcType = FunctionType::get(Type::getInt32Ty(ctx), {Type::getInt32Ty(ctx)}, false);
+            Function *func = Function::Create(funcType, Function::InternalLinkage, "func_" + std::to_string(i), mod);
+            IRBuilder<> builder(BasicBlock::Create(ctx, "entry", func));
+            Value *sum = builder.CreateAdd(func->getArg(0), builder.getInt32(i), "sum");
+            builder.CreateRet(builder.CreateSub(sum, builder.getInt32(3), "diff"));
+        }
+
+        PassOptions options;
+        options.seed = 1234;
+        if (onlyOne) {
+            options.function_filter = [](const Function &F) { return F.getName() == "func_7"; };
+        }
+
+        ModuleAnalysisManager MAM;
+        InstructionSubstitutionPass(options).run(mod, MAM);
+
+        std::string printed;
+        raw_string_ostream os(printed);
+        mod.getFunction("func_7")->print(os);
+        return os.str();
+    };
+
+    EXPECT_EQ(runWithFilter(true), runWithFilter(false));
+}
+
+TEST_F(LLVMPassTest, IncrementalObfuscationReusesUnchangedFunctions) {
+    const std::string stateDir = "incremental_state";
+    std::filesystem::remove_all(stateDir);
+
+    // Three functions printing a string; `variant` only changes func_1
+    auto buildModule = [](LLVMContext &ctx, int variant) {
+        auto mod = std::make_unique<Module>("incremental_module", ctx);
+        // All messages are [10 x i8], so the strings can be passed directly
+        Type *messageTy = ArrayType::get(Type::getInt8Ty(ctx), 10);
+        FunctionCallee puts = mod->getOrInsertFunction("puts",
+            FunctionType::get(Type::getInt32Ty(ctx), {PointerType::getUnqual(messageTy)}, false));
+        for (int i = 0; i < 3; ++i) {
+            FunctionType *funcType = FunctionType::get(Type::getInt32Ty(ctx), {Type::getInt32Ty(ctx)}, false);
+            Function *func = Function::Create(funcType, Function::InternalLinkage, "func_" + std::to_string(i), *mod);
+            IRBuilder<> builder(BasicBlock::Create(ctx, "entry", func));
+            Constant *text = ConstantDataArray::getString(ctx, "message " + std::to_string(i));
+            auto *str = new GlobalVariable(*mod, text->getType(), true, GlobalValue::PrivateLinkage,
+                                           text, "msg_" + std::to_string(i));
+            builder.CreateCall(puts, {str});
+            int addend = (i == 1) ? variant : i;
+            Value *sum = builder.CreateAdd(func->getArg(0), builder.getInt32(addend), "sum");
+            builder.CreateRet(builder.CreateSub(sum, builder.getInt32(3), "diff"));
+        }
+        return mod;
+    };
+
+    auto pipeline = [](Module &mod, const PassOptions &options) {
+        ModuleAnalysisManager MAM;
+        StringObfuscationPass(options).run(mod, MAM);
+        InstructionSubstitutionPass(options).run(mod, MAM);
+        return true;
+    };
+
+    auto printFunction = [](Module &mod, const std::string &name) {
+        std::string printed;
+        raw_string_ostream os(printed);
+        mod.getFunction(name)->print(os);
+        return os.str();
+    };
+
+    IncrementalObfuscator incremental(Logger::getInstance(), stateDir);
+
+    LLVMContext firstCtx;
+    auto first = buildModule(firstCtx, 0);
+    ASSERT_TRUE(incremental.run(*first, PassOptions(), pipeline, "test"));
+    EXPECT_EQ(incremental.get_stats().functions_obfuscated, 3u);
+    EXPECT_EQ(incremental.get_stats().functions_reused, 0u);
+
+    // Only func_1 changes; the others keep their obfuscated bodies
+    LLVMContext secondCtx;
+    auto second = buildModule(secondCtx, 7);
+    ASSERT_TRUE(incremental.run(*second, PassOptions(), pipeline, "test"));
+    EXPECT_EQ(incremental.get_stats().functions_obfuscated, 1u);
+    EXPECT_EQ(incremental.get_stats().functions_reused, 2u);
+    EXPECT_EQ(printFunction(*second, "func_0"), printFunction(*first, "func_0"));
+    EXPECT_EQ(printFunction(*second, "func_2"), printFunction(*first, "func_2"));
+    EXPECT_FALSE(verifyModule(*second, &errs()));
+
+    // A different pipeline key invalidates the state
+    LLVMContext thirdCtx;
+    auto third = buildModule(thirdCtx, 7);
+    ASSERT_TRUE(incremental.run(*third, PassOptions(), pipeline, "other"));
+    EXPECT_EQ(incremental.get_stats().functions_reused, 0u);
+
+    std::filesystem::remove_all(stateDir);
+}
+
 } // namespace test
 } // namespace h5x
\ No newline at end of file
@@ -2,8 +2,14 @@
 #include "utils/ConfigParser.hpp"
 #include "utils/Logger.hpp"
 #include "utils/FileUtils.hpp"
+#include "utils/HashUtils.hpp"
+#include "utils/ThreadPool.hpp"
+#include <atomic>
+#include <csignal>
+#include <cstdio>
 #include <fstream>
 #include <filesystem>
+#include <thread>
 
 namespace h5x {
 namespace test {
@@ -119,6 +125,173 @@ TEST_F(UtilsTest, LoggerLevelFiltering) {
     EXPECT_TRUE(logContent.find("Error message") != std::string::npos);
 }
 
+TEST_F(UtilsTest, LoggerAsyncWritesEveryMessageInThreadOrder) {
+    {
+        Logger logger;
+        logger.setConsoleOutput(false);
+        logger.initialize(testLogFile, LogLevel::DEBUG);
+        logger.enableAsync();
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&logger, t] {
+                for (int i = 0; i < 500; ++i) {
+                    logger.info("thread " + std::to_string(t) + " message " + std::to_string(i));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        logger.flush();
+        EXPECT_EQ(logger.droppedMessages(), 0u);
+    }
+
+    std::ifstream logFile(testLogFile);
+    std::vector<int> next(4, 0);
+    std::string line;
+    size_t messages = 0;
+    while (std::getline(logFile, line)) {
+        size_t pos = line.find("] thread ");
+        if (pos == std::string::npos) continue;
+        int thread = 0, index = 0;
+        ASSERT_EQ(std::sscanf(line.c_str() + pos, "] thread %d message %d", &thread, &index), 2);
+        EXPECT_EQ(index, next[thread]++);
+        messages++;
+    }
+    EXPECT_EQ(messages, 2000u);
+}
+
+TEST_F(UtilsTest, LoggerAsyncDropPolicyCountsDiscardedMessages) {
+    Logger logger;
+    logger.setConsoleOutput(false);
+    logger.initialize(testLogFile, LogLevel::DEBUG);
+
+    AsyncLogOptions options;
+    options.ring_capacity = 4;
+    options.flush_interval = std::chrono::milliseconds(1000);
+    options.overflow = LogOverflowPolicy::DROP;
+    logger.enableAsync(options);
+
+    for (int i = 0; i < 100; ++i) {
+        logger.debug("burst " + std::to_string(i));
+    }
+    EXPECT_GT(logger.droppedMessages(), 0u);
+    logger.disableAsync();
+
+    std::ifstream logFile(testLogFile);
+    std::string content((std::istreambuf_iterator<char>(logFile)), std::istreambuf_iterator<char>());
+    EXPECT_NE(content.find("burst 0"), std::string::npos);
+    EXPECT_NE(content.find("messages (ring buffer full)"), std::string::npos);
+}
+
+TEST_F(UtilsTest, LoggerAsyncBlockPolicyKeepsEveryMessage) {
+    {
+        Logger logger;
+        logger.setConsoleOutput(false);
+        logger.initialize(testLogFile, LogLevel::DEBUG);
+
+        // A tiny ring and a slow timer: producers must wait for the writer
+        AsyncLogOptions options;
+        options.ring_capacity = 4;
+        options.flush_interval = std::chrono::milliseconds(1000);
+        options.overflow = LogOverflowPolicy::BLOCK;
+        logger.enableAsync(options);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 200; ++i) {
+            logger.debug("blocked " + std::to_string(i));
+        }
+        // Woken by the producers, not by the flush interval
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+        EXPECT_EQ(logger.droppedMessages(), 0u);
+    }
+
+    std::ifstream logFile(testLogFile);
+    std::string content((std::istreambuf_iterator<char>(logFile)), std::istreambuf_iterator<char>());
+    EXPECT_NE(content.find("blocked 0\n"), std::string::npos);
+    EXPECT_NE(content.find("blocked 199\n"), std::string::npos);
+}
+
+TEST_F(UtilsTest, LoggerAsyncCanBeToggledWhileThreadsLog) {
+    std::atomic<int> logged{0};
+    {
+        Logger logger;
+        logger.setConsoleOutput(false);
+        logger.initialize(testLogFile, LogLevel::DEBUG);
+        logger.enableAsync();
+
+        std::atomic<bool> done{false};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&] {
+                while (!done.load()) {
+                    logger.info("toggle message");
+                    logged++;
+                }
+            });
+        }
+        for (int cycle = 0; cycle < 20; ++cycle) {
+            logger.disableAsync();
+            logger.enableAsync();
+        }
+        done = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::ifstream logFile(testLogFile);
+    std::string line;
+    int written = 0;
+    while (std::getline(logFile, line)) {
+        if (line.find("toggle message") != std::string::npos) written++;
+    }
+    EXPECT_EQ(written, logged.load());
+}
+
+TEST_F(UtilsTest, LoggerAsyncWritesPendingMessagesOnCrash) {
+    EXPECT_EXIT({
+        Logger logger;
+        logger.setConsoleOutput(false);
+        logger.initialize(testLogFile, LogLevel::DEBUG);
+
+        AsyncLogOptions options;
+        options.flush_interval = std::chrono::hours(1);
+        logger.enableAsync(options);
+        logger.info("last words before the crash");
+        std::raise(SIGABRT);
+    }, ::testing::KilledBySignal(SIGABRT), "");
+
+    std::ifstream logFile(testLogFile);
+    std::string content((std::istreambuf_iterator<char>(logFile)), std::istreambuf_iterator<char>());
+    EXPECT_NE(content.find("last words before the crash\n"), std::string::npos);
+}
+
+TEST_F(UtilsTest, LoggerMacroSkipsDisabledMessages) {
+    Logger logger;
+    logger.setConsoleOutput(false);
+    logger.initialize(testLogFile, LogLevel::WARNING);
+
+    int built = 0;
+    auto message = [&built](const std::string& text) {
+        built++;
+        return text;
+    };
+
+    H5X_LOG_DEBUG(logger, message("debug"));
+    H5X_LOG_INFO(logger, message("info"));
+    EXPECT_EQ(built, 0);
+
+    H5X_LOG_WARNING(logger, message("warning"));
+    EXPECT_EQ(built, 1);
+
+    logger.setLevel(LogLevel::DEBUG);
+    EXPECT_TRUE(logger.isEnabled(LogLevel::DEBUG));
+    H5X_LOG_DEBUG(logger, message("debug"));
+    EXPECT_EQ(built, H5X_MIN_LOG_LEVEL > 0 ? 1 : 2);
+}
+
 TEST_F(UtilsTest, FileUtilsReadWriteFile) {
     std::string testFile = "test_file_utils.txt";
     std::string testContent = "This is test content for file operations.";
@@ -171,5 +344,64 @@ TEST_F(UtilsTest, FileUtilsGetFileSize) {
     }
 }
 
+TEST_F(UtilsTest, ThreadPoolParallelForCoversEveryIndex) {
+    ThreadPool pool(4);
+    std::vector<int> visited(1000, 0);
+    std::atomic<size_t> max_worker{0};
+
+    pool.parallel_for(visited.size(), [&](size_t index, size_t worker_id) {
+        visited[index]++;
+        size_t seen = max_worker.load();
+        while (worker_id > seen && !max_worker.compare_exchange_weak(seen, worker_id)) {}
+    });
+
+    for (int count : visited) {
+        EXPECT_EQ(count, 1);
+    }
+    EXPECT_LT(max_worker.load(), pool.size());
+}
+
+TEST_F(UtilsTest, ThreadPoolPropagatesTaskExceptions) {
+    ThreadPool pool(2);
+    EXPECT_THROW(pool.parallel_for(8, [](size_t index, size_t) {
+        if (index == 5) {
+            throw std::runtime_error("task failed");
+        }
+    }), std::runtime_error);
+
+    // The pool stays usable after a failing batch
+    std::atomic<int> ran{0};
+    pool.parallel_for(4, [&](size_t, size_t) { ran++; });
+    EXPECT_EQ(ran.load(), 4);
+}
+
+TEST_F(UtilsTest, HashUtilsSha256KnownVectors) {
+    EXPECT_EQ(HashUtils::sha256_hex("abc"),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    // Incremental updates match a one-shot digest
+    Sha256Hasher hasher;
+    hasher.update("a");
+    hasher.update("bc");
+    EXPECT_EQ(hasher.final_hex(), HashUtils::sha256_hex("abc"));
+
+    std::ofstream(testLogFile, std::ios::binary) << "abc";
+    EXPECT_EQ(HashUtils::sha256_file(testLogFile), HashUtils::sha256_hex("abc"));
+    EXPECT_EQ(HashUtils::sha256_file("does_not_exist.bin"), "");
+}
+
+TEST_F(UtilsTest, HashUtilsSha256FileMatchesInMemoryDigest) {
+    // Not a multiple of the page or read chunk size
+    std::string data((3 << 20) + 7, '\0');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>((i * 131) ^ (i >> 9));
+    }
+    std::ofstream(testLogFile, std::ios::binary) << data;
+    EXPECT_EQ(HashUtils::sha256_file(testLogFile), HashUtils::sha256_hex(data));
+
+    std::ofstream(testLogFile, std::ios::binary | std::ios::trunc).close();
+    EXPECT_EQ(HashUtils::sha256_file(testLogFile), HashUtils::sha256_hex(""));
+}
+
 } // namespace test
 } // namespace h5x
\ No newline at end of file
@@ -4,8 +4,15 @@
 #include <filesystem>
 #include <chrono>
 #include <iomanip>
+#include <algorithm>
+#include <memory>
+#include <csignal>
 
 #include "../src/core/H5XObfuscationEngine.hpp"
+#include "../src/core/BatchObfuscator.hpp"
+#include "../src/core/CachedResult.hpp"
+#include "../src/core/ObfuscationCache.hpp"
+#include "../src/core/ObfuscationServer.hpp"
 #include "../src/utils/Logger.hpp"
 #include "../src/utils/ConfigParser.hpp"
 
@@ -39,6 +46,7 @@ void print_usage() {
     std::cout << "  batch <input_dir> -o <output_dir> Batch obfuscate files\n";
     std::cout << "  analyze <binary>                 Analyze obfuscated binary\n";
     std::cout << "  verify <binary>                  Verify blockchain integrity\n";
+    std::cout << "  serve [--socket <path>]          Keep engines warm and accept jobs over a Unix socket\n";
     std::cout << "  config [show|set] [options]      Manage configuration\n";
     std::cout << "  version                          Show version information\n";
     std::cout << "  help                             Show this help message\n";
@@ -51,6 +59,12 @@ void print_usage() {
     std::cout << "  --blockchain-verify              Enable blockchain verification\n";
     std::cout << "  --target <platform>              Target platform (linux/windows)\n";
     std::cout << "  --report                         Generate detailed report\n";
+    std::cout << "  --threads <n>                    Batch worker count (default: max_threads)\n";
+    std::cout << "  --cache-dir <dir>                Reuse unchanged obfuscation results\n";
+    std::cout << "  --cache-size <mb>                Cache size cap before LRU eviction\n";
+    std::cout << "  -I<dir> -D<macro> -U<macro> -std=<std>  Flags the input is compiled with\n";
+    std::cout << "  --compile-flag <flag>            Any other compiler flag for the input\n";
+    std::cout << "  --socket <path>                  Server socket (default: /tmp/h5x.sock)\n";
     std::cout << "  --verbose                        Verbose output\n";
     std::cout << "  --quiet                          Minimal output\n";
     std::cout << "\n";
@@ -58,6 +72,7 @@ void print_usage() {
     std::cout << "  h5x-cli obfuscate main.cpp -o protected_main --level 4\n";
     std::cout << "  h5x-cli obfuscate app.cpp -o secure_app --ai-optimize --report\n";
     std::cout << "  h5x-cli batch src/ -o obfuscated/ --level 3 --target linux\n";
+    std::cout << "  h5x-cli serve --socket /tmp/h5x.sock --threads 4\n";
     std::cout << "  h5x-cli analyze protected_binary\n";
     std::cout << "  h5x-cli config show\n";
     std::cout << "\n";
@@ -95,8 +110,13 @@ struct CLIArgs {
     std::string output_file;
     std::string config_file;
     std::string profile;
+    std::string cache_dir;
+    std::string socket_path;
+    int cache_size_mb = 0;
     std::vector<std::string> targets;
+    std::vector<std::string> compile_flags;
     int level = 3;
+    int threads = 0;
     bool ai_optimize = false;
     bool blockchain_verify = false;
     bool generate_report = false;
@@ -120,12 +140,25 @@ CLIArgs parse_arguments(int argc, char* argv[]) {
             args.output_file = argv[++i];
         } else if (arg == "--level" && i + 1 < argc) {
             args.level = std::stoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            args.threads = std::stoi(argv[++i]);
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            args.cache_dir = argv[++i];
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            args.cache_size_mb = std::stoi(argv[++i]);
+        } else if (arg == "--socket" && i + 1 < argc) {
+            args.socket_path = argv[++i];
         } else if (arg == "--config" && i + 1 < argc) {
             args.config_file = argv[++i];
         } else if (arg == "--profile" && i + 1 < argc) {
             args.profile = argv[++i];
         } else if (arg == "--target" && i + 1 < argc) {
             args.targets.push_back(argv[++i]);
+        } else if (arg == "--compile-flag" && i + 1 < argc) {
+            args.compile_flags.push_back(argv[++i]);
+        } else if (arg.rfind("-I", 0) == 0 || arg.rfind("-D", 0) == 0 || arg.rfind("-U", 0) == 0 ||
+                   arg.rfind("-std=", 0) == 0) {
+            args.compile_flags.push_back(arg);
         } else if (arg == "--ai-optimize") {
             args.ai_optimize = true;
         } else if (arg == "--blockchain-verify") {
@@ -164,6 +197,24 @@ void print_progress_bar(const std::string& task, double progress) {
     }
 }
 
+std::unique_ptr<ObfuscationCache> open_cache(const CLIArgs& args, const ObfuscationConfig& config) {
+    if (args.cache_dir.empty() && !config.enable_cache) {
+        return nullptr;
+    }
+    std::string dir = args.cache_dir.empty() ? config.cache_directory : args.cache_dir;
+    int size_mb = args.cache_size_mb > 0 ? args.cache_size_mb : config.cache_size_limit_mb;
+    return std::make_unique<ObfuscationCache>(Logger::getInstance(), dir,
+                                              static_cast<uint64_t>(size_mb) * 1024 * 1024);
+}
+
+void print_cache_stats(const CacheStats& stats) {
+    std::cout << "\n💾 CACHE:\n";
+    std::cout << "  Hits / Misses:  " << stats.hits << " / " << stats.misses << "\n";
+    std::cout << "  Hit Rate:       " << std::fixed << std::setprecision(1) << (stats.hit_rate() * 100.0) << "%\n";
+    std::cout << "  Bytes Saved:    " << stats.bytes_saved << "\n";
+    std::cout << "  Evictions:      " << stats.evictions << "\n";
+}
+
 int cmd_obfuscate(const CLIArgs& args) {
     if (args.input_file.empty() || args.output_file.empty()) {
         std::cerr << "Error: Input and output files required for obfuscation\n";
@@ -203,6 +254,7 @@ int cmd_obfuscate(const CLIArgs& args) {
         config.enable_blockchain_verification = args.blockchain_verify;
         config.generate_detailed_report = args.generate_report;
         config.target_platforms = args.targets.empty() ? std::vector<std::string>{"linux"} : args.targets;
+        config.compile_flags = args.compile_flags;
 
         engine.setConfig(config);
         engine.enableAIOptimization(args.ai_optimize);
@@ -230,25 +282,57 @@ int cmd_obfuscate(const CLIArgs& args) {
         // Start obfuscation
         auto start_time = std::chrono::high_resolution_clock::now();
 
-        bool success = engine.obfuscateFile(args.input_file, args.output_file, args.level);
+        // Unchanged source + config: reuse the previous artifact and its report
+        auto cache = open_cache(args, config);
+        std::string cache_key;
+        std::string stored_report;
+        bool cache_hit = false;
+        if (cache) {
+            cache_key = ObfuscationCache::source_key(args.input_file, config, CLI_VERSION);
+            cache_hit = cache->lookup(cache_key, args.output_file, &stored_report);
+        }
+
+        ObfuscationReport report;
+        if (cache_hit) {
+            report = cached_report(stored_report, args.input_file, args.output_file);
+            report.processingTime = std::chrono::duration<double>(
+                std::chrono::high_resolution_clock::now() - start_time).count();
+
+            // The engine would have verified and written the report itself
+            if (args.blockchain_verify &&
+                !verify_cached_artifact(Logger::getInstance(), config, args.output_file, report)) {
+                std::cerr << "❌ Blockchain verification failed for cached artifact " << args.output_file << "\n";
+                return 1;
+            }
+            if (args.generate_report && !write_cached_report(report, args.output_file)) {
+                std::cerr << "⚠️  Could not write " << args.output_file << ".report.json\n";
+            }
+        } else {
+            bool success = engine.obfuscateFile(args.input_file, args.output_file, args.level);
+            if (!success) {
+                if (!args.quiet) {
+                    print_progress_bar("Processing", 1.0);
+                }
+                std::cerr << "❌ Obfuscation failed: " << engine.getLastError() << "\n";
+                return 1;
+            }
 
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+            report = engine.getLastReport();
+            if (cache) {
+                cache->store(cache_key, args.output_file, report_to_json_string(report));
+            }
+        }
 
         if (!args.quiet) {
             print_progress_bar("Processing", 1.0);
         }
 
-        if (!success) {
-            std::cerr << "❌ Obfuscation failed: " << engine.getLastError() << "\n";
-            return 1;
-        }
-
-        // Get the report
-        auto report = engine.getLastReport();
-
         // Print results
-        std::cout << "\n🎉 Obfuscation completed successfully!\n";
+        if (cache_hit) {
+            std::cout << "\n♻️  Cache hit: reused obfuscated artifact for " << args.input_file << "\n";
+        } else {
+            std::cout << "\n🎉 Obfuscation completed successfully!\n";
+        }
         std::cout << "\n📊 OBFUSCATION RESULTS:\n";
         std::cout << "  Input File:         " << report.inputFile << "\n";
         std::cout << "  Output File:        " << report.outputFile << "\n";
@@ -286,7 +370,12 @@ int cmd_obfuscate(const CLIArgs& args) {
 
         if (args.generate_report) {
             std::cout << "\n📋 DETAILED REPORT:\n";
-            std::cout << "  Report available:   " << args.output_file << ".report.{html,json}\n";
+            std::cout << "  Report available:   " << args.output_file
+                      << (cache_hit ? ".report.json" : ".report.{html,json}") << "\n";
+        }
+
+        if (cache) {
+            print_cache_stats(cache->get_stats());
         }
 
         std::cout << "\n🎯 Ready for deployment! Your code is now protected.\n\n";
@@ -406,58 +495,87 @@ int cmd_batch(const CLIArgs& args) {
             return 1;
         }
 
-        std::cout << "📁 Found " << input_files.size() << " source files to process\n";
-
-        H5XObfuscationEngine engine;
-        if (!engine.initialize()) {
-            std::cerr << "Error: Failed to initialize H5X engine\n";
-            return 1;
-        }
-
-        // Configure settings
-        ObfuscationConfig config;
-        config.obfuscation_level = args.level;
-        config.enable_ai_optimization = args.ai_optimize;
-        config.enable_blockchain_verification = args.blockchain_verify;
-        config.target_platforms = args.targets.empty() ? std::vector<std::string>{"linux"} : args.targets;
-        engine.setConfig(config);
-        engine.enableAIOptimization(args.ai_optimize);
-        engine.enableBlockchainVerification(args.blockchain_verify);
+        // Directory iteration order is unspecified; keep the output stable
+        std::sort(input_files.begin(), input_files.end());
 
-        std::cout << "🚀 Starting batch obfuscation...\n";
+        std::cout << "📁 Found " << input_files.size() << " source files to process\n";
 
-        // For now, just process files one by one (batch not implemented yet)
-        std::vector<bool> results;
+        // Mirror the input tree so equally named files never collide
+        std::vector<BatchJob> jobs;
+        jobs.reserve(input_files.size());
         for (const auto& file : input_files) {
-            std::string output_name = args.output_file + "/" + std::filesystem::path(file).filename().string() + "_obf";
-            bool success = engine.obfuscateFile(file, output_name, args.level);
-            results.push_back(success);
+            std::filesystem::path relative = std::filesystem::relative(file, args.input_file);
+            std::filesystem::path output_path = std::filesystem::path(args.output_file) /
+                relative.parent_path() / (relative.filename().string() + "_obf");
+            jobs.push_back({file, output_path.string()});
         }
 
-        // Print summary
-        int successful = 0;
-        int failed = 0;
-
-        for (size_t i = 0; i < results.size(); ++i) {
-            if (results[i]) {
-                successful++;
+        // Configure settings
+        BatchOptions options;
+        options.config_file = args.config_file;
+        options.level = args.level;
+        options.ai_optimize = args.ai_optimize;
+        options.blockchain_verify = args.blockchain_verify;
+        options.generate_report = args.generate_report;
+        options.config.obfuscation_level = args.level;
+        options.config.enable_ai_optimization = args.ai_optimize;
+        options.config.enable_blockchain_verification = args.blockchain_verify;
+        options.config.generate_detailed_report = args.generate_report;
+        options.config.target_platforms = args.targets.empty() ? std::vector<std::string>{"linux"} : args.targets;
+        options.config.compile_flags = args.compile_flags;
+        if (args.threads > 0) {
+            options.config.max_threads = args.threads;
+        }
+
+        auto cache = open_cache(args, options.config);
+        options.cache = cache.get();
+        options.tool_version = CLI_VERSION;
+
+        size_t workers = BatchObfuscator::plan_worker_count(options.config, jobs.size(),
+                                                            options.engine_memory_mb);
+        std::cout << "🚀 Starting batch obfuscation on " << workers << " workers...\n";
+
+        // Workers log concurrently; keep formatting and I/O off their path
+        Logger::getInstance().enableAsync();
+
+        BatchObfuscator batch(Logger::getInstance());
+        BatchSummary summary = batch.run(jobs, options,
+            [&](const BatchFileResult& result, size_t completed, size_t total) {
                 if (args.verbose) {
-                    std::cout << "✅ " << input_files[i] << " -> obfuscated\n";
+                    std::cout << (result.success ? "✅ " : "❌ ") << result.input_path
+                              << " (" << result.duration.count() << "ms, worker "
+                              << result.worker_id << (result.cache_hit ? ", cached" : "") << ")\n";
+                } else if (!args.quiet) {
+                    print_progress_bar("Processing", static_cast<double>(completed) / total);
                 }
-            } else {
-                failed++;
-                std::cerr << "❌ " << input_files[i] << ": " << engine.getLastError() << "\n";
+            });
+        Logger::getInstance().disableAsync();
+
+        // Print failures in input order
+        for (const auto& result : summary.results) {
+            if (!result.success) {
+                std::cerr << "❌ " << result.input_path << ": " << result.error_message << "\n";
             }
         }
 
         std::cout << "\n📊 BATCH PROCESSING SUMMARY:\n";
-        std::cout << "  Total Files:    " << results.size() << "\n";
-        std::cout << "  Successful:     " << successful << "\n";
-        std::cout << "  Failed:         " << failed << "\n";
+        std::cout << "  Total Files:    " << summary.results.size() << "\n";
+        std::cout << "  Successful:     " << summary.successful << "\n";
+        std::cout << "  Failed:         " << summary.failed << "\n";
+        std::cout << "  Workers:        " << summary.workers_used << "\n";
+        std::cout << "  Wall Time:      " << std::fixed << std::setprecision(2)
+                  << (summary.wall_time.count() / 1000.0) << "s\n";
         std::cout << "  Success Rate:   " << std::fixed << std::setprecision(1) 
-                  << (100.0 * successful / results.size()) << "%\n";
+                  << (100.0 * summary.successful / summary.results.size()) << "%\n";
+        if (args.blockchain_verify) {
+            std::cout << "  On-chain:       " << summary.blockchain_verified << " hashes recorded\n";
+        }
 
-        return failed > 0 ? 1 : 0;
+        if (cache) {
+            print_cache_stats(summary.cache_stats);
+        }
+
+        return summary.failed > 0 ? 1 : 0;
 
     } catch (const std::exception& e) {
         std::cerr << "❌ Batch processing error: " << e.what() << "\n";
@@ -465,6 +583,78 @@ int cmd_batch(const CLIArgs& args) {
     }
 }
 
+ObfuscationServer* active_server = nullptr;
+
+void handle_serve_signal(int) {
+    if (active_server) {
+        active_server->stop();
+    }
+}
+
+int cmd_serve(const CLIArgs& args) {
+    try {
+        ServerOptions options;
+        options.config_file = args.config_file;
+        if (!args.socket_path.empty()) {
+            options.socket_path = args.socket_path;
+        }
+        options.config.obfuscation_level = args.level;
+        options.config.enable_ai_optimization = args.ai_optimize;
+        options.config.enable_blockchain_verification = args.blockchain_verify;
+        options.config.generate_detailed_report = args.generate_report;
+        options.config.target_platforms = args.targets.empty() ? std::vector<std::string>{"linux"} : args.targets;
+        options.config.compile_flags = args.compile_flags;
+        if (args.threads > 0) {
+            options.engines = static_cast<size_t>(args.threads);
+        }
+
+        auto cache = open_cache(args, options.config);
+        options.cache = cache.get();
+        options.tool_version = CLI_VERSION;
+
+        // Jobs from concurrent clients log from many threads
+        Logger::getInstance().enableAsync();
+
+        ObfuscationServer server(Logger::getInstance(), options);
+        active_server = &server;
+        std::signal(SIGINT, handle_serve_signal);
+        std::signal(SIGTERM, handle_serve_signal);
+        std::signal(SIGPIPE, SIG_IGN);
+
+        if (!args.quiet) {
+            std::cout << "🛰️  Serving obfuscation jobs on " << options.socket_path << " (Ctrl+C to stop)\n";
+        }
+        bool served = server.run();
+
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        active_server = nullptr;
+        Logger::getInstance().disableAsync();
+
+        if (!served) {
+            std::cerr << "❌ Failed to listen on " << options.socket_path << "\n";
+            return 1;
+        }
+
+        ServerStats stats = server.get_stats();
+        if (!args.quiet) {
+            std::cout << "\n📊 SERVER SUMMARY:\n";
+            std::cout << "  Connections:    " << stats.connections << "\n";
+            std::cout << "  Jobs Completed: " << stats.jobs_completed << "\n";
+            std::cout << "  Jobs Failed:    " << stats.jobs_failed << "\n";
+            std::cout << "  Engines:        " << stats.engines_created << "\n";
+            if (cache) {
+                print_cache_stats(cache->get_stats());
+            }
+        }
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "❌ Server error: " << e.what() << "\n";
+        return 1;
+    }
+}
+
 int cmd_config(const CLIArgs& args) {
     std::string config_file = args.config_file.empty() ? "config/config.json" : args.config_file;
     
@@ -523,6 +713,9 @@ int cmd_config(const CLIArgs& args) {
             std::cerr << "  obfuscation.string_obfuscation <true|false>\n";
             std::cerr << "  obfuscation.instruction_substitution <true|false>\n";
             std::cerr << "  obfuscation.control_flow_flattening <true|false>\n";
+            std::cerr << "  obfuscation.flattening_dispatcher <flat|clustered>\n";
+            std::cerr << "  obfuscation.flattening_cluster_size <number>\n";
+            std::cerr << "  obfuscation.flattening_preserve_loops <true|false>\n";
             std::cerr << "  obfuscation.bogus_control_flow <true|false>\n";
             std::cerr << "  obfuscation.anti_analysis <true|false>\n";
             std::cerr << "  ai.enabled <true|false>\n";
@@ -566,6 +759,23 @@ int cmd_config(const CLIArgs& args) {
             else if (key == "obfuscation.control_flow_flattening") {
                 config.enable_control_flow_flattening = (value == "true" || value == "1");
             }
+            else if (key == "obfuscation.flattening_dispatcher") {
+                if (value != "flat" && value != "clustered") {
+                    std::cerr << "❌ Error: Dispatcher must be flat or clustered\n";
+                    return 1;
+                }
+                config.flattening_dispatcher = value;
+            }
+            else if (key == "obfuscation.flattening_cluster_size") {
+                config.flattening_cluster_size = std::stoi(value);
+                if (config.flattening_cluster_size < 2) {
+                    std::cerr << "❌ Error: Cluster size must be at least 2\n";
+                    return 1;
+                }
+            }
+            else if (key == "obfuscation.flattening_preserve_loops") {
+                config.flattening_preserve_loops = (value == "true" || value == "1");
+            }
             else if (key == "obfuscation.bogus_control_flow") {
                 config.enable_bogus_control_flow = (value == "true" || value == "1");
             }
@@ -657,6 +867,15 @@ int cmd_config(const CLIArgs& args) {
             else if (key == "obfuscation.control_flow_flattening") {
                 std::cout << (config.enable_control_flow_flattening ? "true" : "false") << "\n";
             }
+            else if (key == "obfuscation.flattening_dispatcher") {
+                std::cout << config.flattening_dispatcher << "\n";
+            }
+            else if (key == "obfuscation.flattening_cluster_size") {
+                std::cout << config.flattening_cluster_size << "\n";
+            }
+            else if (key == "obfuscation.flattening_preserve_loops") {
+                std::cout << (config.flattening_preserve_loops ? "true" : "false") << "\n";
+            }
             else if (key == "obfuscation.bogus_control_flow") {
                 std::cout << (config.enable_bogus_control_flow ? "true" : "false") << "\n";
             }
@@ -778,6 +997,8 @@ int main(int argc, char* argv[]) {
             return cmd_verify(args);
         } else if (args.command == "batch") {
             return cmd_batch(args);
+        } else if (args.command == "serve") {
+            return cmd_serve(args);
         } else {
             std::cerr << "Error: Unknown command '" << args.command << "'\n";
             std::cerr << "Use 'h5x-cli help' for usage information\n";
@@ -17,6 +17,7 @@ from werkzeug.utils import secure_filename
 import hashlib
 import uuid
 import requests
+from h5x_client import H5XClient, H5XServerError
 
 # Add the project root to Python path for imports
 PROJECT_ROOT = Path(__file__).parent.parent.parent
@@ -29,6 +30,8 @@ app.config['MAX_CONTENT_LENGTH'] = 16 * 1024 * 1024  # 16MB max file size
 
 # Configuration
 H5X_CLI_PATH = PROJECT_ROOT / "build" / "h5x-cli"
+# Socket of a running `h5x-cli serve`; jobs fall back to spawning the CLI without it
+H5X_SOCKET_PATH = os.environ.get('H5X_SOCKET', '/tmp/h5x.sock')
 CONFIG_PATH = PROJECT_ROOT / "config" / "config.json"
 OUTPUT_PATH = PROJECT_ROOT / "output"
 LOGS_PATH = PROJECT_ROOT / "logs"
@@ -41,6 +44,7 @@ task_results = {}
 class H5XDashboard:
     def __init__(self):
         self.h5x_cli = str(H5X_CLI_PATH)
+        self.server = H5XClient(H5X_SOCKET_PATH)
         self.ensure_directories()
     
     def ensure_directories(self):
@@ -60,6 +64,8 @@ class H5XDashboard:
             cli_available = result.returncode == 0
             cli_version = "H5X Engine v1.0.0" if cli_available else "Not available"
             
+            server_available = self.server.is_available()
+
             # Check configuration
             config_exists = CONFIG_PATH.exists()
             config_valid = self.validate_config() if config_exists else False
@@ -70,6 +76,8 @@ class H5XDashboard:
             return {
                 'cli_available': cli_available,
                 'cli_version': cli_version,
+                'server_available': server_available,
+                'server_socket': H5X_SOCKET_PATH,
                 'config_exists': config_exists,
                 'config_valid': config_valid,
                 'blockchain_connected': blockchain_status['connected'],
@@ -80,6 +88,8 @@ class H5XDashboard:
             return {
                 'cli_available': False,
                 'cli_version': f"Error: {str(e)}",
+                'server_available': False,
+                'server_socket': H5X_SOCKET_PATH,
                 'config_exists': False,
                 'config_valid': False,
                 'blockchain_connected': False,
@@ -123,6 +133,14 @@ class H5XDashboard:
                 'start_time': datetime.now().isoformat()
             }
             
+            if self.server.is_available():
+                try:
+                    self.run_obfuscation_on_server(input_file, output_name, level, task_id)
+                    return
+                except H5XServerError:
+                    # Server went away mid-job; run it through the CLI instead
+                    active_tasks[task_id]['stage'] = 'Initializing...'
+
             # Update progress
             active_tasks[task_id]['progress'] = 20
             active_tasks[task_id]['stage'] = 'Compiling to LLVM IR...'
@@ -167,6 +185,53 @@ class H5XDashboard:
                 'error': str(e)
             }
     
+    def run_obfuscation_on_server(self, input_file, output_name, level, task_id):
+        """Run obfuscation on the warm `h5x-cli serve` daemon, streaming its progress"""
+        stages = {
+            'queued': 'Waiting for a free engine...',
+            'obfuscating': 'Applying obfuscation passes...'
+        }
+
+        def on_progress(stage, progress):
+            active_tasks[task_id]['progress'] = int(progress * 100)
+            active_tasks[task_id]['stage'] = stages.get(stage, stage)
+
+        reply = self.server.obfuscate(str(PROJECT_ROOT / input_file), str(PROJECT_ROOT / output_name),
+                                      level, on_progress=on_progress)
+
+        if reply.get('success'):
+            report = reply.get('report', {})
+            original_size = report.get('originalSize', 0)
+            obfuscated_size = report.get('obfuscatedSize', 0)
+            metrics = {
+                'functions_processed': report.get('functionsProcessed', 0),
+                'strings_obfuscated': report.get('stringsObfuscated', 0),
+                'instructions_modified': report.get('instructionsModified', 0),
+                'security_score': report.get('securityScore', 0),
+                'processing_time': report.get('processingTime', reply.get('duration_ms', 0) / 1000.0),
+                'original_size': original_size,
+                'obfuscated_size': obfuscated_size,
+                'size_increase': f"{report.get('sizeIncrease', 0) * 100:.1f}%"
+            }
+
+            active_tasks[task_id]['progress'] = 100
+            active_tasks[task_id]['stage'] = 'Completed successfully!'
+            active_tasks[task_id]['status'] = 'completed'
+
+            task_results[task_id] = {
+                'success': True,
+                'metrics': metrics,
+                'output_file': output_name,
+                'cache_hit': reply.get('cache_hit', False),
+                'passes_applied': report.get('passesApplied', [])
+            }
+        else:
+            active_tasks[task_id]['status'] = 'failed'
+            task_results[task_id] = {
+                'success': False,
+                'error': reply.get('error', 'Unknown error')
+            }
+
     def parse_obfuscation_output(self, output_lines):
         """Parse obfuscation CLI output for metrics"""
         metrics = {
@@ -321,6 +386,7 @@ if __name__ == '__main__':
     print("🚀 Starting H5X Web Dashboard...")
     print(f"📁 Project root: {PROJECT_ROOT}")
     print(f"🔧 H5X CLI: {H5X_CLI_PATH}")
+    print(f"🛰️  H5X server socket: {H5X_SOCKET_PATH} ({'connected' if dashboard.server.is_available() else 'not running, using CLI'})")
     print("🌐 Dashboard will be available at: http://localhost:8080")
     print("=" * 60)
     
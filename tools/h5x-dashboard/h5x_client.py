@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""
+Client for the `h5x-cli serve` daemon.
+
+Messages are JSON frames prefixed with a 4-byte big-endian length, sent over
+a Unix domain socket. See src/core/ObfuscationServer.hpp for the protocol.
+"""
+
+import json
+import os
+import socket
+import struct
+import itertools
+
+MAX_FRAME_BYTES = 16 * 1024 * 1024
+
+
+class H5XServerError(Exception):
+    """Raised when the daemon is unreachable or the connection breaks"""
+
+
+class H5XClient:
+    def __init__(self, socket_path, timeout=None):
+        self.socket_path = str(socket_path)
+        self.timeout = timeout
+        self._ids = itertools.count(1)
+
+    def is_available(self):
+        """True if a daemon answers a ping on the socket"""
+        if not os.path.exists(self.socket_path):
+            return False
+        try:
+            return self.request({'type': 'ping'}).get('type') == 'pong'
+        except (OSError, H5XServerError):
+            return False
+
+    def request(self, message):
+        """Send one request and return its single reply"""
+        with self._connect() as sock:
+            self._send(sock, message)
+            return self._receive(sock)
+
+    def obfuscate(self, input_file, output_file, level=3, on_progress=None, **options):
+        """
+        Run one obfuscation job. on_progress(stage, progress) is called for
+        every progress frame; the final result frame is returned.
+        """
+        message = {
+            'id': next(self._ids),
+            'type': 'obfuscate',
+            'input': os.path.abspath(input_file),
+            'output': os.path.abspath(output_file),
+            'level': int(level),
+        }
+        message.update(options)
+
+        with self._connect() as sock:
+            self._send(sock, message)
+            while True:
+                reply = self._receive(sock)
+                if reply.get('type') == 'progress':
+                    if on_progress:
+                        on_progress(reply.get('stage', ''), reply.get('progress', 0.0))
+                    continue
+                return reply
+
+    def _connect(self):
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.settimeout(self.timeout)
+        try:
+            sock.connect(self.socket_path)
+        except OSError as e:
+            sock.close()
+            raise H5XServerError(f"Cannot connect to {self.socket_path}: {e}")
+        return sock
+
+    @staticmethod
+    def _send(sock, message):
+        payload = json.dumps(message).encode('utf-8')
+        sock.sendall(struct.pack('>I', len(payload)) + payload)
+
+    @staticmethod
+    def _receive(sock):
+        header = H5XClient._read_exact(sock, 4)
+        (size,) = struct.unpack('>I', header)
+        if size > MAX_FRAME_BYTES:
+            raise H5XServerError(f"Frame of {size} bytes exceeds the limit")
+        return json.loads(H5XClient._read_exact(sock, size).decode('utf-8'))
+
+    @staticmethod
+    def _read_exact(sock, size):
+        data = b''
+        while len(data) < size:
+            chunk = sock.recv(size - len(data))
+            if not chunk:
+                raise H5XServerError("Connection closed by server")
+            data += chunk
+        return data